@@ -54,11 +54,12 @@
 #include <unirec/unirec.h>
 #include "fields.h"
 
-#include <unordered_map>
+#include <vector>
 #include <pthread.h>
 
 #include "output.h"
 #include "configuration.h"
+#include "storage.h"
 
 //#define DEBUG
 #ifdef DEBUG
@@ -140,29 +141,11 @@ UR_FIELDS (
  * This parameter will be listed in Additional parameters in module help output
  */
 
-/* ----------------------------------------------------------------- */
-#ifdef  AGGREGATOR_KEYWORD_H
-namespace std {
-   /**
-    * std::hash() specialization to use with class Key.
-    * Specialization needed by use class Key as key in std::unordered_map
-    */
-    template<>
-    struct hash<Key>
-    {
-        size_t operator()(const Key &k) const
-        {
-           return SuperFastHash(k.get_data(), k.get_size());
-        }
-    };
-}
-#endif
-/* ----------------------------------------------------------------- */
-
 static int stop = 0;
-static std::unordered_map<Key , void*> storage;                   // Need to be global because of trap_terminate
+static Storage storage;                                // Need to be global because of trap_terminate
 time_t time_last_from_record = time(NULL);             // Passive timeout time info set due to records time
-pthread_mutex_t storage_mutex = PTHREAD_MUTEX_INITIALIZER;                 // For storage modifying sections
+pthread_mutex_t send_mutex = PTHREAD_MUTEX_INITIALIZER;                    // For sending records to output interface
+pthread_rwlock_t template_lock = PTHREAD_RWLOCK_INITIALIZER;              // Timeout thread reads, format change writes output template
 pthread_mutex_t time_last_from_record_mutex = PTHREAD_MUTEX_INITIALIZER;   // For modifying Passive timeout time info
 void flush_storage();
 
@@ -215,12 +198,12 @@ void print_template_fields(ur_template_t* tmplt)
  * @param [in] out_tmplt output UniRec template to free.
  * @param [in] storage Container with stored data to be freed.
  */
-void clean_memory(ur_template_t *in_tmplt, ur_template_t *out_tmplt, std::unordered_map<Key, void*> storage){
-   std::unordered_map<Key, void*>::iterator it;
-   for ( it = storage.begin(); it != storage.end(); it++) {
-      ur_free_record(it->second);
+void clean_memory(ur_template_t *in_tmplt, ur_template_t *out_tmplt, Storage &storage){
+   std::vector<void *> records;
+   storage.pop_all(records);
+   for (size_t i = 0; i < records.size(); i++) {
+      ur_free_record(records[i]);
    }
-   storage.clear();
 
    TRAP_DEFAULT_FINALIZATION();
    ur_free_template(in_tmplt);
@@ -340,7 +323,8 @@ bool send_record_out(ur_template_t *out_tmplt, void *out_rec)
       prepare_to_send(out_rec);
    }
 
-   // Send record to interface 0.
+   // Send record to interface 0, main and timeout thread may send at the same time
+   pthread_mutex_lock(&send_mutex);
    int i = 0;
    for (; i < MAX_TIMEOUT_RETRY; i++) {
       DBG((stderr, "Trying to send..\n"));
@@ -348,13 +332,29 @@ bool send_record_out(ur_template_t *out_tmplt, void *out_rec)
 
       // Handle possible errors
       TRAP_DEFAULT_SEND_ERROR_HANDLING(ret, continue, break);
+      pthread_mutex_unlock(&send_mutex);
       return true;
    }
+   pthread_mutex_unlock(&send_mutex);
 
    fprintf(stderr, "Cannot send record due to error or time_out\n");
    return false;
 }
 
+/* ----------------------------------------------------------------- */
+/**
+ * Send out given records removed from storage and free their memory.
+ * @param [in,out] records records to send, the vector is cleared.
+ */
+void send_records_out(std::vector<void *> &records)
+{
+   for (size_t i = 0; i < records.size(); i++) {
+      send_record_out(OutputTemplate::out_tmplt, records[i]);
+      ur_free_record(records[i]);
+   }
+   records.clear();
+}
+
 /* ----------------------------------------------------------------- */
 /**
  * Tries to send out all stored records, free their memory and clear the storage.
@@ -362,13 +362,9 @@ bool send_record_out(ur_template_t *out_tmplt, void *out_rec)
 void flush_storage()
 {
    // Send all stored data
-  
-   std::unordered_map<Key, void*>::iterator it;
-   for ( it = storage.begin(); it != storage.end(); it++) {
-      send_record_out(OutputTemplate::out_tmplt, it->second);
-      ur_free_record(it->second);
-   }
-   storage.clear();
+   std::vector<void *> records;
+   storage.pop_all(records);
+   send_records_out(records);
 }
 /* ----------------------------------------------------------------- */
 /**
@@ -381,17 +377,25 @@ void *check_timeouts(void *input)
 {
    Config *configuration = (Config*)input;
    int timeout_type = configuration->get_timeout_type();
+   std::vector<void *> records;
 
    if (timeout_type == TIMEOUT_GLOBAL) {
       int timeout = configuration->get_timeout(TIMEOUT_GLOBAL);
       while (!stop) {
          time_t start = time(NULL);
 
-         // Lock the storage -- CRITICAL SECTION START
-         pthread_mutex_lock(&storage_mutex);
-         flush_storage();
-         // Unlock the storage -- CRITICAL SECTION END
-         pthread_mutex_unlock(&storage_mutex);
+         // Output template must not change until removed records are sent
+         pthread_rwlock_rdlock(&template_lock);
+         for (int i = 0; i < STORAGE_SHARDS; i++) {
+            // Lock only one shard -- CRITICAL SECTION START
+            StorageShard &shard = storage.get_shard_at(i);
+            shard.lock();
+            shard.pop_all(records);
+            // Unlock the shard -- CRITICAL SECTION END
+            shard.unlock();
+            send_records_out(records);
+         }
+         pthread_rwlock_unlock(&template_lock);
          time_t end = time(NULL);
 
          int elapsed = difftime(end, start);
@@ -413,24 +417,24 @@ void *check_timeouts(void *input)
       while (!stop) {
          time_t start = time(NULL);
 
-         /* Can happen that record accesed for timeout check is being processed by main thread, need to use lock
-          * Only accessing and modifying different elements is thread safe in stl map container */
-         // Lock the storage -- CRITICAL SECTION START
-         pthread_mutex_lock(&storage_mutex);
-
-         for (std::unordered_map<Key, void*>::iterator it = storage.begin(); it != storage.end(); ) {
-            if (ur_time_get_sec(ur_get(OutputTemplate::out_tmplt, it->second, F_TIME_LAST)) < time_last_from_record - timeout) {
-               // Send record out
-               send_record_out(OutputTemplate::out_tmplt, it->second);
-               ur_free_record(it->second);
-               it = storage.erase(it);
-            }
-            else {
-               ++it;
-            }
+         pthread_mutex_lock(&time_last_from_record_mutex);
+         time_t limit = time_last_from_record - timeout;
+         pthread_mutex_unlock(&time_last_from_record_mutex);
+
+         /* Can happen that record accesed for timeout check is being processed by main thread, need to use lock.
+          * Expired records are at the head of shard expiry queue, only they are visited and removed under the lock
+          * of their shard, they are sent after the shard is unlocked. */
+         pthread_rwlock_rdlock(&template_lock);
+         for (int i = 0; i < STORAGE_SHARDS; i++) {
+            // Lock only one shard -- CRITICAL SECTION START
+            StorageShard &shard = storage.get_shard_at(i);
+            shard.lock();
+            shard.pop_expired(limit, records);
+            // Unlock the shard -- CRITICAL SECTION END
+            shard.unlock();
+            send_records_out(records);
          }
-         // Unlock the storage -- CRITICAL SECTION END
-         pthread_mutex_unlock(&storage_mutex);
+         pthread_rwlock_unlock(&template_lock);
 
          time_t end = time(NULL);
          int elapsed = difftime(end, start);
@@ -463,7 +467,7 @@ int main(int argc, char **argv)
 {
    int ret;
    signed char opt;
-   storage.reserve(MAP_RESERVE);        // Reserve enough space for records without need of rehash()
+   storage.reserve(MAP_RESERVE);        // Reserve enough space for records without need of rehash
 
    /* **** TRAP initialization **** */
 
@@ -564,6 +568,9 @@ int main(int argc, char **argv)
 
    /* **** Main processing loop **** */
 
+   // Key of received record, reused for every record
+   Key rec_key;
+
    // Read data from input, process them and write to output
    while (!stop) {
       const void *in_rec;
@@ -587,16 +594,11 @@ int main(int argc, char **argv)
       if (ret == TRAP_E_FORMAT_CHANGED ) {
          DBG((stderr, "Format change, setting new module configuration\n"));
          // Internal structures cleaning because of possible redefinition
-         std::unordered_map<Key, void*>::iterator it;
 
-         // Lock the storage -- CRITICAL SECTION START
-         pthread_mutex_lock( &storage_mutex );
+         // Stop timeout thread from sending records -- CRITICAL SECTION START
+         pthread_rwlock_wrlock(&template_lock);
 
-         for ( it = storage.begin(); it != storage.end(); it++) {
-            send_record_out(OutputTemplate::out_tmplt, it->second);
-            ur_free_record(it->second);
-         }
-         storage.clear();
+         flush_storage();
 
          OutputTemplate::reset();
          KeyTemplate::reset();
@@ -610,6 +612,7 @@ int main(int argc, char **argv)
 
             if (id == UR_E_INVALID_NAME) {
                fprintf(stderr, "Requested field %s not in input records, cannot continue.\n", config.get_name(i));
+               pthread_rwlock_unlock(&template_lock);
                clean_memory(in_tmplt, NULL, storage);
                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
                return 1;
@@ -619,6 +622,13 @@ int main(int argc, char **argv)
                config.set_variable(true);
 
             if (config.is_key(i)) {
+               if (ur_is_varlen(id) || KeyTemplate::key_size + ur_get_size(id) > MAX_KEY_SIZE) {
+                  fprintf(stderr, "Key field %s is variable length or key is longer than %d bytes, cannot continue.\n", config.get_name(i), MAX_KEY_SIZE);
+                  pthread_rwlock_unlock(&template_lock);
+                  clean_memory(in_tmplt, NULL, storage);
+                  FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+                  return 1;
+               }
                KeyTemplate::add_field(id, ur_get_size(id));
             }
             else {
@@ -631,12 +641,14 @@ int main(int argc, char **argv)
 
          if (OutputTemplate::out_tmplt == NULL){
             fprintf(stderr, "Error: Output template could not be created.\n");
+            pthread_rwlock_unlock(&template_lock);
             clean_memory(in_tmplt, NULL, storage);
             FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
             return -1;
          }
-         // Unlock the storage -- CRITICAL SECTION END
-         pthread_mutex_unlock(&storage_mutex);
+         storage.reset(KeyTemplate::key_size);
+         // Allow timeout thread to send records -- CRITICAL SECTION END
+         pthread_rwlock_unlock(&template_lock);
 
          // Lock the time variable -- CRITICAL SECTION START
          pthread_mutex_lock(&time_last_from_record_mutex);
@@ -651,23 +663,24 @@ int main(int argc, char **argv)
       /* Start message processing */
       time_t record_first = ur_time_get_sec(ur_get(in_tmplt, in_rec, F_TIME_FIRST));
 
-      // Generate key
-      Key rec_key;
+      // Generate key in place, no memory is allocated
+      rec_key.reset();
       for (uint i = 0; i < KeyTemplate::used_fields; i++) {
          rec_key.add_field(ur_get_ptr_by_id(in_tmplt, in_rec, KeyTemplate::indexes_to_record[i]),
-                           ur_get_size(KeyTemplate::indexes_to_record[i]));
+                           KeyTemplate::sizes[i]);
       }
 
-      void *init_ptr = NULL;
-      std::pair<std::unordered_map<Key, void*>::iterator, bool> inserted;
-      // Lock the storage -- CRITICAL SECTION START
-      pthread_mutex_lock( &storage_mutex );
-      inserted = storage.insert(std::make_pair(rec_key, init_ptr));
+      uint32_t hash = Storage::hash(rec_key);
+      StorageShard &shard = storage.get_shard(hash);
+      bool inserted;
+      // Lock the shard -- CRITICAL SECTION START
+      shard.lock();
+      uint32_t entry = shard.find_or_insert(rec_key, hash, inserted);
+      void *stored_rec = shard.record(entry);
 
-      if (inserted.second == false) {
+      if (inserted == false) {
          // Element already exists
          bool new_time_window = false;
-         void *stored_rec = inserted.first->second;
          // Main thread checks time window only when active timeout set
          if ( (config.get_timeout_type() == TIMEOUT_ACTIVE) || (config.get_timeout_type() == TIMEOUT_ACTIVE_PASSIVE)) {
             // Check time window for active timeout
@@ -679,6 +692,7 @@ int main(int argc, char **argv)
          }
          if (new_time_window) {
             if(!send_record_out(OutputTemplate::out_tmplt, stored_rec)) {
+               shard.unlock();
                break;
             }
 
@@ -692,18 +706,21 @@ int main(int argc, char **argv)
          // New element
          // If there should be place for variable length field in record reserve it
          int var_length = config.is_variable() == false ? 0 : 2048;
-         void * out_rec = create_record(OutputTemplate::out_tmplt, var_length);
-         if (!out_rec) {
+         stored_rec = create_record(OutputTemplate::out_tmplt, var_length);
+         if (!stored_rec) {
+            shard.unlock();
             clean_memory(in_tmplt, OutputTemplate::out_tmplt, storage);
             fprintf(stderr, "Error: Memory allocation problem (output record).\n");
             FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
             return -1;
          }
-         init_record_data(in_tmplt, in_rec, OutputTemplate::out_tmplt, out_rec);
-         inserted.first->second = out_rec;
+         init_record_data(in_tmplt, in_rec, OutputTemplate::out_tmplt, stored_rec);
+         shard.record(entry) = stored_rec;
       }
-      // Unlock the storage -- CRITICAL SECTION END
-      pthread_mutex_unlock( &storage_mutex );
+      // Move record to its position in expiry queue of its shard
+      shard.touch(entry, ur_time_get_sec(ur_get(OutputTemplate::out_tmplt, stored_rec, F_TIME_LAST)));
+      // Unlock the shard -- CRITICAL SECTION END
+      shard.unlock();
    }
 
    DBG((stderr, "Module canceled, waiting for running threads.\n"));
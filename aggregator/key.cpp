@@ -51,6 +51,7 @@
  * Static variables declaration, better than global variable
  */
 int KeyTemplate::indexes_to_record [MAX_KEY_FIELDS];
+int KeyTemplate::sizes [MAX_KEY_FIELDS];
 uint KeyTemplate::used_fields = 0;
 uint KeyTemplate::key_size = 0;
 
@@ -58,6 +59,7 @@ uint KeyTemplate::key_size = 0;
 void KeyTemplate::add_field(int record_id, int size)
 {
    indexes_to_record[used_fields] = record_id;
+   sizes[used_fields] = size;
    key_size += size;
    used_fields++;
 }
@@ -74,21 +76,25 @@ void KeyTemplate::reset()
 
 Key::Key()
 {
-   data = new char [KeyTemplate::key_size + 1];
    data_length = 0;
 }
 /* ----------------------------------------------------------------- */
-Key::~Key()
+Key::Key(const Key &other)
 {
-   if (data)
-      delete [] data;
+   data_length = other.data_length;
+   memcpy(data, other.data, data_length);
 }
 /* ----------------------------------------------------------------- */
-Key::Key(const Key &other)
+Key &Key::operator=(const Key &other)
 {
    data_length = other.data_length;
-   data = new char[KeyTemplate::key_size + 1];
    memcpy(data, other.data, data_length);
+   return *this;
+}
+/* ----------------------------------------------------------------- */
+void Key::reset()
+{
+   data_length = 0;
 }
 /* ----------------------------------------------------------------- */
 const char *Key::get_data() const
@@ -51,6 +51,8 @@
 
 /** Maximal supported value of fields used to have aggregation function assigned.*/
 #define MAX_KEY_FIELDS 64                 // Static maximal key members count
+/** Maximal sum of lengths of key fields, key bytes are stored inside Key object.*/
+#define MAX_KEY_SIZE 256
 
 /**
  * Class to represent template for key class creation.
@@ -58,6 +60,7 @@
 class KeyTemplate {
 public:
    static int indexes_to_record [MAX_KEY_FIELDS];   /*!< Field index from global unirec structure. */
+   static int sizes [MAX_KEY_FIELDS];               /*!< Size of field with the same index. */
    static uint used_fields;                         /*!< Count of stored and set fields in template. */
    static uint key_size;                            /*!< Sum of lengths of all fields set in template. */
    /**
@@ -74,25 +77,32 @@ public:
 
 /**
  * Class to represent key for aggregation (key used in map).
+ * Key bytes are stored in fixed inline buffer, so creating a key never allocates memory.
  */
 class Key {
 private:
-   char* data;                   /*!< Raw data value copies of all registered fields. */
+   char data[MAX_KEY_SIZE];      /*!< Raw data value copies of all registered fields. */
    int data_length;              /*!< The length of written bytes into class data variable. */
 public:
    /**
-    * Constructor, allocates memory for storing the key values of KeyTemplate.key_size
+    * Constructor, creates empty key, KeyTemplate.key_size must not exceed MAX_KEY_SIZE.
     */
    Key();
    /**
-    * Destructor, free allocated memory.
+    * Copy constructor, copies only written bytes.
+    * @param [in] other source of data to be copied.
     */
-   ~Key();
+   Key(const Key &other);
    /**
-    * Copy constructor, to make copies to map storage.
+    * Assignment operator, copies only written bytes.
     * @param [in] other source of data to be copied.
+    * @return Reference to this key.
     */
-   Key(const Key &other);
+   Key &operator=(const Key &other);
+   /**
+    * Remove all written bytes, so key can be generated again.
+    */
+   void reset();
    /**
     * Access to private variable data representing key value as array of bytes.
     * @return const pointer to data array.
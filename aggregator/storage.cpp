@@ -0,0 +1,292 @@
+/**
+ * \file storage.cpp
+ * \brief Sharded storage of aggregated records with expiry queues.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cstring>
+
+#include "storage.h"
+
+/* ================================================================= */
+/* ================ StorageShard class definitions ================= */
+/* ================================================================= */
+
+StorageShard::StorageShard() : key_size(0), free_list(NONE), head(NONE), tail(NONE), count(0)
+{
+   pthread_mutex_init(&mutex, NULL);
+   rehash(STORAGE_SHARD_MIN_SLOTS);
+}
+/* ----------------------------------------------------------------- */
+StorageShard::~StorageShard()
+{
+   pthread_mutex_destroy(&mutex);
+}
+/* ----------------------------------------------------------------- */
+void StorageShard::lock()
+{
+   pthread_mutex_lock(&mutex);
+}
+/* ----------------------------------------------------------------- */
+void StorageShard::unlock()
+{
+   pthread_mutex_unlock(&mutex);
+}
+/* ----------------------------------------------------------------- */
+uint32_t StorageShard::find_or_insert(const Key &key, uint32_t hash, bool &inserted)
+{
+   size_t mask = slots.size() - 1;
+   size_t i = hash & mask;
+
+   for (; slots[i].entry != NONE; i = (i + 1) & mask) {
+      if (slots[i].hash == hash && memcmp(keys.data() + slots[i].entry * key_size, key.get_data(), key_size) == 0) {
+         inserted = false;
+         return slots[i].entry;
+      }
+   }
+
+   if ((count + 1) * 2 > slots.size()) {
+      rehash(slots.size() * 2);
+      mask = slots.size() - 1;
+      for (i = hash & mask; slots[i].entry != NONE; i = (i + 1) & mask)
+         ;
+   }
+
+   uint32_t entry = alloc_entry();
+   memcpy(keys.data() + entry * key_size, key.get_data(), key_size);
+   entries[entry].record = NULL;
+   entries[entry].time_last = 0;
+   entries[entry].hash = hash;
+   entries[entry].prev = tail;
+   entries[entry].next = NONE;
+   if (tail != NONE)
+      entries[tail].next = entry;
+   else
+      head = entry;
+   tail = entry;
+
+   slots[i].hash = hash;
+   slots[i].entry = entry;
+   count++;
+   inserted = true;
+   return entry;
+}
+/* ----------------------------------------------------------------- */
+void *&StorageShard::record(uint32_t entry)
+{
+   return entries[entry].record;
+}
+/* ----------------------------------------------------------------- */
+void StorageShard::touch(uint32_t entry, time_t time_last)
+{
+   entries[entry].time_last = time_last;
+   if (entry == tail && (entries[entry].prev == NONE || entries[entries[entry].prev].time_last <= time_last))
+      return;
+
+   unlink(entry);
+
+   // Records mostly arrive in order of TIME_LAST, so the position is found near the tail
+   uint32_t pos = tail;
+   while (pos != NONE && entries[pos].time_last > time_last)
+      pos = entries[pos].prev;
+
+   entries[entry].prev = pos;
+   if (pos != NONE) {
+      entries[entry].next = entries[pos].next;
+      entries[pos].next = entry;
+   } else {
+      entries[entry].next = head;
+      head = entry;
+   }
+   if (entries[entry].next != NONE)
+      entries[entries[entry].next].prev = entry;
+   else
+      tail = entry;
+}
+/* ----------------------------------------------------------------- */
+void StorageShard::pop_expired(time_t limit, std::vector<void *> &records)
+{
+   while (head != NONE && entries[head].time_last < limit) {
+      records.push_back(entries[head].record);
+      remove(head);
+   }
+}
+/* ----------------------------------------------------------------- */
+void StorageShard::pop_all(std::vector<void *> &records)
+{
+   for (uint32_t entry = head; entry != NONE; entry = entries[entry].next)
+      records.push_back(entries[entry].record);
+   reset(key_size);
+}
+/* ----------------------------------------------------------------- */
+void StorageShard::reset(uint key_size)
+{
+   this->key_size = key_size;
+   entries.clear();
+   keys.clear();
+   free_list = NONE;
+   head = NONE;
+   tail = NONE;
+   count = 0;
+   for (size_t i = 0; i < slots.size(); i++)
+      slots[i].entry = NONE;
+}
+/* ----------------------------------------------------------------- */
+void StorageShard::reserve(size_t count)
+{
+   size_t slot_count = slots.size();
+   while (slot_count < count * 2)
+      slot_count *= 2;
+   if (slot_count != slots.size())
+      rehash(slot_count);
+}
+/* ----------------------------------------------------------------- */
+uint32_t StorageShard::alloc_entry()
+{
+   if (free_list != NONE) {
+      uint32_t entry = free_list;
+      free_list = entries[entry].next;
+      return entry;
+   }
+
+   entries.push_back(StorageEntry());
+   keys.resize(keys.size() + key_size);
+   return entries.size() - 1;
+}
+/* ----------------------------------------------------------------- */
+void StorageShard::unlink(uint32_t entry)
+{
+   StorageEntry &e = entries[entry];
+   if (e.prev != NONE)
+      entries[e.prev].next = e.next;
+   else
+      head = e.next;
+   if (e.next != NONE)
+      entries[e.next].prev = e.prev;
+   else
+      tail = e.prev;
+}
+/* ----------------------------------------------------------------- */
+void StorageShard::remove(uint32_t entry)
+{
+   size_t mask = slots.size() - 1;
+   size_t i = entries[entry].hash & mask;
+
+   while (slots[i].entry != entry)
+      i = (i + 1) & mask;
+
+   // Backward shift deletion, move following slots of the cluster closer to their home slot
+   for (size_t j = (i + 1) & mask; slots[j].entry != NONE; j = (j + 1) & mask) {
+      size_t home = slots[j].hash & mask;
+      bool between = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+      if (!between) {
+         slots[i] = slots[j];
+         i = j;
+      }
+   }
+   slots[i].entry = NONE;
+
+   unlink(entry);
+   entries[entry].record = NULL;
+   entries[entry].next = free_list;
+   free_list = entry;
+   count--;
+}
+/* ----------------------------------------------------------------- */
+void StorageShard::rehash(size_t slot_count)
+{
+   Slot empty = {0, NONE};
+   slots.assign(slot_count, empty);
+
+   size_t mask = slot_count - 1;
+   for (uint32_t entry = head; entry != NONE; entry = entries[entry].next) {
+      size_t i = entries[entry].hash & mask;
+      while (slots[i].entry != NONE)
+         i = (i + 1) & mask;
+      slots[i].hash = entries[entry].hash;
+      slots[i].entry = entry;
+   }
+}
+
+/* ================================================================= */
+/* =================== Storage class definitions =================== */
+/* ================================================================= */
+
+uint32_t Storage::hash(const Key &key)
+{
+   return SuperFastHash(key.get_data(), key.get_size());
+}
+/* ----------------------------------------------------------------- */
+StorageShard &Storage::get_shard(uint32_t hash)
+{
+   // Slots are selected by lower bits of hash, shards by the highest ones
+   return shards[(hash >> 24) & (STORAGE_SHARDS - 1)];
+}
+/* ----------------------------------------------------------------- */
+StorageShard &Storage::get_shard_at(int index)
+{
+   return shards[index];
+}
+/* ----------------------------------------------------------------- */
+void Storage::pop_all(std::vector<void *> &records)
+{
+   for (int i = 0; i < STORAGE_SHARDS; i++) {
+      shards[i].lock();
+      shards[i].pop_all(records);
+      shards[i].unlock();
+   }
+}
+/* ----------------------------------------------------------------- */
+void Storage::reset(uint key_size)
+{
+   for (int i = 0; i < STORAGE_SHARDS; i++) {
+      shards[i].lock();
+      shards[i].reset(key_size);
+      shards[i].unlock();
+   }
+}
+/* ----------------------------------------------------------------- */
+void Storage::reserve(size_t count)
+{
+   for (int i = 0; i < STORAGE_SHARDS; i++) {
+      shards[i].lock();
+      shards[i].reserve(count / STORAGE_SHARDS);
+      shards[i].unlock();
+   }
+}
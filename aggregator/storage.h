@@ -0,0 +1,207 @@
+/**
+ * \file storage.h
+ * \brief Sharded storage of aggregated records with expiry queues.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef AGGREGATOR_STORAGE_H
+#define AGGREGATOR_STORAGE_H
+
+#include <cstddef>
+#include <ctime>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "key.h"
+
+/** Number of independently locked storage shards, power of 2.*/
+#define STORAGE_SHARDS 16
+/** Initial number of slots of every storage shard, power of 2.*/
+#define STORAGE_SHARD_MIN_SLOTS 1024
+
+/**
+ * Stored record with its position in expiry queue.
+ */
+struct StorageEntry {
+   void *record;                 /*!< Aggregated (output) record. */
+   time_t time_last;             /*!< TIME_LAST of record in seconds used for passive timeout. */
+   uint32_t hash;                /*!< Hash of key. */
+   uint32_t prev;                /*!< Previous entry in expiry queue. */
+   uint32_t next;                /*!< Next entry in expiry queue or in list of free entries. */
+};
+
+/**
+ * Part of storage with own lock, open addressing table and expiry queue.
+ *
+ * Table uses linear probing, slots refer to entries, so entries (and their keys) never move
+ * and expiry queue is linked by entry indexes. Expiry queue is ordered by TIME_LAST,
+ * the entry with the oldest TIME_LAST is at its head, so expired entries are found without
+ * scanning the whole table even when records arrive out of order.
+ */
+class StorageShard {
+public:
+   static const uint32_t NONE = UINT32_MAX;   /*!< Invalid entry index. */
+
+   StorageShard();
+   ~StorageShard();
+
+   /**
+    * Lock the shard, all other functions require the lock to be held.
+    */
+   void lock();
+   /**
+    * Unlock the shard.
+    */
+   void unlock();
+   /**
+    * Find entry with given key or create new entry with NULL record.
+    * @param [in] key key of record.
+    * @param [in] hash hash of key returned by Storage::hash().
+    * @param [out] inserted true if new entry was created.
+    * @return Index of entry.
+    */
+   uint32_t find_or_insert(const Key &key, uint32_t hash, bool &inserted);
+   /**
+    * Access record of entry.
+    * @param [in] entry index of entry.
+    * @return Reference to record pointer.
+    */
+   void *&record(uint32_t entry);
+   /**
+    * Move entry to its position in expiry queue given by TIME_LAST, it is searched from the end
+    * of queue, so it is cheap for records received in order of TIME_LAST.
+    * @param [in] entry index of entry.
+    * @param [in] time_last current TIME_LAST of entry record in seconds.
+    */
+   void touch(uint32_t entry, time_t time_last);
+   /**
+    * Remove entries from the head of expiry queue with TIME_LAST lower than given time.
+    * @param [in] limit time of expiration.
+    * @param [out] records records of removed entries are appended here.
+    */
+   void pop_expired(time_t limit, std::vector<void *> &records);
+   /**
+    * Remove all entries.
+    * @param [out] records records of removed entries are appended here.
+    */
+   void pop_all(std::vector<void *> &records);
+   /**
+    * Remove all entries and set key size of following entries, records are not freed.
+    * @param [in] key_size size of key in bytes.
+    */
+   void reset(uint key_size);
+   /**
+    * Reserve table for given number of entries.
+    * @param [in] count number of entries.
+    */
+   void reserve(size_t count);
+
+private:
+   /**
+    * Slot of table, hash is stored to avoid key comparison and to move slots without entries access.
+    */
+   struct Slot {
+      uint32_t hash;
+      uint32_t entry;
+   };
+
+   pthread_mutex_t mutex;                /*!< Lock of the shard. */
+   std::vector<Slot> slots;              /*!< Open addressing table, size is power of 2. */
+   std::vector<StorageEntry> entries;    /*!< Entries referred by slots. */
+   std::vector<char> keys;               /*!< Keys of entries, key_size bytes per entry. */
+   uint key_size;                        /*!< Size of key of every entry. */
+   uint32_t free_list;                   /*!< First unused entry. */
+   uint32_t head;                        /*!< The least recently updated entry. */
+   uint32_t tail;                        /*!< The most recently updated entry. */
+   size_t count;                         /*!< Number of used entries. */
+
+   uint32_t alloc_entry();
+   void unlink(uint32_t entry);
+   void remove(uint32_t entry);
+   void rehash(size_t slot_count);
+};
+
+/**
+ * Storage of aggregated records split to shards by hash of key.
+ *
+ * Main thread and timeout thread lock only the shard they work with, timeout thread
+ * visits only expired entries.
+ */
+class Storage {
+public:
+   /**
+    * Hash of key used to select shard and slot.
+    * @param [in] key key of record.
+    * @return Hash value.
+    */
+   static uint32_t hash(const Key &key);
+   /**
+    * Get shard for given hash.
+    * @param [in] hash hash of key.
+    * @return Reference to shard.
+    */
+   StorageShard &get_shard(uint32_t hash);
+   /**
+    * Get shard by its index.
+    * @param [in] index index lower than STORAGE_SHARDS.
+    * @return Reference to shard.
+    */
+   StorageShard &get_shard_at(int index);
+   /**
+    * Remove all entries of all shards.
+    * @param [out] records records of removed entries are appended here.
+    */
+   void pop_all(std::vector<void *> &records);
+   /**
+    * Remove all entries of all shards and set key size of following entries.
+    * @param [in] key_size size of key in bytes.
+    */
+   void reset(uint key_size);
+   /**
+    * Reserve space for given number of records split between shards.
+    * @param [in] count number of records.
+    */
+   void reserve(size_t count);
+
+private:
+   StorageShard shards[STORAGE_SHARDS];   /*!< Shards of storage. */
+};
+
+#endif //AGGREGATOR_STORAGE_H
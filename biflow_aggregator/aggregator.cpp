@@ -33,7 +33,26 @@ Flow_data::Flow_data() : ctx(nullptr), count(0),
 {
 }
 
-const void *Field::post_processing(void *ag_data, std::size_t& typename_size, std::size_t& elem_cnt)
+Flow_data::Flow_data(Flow_data&& other) noexcept : ctx(other.ctx), count(other.count),
+   time_first(other.time_first), time_last(other.time_last), reverse(other.reverse)
+{
+    if (ctx)
+        ctx->flow = this;
+}
+
+Flow_data& Flow_data::operator=(Flow_data&& other) noexcept
+{
+    ctx = other.ctx;
+    count = other.count;
+    time_first = other.time_first;
+    time_last = other.time_last;
+    reverse = other.reverse;
+    if (ctx)
+        ctx->flow = this;
+    return *this;
+}
+
+const void *Field::post_processing(void *ag_data, std::size_t& typename_size, std::size_t& elem_cnt) const
 {
     typename_size = this->typename_size;
     if (post_proc_fnc)
@@ -43,7 +62,7 @@ const void *Field::post_processing(void *ag_data, std::size_t& typename_size, st
     return static_cast<const void *>(ag_data);
 }
 
-const void *Field::post_processing_sm_dir(void *ag_data, std::size_t& typename_size, std::size_t& elem_cnt, bool is_reverse)
+const void *Field::post_processing_sm_dir(void *ag_data, std::size_t& typename_size, std::size_t& elem_cnt, bool is_reverse) const
 {
     typename_size = this->typename_size;
     if (post_proc_sm_dir_fnc)
@@ -53,6 +72,31 @@ const void *Field::post_processing_sm_dir(void *ag_data, std::size_t& typename_s
     return static_cast<const void *>(ag_data);
 }
 
+bool Field::is_snapshot_supported() const noexcept
+{
+    // Bloom filter state cannot be serialized
+    return type != UNIQUE_COUNT;
+}
+
+std::size_t Field::save(const void *ag_data, uint8_t *out) const
+{
+    if (save_fnc)
+        return save_fnc(ag_data, out);
+
+    if (out)
+        std::memcpy(out, ag_data, ag_data_size);
+    return ag_data_size;
+}
+
+std::size_t Field::load(void *ag_data, const uint8_t *in) const
+{
+    if (load_fnc)
+        return load_fnc(ag_data, in);
+
+    std::memcpy(ag_data, in, ag_data_size);
+    return ag_data_size;
+}
+
 void Field::aggregate(const void *src, void *dst)
 {
     ag_fnc(src, dst);
@@ -76,6 +120,8 @@ int Field_template::assign() noexcept
     typename_size = sizeof(T);
     init_fnc = Sorted_merge_data<T, K>::init;
     deinit_fnc = Sorted_merge_data<T, K>::deinit;
+    save_fnc = Sorted_merge_data<T, K>::save;
+    load_fnc = Sorted_merge_data<T, K>::load;
     ag_data_size = sizeof(Sorted_merge_data<T, K>);
     return 0;
 }
@@ -89,6 +135,8 @@ int Field_template::assign_dir() noexcept
     typename_size = sizeof(T);
     init_fnc = Sorted_merge_dir_data<T, K>::init;
     deinit_fnc = Sorted_merge_dir_data<T, K>::deinit;
+    save_fnc = Sorted_merge_dir_data<T, K>::save;
+    load_fnc = Sorted_merge_dir_data<T, K>::load;
     ag_data_size = sizeof(Sorted_merge_dir_data<T, K>);
     return 0;
 }
@@ -104,6 +152,8 @@ int Field_template::assign_first_string() noexcept
     typename_size = sizeof(char);
     init_fnc = String_data::init;
     deinit_fnc = String_data::deinit;
+    save_fnc = String_data::save;
+    load_fnc = String_data::load;
     ag_data_size = sizeof(String_data);
     return 0;
 }
@@ -149,6 +199,8 @@ int Field_template::assign_last_string() noexcept
     typename_size = sizeof(char);
     init_fnc = String_data::init;
     deinit_fnc = String_data::deinit;
+    save_fnc = String_data::save;
+    load_fnc = String_data::load;
     ag_data_size = sizeof(String_data);
     return 0;
 }
@@ -180,6 +232,8 @@ int Field_template::assign_append() noexcept
     post_proc_fnc = Append_data<T>::postprocessing;
     init_fnc = Append_data<T>::init;
     deinit_fnc = Append_data<T>::deinit;
+    save_fnc = Append_data<T>::save;
+    load_fnc = Append_data<T>::load;
     ag_data_size = sizeof(Append_data<T>);
     return 0;
 }
@@ -196,6 +250,18 @@ int Field_template::assign_unique_count() noexcept
     return 0;
 }
 
+template<typename T>
+int Field_template::assign_unique_count_hll() noexcept
+{
+    typename_size = sizeof(uint32_t);
+    ag_fnc = unique_count_hll<T>;
+    post_proc_fnc = Hll_count_data::postprocessing;
+    init_fnc = Hll_count_data::init;
+    deinit_fnc = Hll_count_data::deinit;
+    ag_data_size = sizeof(Hll_count_data);
+    return 0;
+}
+
 template<Field_type ag_type, typename T>
 int Field_template::assign_min_max() noexcept
 {
@@ -460,6 +526,23 @@ int Field_template::set_templates(const Field_type ag_type, const ur_field_type_
             std::cerr << "Only string and int, uint, float, double, mac, time, and IP array can be used to UNIQUE_COUNT function." << std::endl;
             return 1;
         }
+    case UNIQUE_COUNT_HLL:
+        switch (ur_f_type) {
+        case UR_TYPE_UINT8:  return assign_unique_count_hll<uint8_t>();
+        case UR_TYPE_INT8:   return assign_unique_count_hll<int8_t>();
+        case UR_TYPE_UINT16: return assign_unique_count_hll<uint16_t>();
+        case UR_TYPE_INT16:  return assign_unique_count_hll<int16_t>();
+        case UR_TYPE_UINT32: return assign_unique_count_hll<uint32_t>();
+        case UR_TYPE_INT32:  return assign_unique_count_hll<int32_t>();
+        case UR_TYPE_UINT64: return assign_unique_count_hll<uint64_t>();
+        case UR_TYPE_INT64:  return assign_unique_count_hll<int64_t>();
+        case UR_TYPE_MAC:    return assign_unique_count_hll<Mac_addr>();
+        case UR_TYPE_IP:     return assign_unique_count_hll<uint128_t>();
+        case UR_TYPE_STRING: return assign_unique_count_hll<char>();
+        default:
+            std::cerr << "Only string, int, uint, mac and IP can be used to UNIQUE_COUNT_HLL function." << std::endl;
+            return 1;
+        }
     default:
         assert("Invalid case option.\n");
         return 1;
@@ -796,6 +879,12 @@ Field::Field(const Field_config cfg, const ur_field_id_t ur_fid_in, const ur_fie
         if (set_templates(type, ur_field_type))
             throw std::runtime_error("Cannot set field template.");
     }
+
+    // HyperLogLog registers are stored right behind the sketch header
+    if (type == UNIQUE_COUNT_HLL) {
+        precision = cfg.precision;
+        ag_data_size += Hll_count_data::register_count(precision);
+    }
 }
 
 
@@ -811,7 +900,7 @@ void Fields::reset() noexcept
     _offset = 0;
 }
 
-std::vector<std::pair<Field, std::size_t>> Fields::get_fields() noexcept 
+const std::vector<std::pair<Field, std::size_t>>& Fields::get_fields() const noexcept 
 {
     return _fields;
 }
@@ -821,9 +910,36 @@ std::size_t Fields::get_size() noexcept
     return _offset;
 }
 
+bool Fields::is_snapshot_supported() const noexcept
+{
+    for (const auto& data : _fields) {
+        if (!data.first.is_snapshot_supported())
+            return false;
+    }
+    return true;
+}
+
+std::size_t Fields::save(const uint8_t *memory, uint8_t *out) const
+{
+    std::size_t size = 0;
+
+    for (const auto& data : _fields)
+        size += data.first.save(&memory[data.second], out ? &out[size] : nullptr);
+    return size;
+}
+
+std::size_t Fields::load(uint8_t *memory, const uint8_t *in) const
+{
+    std::size_t size = 0;
+
+    for (const auto& data : _fields)
+        size += data.first.load(&memory[data.second], &in[size]);
+    return size;
+}
+
 void Fields::init(uint8_t *memory)
 {
-    for (auto data : _fields) {
+    for (auto& data : _fields) {
         switch (data.first.type) {
         case SUM:
         case MAX:
@@ -849,6 +965,11 @@ void Fields::init(uint8_t *memory)
             data.first.init(memory, &cfg);
             break;
         }
+        case UNIQUE_COUNT_HLL: {
+            struct Config_hll cfg = {data.first.precision};
+            data.first.init(memory, &cfg);
+            break;
+        }
         case SORTED_MERGE:
         case SORTED_MERGE_DIR: {
             struct Config_sorted_merge cfg = {data.first.limit, data.first.delimiter, data.first.sort_type};
@@ -864,62 +985,93 @@ void Fields::init(uint8_t *memory)
 
 void Fields::deinit(uint8_t *memory)
 {
-    for (auto data : _fields) {
+    for (auto& data : _fields) {
         data.first.deinit(memory);
         memory = memory + data.first.ag_data_size;
     }
 }
 
-Timeout_data::Timeout_data(FlowKey key, time_t passive_timeout, time_t active_timeout) :
-    key(key), passive_timeout(passive_timeout), active_timeout(active_timeout)
+void Aggregation_plan::compile(const Fields& fields)
 {
+    _steps.clear();
+    _steps.reserve(fields.get_fields().size());
+
+    for (const auto& data : fields.get_fields()) {
+        const Field& field = data.first;
+        Aggregation_step step = {};
 
+        step.fnc = field.get_aggr_func();
+        step.offset = data.second;
+        step.ur_fid = field.ur_fid;
+        step.ur_r_fid = field.ur_r_fid;
+        step.ur_sort_key_id = field.ur_sort_key_id;
+
+        if (!ur_is_array(field.ur_fid))
+            step.input = Aggregation_step::SCALAR;
+        else if (field.type == SORTED_MERGE_DIR)
+            step.input = Aggregation_step::SORTED_DIR_ARRAY;
+        else if (field.type == SORTED_MERGE)
+            step.input = Aggregation_step::SORTED_ARRAY;
+        else
+            step.input = Aggregation_step::ARRAY;
+
+        if (step.input == Aggregation_step::SORTED_ARRAY || step.input == Aggregation_step::SORTED_DIR_ARRAY)
+            step.is_sort_key_array = ur_is_array(field.ur_sort_key_id);
+
+        _steps.emplace_back(step);
+    }
 }
 
-std::vector<Context *> Flow_data_context_allocator::_ptrs;
-std::size_t Flow_data_context_allocator::_idx = 0;
-uint8_t* Flow_data_context_allocator::_global = nullptr;
-std::function<void(uint8_t *)> Flow_data_context_allocator::_init_field = nullptr;
-std::function<void(uint8_t *)> Flow_data_context_allocator::_deinit_field = nullptr;
+thread_local std::vector<Context *> Flow_data_context_allocator::_ptrs;
+thread_local std::size_t Flow_data_context_allocator::_idx = 0;
+thread_local std::vector<uint8_t *> Flow_data_context_allocator::_chunks;
+thread_local std::size_t Flow_data_context_allocator::_data_size = 0;
+thread_local std::function<void(uint8_t *)> Flow_data_context_allocator::_init_field = nullptr;
+thread_local std::function<void(uint8_t *)> Flow_data_context_allocator::_deinit_field = nullptr;
 
 void Flow_data_context_allocator::deinit()
 {
-    for (std::size_t i = 0; i < _ptrs.size(); i++) {
-        _deinit_field(_ptrs[i]->data);
-    }
-    delete [] _global;
+    clear();
 }
 
 Flow_data_context_allocator::~Flow_data_context_allocator()
 {
-    for (std::size_t i = 0; i < _ptrs.size(); i++) {
-        _deinit_field(_ptrs[i]->data);
-    }
-    delete [] _global;
+    clear();
 }
 
 void Flow_data_context_allocator::init(std::size_t elements, std::size_t data_size, std::function<void(uint8_t *)> init_field, std::function<void(uint8_t *)> deinit_field)
 {
-    std::size_t offset = 0;
+    // Contexts of previous configuration are deinitialized by previous function
+    clear();
 
     _init_field = init_field;
     _deinit_field = deinit_field;
+    _data_size = data_size;
 
-    clear();
+    grow(elements);
+}
+
+void Flow_data_context_allocator::grow(std::size_t elements)
+{
+    std::size_t offset = 0;
+    uint8_t *chunk = new uint8_t[(_data_size + sizeof(Context)) * elements]();
 
-    _ptrs.reserve(elements);
-    _global = new uint8_t[(data_size + sizeof(node<Timeout_data>)) * elements]();
+    _chunks.push_back(chunk);
+    _ptrs.reserve(_ptrs.size() + elements);
 
     for (std::size_t i = 0; i < elements; i++) {
-        Context *ctx = new (std::addressof(_global[offset])) Context;
-        init_field(ctx->data);
+        Context *ctx = new (std::addressof(chunk[offset])) Context;
+        _init_field(ctx->data);
         _ptrs.emplace_back(ctx);
-        offset += data_size + sizeof(node<Timeout_data>);
+        offset += _data_size + sizeof(Context);
     }
 }
 
 Context *Flow_data_context_allocator::get_ptr() noexcept
 {
+    assert(_idx < _ptrs.size());
+    if (_idx >= _ptrs.size())
+        return nullptr;
     return _ptrs[_idx++];
 }
 
@@ -935,10 +1087,12 @@ void Flow_data_context_allocator::clear()
     for (std::size_t i = 0; i < _ptrs.size(); i++) {
         _deinit_field(_ptrs[i]->data);
     }
-    delete [] _global;
-    _global = nullptr;
+    for (uint8_t *chunk : _chunks)
+        delete [] chunk;
+    _chunks.clear();
     _idx = 0;
     _ptrs.clear();
+    Slab_pool::clear();
 }
 
 namespace std {
@@ -13,7 +13,7 @@
 
 #include "flat_hash_map.h"
 #include "key_template.h"
-#include "linked_list.h"
+#include "timer_wheel.h"
 
 #include <cassert>
 #include <string>
@@ -41,6 +41,7 @@ enum Field_type {
     LAST_NON_EMPTY,
     APPEND,
     UNIQUE_COUNT,
+    UNIQUE_COUNT_HLL,
     SORTED_MERGE,
     SORTED_MERGE_DIR,
     INVALID_TYPE,
@@ -61,6 +62,8 @@ using post_func = const void *(*)(void *, std::size_t&);
 using post_func_sm_dir = const void *(*)(void *, std::size_t&, bool);
 using init_func = void (*)(void *, const void *);
 using deinit_func = void (*)(void *);
+using save_func = std::size_t (*)(const void *, uint8_t *);
+using load_func = std::size_t (*)(void *, const uint8_t *);
 
 /**
  * @brief Class that holds field templates information.
@@ -99,6 +102,9 @@ class Field_template {
     template<typename T>
     int assign_unique_count() noexcept;
 
+    template<typename T>
+    int assign_unique_count_hll() noexcept;
+
     template<Field_type ag_type, typename T>
     int assign_min_max() noexcept;
 
@@ -125,6 +131,16 @@ protected:
      * @brief Pointer to deinit function
      */
     deinit_func deinit_fnc;
+
+    /**
+     * @brief Pointer to function that serializes aggregated data, nullptr for plain data
+     */
+    save_func save_fnc;
+
+    /**
+     * @brief Pointer to function that restores serialized aggregated data, nullptr for plain data
+     */
+    load_func load_fnc;
     
     /**
      * @brief Size of templated type T
@@ -151,48 +167,48 @@ protected:
 
 public:
 
+    Field_template() : ag_fnc(nullptr), post_proc_fnc(nullptr), post_proc_sm_dir_fnc(nullptr),
+        init_fnc(nullptr), deinit_fnc(nullptr), save_fnc(nullptr), load_fnc(nullptr), typename_size(0), ag_data_size(0)
+    {
+    }
+
     /**
      * @brief Size of memory needed for aggregation of this field.
      */
     std::size_t ag_data_size;
-};
-
-/**
- * @brief Structure that holds information about active and passive timeout of flow
- */
-struct Timeout_data {
-
-    /**
-     * @brief Construct a new Timeout_data object
-     * 
-     * @param key              Flow key
-     * @param passive_timeout  Passive timeout expiration       
-     * @param active_timeout   Active timeout expiration
-     */
-    Timeout_data(FlowKey key, time_t passive_timeout, time_t active_timeout);
 
     /**
-     * @brief Construct a new Timeout_data object
-     * 
+     * @brief Get pointer to aggregation function
      */
-    Timeout_data() : passive_timeout(0), active_timeout(0)
+    aggr_func get_aggr_func() const noexcept
     {
+        return ag_fnc;
     }
-
-    FlowKey key;
-    time_t passive_timeout;
-    time_t active_timeout;
 };
 
+struct Flow_data;
+
 /**
  * @brief Structure that holds context of flow data.
  */
 struct Context {
 
     /**
-     * @brief Timeout data structure as Linked list item  
+     * @brief Passive timeout of flow, expiration time is passive timeout
+     */
+    Timer_node<Context> passive_timer;
+
+    /**
+     * @brief Active timeout of flow, expiration time is active timeout
+     */
+    Timer_node<Context> active_timer;
+
+    /**
+     * @brief Flow data in flow cache that own this context.
+     *
+     * Updated every time flow cache moves its entry, so flow can be found without hash lookup.
      */
-    node<Timeout_data> t_data; 
+    Flow_data *flow;
 
     /**
      * @brief Flow data memory
@@ -212,6 +228,15 @@ struct Flow_data {
      */
     Flow_data();
 
+    Flow_data(const Flow_data&) = default;
+    Flow_data& operator=(const Flow_data&) = default;
+
+    /**
+     * @brief Move flow data and update back pointer of its context.
+     */
+    Flow_data(Flow_data&& other) noexcept;
+    Flow_data& operator=(Flow_data&& other) noexcept;
+
     /**
      * @brief Pointer to flow context structure.
      */
@@ -283,6 +308,11 @@ struct Field_config {
      */
     std::size_t limit;
 
+    /**
+     * @brief HyperLogLog precision (only for UNIQUE_COUNT_HLL)
+     */
+    uint8_t precision;
+
     /**
      * @brief Field goes to output template.
      */
@@ -359,9 +389,30 @@ public:
     /**
      * @brief Call field post-processing function.
      */
-    const void *post_processing(void *ag_data, std::size_t& typename_size, std::size_t& elem_cnt);
+    const void *post_processing(void *ag_data, std::size_t& typename_size, std::size_t& elem_cnt) const;
+
+    const void *post_processing_sm_dir(void *ag_data, std::size_t& typename_size, std::size_t& elem_cnt, bool is_reverse) const;
+
+    /**
+     * @brief Check if aggregated data can be stored to snapshot.
+     */
+    bool is_snapshot_supported() const noexcept;
+
+    /**
+     * @brief Serialize aggregated data.
+     *
+     * @param ag_data Aggregated data
+     * @param out     Output memory or nullptr to get size only
+     * @return Size of serialized data
+     */
+    std::size_t save(const void *ag_data, uint8_t *out) const;
 
-    const void *post_processing_sm_dir(void *ag_data, std::size_t& typename_size, std::size_t& elem_cnt, bool is_reverse);
+    /**
+     * @brief Restore serialized aggregated data to initialized memory.
+     *
+     * @return Size of consumed serialized data
+     */
+    std::size_t load(void *ag_data, const uint8_t *in) const;
 };
 
 /**
@@ -393,6 +444,27 @@ public:
      */
     std::size_t get_size() noexcept;
 
+    /**
+     * @brief Check if aggregated data of all fields can be stored to snapshot.
+     */
+    bool is_snapshot_supported() const noexcept;
+
+    /**
+     * @brief Serialize aggregated data of all fields.
+     *
+     * @param memory Memory of fields
+     * @param out    Output memory or nullptr to get size only
+     * @return Size of serialized data
+     */
+    std::size_t save(const uint8_t *memory, uint8_t *out) const;
+
+    /**
+     * @brief Restore serialized aggregated data of all fields to initialized memory.
+     *
+     * @return Size of consumed serialized data
+     */
+    std::size_t load(uint8_t *memory, const uint8_t *in) const;
+
     /**
      * @brief Add field
      */
@@ -420,40 +492,110 @@ public:
     /**
      * @brief return vector of all fields and their size
      */
-    std::vector<std::pair<Field, std::size_t>> get_fields() noexcept;
+    const std::vector<std::pair<Field, std::size_t>>& get_fields() const noexcept;
+};
+
+/**
+ * @brief One step of aggregation plan, pre-resolved aggregation of one field.
+ */
+struct Aggregation_step {
+
+    /**
+     * @brief Way how source data are passed to aggregation function.
+     */
+    enum Input_type : uint8_t {
+        SCALAR,            ///< Pointer to field value, reverse field is used for reversed key
+        ARRAY,             ///< ur_array_data structure
+        SORTED_ARRAY,      ///< ur_array_data structure with sort key
+        SORTED_DIR_ARRAY,  ///< ur_array_dir_data structure with sort key
+    };
+
+    /**
+     * @brief Pointer to aggregation function
+     */
+    aggr_func fnc;
+
+    /**
+     * @brief Offset of field data in flow context
+     */
+    std::size_t offset;
+
+    ur_field_id_t ur_fid;
+    ur_field_id_t ur_r_fid;
+    ur_field_id_t ur_sort_key_id;
+    Input_type input;
+
+    /**
+     * @brief Sort key is array, otherwise it is one element
+     */
+    bool is_sort_key_array;
+};
+
+/**
+ * @brief Flat array of aggregation steps compiled from fields once per input template.
+ *
+ * Aggregation of record walks this array, no field configuration is copied or allocated.
+ */
+class Aggregation_plan {
+
+    std::vector<Aggregation_step> _steps;
+
+public:
+
+    /**
+     * @brief Compile plan from fields.
+     */
+    void compile(const Fields& fields);
+
+    /**
+     * @brief Aggregate record to flow context data.
+     *
+     * @param tmplt           Input template
+     * @param in_data         Input record
+     * @param ctx_data        Flow context data
+     * @param is_key_reversed Record is in reverse direction
+     */
+    void aggregate(const ur_template_t *tmplt, const void *in_data, uint8_t *ctx_data, bool is_key_reversed) const noexcept;
 };
 
 
 // TODO reinit after release
 /**
  * @brief Class to allocate Context of flow data
+ *
+ * Allocator state is thread local, every thread that owns a flow cache has its own arena.
  */
 class Flow_data_context_allocator {
     
     /**
      * @brief Vector of allocated pointers 
      */
-    static std::vector<Context *> _ptrs;
+    static thread_local std::vector<Context *> _ptrs;
 
     /**
      * @brief Current index to vector 
      */
-    static std::size_t _idx;
+    static thread_local std::size_t _idx;
 
     /**
-     * @brief Pointer to memory that holds all Context structures.
+     * @brief Memory chunks that hold Context structures, new chunk is added by grow().
      */
-    static uint8_t *_global;
+    static thread_local std::vector<uint8_t *> _chunks;
+
+    /**
+     * @brief Size of flow field data
+     */
+    static thread_local std::size_t _data_size;
 
     /**
      * @brief Pointer to function that initialize flow field data
      */
-    static std::function<void(uint8_t *)> _init_field;
+    static thread_local std::function<void(uint8_t *)> _init_field;
 
     /**
      * @brief Pointer to function that deinitialize flow field data
      */
-    static std::function<void(uint8_t *)> _deinit_field;
+    static thread_local std::function<void(uint8_t *)> _deinit_field;
 
 public:
 
@@ -466,8 +608,17 @@ public:
      */
     static void init(std::size_t elements, std::size_t data_size, std::function<void(uint8_t *)> init_field, std::function<void(uint8_t *)> deinit_field);
 
+    /**
+     * @brief Add initialized Contexts for more elements, pointers returned earlier stay valid.
+     * 
+     * @param elements Number of added elements
+     */
+    static void grow(std::size_t elements);
+
     /**
      * @brief Get the pointer to available Context memory
+     *
+     * @return Pointer to Context or nullptr if all Contexts are used.
      */
     static Context *get_ptr() noexcept;
 
@@ -505,14 +656,28 @@ public:
 
     Fields fields;
 
+    /**
+     * @brief Aggregation plan compiled from fields
+     */
+    Aggregation_plan plan;
+
+    using Table = ska::flat_hash_map<Key, Flow_data>;
+
+    /**
+     * @brief Handler of flow that does not fit to flow cache while flows are moved from old_cache.
+     *
+     * Handler has to send (or drop) the flow and release its key and context, flow is removed then.
+     */
+    using Evict = std::function<void(Key&, Flow_data&)>;
+
     /**
      * @brief Construct a new Aggregator object
      * 
      * Reserve flow cache size
      * 
-     * @param flow_cache_size Maximal flow cache size, power of 2
+     * @param flow_cache_size Flow cache size, power of 2
      */
-    Aggregator(std::size_t flow_cache_size)
+    Aggregator(std::size_t flow_cache_size) : _capacity(flow_cache_size), _cursor(0)
     {
         flow_cache.reserve(flow_cache_size);
     }
@@ -520,7 +685,147 @@ public:
     /**
      * @brief Flow cache, holds keys and data
      */
-    ska::flat_hash_map<Key, Flow_data> flow_cache;
+    Table flow_cache;
+
+    /**
+     * @brief Previous flow cache while flow cache grows, its flows are moved to flow_cache gradually.
+     */
+    Table old_cache;
+
+    /**
+     * @brief Get flow cache iterator of flow that owns given context without hash lookup.
+     *
+     * Iterator may point to old_cache, use erase() of Aggregator to remove the flow.
+     */
+    typename Table::iterator find(const Context *ctx) noexcept
+    {
+        using value_type = typename Table::value_type;
+        uint8_t *flow = reinterpret_cast<uint8_t *>(ctx->flow);
+        return flow_cache.iterator_to(*reinterpret_cast<value_type *>(flow - offsetof(value_type, second)));
+    }
+
+    /**
+     * @brief Remove flow from the table which holds it.
+     */
+    void erase(typename Table::iterator it)
+    {
+        if (old_cache.owns(*it))
+            old_cache.erase(it);
+        else
+            flow_cache.erase(it);
+    }
+
+    /**
+     * @brief Get number of flows in both tables.
+     */
+    std::size_t size() const noexcept
+    {
+        return flow_cache.size() + old_cache.size();
+    }
+
+    /**
+     * @brief Get maximal number of flows of current flow cache.
+     */
+    std::size_t capacity() const noexcept
+    {
+        return _capacity;
+    }
+
+    /**
+     * @brief Check if flows are being moved from old_cache.
+     */
+    bool is_growing() const noexcept
+    {
+        return !old_cache.empty();
+    }
+
+    /**
+     * @brief Replace flow cache by empty table with bigger capacity.
+     *
+     * Flows stay in old_cache and are moved to new flow cache by migrate() and promote().
+     * Flows are moved with their Flow_data, so contexts keep pointing to them.
+     */
+    void start_growth(std::size_t capacity)
+    {
+        assert(!is_growing());
+        old_cache.swap(flow_cache);
+        flow_cache.reserve(capacity);
+        _capacity = capacity;
+        _cursor = 0;
+    }
+
+    /**
+     * @brief Move flow with given key from old_cache, so it is found in flow cache.
+     */
+    void promote(const Key& key, const Evict& evict)
+    {
+        auto it = old_cache.find(key);
+        if (it != old_cache.end())
+            move_flow(it, evict);
+    }
+
+    /**
+     * @brief Move at most given number of flows from old_cache to flow cache.
+     */
+    void migrate(std::size_t count, const Evict& evict)
+    {
+        std::size_t budget = count * 4;
+
+        while (count && budget-- && !old_cache.empty()) {
+            // Flows behind cursor can be shifted before it by erase, start again from the beginning
+            if (_cursor >= old_cache.slot_range())
+                _cursor = 0;
+            auto it = old_cache.slot_at(_cursor);
+            if (it == old_cache.end()) {
+                _cursor++;
+                continue;
+            }
+            move_flow(it, evict);
+            count--;
+        }
+        if (old_cache.empty())
+            Table().swap(old_cache);
+    }
+
+    /**
+     * @brief Move all flows from old_cache to flow cache.
+     */
+    void finish_growth(const Evict& evict)
+    {
+        while (is_growing())
+            migrate(old_cache.size(), evict);
+    }
+
+private:
+
+    /**
+     * @brief Move flow to flow cache without growing it.
+     *
+     * Contexts are allocated only for capacity flows, so flow cache must never hold more of them.
+     * Flow displaced by collision, or the moved flow itself when flow cache is full, is evicted.
+     */
+    void move_flow(typename Table::iterator it, const Evict& evict)
+    {
+        auto inserted = flow_cache.insert_no_grow(_removed, std::move(it->first), std::move(it->second));
+
+        if (inserted.second == ska::SWAPPED)
+            evict(_removed.first, _removed.second);
+        else if (inserted.second == ska::FULL)
+            evict(it->first, it->second);
+        old_cache.erase(it);
+    }
+
+    /**
+     * @brief Flow displaced from flow cache by move_flow().
+     */
+    typename Table::value_type _removed;
+
+    std::size_t _capacity;
+
+    /**
+     * @brief Next slot of old_cache to migrate.
+     */
+    std::size_t _cursor;
 };
 
 } // namespace agg
@@ -12,7 +12,11 @@
 #define AGGREGATOR_FUNCTIONS_H
 
 #include "aggregator.h"
+#include "slab_allocator.h"
+#include <algorithm>
 
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <nemea-common/BloomFilter.hpp>
@@ -42,6 +46,40 @@ struct ur_array_dir_data {
     bool is_key_reversed;
 };
 
+/**
+ * @brief Serialize vector elements behind their count.
+ *
+ * @param out Output memory or nullptr to get size only
+ * @return Size of serialized data
+ */
+template<typename T, typename A>
+inline std::size_t save_vector(const std::vector<T, A>& vec, uint8_t *out) noexcept
+{
+    uint32_t cnt = vec.size();
+
+    if (out) {
+        std::memcpy(out, &cnt, sizeof(cnt));
+        std::memcpy(out + sizeof(cnt), static_cast<const void *>(vec.data()), cnt * sizeof(T));
+    }
+    return sizeof(cnt) + cnt * sizeof(T);
+}
+
+/**
+ * @brief Restore vector serialized by save_vector().
+ *
+ * @return Size of consumed data
+ */
+template<typename T, typename A>
+inline std::size_t load_vector(std::vector<T, A>& vec, const uint8_t *in)
+{
+    uint32_t cnt;
+
+    std::memcpy(&cnt, in, sizeof(cnt));
+    vec.resize(cnt);
+    std::memcpy(static_cast<void *>(vec.data()), in + sizeof(cnt), cnt * sizeof(T));
+    return sizeof(cnt) + cnt * sizeof(T);
+}
+
 /** 
  * @brief Basic template data structure that store variable of given type T.
  */ 
@@ -135,6 +173,30 @@ struct String_data {
         elem_cnt = s_data->data.size(); 
         return s_data->data.data();
     }
+
+    static inline std::size_t save(const void *mem, uint8_t *out) noexcept
+    {
+        const String_data *s_data = static_cast<const String_data*>(mem);
+        uint32_t len = s_data->data.size();
+
+        if (out) {
+            std::memcpy(out, &len, sizeof(len));
+            std::memcpy(out + sizeof(len), s_data->data.data(), len);
+            out[sizeof(len) + len] = s_data->is_set;
+        }
+        return sizeof(len) + len + 1;
+    }
+
+    static inline std::size_t load(void *mem, const uint8_t *in)
+    {
+        String_data *s_data = static_cast<String_data*>(mem);
+        uint32_t len;
+
+        std::memcpy(&len, in, sizeof(len));
+        s_data->data.assign(reinterpret_cast<const char *>(in + sizeof(len)), len);
+        s_data->is_set = in[sizeof(len) + len];
+        return sizeof(len) + len + 1;
+    }
 };
 
 /**
@@ -150,7 +212,7 @@ struct Config_append {
  */
 template<typename T>
 struct Append_data : Config_append {
-    std::vector<T> data;
+    Slab_vector<T> data;
     
     static inline void init(void *mem, const void *cfg)
     {
@@ -173,6 +235,16 @@ struct Append_data : Config_append {
         elem_cnt = append->data.size(); 
         return append->data.data();
     }
+
+    static inline std::size_t save(const void *mem, uint8_t *out) noexcept
+    {
+        return save_vector(static_cast<const Append_data<T>*>(mem)->data, out);
+    }
+
+    static inline std::size_t load(void *mem, const uint8_t *in)
+    {
+        return load_vector(static_cast<Append_data<T>*>(mem)->data, in);
+    }
 };
 
 /**
@@ -219,6 +291,91 @@ struct Unique_count_data : Config_unique_count {
     }
 };
 
+/**
+ * @brief Configuration for HyperLogLog unique count function
+ */
+struct Config_hll {
+    uint8_t precision;
+};
+
+/**
+ * @brief HyperLogLog sketch used to estimate count of unique values.
+ *
+ * Sketch has 2^precision one byte registers stored right behind this structure
+ * in flow context memory, so the state does not depend on number of inserted values.
+ */
+struct Hll_count_data {
+    uint8_t precision;
+    uint32_t estimate;
+    uint8_t registers[];
+
+    static constexpr uint8_t min_precision = 4;
+    static constexpr uint8_t max_precision = 16;
+    static constexpr uint8_t default_precision = 8;
+
+    static inline std::size_t register_count(uint8_t precision) noexcept
+    {
+        return std::size_t(1) << precision;
+    }
+
+    static inline void init(void *mem, const void *cfg) noexcept
+    {
+        const Config_hll *config = static_cast<const Config_hll *>(cfg);
+        Hll_count_data *hll = new(mem) Hll_count_data();
+        hll->precision = config->precision;
+        std::memset(hll->registers, 0, register_count(hll->precision));
+    }
+
+    static inline void deinit(void *mem)
+    {
+        Hll_count_data *hll = static_cast<Hll_count_data *>(mem);
+        hll->~Hll_count_data();
+    }
+
+    /**
+     * @brief Insert 64 bit hash of value to sketch.
+     */
+    inline void insert(uint64_t hash) noexcept
+    {
+        std::size_t index = hash >> (64 - precision);
+        // Guard bit limits rank to 64 - precision + 1
+        uint64_t rest = (hash << precision) | (uint64_t(1) << (precision - 1));
+        uint8_t rank = __builtin_clzll(rest) + 1;
+        if (rank > registers[index])
+            registers[index] = rank;
+    }
+
+    static inline const void *postprocessing(void *mem, std::size_t& elem_cnt) noexcept
+    {
+        Hll_count_data *hll = static_cast<Hll_count_data *>(mem);
+        const std::size_t m = register_count(hll->precision);
+        std::size_t zeros = 0;
+        double sum = 0;
+        double alpha;
+
+        for (std::size_t i = 0; i < m; i++) {
+            sum += std::ldexp(1.0, -hll->registers[i]);
+            zeros += hll->registers[i] == 0;
+        }
+
+        switch (m) {
+        case 16: alpha = 0.673; break;
+        case 32: alpha = 0.697; break;
+        case 64: alpha = 0.709; break;
+        default: alpha = 0.7213 / (1.0 + 1.079 / m); break;
+        }
+
+        double estimate = alpha * m * m / sum;
+        // Small range correction, 64 bit hash does not need the large range one
+        if (estimate <= 2.5 * m && zeros != 0)
+            estimate = m * std::log(static_cast<double>(m) / zeros);
+
+        hll->estimate = static_cast<uint32_t>(std::llround(estimate));
+        elem_cnt = 1;
+        return static_cast<void *>(&hll->estimate);
+    }
+};
+
 /**
  * @brief Configuration to sorted merge function
  */
@@ -228,13 +385,53 @@ struct Config_sorted_merge {
     Sort_type sort_type;
 };
 
+/**
+ * @brief Order of (value, sort key) pairs in output of sorted merge.
+ */
+template <typename T, typename K>
+struct Sort_key_compare {
+    Sort_type sort_type;
+
+    explicit Sort_key_compare(Sort_type sort_type) : sort_type(sort_type) {}
+
+    bool operator()(const std::pair<T, K>& a, const std::pair<T, K>& b) const noexcept
+    {
+        if (sort_type == ASCENDING)
+            return a.second < b.second;
+        else
+            return a.second > b.second;
+    }
+};
+
+/**
+ * @brief Insert pair to heap which keeps at most limit pairs that go first to output.
+ *
+ * Top of the heap is the last of kept pairs, it is replaced when better pair comes.
+ */
+template <typename T, typename K>
+inline void top_k_insert(Slab_vector<std::pair<T, K>>& heap, std::size_t limit, Sort_type sort_type, const std::pair<T, K>& t_k)
+{
+    Sort_key_compare<T, K> compare(sort_type);
+
+    if (heap.size() < limit) {
+        heap.push_back(t_k);
+        std::push_heap(heap.begin(), heap.end(), compare);
+    } else if (limit != 0 && compare(t_k, heap.front())) {
+        std::pop_heap(heap.begin(), heap.end(), compare);
+        heap.back() = t_k;
+        std::push_heap(heap.begin(), heap.end(), compare);
+    }
+}
+
 /**
  * @brief Structure used to store data for sorted append function.
+ *
+ * Only limit pairs which go to output are kept, data is heap ordered by Sort_key_compare.
  */
 template <typename T, typename K>
 struct Sorted_merge_data : Config_sorted_merge {
-    std::vector<std::pair<T, K>> data;
-    std::vector<T> result;
+    Slab_vector<std::pair<T, K>> data;
+    Slab_vector<T> result;
     
     static inline void init(void *mem, const void *cfg)
     {
@@ -255,13 +452,7 @@ struct Sorted_merge_data : Config_sorted_merge {
     static inline const void *postprocessing(void *mem, std::size_t& elem_cnt)
     {
         Sorted_merge_data<T, K> *sorted_merge = static_cast<Sorted_merge_data<T, K>*>(mem);
-        Sort_type sort_type = sorted_merge->sort_type;
-        sort(sorted_merge->data.begin(), sorted_merge->data.end(), [&sort_type](const std::pair<T,K>& a, const std::pair<T,K>& b) -> bool { 
-            if (sort_type == ASCENDING)
-                return a.second < b.second;
-            else
-                return a.second > b.second;
-            }); 
+        std::sort_heap(sorted_merge->data.begin(), sorted_merge->data.end(), Sort_key_compare<T, K>(sorted_merge->sort_type));
 
         for (auto it = sorted_merge->data.begin(); it != sorted_merge->data.end(); it++) {
             if (sorted_merge->result.size() == sorted_merge->limit)
@@ -272,12 +463,27 @@ struct Sorted_merge_data : Config_sorted_merge {
         elem_cnt = sorted_merge->result.size();
         return sorted_merge->result.data();
     }    
+
+    static inline std::size_t save(const void *mem, uint8_t *out) noexcept
+    {
+        return save_vector(static_cast<const Sorted_merge_data<T, K>*>(mem)->data, out);
+    }
+
+    static inline std::size_t load(void *mem, const uint8_t *in)
+    {
+        return load_vector(static_cast<Sorted_merge_data<T, K>*>(mem)->data, in);
+    }
 };
 
+/**
+ * @brief Structure used to store data for sorted append function with values negated in reverse direction.
+ *
+ * Only limit pairs which go to output are kept, data is heap ordered by Sort_key_compare.
+ */
 template <typename T, typename K>
 struct Sorted_merge_dir_data : Config_sorted_merge {
-    std::vector<std::pair<T, K>> data;
-    std::vector<T> result;
+    Slab_vector<std::pair<T, K>> data;
+    Slab_vector<T> result;
     
     static inline void init(void *mem, const void *cfg)
     {
@@ -298,13 +504,7 @@ struct Sorted_merge_dir_data : Config_sorted_merge {
     static inline const void *postprocessing(void *mem, std::size_t& elem_cnt, bool is_reverse)
     {
         Sorted_merge_dir_data<T, K> *sorted_merge = static_cast<Sorted_merge_dir_data<T, K>*>(mem);
-        Sort_type sort_type = sorted_merge->sort_type;
-        sort(sorted_merge->data.begin(), sorted_merge->data.end(), [&sort_type](const std::pair<T,K>& a, const std::pair<T,K>& b) -> bool { 
-            if (sort_type == ASCENDING)
-                return a.second < b.second;
-            else
-                return a.second > b.second;
-            }); 
+        std::sort_heap(sorted_merge->data.begin(), sorted_merge->data.end(), Sort_key_compare<T, K>(sorted_merge->sort_type));
 
         for (auto it = sorted_merge->data.begin(); it != sorted_merge->data.end(); it++) {
             if (sorted_merge->result.size() == sorted_merge->limit)
@@ -318,6 +518,16 @@ struct Sorted_merge_dir_data : Config_sorted_merge {
         elem_cnt = sorted_merge->result.size();
         return sorted_merge->result.data();
     }    
+
+    static inline std::size_t save(const void *mem, uint8_t *out) noexcept
+    {
+        return save_vector(static_cast<const Sorted_merge_dir_data<T, K>*>(mem)->data, out);
+    }
+
+    static inline std::size_t load(void *mem, const uint8_t *in)
+    {
+        return load_vector(static_cast<Sorted_merge_dir_data<T, K>*>(mem)->data, in);
+    }
 };
 
 /**
@@ -590,6 +800,26 @@ inline void unique_count(const void* src, void* dst) noexcept
     }    
 }
 
+/**
+ * @brief Inserts hash of element from src pointer into HyperLogLog sketch.
+ * @tparam T template type variable.
+ * @param [in] src pointer to source of new data.
+ * @param [in,out] dst pointer to already stored data which will be updated (modified).
+ */
+template<typename T>
+inline void unique_count_hll(const void* src, void* dst) noexcept
+{
+    Hll_count_data *hll = static_cast<Hll_count_data *>(dst);
+
+    if (std::is_same<T, char>::value) {
+        const ur_array_data* src_data = (static_cast<const ur_array_data*>(src));
+        if (src_data->cnt_elements != 0)
+            hll->insert(XXH3_64bits(src_data->ptr_first, src_data->cnt_elements));
+        return;
+    }
+    hll->insert(XXH3_64bits(src, sizeof(T)));
+}
+
 template <typename T, typename K>
 inline void sorted_merge(const void *src, void *dst) noexcept
 {
@@ -600,7 +830,7 @@ inline void sorted_merge(const void *src, void *dst) noexcept
 
     for (std::size_t i = 0; i < src_data->sort_key_elements; i++) {
         std::pair<T, K> t_k = std::make_pair(((T *)src_data->ptr_first)[i], ((K*)src_data->sort_key)[i]);
-        sorted_merge->data.emplace_back(t_k);
+        top_k_insert(sorted_merge->data, sorted_merge->limit, sorted_merge->sort_type, t_k);
     }
 }
 
@@ -618,7 +848,46 @@ inline void sorted_merge_dir(const void *src, void *dst) noexcept
             value = -value;
         }
         std::pair<T, K> t_k = std::make_pair(value, ((K*)src_data->sort_key)[i]);
-        sorted_merge->data.emplace_back(t_k);
+        top_k_insert(sorted_merge->data, sorted_merge->limit, sorted_merge->sort_type, t_k);
+    }
+}
+
+inline void Aggregation_plan::aggregate(const ur_template_t *tmplt, const void *in_data, uint8_t *ctx_data, bool is_key_reversed) const noexcept
+{
+    for (const Aggregation_step& step : _steps) {
+        switch (step.input) {
+        case Aggregation_step::SCALAR:
+            step.fnc(ur_get_ptr_by_id(tmplt, in_data, is_key_reversed ? step.ur_r_fid : step.ur_fid), &ctx_data[step.offset]);
+            break;
+        case Aggregation_step::ARRAY:
+        case Aggregation_step::SORTED_ARRAY: {
+            ur_array_data src_data;
+            src_data.cnt_elements = ur_array_get_elem_cnt(tmplt, in_data, step.ur_fid);
+            src_data.ptr_first = ur_get_ptr_by_id(tmplt, in_data, step.ur_fid);
+            if (step.input == Aggregation_step::SORTED_ARRAY) {
+                src_data.sort_key = ur_get_ptr_by_id(tmplt, in_data, step.ur_sort_key_id);
+                if (step.is_sort_key_array)
+                    src_data.sort_key_elements = ur_array_get_elem_cnt(tmplt, in_data, step.ur_sort_key_id);
+                else
+                    src_data.sort_key_elements = 1;
+            }
+            step.fnc(&src_data, &ctx_data[step.offset]);
+            break;
+        }
+        case Aggregation_step::SORTED_DIR_ARRAY: {
+            ur_array_dir_data src_dir_data;
+            src_dir_data.cnt_elements = ur_array_get_elem_cnt(tmplt, in_data, step.ur_fid);
+            src_dir_data.ptr_first = ur_get_ptr_by_id(tmplt, in_data, step.ur_fid);
+            src_dir_data.sort_key = ur_get_ptr_by_id(tmplt, in_data, step.ur_sort_key_id);
+            if (step.is_sort_key_array)
+                src_dir_data.sort_key_elements = ur_array_get_elem_cnt(tmplt, in_data, step.ur_sort_key_id);
+            else
+                src_dir_data.sort_key_elements = 1;
+            src_dir_data.is_key_reversed = is_key_reversed;
+            step.fnc(&src_dir_data, &ctx_data[step.offset]);
+            break;
+        }
+        }
     }
 }
 
@@ -9,6 +9,7 @@
  */
 
 #include "configuration.h"
+#include "aggregator_functions.h"
 #include "rapidxml.hpp"
 
 #include <fstream>
@@ -26,6 +27,10 @@ Configuration::Configuration()
     _eof_terminate = false;
     _is_biflow_key = false;
     _flow_cache_size = 65536;
+    _initial_flow_cache_size = 0;
+    _thread_cnt = 1;
+    _batch_size = 1024;
+    _batch_latency = 100;
     _t_passive = 20;
     _t_active = 40;
 }
@@ -37,6 +42,42 @@ void Configuration::set_flow_cache_size(const char *input)
         _flow_cache_size = 4;
 }
 
+void Configuration::set_initial_flow_cache_size(const char *input)
+{
+    _initial_flow_cache_size = 1 << std::stoul(input); 
+    if (_initial_flow_cache_size <= 4)
+        _initial_flow_cache_size = 4;
+}
+
+void Configuration::set_thread_count(const char *input)
+{
+    _thread_cnt = std::stoul(input);
+    if (_thread_cnt == 0)
+        _thread_cnt = 1;
+}
+
+void Configuration::set_batch_size(const char *input)
+{
+    _batch_size = std::stoul(input);
+    if (_batch_size == 0)
+        _batch_size = 1;
+}
+
+void Configuration::set_batch_latency(const char *input)
+{
+    _batch_latency = std::stoul(input);
+}
+
+void Configuration::set_snapshot_path(const char *input)
+{
+    _snapshot_path = input;
+}
+
+void Configuration::set_stats_socket_path(const char *input)
+{
+    _stats_socket_path = input;
+}
+
 void Configuration::set_active_timeout(const char *input)
 {
     _t_active = std::stoul(input);
@@ -66,6 +107,36 @@ std::size_t Configuration::get_flow_cache_size() noexcept
     return _flow_cache_size;
 }
 
+std::size_t Configuration::get_initial_flow_cache_size() noexcept
+{
+    return _initial_flow_cache_size;
+}
+
+std::size_t Configuration::get_thread_count() noexcept
+{
+    return _thread_cnt;
+}
+
+std::size_t Configuration::get_batch_size() noexcept
+{
+    return _batch_size;
+}
+
+std::size_t Configuration::get_batch_latency() noexcept
+{
+    return _batch_latency;
+}
+
+const std::string& Configuration::get_snapshot_path() noexcept
+{
+    return _snapshot_path;
+}
+
+const std::string& Configuration::get_stats_socket_path() noexcept
+{
+    return _stats_socket_path;
+}
+
 bool Configuration::get_eof_termination() noexcept
 {
     return _eof_terminate;
@@ -96,6 +167,12 @@ void Configuration::print() noexcept
 {
     std::cout << "***** Configuration *****" << std::endl;
     std::cout << "Flow cache size: " << _flow_cache_size << std::endl; 
+    std::cout << "Initial flow cache size: " << _initial_flow_cache_size << std::endl; 
+    std::cout << "Threads: " << _thread_cnt << std::endl; 
+    std::cout << "Batch size: " << _batch_size << std::endl; 
+    std::cout << "Batch latency: " << _batch_latency << std::endl; 
+    std::cout << "Snapshot: " << _snapshot_path << std::endl; 
+    std::cout << "Statistics socket: " << _stats_socket_path << std::endl; 
     std::cout << "Active timeout: " << _t_active << std::endl; 
     std::cout << "Passive timeout: " << _t_passive << std::endl; 
     std::cout << "*************************" << std::endl;
@@ -111,6 +188,7 @@ void Configuration::print_cfg_field(agg::Field_config& field)
     std::cout << "Sort type: " << field.sort_type << std::endl;
     std::cout << "Delimiter: " << field.delimiter << std::endl;
     std::cout << "Size: " << field.limit << std::endl;
+    std::cout << "Precision: " << static_cast<unsigned>(field.precision) << std::endl;
     std::cout << "----------------" << std::endl;
 }
 
@@ -129,9 +207,10 @@ agg::Field_type Configuration::get_field_type(const char *input)
     if (!std::strcmp(input, "BITOR")) return agg::BIT_OR;
     if (!std::strcmp(input, "APPEND")) return agg::APPEND;
     if (!std::strcmp(input, "UNIQUE_COUNT")) return agg::UNIQUE_COUNT;
+    if (!std::strcmp(input, "UNIQUE_COUNT_HLL")) return agg::UNIQUE_COUNT_HLL;
     if (!std::strcmp(input, "SORTED_MERGE")) return agg::SORTED_MERGE;
     if (!std::strcmp(input, "SORTED_MERGE_DIR")) return agg::SORTED_MERGE_DIR;
-    std::cerr << "Invalid type field. Given: " << input << ", Expected: KEY|SUM|MIN|MAX|AVG|FIRST|FIRST_NON_EMPTY|LAST|LAST_NON_EMPTY|BITAND|BITOR|APPEND|SORTED_MERGE|SORTED_MERGE_DIR." << std::endl;
+    std::cerr << "Invalid type field. Given: " << input << ", Expected: KEY|SUM|MIN|MAX|AVG|FIRST|FIRST_NON_EMPTY|LAST|LAST_NON_EMPTY|BITAND|BITOR|APPEND|SORTED_MERGE|SORTED_MERGE_DIR|UNIQUE_COUNT|UNIQUE_COUNT_HLL." << std::endl;
     return agg::INVALID_TYPE;
 }
 
@@ -206,11 +285,22 @@ std::pair<agg::Field_config, bool> Configuration::parse_field(xml_node<> *xml_fi
                 std::cerr << "Invalid size format. Given: " << option->value() << ", expected: unsigned number." << std::endl;
                 return std::make_pair(field, 1);;
             }
+        } else if (!std::strcmp(option->name(), "precision")) {
+            unsigned long precision = std::strtoul(option->value(), NULL, 10);
+            if (precision < agg::Hll_count_data::min_precision || precision > agg::Hll_count_data::max_precision) {
+                std::cerr << "Invalid precision. Given: " << option->value() << ", expected: number from "
+                          << static_cast<unsigned>(agg::Hll_count_data::min_precision) << " to "
+                          << static_cast<unsigned>(agg::Hll_count_data::max_precision) << "." << std::endl;
+                return std::make_pair(field, false);
+            }
+            field.precision = precision;
         } else {
-            std::cerr << "Invlaid file format. Expected 'name|type|[reverse_name|sort_key|sort_type|delimiter|size]', given '" << option->name() << "'" << std::endl;
+            std::cerr << "Invlaid file format. Expected 'name|type|[reverse_name|sort_key|sort_type|delimiter|size|precision]', given '" << option->name() << "'" << std::endl;
             return std::make_pair(field, 1);;
         }
     }
+    if (field.type == agg::UNIQUE_COUNT_HLL && field.precision == 0)
+        field.precision = agg::Hll_count_data::default_precision;
     field.to_output = true;
     //print_cfg_field(field);
     return std::make_pair(field, verify_field(field));
@@ -261,6 +351,7 @@ int Configuration::check_biflow_key_presence()
             f_cfg.sort_type = field.sort_type;
             f_cfg.delimiter = field.delimiter;
             f_cfg.limit = field.limit;
+            f_cfg.precision = field.precision;
             f_cfg.to_output = false;
             _cfg_fields.emplace_back(f_cfg);
         }
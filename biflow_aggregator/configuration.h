@@ -65,6 +65,41 @@ private:
      */ 
     std::size_t _flow_cache_size;
 
+    /**
+     * @brief Initial flow cache size, flow cache grows up to _flow_cache_size. 0 when flow cache is preallocated.
+     *
+     * Must be power of 2
+     */
+    std::size_t _initial_flow_cache_size;
+
+    /**
+     * @brief Number of worker threads.
+     *
+     * Flow cache is split to the same number of shards, every worker owns one shard.
+     * Value 1 means that records are processed by the receiving thread.
+     */
+    std::size_t _thread_cnt;
+
+    /**
+     * @brief Maximal number of output records sent to libtrap together.
+     */
+    std::size_t _batch_size;
+
+    /**
+     * @brief Maximal time in milliseconds output record waits in batch.
+     */
+    std::size_t _batch_latency;
+
+    /**
+     * @brief File used to store flow cache on SIGUSR1 and shutdown. Empty when disabled.
+     */
+    std::string _snapshot_path;
+
+    /**
+     * @brief UNIX socket which provides runtime statistics. Empty when disabled.
+     */
+    std::string _stats_socket_path;
+
     /**
      * @brief passive timeout
      * 
@@ -242,6 +277,80 @@ public:
      */
     std::size_t get_flow_cache_size() noexcept;
 
+    /**
+     * @brief Set the initial number of records stored in flow cache, enables growing flow cache.
+     * 
+     * @param input Size in text format.
+     */
+    void set_initial_flow_cache_size(const char *input);
+
+    /**
+     * @brief Get the initial flow cache size, 0 when flow cache does not grow.
+     */
+    std::size_t get_initial_flow_cache_size() noexcept;
+
+    /**
+     * @brief Set the number of worker threads.
+     *
+     * See _thread_cnt for more info.
+     *
+     * @param input Number of threads in text format.
+     */
+    void set_thread_count(const char *input);
+
+    /**
+     * @brief Get the number of worker threads
+     */
+    std::size_t get_thread_count() noexcept;
+
+    /**
+     * @brief Set the maximal number of records in output batch.
+     *
+     * @param input Number of records in text format.
+     */
+    void set_batch_size(const char *input);
+
+    /**
+     * @brief Get the maximal number of records in output batch.
+     */
+    std::size_t get_batch_size() noexcept;
+
+    /**
+     * @brief Set the maximal latency of output batch.
+     *
+     * @param input Latency in milliseconds in text format.
+     */
+    void set_batch_latency(const char *input);
+
+    /**
+     * @brief Get the maximal latency of output batch in milliseconds.
+     */
+    std::size_t get_batch_latency() noexcept;
+
+    /**
+     * @brief Set the snapshot file.
+     *
+     * @param input Path to snapshot file.
+     */
+    void set_snapshot_path(const char *input);
+
+    /**
+     * @brief Get the snapshot file, empty string when snapshot is disabled.
+     */
+    const std::string& get_snapshot_path() noexcept;
+
+    /**
+     * @brief Set the statistics socket.
+     *
+     * @param input Path to UNIX socket.
+     */
+    void set_stats_socket_path(const char *input);
+
+    /**
+     * @brief Get the statistics socket, empty string when statistics are disabled.
+     */
+    const std::string& get_stats_socket_path() noexcept;
+
     /**
      * @brief check if key is biflow
      */
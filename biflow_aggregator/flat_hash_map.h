@@ -611,6 +611,41 @@ public:
         }
     }
 
+    // value must be stored in this table, no lookup is done
+    iterator iterator_to(value_type & value)
+    {
+        return { reinterpret_cast<EntryPointer>(reinterpret_cast<char *>(std::addressof(value)) - offsetof(Entry, value)) };
+    }
+
+    // number of slots between value and its desired slot
+    static int probe_length(iterator it)
+    {
+        return it.current->distance_from_desired;
+    }
+
+    // value is stored in this table
+    bool owns(const value_type & value) const
+    {
+        const char *ptr = reinterpret_cast<const char *>(std::addressof(value));
+        return ptr >= reinterpret_cast<const char *>(entries)
+            && ptr < reinterpret_cast<const char *>(entries + static_cast<ptrdiff_t>(num_slots_minus_one + max_lookups));
+    }
+
+    // number of slots which can hold value, including overflow slots behind the last bucket
+    size_t slot_range() const
+    {
+        return num_slots_minus_one + max_lookups;
+    }
+
+    // iterator to value in slot with given index or end() for empty slot
+    iterator slot_at(size_t index)
+    {
+        EntryPointer it = entries + static_cast<ptrdiff_t>(index);
+        if (it->has_value())
+            return { it };
+        return end();
+    }
+
     template<typename Key>
     iterator get_delete_candidate(Key && key)
     {
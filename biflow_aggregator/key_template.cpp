@@ -22,12 +22,22 @@ namespace agg {
 
 constexpr std::size_t string_hash_size = sizeof(uint64_t);
 
-ska::flat_hash_map<uint64_t, KeyString> FlowKey::key_strings;
+thread_local ska::flat_hash_map<uint64_t, KeyString> FlowKey::key_strings;
 
 std::vector<std::tuple<ur_field_id_t, ur_field_id_t, std::size_t>> Key_template::_key_fields;
 
 std::size_t Key_template::_key_size = 0;
 
+std::vector<Key_template::Segment> Key_template::_segments;
+
+std::vector<Key_template::Segment> Key_template::_reverse_segments;
+
+bool Key_template::_is_fixed = false;
+
+uint16_t Key_template::_src_ip_offset = 0;
+
+uint16_t Key_template::_dst_ip_offset = 0;
+
 void Key_template::add(ur_field_id_t ur_fid, ur_field_id_t r_ur_fid)
 {
     if (ur_get_type(ur_fid) == UR_TYPE_STRING) {
@@ -44,6 +54,44 @@ void Key_template::reset() noexcept
 {
     _key_size = 0;
     _key_fields.clear();
+    _segments.clear();
+    _reverse_segments.clear();
+    _is_fixed = false;
+}
+
+void Key_template::add_segment(std::vector<Segment>& segments, uint16_t src, uint16_t dst, uint16_t size)
+{
+    if (!segments.empty() && segments.back().src + segments.back().size == src) {
+        segments.back().size += size;
+        return;
+    }
+    segments.push_back(Segment{src, dst, size});
+}
+
+void Key_template::compile(const ur_template_t *tmplt)
+{
+    uint16_t dst = 0;
+
+    _segments.clear();
+    _reverse_segments.clear();
+    _is_fixed = !_key_fields.empty();
+
+    for (const auto& field : _key_fields) {
+        if (ur_is_dynamic(std::get<ID>(field)) || ur_is_dynamic(std::get<REVERSE_ID>(field))) {
+            _is_fixed = false;
+            return;
+        }
+    }
+
+    for (const auto& field : _key_fields) {
+        uint16_t size = std::get<SIZE>(field);
+        add_segment(_segments, tmplt->offset[std::get<ID>(field)], dst, size);
+        add_segment(_reverse_segments, tmplt->offset[std::get<REVERSE_ID>(field)], dst, size);
+        dst += size;
+    }
+
+    _src_ip_offset = tmplt->offset[F_SRC_IP];
+    _dst_ip_offset = tmplt->offset[F_DST_IP];
 }
 
 std::vector<std::tuple<ur_field_id_t, ur_field_id_t, std::size_t>> Key_template::get_fields() noexcept
@@ -60,24 +108,33 @@ std::size_t Key_template::get_size() noexcept
 // FLOW KEY ALLOCATOR
 // ###############################
 
-std::size_t Flow_key_allocator::_idx = 0;
+thread_local std::size_t Flow_key_allocator::_idx = 0;
 
-uint8_t* Flow_key_allocator::_global = nullptr;
+thread_local std::vector<uint8_t *> Flow_key_allocator::_chunks;
 
-std::vector<uint8_t *> Flow_key_allocator::_ptrs;
+thread_local std::size_t Flow_key_allocator::_rec_size = 0;
+
+thread_local std::vector<uint8_t *> Flow_key_allocator::_ptrs;
 
 void Flow_key_allocator::init(std::size_t elements, std::size_t rec_size)
 {
-    std::size_t offset = 0;
-
     clear();
 
-    _ptrs.reserve(elements);
-    _global = new uint8_t[rec_size * elements];
+    _rec_size = rec_size;
+    grow(elements);
+}
+
+void Flow_key_allocator::grow(std::size_t elements)
+{
+    std::size_t offset = 0;
+    uint8_t *chunk = new uint8_t[_rec_size * elements];
+
+    _chunks.push_back(chunk);
+    _ptrs.reserve(_ptrs.size() + elements);
 
     for (std::size_t i = 0; i < elements; i++) {
-        _ptrs.emplace_back(&_global[offset]);
-        offset += rec_size;
+        _ptrs.emplace_back(&chunk[offset]);
+        offset += _rec_size;
     }
 }
 
@@ -93,8 +150,9 @@ void Flow_key_allocator::release_ptr(uint8_t *ptr) noexcept
 
 void Flow_key_allocator::clear()
 {
-    delete [] _global;
-    _global = nullptr;
+    for (uint8_t *chunk : _chunks)
+        delete [] chunk;
+    _chunks.clear();
     _idx = 0;
     _ptrs.clear();
 }
@@ -103,10 +161,39 @@ void Flow_key_allocator::clear()
 // FLOW KEY
 // ###############################
 
-bool FlowKey::generate(const void *in_data, ur_template_t *tmplt, bool is_biflow)
+using uint128_t = unsigned __int128;
+
+/**
+ * @brief Copy segment of record, common field sizes are copied by single load and store.
+ */
+static inline void copy_segment(uint8_t *dst, const uint8_t *src, std::size_t size) noexcept
 {
-    using uint128_t = unsigned __int128;
+    switch (size) {
+    case 1:
+        *dst = *src;
+        break;
+    case 2:
+        std::memcpy(dst, src, 2);
+        break;
+    case 4:
+        std::memcpy(dst, src, 4);
+        break;
+    case 8:
+        std::memcpy(dst, src, 8);
+        break;
+    case 16:
+        std::memcpy(dst, src, 16);
+        break;
+    case 32:
+        std::memcpy(dst, src, 32);
+        break;
+    default:
+        std::memcpy(dst, src, size);
+    }
+}
 
+bool FlowKey::generate(const void *in_data, ur_template_t *tmplt, bool is_biflow)
+{
     // current offset in key data
     std::size_t offset = 0;
 
@@ -115,9 +202,27 @@ bool FlowKey::generate(const void *in_data, ur_template_t *tmplt, bool is_biflow
         _key_data = Flow_key_allocator::get_ptr(); 
     }
 
+    // Generate key of fixed-size fields by precomputed segments
+    if (Key_template::_is_fixed) {
+        const uint8_t *rec = static_cast<const uint8_t *>(in_data);
+        bool is_reversed = false;
+
+        if (is_biflow) {
+            uint128_t src_ip;
+            uint128_t dst_ip;
+            std::memcpy(&src_ip, rec + Key_template::_src_ip_offset, sizeof(src_ip));
+            std::memcpy(&dst_ip, rec + Key_template::_dst_ip_offset, sizeof(dst_ip));
+            is_reversed = src_ip > dst_ip;
+        }
+
+        for (const auto& segment : is_reversed ? Key_template::_reverse_segments : Key_template::_segments)
+            copy_segment(_key_data + segment.dst, rec + segment.src, segment.size);
+        return is_reversed;
+    }
+
     // Generate non biflow key
     if (is_biflow == false) {
-        for (auto field : Key_template::get_fields()) {
+        for (const auto& field : Key_template::_key_fields) {
             if (ur_get_type(std::get<Key_template::ID>(field)) == UR_TYPE_STRING) {
                 uint64_t hash = XXH3_64bits(ur_get_ptr_by_id(tmplt, in_data, std::get<Key_template::ID>(field)), 
                     ur_get_var_len(tmplt, in_data, std::get<Key_template::ID>(field)));
@@ -133,13 +238,13 @@ bool FlowKey::generate(const void *in_data, ur_template_t *tmplt, bool is_biflow
     // Generate biflow key
     if (*reinterpret_cast<uint128_t*>(&ur_get(tmplt, in_data, F_SRC_IP)) 
         > *reinterpret_cast<uint128_t*>(&ur_get(tmplt, in_data, F_DST_IP))) {
-        for (auto field : Key_template::get_fields()) {
+        for (const auto& field : Key_template::_key_fields) {
             update(ur_get_ptr_by_id(tmplt, in_data, std::get<Key_template::REVERSE_ID>(field)), 
                 std::get<Key_template::SIZE>(field), offset);
         }
         return true;
     } else {
-        for (auto field : Key_template::get_fields()) {
+        for (const auto& field : Key_template::_key_fields) {
             update(ur_get_ptr_by_id(tmplt, in_data, std::get<Key_template::ID>(field)), 
                 std::get<Key_template::SIZE>(field), offset);
         }
@@ -158,6 +263,13 @@ std::pair<void *, std::size_t> FlowKey::get_key() const noexcept
     return std::make_pair(_key_data, Key_template::_key_size);
 }    
 
+void FlowKey::load(const void *src) noexcept
+{
+    if (_key_data == nullptr)
+        _key_data = Flow_key_allocator::get_ptr();
+    std::memcpy(_key_data, src, Key_template::_key_size);
+}
+
 FlowKey::FlowKey(const FlowKey &other) noexcept 
     : _key_data(other._key_data) 
 { 
@@ -37,6 +37,38 @@ class Key_template {
      */
     static std::size_t _key_size;
 
+    /**
+     * @brief Continuous part of input record copied to key.
+     */
+    struct Segment {
+        uint16_t src;  ///< Offset in input record
+        uint16_t dst;  ///< Offset in key
+        uint16_t size; ///< Size of copied data
+    };
+
+    /**
+     * @brief Segments of key, fields that follow each other in record are merged to one segment.
+     */
+    static std::vector<Segment> _segments;
+
+    /**
+     * @brief Segments of reversed biflow key.
+     */
+    static std::vector<Segment> _reverse_segments;
+
+    /**
+     * @brief All key fields have fixed size, key is generated by segments.
+     */
+    static bool _is_fixed;
+
+    /**
+     * @brief Offsets of SRC_IP and DST_IP in input record, they decide direction of biflow key.
+     */
+    static uint16_t _src_ip_offset;
+    static uint16_t _dst_ip_offset;
+
+    static void add_segment(std::vector<Segment>& segments, uint16_t src, uint16_t dst, uint16_t size);
+
     friend class FlowKey;
 
 public:
@@ -68,6 +100,16 @@ public:
      */
     static std::size_t get_size() noexcept;
 
+    /**
+     * @brief Prepare key generation for input template.
+     *
+     * When all key fields have fixed size, offsets of fields in record are precomputed
+     * and key is generated by copying continuous segments of record.
+     *
+     * @param tmplt Input template
+     */
+    static void compile(const ur_template_t *tmplt);
+
     /**
      * @brief Reset class to default state.
      */
@@ -101,7 +143,10 @@ class FlowKey {
 
 public:
 
-    static ska::flat_hash_map<uint64_t, KeyString> key_strings;
+    /**
+     * @brief Strings used in keys, every thread that owns a flow cache has its own map.
+     */
+    static thread_local ska::flat_hash_map<uint64_t, KeyString> key_strings;
 
     /**
      * @brief Construct a new Flow Key object
@@ -155,28 +200,42 @@ public:
      */
     std::pair<void *, std::size_t> get_key() const noexcept;
 
+    /**
+     * @brief Set key from serialized key data.
+     * 
+     * @param src Key data of template key size
+     */
+    void load(const void *src) noexcept;
+
     void reset();
 };
 
 /**
  * @brief Class to allocate Flow key memory
+ *
+ * Allocator state is thread local, every thread that owns a flow cache has its own arena.
  */
 class Flow_key_allocator {
 
     /**
      * @brief Vector of pointer to key data 
      */
-    static std::vector<uint8_t *> _ptrs;
+    static thread_local std::vector<uint8_t *> _ptrs;
 
     /**
      * @brief Current index in vector 
      */
-    static std::size_t _idx;
+    static thread_local std::size_t _idx;
+
+    /**
+     * @brief Memory chunks that hold key data segments, new chunk is added by grow()
+     */
+    static thread_local std::vector<uint8_t *> _chunks;
 
     /**
-     * @brief Pointer to memory that holds all key data segments 
+     * @brief Size of key data
      */
-    static uint8_t *_global;
+    static thread_local std::size_t _rec_size;
 
 public:
 
@@ -188,6 +247,13 @@ public:
      */
     static void init(std::size_t elements, std::size_t rec_size);
 
+    /**
+     * @brief Add memory for more elements, pointers returned earlier stay valid.
+     * 
+     * @param elements Number of added elements
+     */
+    static void grow(std::size_t elements);
+
     /**
      * @brief Get the pointer to available key data memory
      */
@@ -14,11 +14,21 @@
 #include "aggregator_functions.h"
 #include "flat_hash_map.h"
 #include "fields.h"
+#include "spsc_ring.h"
+#include "snapshot.h"
+#include "statistics.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <csignal>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <thread>
+#include <vector>
 
 #include <getopt.h>
 #include <unistd.h>
@@ -78,14 +88,25 @@ UR_FIELDS (
     PARAM('n', "name", "Name of config section.", required_argument, "name") \
     PARAM('e', "eof", "End when receive EOF.", no_argument, "flag") \
     PARAM('s', "size", "Max number of elements in flow cache.", required_argument, "number") \
+    PARAM('E', "initial-size", "Initial number of elements in flow cache, flow cache grows up to --size when it is full.", required_argument, "number") \
     PARAM('a', "active-timeout", "Active timeout.", required_argument, "number") \
     PARAM('p', "passive-timeout", "Passive timeout.", required_argument, "number") \
-    PARAM('g', "global-timeout", "Global timeout.", required_argument, "number")
+    PARAM('g', "global-timeout", "Global timeout.", required_argument, "number") \
+    PARAM('t', "threads", "Number of worker threads, flow cache is split between them by hash of flow key.", required_argument, "number") \
+    PARAM('b', "batch-size", "Maximal number of records sent to output interface together.", required_argument, "number") \
+    PARAM('l', "batch-latency", "Maximal time in milliseconds a record waits in output batch.", required_argument, "number") \
+    PARAM('S', "snapshot", "File used to store flow cache on SIGUSR1 and shutdown, flows are restored from it on start.", required_argument, "filename") \
+    PARAM('m', "stats-socket", "UNIX socket which provides runtime statistics of flow cache.", required_argument, "path")
 
 trap_module_info_t *module_info = NULL;
 static volatile int stop = 0;
 static volatile bool force_stop = true;
 
+/**
+ * Set by SIGUSR1, flow cache is stored to snapshot file when set.
+ */
+static volatile sig_atomic_t snapshot_request = 0;
+
 /**
  * @brief Kill program
  */
@@ -137,36 +158,178 @@ install_signal_handler(struct sigaction &sigbreak)
 }
 
 /**
- * Send record to output interface.
- * @param [in] out_tmplt UniRec template of output record.
+ * Function to handle SIGUSR1 signal used to request snapshot of flow cache.
+ * @param [in] signal caught signal value.
+ */
+static void
+snapshot_handler(const int signum)
+{
+    (void) signum;
+    snapshot_request = 1;
+}
+
+/**
+ * Install signal handler to SIGUSR1 signal.
+ */
+static int
+install_snapshot_handler()
+{
+    struct sigaction sigsnapshot;
+
+    sigsnapshot.sa_handler = snapshot_handler;
+    sigemptyset(&sigsnapshot.sa_mask);
+    sigsnapshot.sa_flags = SA_RESTART;
+
+    if (sigaction(SIGUSR1, &sigsnapshot, NULL) != 0) {
+        std::cerr << "sigaction() error." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Mutex that serializes access to output interface when flow cache is split to more threads.
+ */
+static std::mutex output_mutex;
+
+/**
+ * Set when output interface reports fatal error, module stops and nothing more is sent.
+ */
+static std::atomic<bool> output_failed(false);
+
+/**
+ * Send record to output interface. Caller must hold output_mutex.
+ * Record is dropped after repeated timeouts, fatal error stops the module.
  * @param [in] out_rec pointer to record which is going to be send
+ * @param [in] size size of record
  * @return True if record successfully sent, false if record was not send.
  */
 static bool 
-send_record_out(ur_template_t *out_tmplt, void *out_rec)
+send_record_out(const void *out_rec, uint16_t size)
 {
     constexpr int max_try = 3;
     int ret;
 
     for (int i = 0; i < max_try; i++) {
-        ret = trap_send(0, out_rec, ur_rec_size(out_tmplt, out_rec));
-        TRAP_DEFAULT_SEND_ERROR_HANDLING(ret, continue, break);
+        ret = trap_send(0, out_rec, size);
+        TRAP_DEFAULT_SEND_ERROR_HANDLING(ret, continue, {
+            output_failed = true;
+            stop = 1;
+            return false;
+        });
         return true;
     }
-    std::cerr << "Cannot send record due to error or time_out" << std::endl;
+    std::cerr << "Cannot send record due to time_out" << std::endl;
     return false;
 }
 
+/**
+ * @brief Size of output arena without space reserved for record which is being built.
+ */
+constexpr std::size_t output_arena_size = 1 << 20;
+
+/**
+ * @brief Output records serialized back-to-back in preallocated arena.
+ *
+ * Records are built directly in the arena and whole batch is handed to libtrap under one lock
+ * of output interface. Batch is sent when it holds maximal number of records, when the arena
+ * is full or when the oldest record waits longer than maximal latency.
+ */
+class Output_batch {
+public:
+
+    Output_batch() : _arena(output_arena_size + UR_MAX_SIZE), _used(0), _max_records(1), _max_latency(0)
+    {
+    }
+
+    /**
+     * @brief Set limits of batch.
+     *
+     * @param max_records Maximal number of records in batch
+     * @param max_latency Maximal time the oldest record waits in batch
+     */
+    void configure(std::size_t max_records, std::chrono::milliseconds max_latency)
+    {
+        _max_records = max_records;
+        _max_latency = max_latency;
+        _sizes.reserve(max_records);
+    }
+
+    /**
+     * @brief Get memory for next record with cleared static part.
+     */
+    void *next_record(ur_template_t *out_tmplt) noexcept
+    {
+        void *out_rec = &_arena[_used];
+        std::memset(out_rec, 0, ur_rec_fixlen_size(out_tmplt));
+        return out_rec;
+    }
+
+    /**
+     * @brief Add record returned by next_record() to batch, send batch when it is full.
+     */
+    void commit(ur_template_t *out_tmplt, const void *out_rec)
+    {
+        uint16_t size = ur_rec_size(out_tmplt, out_rec);
+
+        if (_sizes.empty())
+            _oldest = std::chrono::steady_clock::now();
+        _sizes.push_back(size);
+        _used += size;
+        if (_sizes.size() >= _max_records || _used > output_arena_size)
+            send(false);
+    }
+
+    /**
+     * @brief Send batch when the oldest record waits longer than maximal latency.
+     */
+    void check_latency()
+    {
+        if (!_sizes.empty() && std::chrono::steady_clock::now() - _oldest >= _max_latency)
+            send(true);
+    }
+
+    /**
+     * @brief Hand all records to libtrap, records are dropped after fatal error of output interface.
+     *
+     * @param flush Flush output interface after records are sent.
+     */
+    void send(bool flush)
+    {
+        std::size_t offset = 0;
+
+        std::lock_guard<std::mutex> lock(output_mutex);
+        for (uint16_t size : _sizes) {
+            if (output_failed)
+                break;
+            (void) send_record_out(&_arena[offset], size);
+            offset += size;
+        }
+        if (flush && !output_failed)
+            trap_send_flush(0);
+        _sizes.clear();
+        _used = 0;
+    }
+
+private:
+    std::vector<uint8_t> _arena;
+    std::vector<uint16_t> _sizes;
+    std::size_t _used;
+    std::size_t _max_records;
+    std::chrono::milliseconds _max_latency;
+    std::chrono::steady_clock::time_point _oldest;
+};
 
 static void 
-proccess_and_send(agg::Aggregator<agg::FlowKey>& agg, const agg::FlowKey& key, const agg::Flow_data& flow_data, ur_template_t *out_tmplt, void *out_rec) 
+proccess_and_send(agg::Aggregator<agg::FlowKey>& agg, const agg::FlowKey& key, const agg::Flow_data& flow_data, ur_template_t *out_tmplt, Output_batch& batch) 
 {
     ur_field_id_t field_id;
-    agg::Field *field;
+    const agg::Field *field;
     std::size_t offset = 0;
     std::size_t elem_cnt;
     std::size_t size;
     void *key_data;
+    void *out_rec = batch.next_record(out_tmplt);
 
     std::tie(key_data, std::ignore) = key.get_key();
 
@@ -189,7 +352,7 @@ proccess_and_send(agg::Aggregator<agg::FlowKey>& agg, const agg::FlowKey& key, c
     }
 
     // Add aggregated fields
-    for (auto agg_field : agg.fields.get_fields()) {
+    for (const auto& agg_field : agg.fields.get_fields()) {
         field = std::addressof(agg_field.first);
         const void *agg_data;
         if (field->type == agg::SORTED_MERGE_DIR) {
@@ -197,7 +360,7 @@ proccess_and_send(agg::Aggregator<agg::FlowKey>& agg, const agg::FlowKey& key, c
         } else {
             agg_data = field->post_processing(&flow_data.ctx->data[agg_field.second], size, elem_cnt);
         }
-        if (ur_is_array(field->ur_fid)) {
+        if (ur_is_array(field->ur_fid_out)) {
             ur_array_allocate(out_tmplt, out_rec, field->ur_fid_out, elem_cnt);
             std::memcpy(ur_get_ptr_by_id(out_tmplt, out_rec, field->ur_fid_out), agg_data, size * elem_cnt);
         } else {
@@ -205,7 +368,7 @@ proccess_and_send(agg::Aggregator<agg::FlowKey>& agg, const agg::FlowKey& key, c
             std::memcpy(ur_get_ptr_by_id(out_tmplt, out_rec, field_id), agg_data, size);
         }
     }
-    (void) send_record_out(out_tmplt, out_rec);
+    batch.commit(out_tmplt, out_rec);
 }
 
 static int process_format_change(
@@ -249,7 +412,7 @@ static int process_format_change(
             if (ur_get_type(ur_fid) == UR_TYPE_STRING)
                 is_string_key = true;
             agg::Key_template::add(ur_fid, ur_r_fid);
-        } else if (field_cfg.type == agg::UNIQUE_COUNT) {
+        } else if (field_cfg.type == agg::UNIQUE_COUNT || field_cfg.type == agg::UNIQUE_COUNT_HLL) {
             const int ur_fid_out = ur_define_field((field_cfg.name + "_UNIQUE_COUNT").c_str(), UR_TYPE_UINT32);
             out_template.append("," + field_cfg.name + "_UNIQUE_COUNT");
             int ur_r_fid_out = ur_fid_out;
@@ -268,12 +431,15 @@ static int process_format_change(
             out_template.append("," + field_cfg.name);
     }
 
+    agg::Key_template::compile(in_tmplt);
+
     *out_tmplt = ur_create_output_template(0, out_template.c_str(), NULL);
     if (*out_tmplt == NULL) {
         std::cerr << "Error: Output template could not be created." << std::endl;
         return 1;
     }
 
+    agg.plan.compile(agg.fields);
     return 0;
 }
 
@@ -301,12 +467,44 @@ process_key_string(const agg::FlowKey& key, const void *in_data, ur_template_t *
     }
 }
 
+/**
+ * @brief Passive and active timeouts of flows.
+ *
+ * Passive timeouts are expired by time of received records, active timeouts by the latest TIME_LAST.
+ */
+struct Flow_timers {
+    Timer_wheel<agg::Context> passive;
+    Timer_wheel<agg::Context> active;
+
+    void clear() noexcept
+    {
+        passive.clear();
+        active.clear();
+    }
+};
+
+/**
+ * @brief Allocate context of new flow and link it with flow data.
+ */
+static agg::Context *
+new_flow_context(agg::Flow_data& flow_data)
+{
+    agg::Context *ctx = agg::Flow_data_context_allocator::get_ptr();
+    if (ctx == nullptr)
+        throw std::runtime_error("Flow cache holds more flows than allocated contexts.");
+    ctx->passive_timer.owner = ctx;
+    ctx->active_timer.owner = ctx;
+    ctx->flow = std::addressof(flow_data);
+    flow_data.ctx = ctx;
+    return ctx;
+}
+
 void post_insert_flow(
     const void *in_data,
     ur_template_t *in_tmplt,
     agg::FlowKey& key, 
     agg::Flow_data& flow_data,
-    Dll<agg::Timeout_data>& dll,
+    Flow_timers& timers,
     bool is_string_key, 
     bool is_key_reversed,
     time_t time_first,
@@ -314,34 +512,32 @@ void post_insert_flow(
     time_t t_passive, 
     time_t t_active)
 {
-    agg::Context *ctx = agg::Flow_data_context_allocator::get_ptr();
-    agg::Timeout_data timeout_data(key, time_last + t_passive, time_first + t_active);
-    ctx->t_data.init(std::move(timeout_data));
-    flow_data.ctx = ctx;
+    agg::Context *ctx = new_flow_context(flow_data);
 
     flow_data.update(ur_get(in_tmplt, in_data, F_TIME_FIRST), 
                      ur_get(in_tmplt, in_data, F_TIME_LAST),
                      ur_is_present(in_tmplt, F_COUNT) ? ur_get(in_tmplt, in_data, F_COUNT) : 1,
                      is_key_reversed);
 
-    dll.insert(&ctx->t_data);
+    timers.passive.schedule(&ctx->passive_timer, time_last + t_passive);
+    timers.active.schedule(&ctx->active_timer, time_first + t_active);
     if (is_string_key)
         process_key_string(key, in_data, in_tmplt);
 }
 
 void pre_delete_flow(
-    void *out_rec,
+    Output_batch& batch,
     ur_template_t *out_tmplt,
     agg::Aggregator<agg::FlowKey>& agg,
     agg::FlowKey& key, 
     agg::Flow_data& flow_data,
-    Dll<agg::Timeout_data>& dll)
+    Flow_timers& timers)
 {
-    node<agg::Timeout_data> *t_data = &flow_data.ctx->t_data;
-    proccess_and_send(agg, key, flow_data, out_tmplt, out_rec);
+    timers.passive.cancel(&flow_data.ctx->passive_timer);
+    timers.active.cancel(&flow_data.ctx->active_timer);
+    proccess_and_send(agg, key, flow_data, out_tmplt, batch);
     agg::Flow_data_context_allocator::release_ptr(flow_data.ctx); 
     agg::Flow_key_allocator::release_ptr(static_cast<uint8_t *>(key.get_key().first));
-    dll.delete_node(t_data);
 }
 
 void update_flow(
@@ -349,16 +545,17 @@ void update_flow(
     ur_template_t *in_tmplt,
     agg::FlowKey& key, 
     agg::Flow_data& flow_data,
-    Dll<agg::Timeout_data>& dll,
+    Flow_timers& timers,
     bool is_key_reversed,
     time_t t_passive, 
     time_t t_active)
 {
     time_t time_last;
     time_t time_first;
-    time_t pt;
+    time_t passive_timeout;
 
-    node<agg::Timeout_data> *t_data = &flow_data.ctx->t_data;
+    Timer_node<agg::Context> *passive_timer = &flow_data.ctx->passive_timer;
+    Timer_node<agg::Context> *active_timer = &flow_data.ctx->active_timer;
     flow_data.update(ur_get(in_tmplt, in_data, F_TIME_FIRST), 
                      ur_get(in_tmplt, in_data, F_TIME_LAST),
                      ur_is_present(in_tmplt, F_COUNT) ? ur_get(in_tmplt, in_data, F_COUNT) : 1,
@@ -366,58 +563,740 @@ void update_flow(
 
     time_last  = ur_time_get_sec(flow_data.time_last);
     time_first = ur_time_get_sec(flow_data.time_first);
-    pt = t_data->value.passive_timeout;
-    if (time_first + t_active < t_data->value.active_timeout)
-        t_data->value.active_timeout = time_first + t_active;
-    if (time_last + t_passive < t_data->value.active_timeout)
-        t_data->value.passive_timeout = time_last + t_passive;
+    if (time_first + t_active < active_timer->expire)
+        timers.active.reschedule(active_timer, time_first + t_active);
+    if (time_last + t_passive < active_timer->expire)
+        passive_timeout = time_last + t_passive;
     else
-        t_data->value.passive_timeout = t_data->value.active_timeout;
-    if (pt != t_data->value.passive_timeout)
-        dll.swap(t_data);
+        passive_timeout = active_timer->expire;
+    if (passive_timeout != passive_timer->expire)
+        timers.passive.reschedule(passive_timer, passive_timeout);
 }
 
 static void flush_all(agg::Aggregator<agg::FlowKey>& aggregator, 
-    ur_template_t* out_template, void* out_record, Dll<agg::Timeout_data>& dll) 
+    ur_template_t* out_template, Output_batch& batch, Flow_timers& timers) 
 {
     for (auto flow_data : aggregator.flow_cache) {
-        proccess_and_send(aggregator, flow_data.first, flow_data.second, out_template, out_record);
+        proccess_and_send(aggregator, flow_data.first, flow_data.second, out_template, batch);
         agg::Flow_key_allocator::release_ptr(static_cast<uint8_t *>(flow_data.first.get_key().first));
         agg::Flow_data_context_allocator::release_ptr(flow_data.second.ctx);        
     }
-    dll.clear();
+    timers.clear();
     aggregator.flow_cache.clear();
-    trap_send_flush(0);
+    batch.send(true);
+}
+
+/**
+ * @brief Size of ring that passes records from receiving thread to one worker.
+ */
+constexpr std::size_t shard_ring_size = 1 << 22;
+
+/**
+ * @brief Types of messages passed from receiving thread to workers.
+ */
+enum Shard_message {
+    MSG_RECORD,          ///< Flow key followed by UniRec record to aggregate
+    MSG_RECORD_REVERSED, ///< Same as MSG_RECORD, key was generated with swapped direction
+    MSG_FORMAT_CHANGE,   ///< Flush all flows and wait for new configuration
+    MSG_REINIT,          ///< New configuration is ready, initialize allocators
+    MSG_FLUSH,           ///< Global flush of all flows
+    MSG_SNAPSHOT,        ///< Store flows to snapshot file
+    MSG_STOP,            ///< Flush all flows and terminate
+};
+
+/**
+ * @brief Part of flow cache with all data needed to process records of its flows.
+ *
+ * In single-threaded mode there is one shard processed directly by the receiving thread.
+ * Otherwise every shard is owned by a worker thread which receives records through SPSC ring.
+ */
+struct Flow_cache_shard {
+
+    Flow_cache_shard(std::size_t index, std::size_t initial_size, std::size_t cache_size, std::size_t ring_size) :
+        agg(initial_size), cache_size(cache_size), time_last(0), index(index), restore_checked(false), ring(ring_size)
+    {
+        stats.capacity.set(initial_size);
+    }
+
+    agg::Aggregator<agg::FlowKey> agg;
+    Flow_timers timers;
+    agg::FlowKey key;
+    agg::Flow_data placeholder;
+    std::pair<agg::FlowKey, agg::Flow_data> removed;
+
+    /**
+     * @brief Maximal number of flows in this shard, flow cache grows up to this size.
+     */
+    std::size_t cache_size;
+
+    /**
+     * @brief Output records of this shard waiting to be sent.
+     */
+    Output_batch batch;
+
+    /**
+     * @brief Latest TIME_LAST seen by this shard.
+     */
+    time_t time_last;
+
+    /**
+     * @brief Index of shard, selects its snapshot file.
+     */
+    std::size_t index;
+
+    /**
+     * @brief Snapshot file was already checked, flows are restored only on the first start.
+     */
+    bool restore_checked;
+
+    /**
+     * @brief Runtime statistics of this shard.
+     */
+    agg::Shard_stats stats;
+
+    Spsc_ring ring;
+    std::thread thread;
+};
+
+/**
+ * @brief Data shared by receiving thread and workers.
+ *
+ * Templates are changed only by receiving thread while all workers wait for MSG_REINIT message.
+ */
+struct Shared_context {
+
+    Shared_context(Configuration& config) :
+        config(config), work_tmplt(nullptr), out_tmplt(nullptr), is_string_key(false), time_last(0), acked(0)
+    {
+    }
+
+    Configuration& config;
+
+    /**
+     * @brief Private copy of input template used by workers.
+     */
+    ur_template_t *work_tmplt;
+
+    ur_template_t *out_tmplt;
+    bool is_string_key;
+
+    /**
+     * @brief Description of templates and fields, snapshot is restored only when it matches.
+     */
+    std::string snapshot_signature;
+
+    /**
+     * @brief Latest TIME_LAST seen by receiving thread.
+     */
+    std::atomic<time_t> time_last;
+
+    /**
+     * @brief Number of workers that finished processing of MSG_FORMAT_CHANGE message.
+     */
+    std::atomic<std::size_t> acked;
+};
+
+/**
+ * @brief Get handler that sends flows which do not fit to flow cache of shard while it grows.
+ */
+static agg::Aggregator<agg::FlowKey>::Evict
+evict_handler(Flow_cache_shard& shard, ur_template_t *out_tmplt)
+{
+    return [&shard, out_tmplt](agg::FlowKey& key, agg::Flow_data& flow_data) {
+        shard.stats.evictions.add();
+        pre_delete_flow(shard.batch, out_tmplt, shard.agg, key, flow_data, shard.timers);
+    };
+}
+
+/**
+ * @brief Send and remove all flows which passive or active timeout expired.
+ *
+ * @param passive_time Time to expire passive timeouts
+ * @param active_time  Time to expire active timeouts, 0 to skip them
+ */
+static void 
+expire_flows(Flow_cache_shard& shard, ur_template_t *out_tmplt, time_t passive_time, time_t active_time)
+{
+    auto expire_flow = [&](agg::Context *ctx, Timer_wheel<agg::Context>& other, Timer_node<agg::Context> *other_timer, agg::Counter& expired) {
+        auto data = shard.agg.find(ctx);
+        expired.add();
+        other.cancel(other_timer);
+        proccess_and_send(shard.agg, data->first, data->second, out_tmplt, shard.batch);
+        agg::Flow_data_context_allocator::release_ptr(ctx); 
+        agg::Flow_key_allocator::release_ptr(static_cast<uint8_t *>(data->first.get_key().first));
+        shard.agg.erase(data);
+    };
+
+    shard.timers.passive.advance(passive_time, [&](agg::Context *ctx) {
+        expire_flow(ctx, shard.timers.active, &ctx->active_timer, shard.stats.passive_expired);
+    });
+    if (active_time) {
+        shard.timers.active.advance(active_time, [&](agg::Context *ctx) {
+            expire_flow(ctx, shard.timers.passive, &ctx->passive_timer, shard.stats.active_expired);
+        });
+    }
+    shard.stats.flows.set(shard.agg.size());
+}
+
+/**
+ * @brief Number of flows moved from previous flow cache with every inserted key while flow cache grows.
+ *
+ * New flow cache has double capacity, so all flows are moved before it is full.
+ */
+constexpr std::size_t migrate_step = 4;
+
+/**
+ * @brief Double capacity of flow cache and allocators of shard unless maximal size is reached.
+ *
+ * @return True if flow cache was replaced by bigger one
+ */
+static bool
+grow_shard(Flow_cache_shard& shard)
+{
+    std::size_t capacity = shard.agg.capacity();
+
+    if (shard.agg.is_growing() || capacity >= shard.cache_size)
+        return false;
+
+    agg::Flow_key_allocator::grow(capacity);
+    agg::Flow_data_context_allocator::grow(capacity);
+    shard.agg.start_growth(capacity * 2);
+    shard.stats.capacity.set(capacity * 2);
+    return true;
 }
 
+/**
+ * @brief Insert key of shard to flow cache, grow flow cache when it is full.
+ */
+static std::pair<agg::Aggregator<agg::FlowKey>::Table::iterator, int>
+insert_key(Flow_cache_shard& shard, ur_template_t *out_tmplt)
+{
+    if (unlikely(shard.agg.is_growing())) {
+        auto evict = evict_handler(shard, out_tmplt);
+        shard.agg.promote(shard.key, evict);
+        shard.agg.migrate(migrate_step, evict);
+    }
+
+    auto inserted = shard.agg.flow_cache.insert_no_grow(shard.removed, std::move(shard.key), shard.placeholder);
+    if (unlikely(inserted.second == ska::FULL) && grow_shard(shard))
+        inserted = shard.agg.flow_cache.insert_no_grow(shard.removed, std::move(shard.key), shard.placeholder);
+    return inserted;
+}
+
+/**
+ * @brief Aggregate record to flow cache of given shard.
+ *
+ * Timeouted flows are checked once per record, against time_first of the record for passive
+ * timeout (but never before time of previous records) and against time_last for active timeout.
+ * Key of the record is generated unless it was already generated by receiving thread,
+ * then it is passed in key_data together with its direction.
+ */
+static void
+process_record(Flow_cache_shard& shard, Shared_context& ctx, const void *in_data, ur_template_t *in_tmplt,
+               time_t time_last, const void *key_data = nullptr, bool is_key_reversed = false)
+{
+    time_t time_first = ur_time_get_sec(ur_get(in_tmplt, in_data, F_TIME_FIRST));
+    time_t t_passive = ctx.config.get_passive_timeout() >> 32;
+    time_t t_active = ctx.config.get_active_timeout() >> 32;
+    bool is_sampled = shard.stats.records.get() % agg::latency_sample_period == 0;
+    std::chrono::steady_clock::time_point start;
+
+    if (unlikely(is_sampled))
+        start = std::chrono::steady_clock::now();
+
+    time_t passive_time = std::max(shard.time_last, time_first);
+    if (shard.time_last < time_last)
+        shard.time_last = time_last;
+
+    // Check timeouted flows
+    if (!ctx.config.get_global_flush_configuration().is_set())
+        expire_flows(shard, ctx.out_tmplt, passive_time, shard.time_last);
+
+    if (key_data != nullptr)
+        shard.key.load(key_data);
+    else
+        is_key_reversed = shard.key.generate(in_data, in_tmplt, ctx.config.is_biflow_key());
+
+    auto insered_data = insert_key(shard, ctx.out_tmplt); // todo insert only key
+    switch (insered_data.second) {
+    case ska::DUPLICATED:
+        update_flow(in_data,
+                    in_tmplt,
+                    insered_data.first->first,
+                    insered_data.first->second,
+                    shard.timers,
+                    is_key_reversed,
+                    t_passive,
+                    t_active);
+        break;
+    case ska::INSERTED:
+        shard.stats.inserted.add();
+        post_insert_flow(in_data,
+                         in_tmplt,
+                         insered_data.first->first,
+                         insered_data.first->second,
+                         shard.timers,
+                         ctx.is_string_key,
+                         is_key_reversed,
+                         time_first,
+                         ur_time_get_sec(ur_get(in_tmplt, in_data, F_TIME_LAST)),
+                         t_passive,
+                         t_active);
+        break;
+    case ska::SWAPPED:
+        shard.stats.collisions.add();
+        shard.stats.inserted.add();
+        pre_delete_flow(shard.batch,
+                        ctx.out_tmplt,
+                        shard.agg,
+                        shard.removed.first,
+                        shard.removed.second,
+                        shard.timers);
+        post_insert_flow(in_data,
+                         in_tmplt,
+                         insered_data.first->first,
+                         insered_data.first->second,
+                         shard.timers,
+                         ctx.is_string_key,
+                         is_key_reversed,
+                         time_first,
+                         ur_time_get_sec(ur_get(in_tmplt, in_data, F_TIME_LAST)),
+                         t_passive,
+                         t_active);
+        break;
+    case ska::FULL: {
+        shard.stats.evictions.add();
+        shard.stats.inserted.add();
+        auto to_delete = shard.agg.flow_cache.get_delete_candidate(std::move(shard.key));
+        pre_delete_flow(shard.batch,
+                        ctx.out_tmplt,
+                        shard.agg,
+                        to_delete->first, 
+                        to_delete->second,
+                        shard.timers);
+        shard.agg.flow_cache.erase(to_delete);
+        insered_data = shard.agg.flow_cache.insert_no_grow(shard.removed, std::move(shard.key), shard.placeholder); // cant fail
+        post_insert_flow(in_data,
+                         in_tmplt,
+                         insered_data.first->first,
+                         insered_data.first->second,
+                         shard.timers,
+                         ctx.is_string_key,
+                         is_key_reversed,
+                         time_first,
+                         ur_time_get_sec(ur_get(in_tmplt, in_data, F_TIME_LAST)),
+                         t_passive,
+                         t_active);
+        break;
+    }
+    default:
+        throw std::runtime_error("Invalid case option (flat_hash_map).");
+        break;
+    }
+
+    shard.stats.probe_length.add(ska::flat_hash_map<agg::FlowKey, agg::Flow_data>::probe_length(insered_data.first));
+
+    agg::Flow_data *cache_data = static_cast<agg::Flow_data *>(std::addressof(insered_data.first->second));
+    shard.agg.plan.aggregate(in_tmplt, in_data, cache_data->ctx->data, is_key_reversed);
+
+    shard.stats.records.add();
+    shard.stats.flows.set(shard.agg.size());
+    shard.stats.slab_bytes.set(agg::Slab_pool::get_reserved());
+    if (unlikely(is_sampled)) {
+        std::chrono::nanoseconds latency = std::chrono::steady_clock::now() - start;
+        shard.stats.record_latency_ns.add(latency.count());
+    }
+}
+
+/**
+ * @brief Init key and context allocators of calling thread for given shard.
+ */
+static void
+init_allocators(Flow_cache_shard& shard)
+{
+    agg::Flow_key_allocator::init(shard.agg.capacity() + 1, agg::Key_template::get_size());
+    agg::Flow_data_context_allocator::init(
+        shard.agg.capacity() + 1, 
+        shard.agg.fields.get_size(), 
+        std::bind(&agg::Fields::init, shard.agg.fields, std::placeholders::_1),
+        std::bind(&agg::Fields::deinit, shard.agg.fields, std::placeholders::_1));
+}
+
+/**
+ * @brief Send all flows of shard and account the flush to statistics.
+ */
+static void
+flush_shard(Flow_cache_shard& shard, ur_template_t *out_tmplt)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    shard.agg.finish_growth(evict_handler(shard, out_tmplt));
+    shard.stats.flushed.add(shard.agg.size());
+    flush_all(shard.agg, out_tmplt, shard.batch, shard.timers);
+    shard.stats.flows.set(0);
+    shard.stats.flush_count.add();
+    shard.stats.flush_time_us.add(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * @brief Send all flows of shard and return shard to empty state.
+ */
+static void
+reset_shard(Flow_cache_shard& shard, ur_template_t *out_tmplt)
+{
+    flush_shard(shard, out_tmplt);
+    shard.key.reset();
+    shard.agg.flow_cache.clear();
+    shard.timers.clear();
+}
+
+/**
+ * @brief Return shard to empty state without sending its flows.
+ */
+static void
+discard_shard(Flow_cache_shard& shard)
+{
+    shard.agg.finish_growth([](agg::FlowKey& key, agg::Flow_data& flow_data) {
+        agg::Flow_key_allocator::release_ptr(static_cast<uint8_t *>(key.get_key().first));
+        agg::Flow_data_context_allocator::release_ptr(flow_data.ctx);
+    });
+    for (auto& flow_data : shard.agg.flow_cache) {
+        agg::Flow_key_allocator::release_ptr(static_cast<uint8_t *>(flow_data.first.get_key().first));
+        agg::Flow_data_context_allocator::release_ptr(flow_data.second.ctx);
+    }
+    shard.key.reset();
+    shard.agg.flow_cache.clear();
+    shard.timers.clear();
+    shard.stats.flows.set(0);
+    shard.batch.send(true);
+}
+
+/**
+ * @brief Get snapshot file of shard, every worker has its own file.
+ */
+static std::string
+snapshot_file(Shared_context& ctx, const Flow_cache_shard& shard)
+{
+    if (ctx.config.get_thread_count() == 1)
+        return ctx.config.get_snapshot_path();
+    return ctx.config.get_snapshot_path() + "." + std::to_string(shard.index);
+}
+
+/**
+ * @brief Describe templates, key and fields, layout of stored flows depends on all of them.
+ */
+static std::string
+snapshot_signature(Shared_context& ctx, agg::Fields& fields, ur_template_t *in_tmplt)
+{
+    std::ostringstream signature;
+    char *tmplt_str;
+
+    tmplt_str = ur_template_string(in_tmplt);
+    signature << (tmplt_str ? tmplt_str : "") << ';';
+    free(tmplt_str);
+    tmplt_str = ur_template_string(ctx.out_tmplt);
+    signature << (tmplt_str ? tmplt_str : "") << ';';
+    free(tmplt_str);
+
+    for (auto tmplt_field : agg::Key_template::get_fields())
+        signature << ur_get_name(std::get<agg::Key_template::ID>(tmplt_field)) << ',';
+    signature << agg::Key_template::get_size() << ';' << fields.get_size() << ';';
+
+    for (const auto& agg_field : fields.get_fields()) {
+        const agg::Field& field = agg_field.first;
+        signature << field.name << ',' << field.reverse_name << ',' << field.type << ',' << field.limit << ','
+                  << static_cast<unsigned>(field.precision) << ',' << field.sort_name << ',' << field.sort_type << ','
+                  << static_cast<int>(field.delimiter) << ';';
+    }
+    signature << ctx.config.get_thread_count() << ';' << ctx.config.is_biflow_key();
+    return signature.str();
+}
+
+/**
+ * @brief Store all flows of shard to its snapshot file.
+ *
+ * @return 0 on success, 1 when snapshot is not possible or failed
+ */
+static int
+save_shard_snapshot(Flow_cache_shard& shard, Shared_context& ctx)
+{
+    if (ctx.out_tmplt == NULL)
+        return 1;
+    if (ctx.is_string_key || !shard.agg.fields.is_snapshot_supported()) {
+        std::cerr << "Snapshot: String keys and UNIQUE_COUNT fields cannot be stored, snapshot skipped." << std::endl;
+        return 1;
+    }
+    shard.agg.finish_growth(evict_handler(shard, ctx.out_tmplt));
+    return agg::save_snapshot(snapshot_file(ctx, shard), ctx.snapshot_signature, shard.agg.fields,
+        shard.agg.flow_cache, shard.time_last);
+}
+
+/**
+ * @brief Load flows from snapshot file of shard and remove the file.
+ *
+ * Flows are inserted with their original timeouts, snapshot is ignored when it was made
+ * with different templates or configuration.
+ */
+static void
+restore_shard_snapshot(Flow_cache_shard& shard, Shared_context& ctx)
+{
+    agg::Snapshot_reader reader;
+    agg::Snapshot_flow flow;
+    std::size_t restored = 0;
+
+    shard.restore_checked = true;
+    if (ctx.config.get_snapshot_path().empty() || ctx.is_string_key || !shard.agg.fields.is_snapshot_supported())
+        return;
+
+    const std::string path = snapshot_file(ctx, shard);
+    if (reader.open(path, ctx.snapshot_signature) != 0)
+        return;
+
+    shard.timers.passive.reset(reader.get_time_last());
+    shard.timers.active.reset(reader.get_time_last());
+
+    while (reader.next(flow)) {
+        shard.key.load(flow.key);
+        auto inserted = insert_key(shard, ctx.out_tmplt);
+        switch (inserted.second) {
+        case ska::DUPLICATED:
+            continue;
+        case ska::SWAPPED:
+            pre_delete_flow(shard.batch, ctx.out_tmplt, shard.agg, shard.removed.first, shard.removed.second, shard.timers);
+            break;
+        case ska::FULL: {
+            auto to_delete = shard.agg.flow_cache.get_delete_candidate(std::move(shard.key));
+            pre_delete_flow(shard.batch, ctx.out_tmplt, shard.agg, to_delete->first, to_delete->second, shard.timers);
+            shard.agg.flow_cache.erase(to_delete);
+            inserted = shard.agg.flow_cache.insert_no_grow(shard.removed, std::move(shard.key), shard.placeholder); // cant fail
+            break;
+        }
+        default:
+            break;
+        }
+
+        agg::Flow_data& flow_data = inserted.first->second;
+        agg::Context *flow_ctx = new_flow_context(flow_data);
+        flow_data.count = flow.count;
+        flow_data.time_first = flow.time_first;
+        flow_data.time_last = flow.time_last;
+        flow_data.reverse = flow.reverse;
+        shard.agg.fields.load(flow_ctx->data, flow.data);
+        shard.timers.passive.schedule(&flow_ctx->passive_timer, flow.passive_timeout);
+        shard.timers.active.schedule(&flow_ctx->active_timer, flow.active_timeout);
+        restored++;
+    }
+
+    if (shard.time_last < reader.get_time_last())
+        shard.time_last = reader.get_time_last();
+    shard.stats.flows.set(shard.agg.size());
+    reader.close();
+    unlink(path.c_str());
+    std::cout << "Snapshot: " << restored << " flows restored from " << path << std::endl;
+}
+
+/**
+ * @brief Create new output template and fields of all shards for current input template.
+ */
+static int
+reconfigure_shards(Shared_context& ctx, std::vector<std::unique_ptr<Flow_cache_shard>>& shards, ur_template_t *in_tmplt)
+{
+    // Free previous fields and template
+    for (auto& shard : shards)
+        shard->agg.fields.reset();
+    ur_free_template(ctx.out_tmplt);
+    ctx.out_tmplt = NULL;
+    agg::Key_template::reset();
+
+    ctx.is_string_key = false;
+    if (process_format_change(ctx.config, shards[0]->agg, in_tmplt, std::addressof(ctx.out_tmplt), ctx.is_string_key) != 0)
+        return 1;
+
+    for (auto& shard : shards) {
+        shard->agg.fields = shards[0]->agg.fields;
+        shard->agg.plan = shards[0]->agg.plan;
+    }
+
+    if (!ctx.config.get_snapshot_path().empty())
+        ctx.snapshot_signature = snapshot_signature(ctx, shards[0]->agg.fields, in_tmplt);
+    return 0;
+}
+
+/**
+ * @brief Create private copy of input template for workers.
+ *
+ * Input template is modified by receiving thread on format change while workers
+ * can still process records of previous format. Copy is created from interface
+ * specification of input template so it has the same layout as pushed records.
+ */
+static ur_template_t *
+copy_template(ur_template_t *in_tmplt)
+{
+    ur_template_t *tmplt;
+    char *spec = ur_template_string(in_tmplt);
+
+    if (spec == NULL)
+        return NULL;
+    tmplt = ur_create_template_from_ifc_spec(spec);
+    free(spec);
+    return tmplt;
+}
+
+/**
+ * @brief Worker thread, aggregates records of one shard received through ring.
+ */
+static void
+worker_loop(Flow_cache_shard& shard, Shared_context& ctx)
+{
+    const Spsc_ring::Message *msg;
+    unsigned idle_cnt = 0;
+    bool flush_set = ctx.config.get_global_flush_configuration().is_set();
+
+    for (;;) {
+        // Load global time before ring is checked, all records older than this time are already in ring.
+        time_t time_last = ctx.time_last.load(std::memory_order_acquire);
+
+        shard.batch.check_latency();
+        msg = shard.ring.front();
+        if (msg == nullptr) {
+            if (shard.time_last < time_last)
+                shard.time_last = time_last;
+            if (!flush_set)
+                expire_flows(shard, ctx.out_tmplt, shard.time_last, 0);
+            if (++idle_cnt < 64)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        idle_cnt = 0;
+
+        switch (msg->type) {
+        case MSG_RECORD:
+        case MSG_RECORD_REVERSED:
+            process_record(shard,
+                           ctx,
+                           static_cast<const uint8_t *>(msg->data()) + agg::Key_template::get_size(),
+                           ctx.work_tmplt,
+                           msg->stamp,
+                           msg->data(),
+                           msg->type == MSG_RECORD_REVERSED);
+            break;
+        case MSG_FLUSH:
+            flush_shard(shard, ctx.out_tmplt);
+            break;
+        case MSG_SNAPSHOT:
+            (void) save_shard_snapshot(shard, ctx);
+            break;
+        case MSG_FORMAT_CHANGE:
+            reset_shard(shard, ctx.out_tmplt);
+            shard.ring.pop();
+            ctx.acked.fetch_add(1, std::memory_order_release);
+            // Templates are changed by receiving thread now, do not touch them until MSG_REINIT or MSG_STOP
+            while (shard.ring.front() == nullptr)
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        case MSG_REINIT:
+            init_allocators(shard);
+            if (!shard.restore_checked)
+                restore_shard_snapshot(shard, ctx);
+            break;
+        case MSG_STOP:
+            if (ctx.config.get_snapshot_path().empty() || save_shard_snapshot(shard, ctx) != 0)
+                reset_shard(shard, ctx.out_tmplt);
+            else
+                discard_shard(shard);
+            shard.ring.pop();
+            agg::Flow_key_allocator::clear();
+            agg::Flow_data_context_allocator::deinit();
+            return;
+        }
+        shard.ring.pop();
+    }
+}
+
+/**
+ * @brief Insert message to ring of given shard, wait while the ring is full.
+ */
+static void
+push_message(Flow_cache_shard& shard, Shard_message type, time_t stamp, const void *data, uint32_t size)
+{
+    while (!shard.ring.push(type, stamp, data, size))
+        std::this_thread::yield();
+}
+
+/**
+ * @brief Compute hash of flow key used to select shard.
+ *
+ * Cheap multiplicative hash, flow cache of the shard hashes the key again with its own hash.
+ */
+static inline uint64_t
+shard_hash(const agg::FlowKey& key) noexcept
+{
+    auto key_data = key.get_key();
+    const uint8_t *data = static_cast<const uint8_t *>(key_data.first);
+    std::size_t size = key_data.second;
+    uint64_t hash = size;
+    uint64_t word;
+
+    for (; size >= sizeof(word); data += sizeof(word), size -= sizeof(word)) {
+        std::memcpy(&word, data, sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    }
+    if (size) {
+        word = 0;
+        std::memcpy(&word, data, size);
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Insert record to ring of shard selected by its flow key, wait while the ring is full.
+ *
+ * Key is sent in front of the record so worker does not generate it again.
+ */
+static void
+push_record(std::vector<std::unique_ptr<Flow_cache_shard>>& shards, const agg::FlowKey& key,
+            bool is_key_reversed, time_t stamp, const void *data, uint32_t size)
+{
+    Flow_cache_shard& shard = *shards[(shard_hash(key) >> 32) % shards.size()];
+    auto key_data = key.get_key();
+    Shard_message type = is_key_reversed ? MSG_RECORD_REVERSED : MSG_RECORD;
+
+    while (!shard.ring.push(type, stamp, key_data.first, key_data.second, data, size))
+        std::this_thread::yield();
+}
+
+/**
+ * @brief Insert message without payload to rings of all shards.
+ */
+static void
+broadcast_message(std::vector<std::unique_ptr<Flow_cache_shard>>& shards, Shard_message type)
+{
+    for (auto& shard : shards)
+        push_message(*shard, type, 0, nullptr, 0);
+}
+
+/**
+ * @brief Receive records and process them by the receiving thread.
+ */
 static int 
-do_mainloop(Configuration& config)
+do_mainloop(Shared_context& ctx, std::vector<std::unique_ptr<Flow_cache_shard>>& shards)
 {
-    agg::Aggregator<agg::FlowKey> agg(config.get_flow_cache_size());
+    Flow_cache_shard& shard = *shards[0];
     ur_template_t *in_tmplt;
-    ur_template_t *out_tmplt = NULL;
     uint16_t flow_size;
     const void *in_data;
-    void *out_rec = NULL;
     int recv_code;
-    agg::FlowKey key;
-    agg::Flow_data placeholder;
-    std::pair<agg::FlowKey, agg::Flow_data> removed;
-    agg::Field *field;
-    bool is_string_key = false;
-    bool timeouted = false;
-
-    time_t time_first;
-    time_t time_last = 0;
     time_t last_flush_time = 0;
-    time_t t_passive = config.get_passive_timeout() >> 32;
-    time_t t_active = config.get_active_timeout() >> 32;
     const Configuration::Global_flush_configuration& flush_configuration 
-        = config.get_global_flush_configuration();
-    std::size_t flow_cnt = 0;
-    Dll<agg::Timeout_data> dll;
+        = ctx.config.get_global_flush_configuration();
 
-    trap_ifcctl(TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, 500000);
+    // Output batch is checked after every receive, timeout must not be longer than its latency
+    std::size_t recv_timeout = std::min<std::size_t>(500, ctx.config.get_batch_latency());
+    trap_ifcctl(TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, std::max<std::size_t>(recv_timeout, 1) * 1000);
     //trap_ifcctl(TRAPIFC_OUTPUT, 0, TRAPCTL_SETTIMEOUT, 1);
 
     //  Create UniRec input templates
@@ -427,30 +1306,28 @@ do_mainloop(Configuration& config)
         return 1;
     }
 
+    // Check timeouted flows by time of the last record, records check them in process_record()
+    auto expire_idle = [&]() {
+        if (!flush_configuration.is_set())
+            expire_flows(shard, ctx.out_tmplt, shard.time_last, 0);
+    };
+
     while (unlikely(stop == false)) {
+        shard.batch.check_latency();
 
-    	// Check timeouted flows
-        for (node<agg::Timeout_data> *t_data = dll.begin(); !flush_configuration.is_set() && t_data != NULL; t_data = t_data->next) {
-            if (time_last >= t_data->value.passive_timeout) { // timeouted 
-                auto data = agg.flow_cache.find(t_data->value.key);
-                proccess_and_send(agg, data->first, data->second, out_tmplt, out_rec);
-                agg::Flow_data_context_allocator::release_ptr(data->second.ctx); 
-                agg::Flow_key_allocator::release_ptr(static_cast<uint8_t *>(data->first.get_key().first));
-                agg.flow_cache.erase(data);
-                dll.delete_first_node();
-                timeouted = true;
-            } else
-                break;
-        }
-        if (timeouted == true) {
-            trap_send_flush(0);
-            timeouted = false;
+        if (unlikely(snapshot_request)) {
+            snapshot_request = 0;
+            (void) save_shard_snapshot(shard, ctx);
         }
 
         recv_code = TRAP_RECEIVE(0, in_data, flow_size, in_tmplt);
+        if (recv_code == TRAP_E_TIMEOUT) {
+            expire_idle();
+            continue;
+        }
         TRAP_DEFAULT_RECV_ERROR_HANDLING(recv_code, continue, break);
         if (unlikely(flow_size <= 1)) {
-            if (config.get_eof_termination()) {
+            if (ctx.config.get_eof_termination()) {
                 stop = 1;
                 break;
             } else
@@ -461,184 +1338,154 @@ do_mainloop(Configuration& config)
 
             // clear all memory
             // flush all flows
-            flush_all(agg, out_tmplt, out_rec, dll);
+            expire_idle();
+            reset_shard(shard, ctx.out_tmplt);
 
-            // Free previous record and temlate
-            ur_free_template(out_tmplt);
-            ur_free_record(out_rec);
+            if (reconfigure_shards(ctx, shards, in_tmplt) != 0) {
+                stop = 1;
+                break;
+            }
 
-            key.reset();
-            agg.fields.reset();
-            agg.flow_cache.clear();
-            agg::Key_template::reset();
-            dll.clear();
+            init_allocators(shard);
+            if (!shard.restore_checked)
+                restore_shard_snapshot(shard, ctx);
+        }
+
+        time_t time_last = std::max<time_t>(shard.time_last, ur_time_get_sec(ur_get(in_tmplt, in_data, F_TIME_LAST)));
 
-            if (process_format_change(config, agg, in_tmplt, std::addressof(out_tmplt), is_string_key) != 0) {
+        if (unlikely(flush_configuration.is_set() && time_last - last_flush_time >= flush_configuration.interval)) {
+            last_flush_time = time_last;
+            if (flush_configuration.type == Configuration::Global_flush_configuration::Type::ABSOLUTE) {
+                last_flush_time = last_flush_time / flush_configuration.interval * flush_configuration.interval;
+            }    
+            flush_shard(shard, ctx.out_tmplt);
+        }
+
+        process_record(shard, ctx, in_data, in_tmplt, time_last);
+    }
+
+    expire_idle();
+    if (!ctx.config.get_snapshot_path().empty() && save_shard_snapshot(shard, ctx) == 0) {
+        discard_shard(shard);
+    } else {
+        shard.agg.finish_growth(evict_handler(shard, ctx.out_tmplt));
+        for (auto flow_data : shard.agg.flow_cache) {
+            proccess_and_send(shard.agg, flow_data.first, flow_data.second, ctx.out_tmplt, shard.batch);
+            agg::Flow_key_allocator::release_ptr(static_cast<uint8_t *>(flow_data.first.get_key().first));
+            agg::Flow_data_context_allocator::release_ptr(flow_data.second.ctx);
+        }
+        shard.batch.send(false);
+    }
+
+    //send eof
+    char dummy[1] = {0};
+    trap_send(0, dummy, 1);
+    trap_send_flush(0);
+
+    force_stop = false;
+
+    agg::Flow_key_allocator::clear();
+    agg::Flow_data_context_allocator::deinit();
+    ur_free_template(in_tmplt);
+    return output_failed ? 1 : 0;
+}
+
+/**
+ * @brief Receive records and distribute them to worker threads by hash of flow key.
+ */
+static int 
+do_sharded_mainloop(Shared_context& ctx, std::vector<std::unique_ptr<Flow_cache_shard>>& shards)
+{
+    ur_template_t *in_tmplt;
+    uint16_t flow_size;
+    const void *in_data;
+    int recv_code;
+    int ret = 0;
+    agg::FlowKey key;
+    time_t time_last = 0;
+    time_t last_flush_time = 0;
+    const Configuration::Global_flush_configuration& flush_configuration 
+        = ctx.config.get_global_flush_configuration();
+
+    trap_ifcctl(TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, 500000);
+
+    //  Create UniRec input templates
+    in_tmplt = ur_create_input_template(0, "TIME_FIRST,TIME_LAST", NULL);
+    if (in_tmplt == NULL) {
+        std::cerr << "Error: Input template could not be created." << std::endl;
+        return 1;
+    }
+
+    for (auto& shard : shards) {
+        Flow_cache_shard *shard_ptr = shard.get();
+        shard->thread = std::thread([shard_ptr, &ctx]() { worker_loop(*shard_ptr, ctx); });
+    }
+
+    while (unlikely(stop == false)) {
+        if (unlikely(snapshot_request)) {
+            snapshot_request = 0;
+            broadcast_message(shards, MSG_SNAPSHOT);
+        }
+
+        recv_code = TRAP_RECEIVE(0, in_data, flow_size, in_tmplt);
+        TRAP_DEFAULT_RECV_ERROR_HANDLING(recv_code, continue, break);
+        if (unlikely(flow_size <= 1)) {
+            if (ctx.config.get_eof_termination()) {
+                stop = 1;
+                break;
+            } else
+                continue;
+        }
+
+        if (unlikely(TRAP_E_FORMAT_CHANGED == recv_code)) {
+            // flush all flows and wait until all workers are idle
+            broadcast_message(shards, MSG_FORMAT_CHANGE);
+            while (ctx.acked.load(std::memory_order_acquire) != shards.size())
+                std::this_thread::yield();
+            ctx.acked.store(0, std::memory_order_relaxed);
+
+            key.reset();
+            if (reconfigure_shards(ctx, shards, in_tmplt) != 0) {
                 stop = 1;
+                ret = 1;
                 break;
             }
-            out_rec = ur_create_record(out_tmplt, UR_MAX_SIZE);
-            if (out_rec == NULL) {
-                std::cerr << "Error: Output record could not be created." << std::endl;
+
+            ur_free_template(ctx.work_tmplt);
+            ctx.work_tmplt = copy_template(in_tmplt);
+            if (ctx.work_tmplt == NULL) {
+                std::cerr << "Error: Worker template could not be created." << std::endl;
                 stop = 1;
+                ret = 1;
                 break;
             }
 
-            agg::Flow_key_allocator::init(config.get_flow_cache_size() + 1, agg::Key_template::get_size());
-            agg::Flow_data_context_allocator::init(
-                config.get_flow_cache_size() + 1, 
-                agg.fields.get_size(), 
-                std::bind(&agg::Fields::init, agg.fields, std::placeholders::_1),
-                std::bind(&agg::Fields::deinit, agg.fields, std::placeholders::_1));
+            // Key of receiving thread is used only to select shard
+            agg::Flow_key_allocator::init(1, agg::Key_template::get_size());
+            broadcast_message(shards, MSG_REINIT);
         }
 
-        time_first = ur_time_get_sec(ur_get(in_tmplt, in_data, F_TIME_FIRST));
         if (time_last < ur_time_get_sec(ur_get(in_tmplt, in_data, F_TIME_LAST)))
             time_last = ur_time_get_sec(ur_get(in_tmplt, in_data, F_TIME_LAST));
 
-        // Check timeouted flows
-        for (node<agg::Timeout_data> *t_data = dll.begin(); !flush_configuration.is_set() && t_data != NULL; t_data = t_data->next) {
-            if (time_first >= t_data->value.passive_timeout || time_last >= t_data->value.active_timeout) { // timeouted 
-                auto data = agg.flow_cache.find(t_data->value.key);
-                proccess_and_send(agg, data->first, data->second, out_tmplt, out_rec);
-                agg::Flow_data_context_allocator::release_ptr(data->second.ctx); 
-                agg::Flow_key_allocator::release_ptr(static_cast<uint8_t *>(data->first.get_key().first));
-                agg.flow_cache.erase(data);
-                dll.delete_first_node();
-                timeouted = true;
-            } else
-                break;
-        }
-        if (timeouted == true) {
-            trap_send_flush(0);
-            timeouted = false;
-        }
-
         if (unlikely(flush_configuration.is_set() && time_last - last_flush_time >= flush_configuration.interval)) {
             last_flush_time = time_last;
             if (flush_configuration.type == Configuration::Global_flush_configuration::Type::ABSOLUTE) {
                 last_flush_time = last_flush_time / flush_configuration.interval * flush_configuration.interval;
             }    
-            flush_all(agg, out_tmplt, out_rec, dll);
+            broadcast_message(shards, MSG_FLUSH);
         }
-        
-        bool is_key_reversed = key.generate(in_data, in_tmplt, config.is_biflow_key());
 
-        auto insered_data = agg.flow_cache.insert_no_grow(removed, std::move(key), placeholder); // todo insert only key
-        switch (insered_data.second) {
-        case ska::DUPLICATED:
-            update_flow(in_data,
-                        in_tmplt,
-                        insered_data.first->first,
-                        insered_data.first->second,
-                        dll,
-                        is_key_reversed,
-                        t_passive,
-                        t_active);
-        	break;
-        case ska::INSERTED:
-        	post_insert_flow(in_data,
-                             in_tmplt,
-                             insered_data.first->first,
-                             insered_data.first->second,
-                             dll,
-                             is_string_key,
-                             is_key_reversed,
-                             time_first,
-                             ur_time_get_sec(ur_get(in_tmplt, in_data, F_TIME_LAST)),
-                             t_passive,
-                             t_active);
-            break;
-        case ska::SWAPPED:
-            pre_delete_flow(out_rec,
-                            out_tmplt,
-                            agg,
-                            removed.first,
-                            removed.second,
-                            dll);
-            post_insert_flow(in_data,
-                             in_tmplt,
-                             insered_data.first->first,
-                             insered_data.first->second,
-                             dll,
-                             is_string_key,
-                             is_key_reversed,
-                             time_first,
-                             ur_time_get_sec(ur_get(in_tmplt, in_data, F_TIME_LAST)),
-                             t_passive,
-                             t_active);
-            break;
-        case ska::FULL: {
-            auto to_delete = agg.flow_cache.get_delete_candidate(std::move(key));
-            pre_delete_flow(out_rec,
-                            out_tmplt,
-                            agg,
-                            to_delete->first, 
-                            to_delete->second,
-                            dll);
-            agg.flow_cache.erase(to_delete->first);
-            insered_data = agg.flow_cache.insert_no_grow(removed, std::move(key), placeholder); // cant fail
-            post_insert_flow(in_data,
-                             in_tmplt,
-                             insered_data.first->first,
-                             insered_data.first->second,
-                             dll,
-                             is_string_key,
-                             is_key_reversed,
-                             time_first,
-                             ur_time_get_sec(ur_get(in_tmplt, in_data, F_TIME_LAST)),
-                             t_passive,
-                             t_active);
-            break;
-        }
-        default:
-            throw std::runtime_error("Invalid case option (flat_hash_map).");
-            break;
-        }
-
-        agg::Flow_data *cache_data = static_cast<agg::Flow_data *>(std::addressof(insered_data.first->second));
-        for (auto agg_field : agg.fields.get_fields()) {
-            field = std::addressof(agg_field.first);
-            if (ur_is_array(field->ur_fid)) {
-                if (field->type == agg::SORTED_MERGE_DIR) {
-                    agg::ur_array_dir_data src_dir_data;
-                    src_dir_data.cnt_elements = ur_array_get_elem_cnt(in_tmplt, in_data, field->ur_fid);
-                    src_dir_data.ptr_first = ur_get_ptr_by_id(in_tmplt, in_data, field->ur_fid);
-                    src_dir_data.sort_key = ur_get_ptr_by_id(in_tmplt, in_data, field->ur_sort_key_id);
-                    if (ur_is_array(field->ur_sort_key_id))
-                        src_dir_data.sort_key_elements = ur_array_get_elem_cnt(in_tmplt, in_data, field->ur_sort_key_id);
-                    else
-                        src_dir_data.sort_key_elements = 1;
-                    src_dir_data.is_key_reversed = is_key_reversed;
-                    field->aggregate(std::addressof(src_dir_data), std::addressof(cache_data->ctx->data[agg_field.second]));
-                } else {
-                    agg::ur_array_data src_data;
-                    src_data.cnt_elements = ur_array_get_elem_cnt(in_tmplt, in_data, field->ur_fid);
-                    src_data.ptr_first = ur_get_ptr_by_id(in_tmplt, in_data, field->ur_fid);
-                    if (field->type == agg::SORTED_MERGE) {
-                        src_data.sort_key = ur_get_ptr_by_id(in_tmplt, in_data, field->ur_sort_key_id);
-                        if (ur_is_array(field->ur_sort_key_id))
-                            src_data.sort_key_elements = ur_array_get_elem_cnt(in_tmplt, in_data, field->ur_sort_key_id);
-                        else
-                            src_data.sort_key_elements = 1;
-
-                    }
-                    field->aggregate(std::addressof(src_data), std::addressof(cache_data->ctx->data[agg_field.second]));
-                }
-            } else {
-                ur_field_id_t field_id = is_key_reversed ? field->ur_r_fid : field->ur_fid;
-                field->aggregate(ur_get_ptr_by_id(in_tmplt, in_data, field_id), std::addressof(cache_data->ctx->data[agg_field.second]));
-            }
-        }
+        bool is_key_reversed = key.generate(in_data, in_tmplt, ctx.config.is_biflow_key());
+        push_record(shards, key, is_key_reversed, time_last, in_data, flow_size);
 
-        flow_cnt++;
+        // Publish time after the record is in ring
+        ctx.time_last.store(time_last, std::memory_order_release);
     }
 
-    for (auto flow_data : agg.flow_cache) {
-        proccess_and_send(agg, flow_data.first, flow_data.second, out_tmplt, out_rec);
-        agg::Flow_key_allocator::release_ptr(static_cast<uint8_t *>(flow_data.first.get_key().first));
-        agg::Flow_data_context_allocator::release_ptr(flow_data.second.ctx);
-    }
+    broadcast_message(shards, MSG_STOP);
+    for (auto& shard : shards)
+        shard->thread.join();
 
     //send eof
     char dummy[1] = {0};
@@ -647,12 +1494,57 @@ do_mainloop(Configuration& config)
 
     force_stop = false;
 
+    key.reset();
     agg::Flow_key_allocator::clear();
-    agg::Flow_data_context_allocator::deinit();
-    ur_free_record(out_rec);
     ur_free_template(in_tmplt);
-    ur_free_template(out_tmplt);
-    return 0;
+    return output_failed ? 1 : ret;
+}
+
+/**
+ * @brief Create flow cache shards and run main loop.
+ */
+static int
+run_aggregator(Configuration& config)
+{
+    Shared_context ctx(config);
+    std::vector<std::unique_ptr<Flow_cache_shard>> shards;
+    agg::Stats_server stats_server;
+    std::size_t thread_cnt = config.get_thread_count();
+    std::size_t shard_cache_size = 4;
+    std::size_t shard_initial_size = 4;
+    int ret;
+
+    // Flow cache of every shard must be power of 2
+    while (shard_cache_size * 2 * thread_cnt <= config.get_flow_cache_size())
+        shard_cache_size *= 2;
+    if (config.get_initial_flow_cache_size() == 0)
+        shard_initial_size = shard_cache_size;
+    while (shard_initial_size * 2 * thread_cnt <= config.get_initial_flow_cache_size() && shard_initial_size < shard_cache_size)
+        shard_initial_size *= 2;
+
+    for (std::size_t i = 0; i < thread_cnt; i++) {
+        std::size_t ring_size = thread_cnt > 1 ? shard_ring_size : 0;
+        shards.emplace_back(std::unique_ptr<Flow_cache_shard>(new Flow_cache_shard(i, shard_initial_size, shard_cache_size, ring_size)));
+        shards.back()->batch.configure(config.get_batch_size(), std::chrono::milliseconds(config.get_batch_latency()));
+    }
+
+    if (!config.get_stats_socket_path().empty()) {
+        std::vector<const agg::Shard_stats *> stats;
+        for (auto& shard : shards)
+            stats.push_back(&shard->stats);
+        if (stats_server.start(config.get_stats_socket_path(), stats) != 0)
+            return 1;
+    }
+
+    if (thread_cnt == 1)
+        ret = do_mainloop(ctx, shards);
+    else
+        ret = do_sharded_mainloop(ctx, shards);
+
+    stats_server.stop();
+    ur_free_template(ctx.out_tmplt);
+    ur_free_template(ctx.work_tmplt);
+    return ret;
 }
 
 int
@@ -693,9 +1585,27 @@ main(int argc, char **argv)
         case 's':
             config.set_flow_cache_size(optarg);
             break;
+        case 'E':
+            config.set_initial_flow_cache_size(optarg);
+            break;
         case 'g':
             config.set_global_flush_configuration(optarg);
             break;
+        case 't':
+            config.set_thread_count(optarg);
+            break;
+        case 'b':
+            config.set_batch_size(optarg);
+            break;
+        case 'l':
+            config.set_batch_latency(optarg);
+            break;
+        case 'S':
+            config.set_snapshot_path(optarg);
+            break;
+        case 'm':
+            config.set_stats_socket_path(optarg);
+            break;
         default:
             std::cerr << "Invalid argument " << opt << ", skipped..." << std::endl;
         }
@@ -718,9 +1628,11 @@ main(int argc, char **argv)
         std::cerr << "Passive timeout cannot be bigger than active timeout." << std::endl;
         goto failure;
     }
+    if (!config.get_snapshot_path().empty() && install_snapshot_handler() != 0)
+        goto failure;
 
     try {
-        if (do_mainloop(config) != 0)
+        if (run_aggregator(config) != 0)
             goto failure;
     } catch ( std::runtime_error &e) {
       std::cerr << e.what() << std::endl;
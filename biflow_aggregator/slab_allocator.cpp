@@ -0,0 +1,91 @@
+/**
+ * @file slab_allocator.cpp
+ * @brief Slab allocator with size classes for variable-length aggregation data.
+ * @version 1.0
+ * @date 17.10.2026
+ *
+ * @copyright Copyright (c) 2026 CESNET
+ */
+
+#include "slab_allocator.h"
+
+#include <new>
+
+namespace agg {
+
+thread_local Slab_pool::Free_block *Slab_pool::_free[class_count];
+
+thread_local std::vector<uint8_t *> Slab_pool::_slabs;
+
+thread_local std::size_t Slab_pool::_slab_used = 0;
+
+std::size_t Slab_pool::size_class(std::size_t size) noexcept
+{
+    if (size <= (std::size_t(1) << min_class_bits))
+        return 0;
+    return 64 - __builtin_clzll(size - 1) - min_class_bits;
+}
+
+void *Slab_pool::allocate(std::size_t size)
+{
+    if (size > max_block_size)
+        return ::operator new(size);
+
+    std::size_t cls = size_class(size);
+    if (_free[cls]) {
+        Free_block *block = _free[cls];
+        _free[cls] = block->next;
+        return block;
+    }
+
+    std::size_t block_size = std::size_t(1) << (min_class_bits + cls);
+    if (_slabs.empty() || _slab_used + block_size > slab_size) {
+        // Split rest of the last slab to free blocks of smaller classes
+        while (!_slabs.empty() && slab_size - _slab_used >= (std::size_t(1) << min_class_bits)) {
+            std::size_t rest = slab_size - _slab_used;
+            std::size_t rest_cls = 63 - __builtin_clzll(rest) - min_class_bits;
+            if (rest_cls >= class_count)
+                rest_cls = class_count - 1;
+            deallocate(_slabs.back() + _slab_used, std::size_t(1) << (min_class_bits + rest_cls));
+            _slab_used += std::size_t(1) << (min_class_bits + rest_cls);
+        }
+        _slabs.push_back(static_cast<uint8_t *>(::operator new(slab_size)));
+        _slab_used = 0;
+    }
+
+    void *ptr = _slabs.back() + _slab_used;
+    _slab_used += block_size;
+    return ptr;
+}
+
+void Slab_pool::deallocate(void *ptr, std::size_t size) noexcept
+{
+    if (ptr == nullptr)
+        return;
+    if (size > max_block_size) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    std::size_t cls = size_class(size);
+    Free_block *block = static_cast<Free_block *>(ptr);
+    block->next = _free[cls];
+    _free[cls] = block;
+}
+
+void Slab_pool::clear() noexcept
+{
+    for (uint8_t *slab : _slabs)
+        ::operator delete(slab);
+    _slabs.clear();
+    _slab_used = 0;
+    for (std::size_t i = 0; i < class_count; i++)
+        _free[i] = nullptr;
+}
+
+std::size_t Slab_pool::get_reserved() noexcept
+{
+    return _slabs.size() * slab_size;
+}
+
+} // namespace agg
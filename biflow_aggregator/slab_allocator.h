@@ -0,0 +1,129 @@
+/**
+ * @file slab_allocator.h
+ * @brief Slab allocator with size classes for variable-length aggregation data.
+ * @version 1.0
+ * @date 17.10.2026
+ *
+ * @copyright Copyright (c) 2026 CESNET
+ */
+
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace agg {
+
+/**
+ * @brief Thread local pool of memory blocks with power of two sizes.
+ *
+ * Blocks are carved from large slabs and returned to free list of their size class,
+ * so flows which come and go reuse the same memory without calling malloc. Slabs are
+ * released all at once by clear(), when flow contexts of the thread are destroyed.
+ * Blocks bigger than the largest size class are allocated directly.
+ */
+class Slab_pool {
+public:
+
+    /**
+     * @brief Get block of at least given size.
+     */
+    static void *allocate(std::size_t size);
+
+    /**
+     * @brief Return block obtained by allocate() with the same size.
+     */
+    static void deallocate(void *ptr, std::size_t size) noexcept;
+
+    /**
+     * @brief Release all slabs. No block of the pool may be used after this call.
+     */
+    static void clear() noexcept;
+
+    /**
+     * @brief Get size of memory held in slabs of calling thread.
+     */
+    static std::size_t get_reserved() noexcept;
+
+private:
+
+    static constexpr std::size_t min_class_bits = 4;
+    static constexpr std::size_t class_count = 13;
+    static constexpr std::size_t max_block_size = std::size_t(1) << (min_class_bits + class_count - 1);
+    static constexpr std::size_t slab_size = std::size_t(1) << 20;
+
+    /**
+     * @brief Free block, next free block of the same class is stored in its memory.
+     */
+    struct Free_block {
+        Free_block *next;
+    };
+
+    static std::size_t size_class(std::size_t size) noexcept;
+
+    /**
+     * @brief Heads of free lists of size classes.
+     */
+    static thread_local Free_block *_free[class_count];
+
+    /**
+     * @brief All slabs of the thread.
+     */
+    static thread_local std::vector<uint8_t *> _slabs;
+
+    /**
+     * @brief Used part of the last slab.
+     */
+    static thread_local std::size_t _slab_used;
+};
+
+/**
+ * @brief Allocator of standard containers that takes memory from Slab_pool.
+ */
+template<typename T>
+struct Slab_allocator {
+    using value_type = T;
+
+    Slab_allocator() noexcept
+    {
+    }
+
+    template<typename U>
+    Slab_allocator(const Slab_allocator<U>&) noexcept
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(Slab_pool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *ptr, std::size_t n) noexcept
+    {
+        Slab_pool::deallocate(ptr, n * sizeof(T));
+    }
+};
+
+template<typename T, typename U>
+inline bool operator==(const Slab_allocator<T>&, const Slab_allocator<U>&) noexcept
+{
+    return true;
+}
+
+template<typename T, typename U>
+inline bool operator!=(const Slab_allocator<T>&, const Slab_allocator<U>&) noexcept
+{
+    return false;
+}
+
+/**
+ * @brief Vector with elements stored in Slab_pool.
+ */
+template<typename T>
+using Slab_vector = std::vector<T, Slab_allocator<T>>;
+
+} // namespace agg
+
+#endif // SLAB_ALLOCATOR_H
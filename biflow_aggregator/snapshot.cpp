@@ -0,0 +1,233 @@
+/**
+ * @file snapshot.cpp
+ * @brief Snapshot of flow cache stored in memory mapped file.
+ * @version 1.0
+ * @date 17.10.2026
+ *
+ * @copyright Copyright (c) 2026 CESNET
+ */
+
+#include "snapshot.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace agg {
+
+namespace {
+
+const char snapshot_magic[8] = {'B', 'I', 'A', 'G', 'S', 'N', 'A', 'P'};
+constexpr uint32_t snapshot_version = 1;
+
+/**
+ * @brief Header of snapshot file, followed by signature and flows.
+ */
+struct Snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t signature_size;
+    uint64_t key_size;
+    uint64_t flow_cnt;
+    int64_t time_last;
+};
+
+/**
+ * @brief Stored flow, follows its key and precedes its aggregated data.
+ */
+struct Stored_flow {
+    uint32_t count;
+    uint32_t data_size;
+    int64_t time_first;
+    int64_t time_last;
+    int64_t passive_timeout;
+    int64_t active_timeout;
+    uint8_t reverse;
+};
+
+void print_error(const char *msg, const std::string& path)
+{
+    std::cerr << "Snapshot: " << msg << " " << path << " (" << std::strerror(errno) << ")" << std::endl;
+}
+
+} // namespace
+
+int save_snapshot(const std::string& path, const std::string& signature, const Fields& fields,
+    const ska::flat_hash_map<FlowKey, Flow_data>& flow_cache, time_t time_last)
+{
+    const std::size_t key_size = Key_template::get_size();
+    const std::string tmp_path = path + ".tmp";
+    std::size_t size = sizeof(Snapshot_header) + signature.size();
+
+    for (const auto& flow : flow_cache)
+        size += key_size + sizeof(Stored_flow) + fields.save(flow.second.ctx->data, nullptr);
+
+    int fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        print_error("Cannot create file", tmp_path);
+        return 1;
+    }
+    if (ftruncate(fd, size) != 0) {
+        print_error("Cannot resize file", tmp_path);
+        ::close(fd);
+        unlink(tmp_path.c_str());
+        return 1;
+    }
+    void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        print_error("Cannot map file", tmp_path);
+        ::close(fd);
+        unlink(tmp_path.c_str());
+        return 1;
+    }
+
+    uint8_t *out = static_cast<uint8_t *>(mem);
+    Snapshot_header header;
+    std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+    header.version = snapshot_version;
+    header.signature_size = signature.size();
+    header.key_size = key_size;
+    header.flow_cnt = flow_cache.size();
+    header.time_last = time_last;
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    std::memcpy(out, signature.data(), signature.size());
+    out += signature.size();
+
+    for (const auto& flow : flow_cache) {
+        Stored_flow stored = {};
+        std::memcpy(out, flow.first.get_key().first, key_size);
+        out += key_size;
+        stored.count = flow.second.count;
+        stored.time_first = flow.second.time_first;
+        stored.time_last = flow.second.time_last;
+        stored.reverse = flow.second.reverse;
+        stored.passive_timeout = flow.second.ctx->passive_timer.expire;
+        stored.active_timeout = flow.second.ctx->active_timer.expire;
+        stored.data_size = fields.save(flow.second.ctx->data, out + sizeof(stored));
+        std::memcpy(out, &stored, sizeof(stored));
+        out += sizeof(stored) + stored.data_size;
+    }
+
+    int ret = 0;
+    if (msync(mem, size, MS_SYNC) != 0) {
+        print_error("Cannot write file", tmp_path);
+        ret = 1;
+    }
+    munmap(mem, size);
+    ::close(fd);
+
+    if (ret == 0 && rename(tmp_path.c_str(), path.c_str()) != 0) {
+        print_error("Cannot rename file to", path);
+        ret = 1;
+    }
+    if (ret != 0)
+        unlink(tmp_path.c_str());
+    return ret;
+}
+
+Snapshot_reader::Snapshot_reader() :
+    _data(nullptr), _size(0), _offset(0), _key_size(0), _flow_cnt(0), _time_last(0)
+{
+}
+
+Snapshot_reader::~Snapshot_reader()
+{
+    close();
+}
+
+int Snapshot_reader::open(const std::string& path, const std::string& signature)
+{
+    struct stat st;
+    Snapshot_header header;
+
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT)
+            print_error("Cannot open file", path);
+        return 1;
+    }
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(header)) {
+        std::cerr << "Snapshot: Invalid file " << path << std::endl;
+        ::close(fd);
+        return 1;
+    }
+
+    void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        print_error("Cannot map file", path);
+        return 1;
+    }
+    _data = static_cast<const uint8_t *>(mem);
+    _size = st.st_size;
+    madvise(mem, _size, MADV_SEQUENTIAL);
+
+    std::memcpy(&header, _data, sizeof(header));
+    if (std::memcmp(header.magic, snapshot_magic, sizeof(header.magic)) || header.version != snapshot_version
+        || sizeof(header) + header.signature_size > _size) {
+        std::cerr << "Snapshot: Invalid file " << path << std::endl;
+        close();
+        return 1;
+    }
+    if (header.key_size != Key_template::get_size() || header.signature_size != signature.size()
+        || std::memcmp(_data + sizeof(header), signature.data(), signature.size())) {
+        std::cerr << "Snapshot: File " << path << " does not match current template and configuration, ignored." << std::endl;
+        close();
+        return 1;
+    }
+
+    _offset = sizeof(header) + header.signature_size;
+    _key_size = header.key_size;
+    _flow_cnt = header.flow_cnt;
+    _time_last = header.time_last;
+    return 0;
+}
+
+bool Snapshot_reader::next(Snapshot_flow& flow) noexcept
+{
+    Stored_flow stored;
+
+    if (_flow_cnt == 0 || _offset + _key_size + sizeof(stored) > _size)
+        return false;
+
+    flow.key = _data + _offset;
+    std::memcpy(&stored, _data + _offset + _key_size, sizeof(stored));
+    if (_offset + _key_size + sizeof(stored) + stored.data_size > _size)
+        return false;
+
+    flow.count = stored.count;
+    flow.time_first = stored.time_first;
+    flow.time_last = stored.time_last;
+    flow.reverse = stored.reverse;
+    flow.passive_timeout = stored.passive_timeout;
+    flow.active_timeout = stored.active_timeout;
+    flow.data = _data + _offset + _key_size + sizeof(stored);
+
+    _offset += _key_size + sizeof(stored) + stored.data_size;
+    _flow_cnt--;
+    return true;
+}
+
+time_t Snapshot_reader::get_time_last() const noexcept
+{
+    return _time_last;
+}
+
+void Snapshot_reader::close() noexcept
+{
+    if (_data)
+        munmap(const_cast<uint8_t *>(_data), _size);
+    _data = nullptr;
+    _size = 0;
+    _flow_cnt = 0;
+}
+
+} // namespace agg
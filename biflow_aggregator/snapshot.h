@@ -0,0 +1,103 @@
+/**
+ * @file snapshot.h
+ * @brief Snapshot of flow cache stored in memory mapped file.
+ * @version 1.0
+ * @date 17.10.2026
+ *
+ * @copyright Copyright (c) 2026 CESNET
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "aggregator.h"
+#include "flat_hash_map.h"
+#include "key_template.h"
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+namespace agg {
+
+/**
+ * @brief Flow read from snapshot.
+ */
+struct Snapshot_flow {
+    const uint8_t *key;
+    uint32_t count;
+    time_t time_first;
+    time_t time_last;
+    bool reverse;
+    time_t passive_timeout;
+    time_t active_timeout;
+
+    /**
+     * @brief Aggregated data serialized by Fields::save()
+     */
+    const uint8_t *data;
+};
+
+/**
+ * @brief Write all flows of flow cache to snapshot file.
+ *
+ * File is written under temporary name and renamed when it is complete.
+ *
+ * @param path       Snapshot file
+ * @param signature  Description of templates and fields, snapshot is restored only with the same signature
+ * @param fields     Aggregation fields
+ * @param flow_cache Flow cache
+ * @param time_last  Latest time seen by flow cache
+ * @return 0 on success, 1 on error
+ */
+int save_snapshot(const std::string& path, const std::string& signature, const Fields& fields,
+    const ska::flat_hash_map<FlowKey, Flow_data>& flow_cache, time_t time_last);
+
+/**
+ * @brief Sequential reader of snapshot file.
+ */
+class Snapshot_reader {
+public:
+
+    Snapshot_reader();
+    ~Snapshot_reader();
+
+    Snapshot_reader(const Snapshot_reader&) = delete;
+    Snapshot_reader& operator=(const Snapshot_reader&) = delete;
+
+    /**
+     * @brief Open snapshot file and check its signature.
+     *
+     * @return 0 on success, 1 when file does not exist, is corrupted or signature does not match
+     */
+    int open(const std::string& path, const std::string& signature);
+
+    /**
+     * @brief Read next flow.
+     *
+     * @return false when there are no more flows
+     */
+    bool next(Snapshot_flow& flow) noexcept;
+
+    /**
+     * @brief Get the latest time seen by flow cache when snapshot was taken.
+     */
+    time_t get_time_last() const noexcept;
+
+    /**
+     * @brief Unmap file.
+     */
+    void close() noexcept;
+
+private:
+    const uint8_t *_data;
+    std::size_t _size;
+    std::size_t _offset;
+    std::size_t _key_size;
+    uint64_t _flow_cnt;
+    time_t _time_last;
+};
+
+} // namespace agg
+
+#endif // SNAPSHOT_H
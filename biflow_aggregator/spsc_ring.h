@@ -0,0 +1,215 @@
+/**
+ * @file spsc_ring.h
+ * @brief Lock-free single producer single consumer ring of variable sized messages.
+ * @version 1.0
+ * @date 17.10.2026
+ *
+ * @copyright Copyright (c) 2026 CESNET
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+/**
+ * @brief Ring buffer used to pass messages from one producer thread to one consumer thread.
+ *
+ * Messages are stored back-to-back in one contiguous buffer. Every message consists of a header
+ * followed by the payload. When the message does not fit to the end of the buffer, padding
+ * message is inserted and the message is stored from the beginning of the buffer.
+ */
+class Spsc_ring {
+public:
+
+    /**
+     * @brief Message header.
+     */
+    struct Message {
+        uint32_t size;  ///< Size of the payload
+        uint16_t type;  ///< User defined message type
+        time_t stamp;   ///< User defined timestamp
+
+        /**
+         * @brief Get pointer to message payload.
+         */
+        const void *data() const noexcept
+        {
+            return this + 1;
+        }
+    };
+
+    /**
+     * @brief Construct a new ring.
+     *
+     * @param capacity Size of ring in bytes, power of 2. Zero means no buffer is allocated.
+     */
+    Spsc_ring(std::size_t capacity)
+        : _buffer(capacity ? new Message[capacity / sizeof(Message)] : nullptr),
+          _capacity(capacity), _mask(capacity - 1), _head(0), _cached_tail(0), _tail(0), _cached_head(0)
+    {
+    }
+
+    Spsc_ring(const Spsc_ring&) = delete;
+    Spsc_ring& operator=(const Spsc_ring&) = delete;
+
+    ~Spsc_ring()
+    {
+        delete [] _buffer;
+    }
+
+    /**
+     * @brief Insert new message to ring. Called by producer only.
+     *
+     * @param type  Message type
+     * @param stamp Message timestamp
+     * @param data  Pointer to payload
+     * @param size  Size of payload
+     * @return true  Message inserted
+     * @return false Not enough space in ring
+     */
+    bool push(uint16_t type, time_t stamp, const void *data, uint32_t size) noexcept
+    {
+        return push(type, stamp, nullptr, 0, data, size);
+    }
+
+    /**
+     * @brief Insert new message whose payload consists of two parts. Called by producer only.
+     *
+     * Parts are copied back-to-back, so the consumer sees one payload of head_size + size bytes.
+     *
+     * @param type      Message type
+     * @param stamp     Message timestamp
+     * @param head      Pointer to first part of payload
+     * @param head_size Size of first part of payload
+     * @param data      Pointer to second part of payload
+     * @param size      Size of second part of payload
+     * @return true  Message inserted
+     * @return false Not enough space in ring
+     */
+    bool push(uint16_t type, time_t stamp, const void *head, uint32_t head_size,
+              const void *data, uint32_t size) noexcept
+    {
+        const std::size_t entry_size = aligned_size(head_size + size);
+        std::size_t tail = _tail.load(std::memory_order_relaxed);
+        std::size_t offset = tail & _mask;
+        std::size_t padding = offset + entry_size > _capacity ? _capacity - offset : 0;
+
+        if (padding + entry_size > _capacity - (tail - _cached_head)) {
+            _cached_head = _head.load(std::memory_order_acquire);
+            if (padding + entry_size > _capacity - (tail - _cached_head))
+                return false;
+        }
+
+        if (padding) {
+            Message *pad = message_at(offset);
+            pad->type = padding_type;
+            pad->size = padding - sizeof(Message);
+            tail += padding;
+            offset = 0;
+        }
+
+        Message *msg = message_at(offset);
+        msg->size = head_size + size;
+        msg->type = type;
+        msg->stamp = stamp;
+        if (head_size)
+            std::memcpy(msg + 1, head, head_size);
+        if (size)
+            std::memcpy(reinterpret_cast<uint8_t *>(msg + 1) + head_size, data, size);
+
+        _tail.store(tail + entry_size, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Get the oldest message in ring. Called by consumer only.
+     *
+     * @return Pointer to message or nullptr if ring is empty.
+     */
+    const Message *front() noexcept
+    {
+        std::size_t head = _head.load(std::memory_order_relaxed);
+
+        for (;;) {
+            if (head == _cached_tail) {
+                _cached_tail = _tail.load(std::memory_order_acquire);
+                if (head == _cached_tail)
+                    return nullptr;
+            }
+
+            const Message *msg = message_at(head & _mask);
+            if (msg->type != padding_type)
+                return msg;
+
+            head += aligned_size(msg->size);
+            _head.store(head, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @brief Remove the oldest message returned by front(). Called by consumer only.
+     */
+    void pop() noexcept
+    {
+        std::size_t head = _head.load(std::memory_order_relaxed);
+        _head.store(head + aligned_size(message_at(head & _mask)->size), std::memory_order_release);
+    }
+
+    /**
+     * @brief Check if ring is empty.
+     */
+    bool empty() const noexcept
+    {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+private:
+
+    /**
+     * @brief Message type reserved for padding at the end of buffer.
+     */
+    static constexpr uint16_t padding_type = UINT16_MAX;
+
+    /**
+     * @brief Size of cache line, used to separate producer and consumer data.
+     */
+    static constexpr std::size_t cache_line_size = 64;
+
+    static std::size_t aligned_size(std::size_t size) noexcept
+    {
+        return (sizeof(Message) + size + sizeof(Message) - 1) / sizeof(Message) * sizeof(Message);
+    }
+
+    Message *message_at(std::size_t offset) const noexcept
+    {
+        return reinterpret_cast<Message *>(reinterpret_cast<uint8_t *>(_buffer) + offset);
+    }
+
+    Message *_buffer;
+    const std::size_t _capacity;
+    const std::size_t _mask;
+
+    uint8_t _pad0[cache_line_size];
+
+    /**
+     * @brief Consumer position and its copy of producer position.
+     */
+    std::atomic<std::size_t> _head;
+    std::size_t _cached_tail;
+
+    uint8_t _pad1[cache_line_size];
+
+    /**
+     * @brief Producer position and its copy of consumer position.
+     */
+    std::atomic<std::size_t> _tail;
+    std::size_t _cached_head;
+
+    uint8_t _pad2[cache_line_size];
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,196 @@
+/**
+ * @file statistics.cpp
+ * @brief Runtime statistics of flow cache provided over UNIX socket.
+ * @version 1.0
+ * @date 17.10.2026
+ *
+ * @copyright Copyright (c) 2026 CESNET
+ */
+
+#include "statistics.h"
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace agg {
+
+namespace {
+
+/**
+ * @brief Scalar counter of shard statistics with its name.
+ */
+struct Counter_desc {
+    const char *name;
+    Counter Shard_stats::*counter;
+};
+
+const Counter_desc counters[] = {
+    {"records", &Shard_stats::records},
+    {"flows", &Shard_stats::flows},
+    {"capacity", &Shard_stats::capacity},
+    {"inserted", &Shard_stats::inserted},
+    {"collisions", &Shard_stats::collisions},
+    {"evictions", &Shard_stats::evictions},
+    {"passive_expired", &Shard_stats::passive_expired},
+    {"active_expired", &Shard_stats::active_expired},
+    {"flushed", &Shard_stats::flushed},
+    {"flush_count", &Shard_stats::flush_count},
+    {"flush_time_us", &Shard_stats::flush_time_us},
+    {"slab_bytes", &Shard_stats::slab_bytes},
+};
+
+/**
+ * @brief Append names of histogram buckets to header.
+ */
+template<std::size_t N>
+void histogram_header(std::ostringstream& header, const char *name)
+{
+    header << ',' << name << "_0";
+    for (std::size_t i = 1; i < N - 1; i++)
+        header << ',' << name << "_lt_" << (uint64_t(1) << i);
+    header << ',' << name << "_ge_" << (uint64_t(1) << (N - 2));
+}
+
+/**
+ * @brief Append sum of histogram buckets of all shards to values.
+ */
+template<std::size_t N>
+void histogram_values(std::ostringstream& values, const std::vector<const Shard_stats *>& stats,
+    Histogram<N> Shard_stats::*histogram)
+{
+    for (std::size_t i = 0; i < N; i++) {
+        uint64_t sum = 0;
+        for (const Shard_stats *shard : stats)
+            sum += (shard->*histogram).get(i);
+        values << ',' << sum;
+    }
+}
+
+void send_to_sock(int client_fd, const std::string& str)
+{
+    const char *data = str.data();
+    std::size_t size = str.size();
+
+    while (size > 0) {
+        ssize_t sent = send(client_fd, data, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+            break;
+        size -= sent;
+        data += sent;
+    }
+}
+
+} // namespace
+
+Stats_server::Stats_server() : _fd(-1), _stop(false)
+{
+}
+
+Stats_server::~Stats_server()
+{
+    stop();
+}
+
+int Stats_server::start(const std::string& path, const std::vector<const Shard_stats *>& stats)
+{
+    struct sockaddr_un address;
+
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Statistics socket path is too long." << std::endl;
+        return 1;
+    }
+
+    _fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_fd < 0) {
+        std::cerr << "Error: Statistics socket creation failed." << std::endl;
+        return 1;
+    }
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path.c_str());
+    unlink(path.c_str());
+
+    if (bind(_fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0) {
+        std::cerr << "Error: Statistics socket bind failed." << std::endl;
+        close(_fd);
+        _fd = -1;
+        return 1;
+    }
+    _path = path;
+
+    // changing permissions for socket so munin can read data from it
+    if (chmod(path.c_str(), S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH) != 0
+        || listen(_fd, 5) < 0) {
+        std::cerr << "Error: Statistics socket setup failed." << std::endl;
+        stop();
+        return 1;
+    }
+
+    _stats = stats;
+    _stop = false;
+    _thread = std::thread(&Stats_server::run, this);
+    return 0;
+}
+
+void Stats_server::stop()
+{
+    _stop = true;
+    if (_thread.joinable())
+        _thread.join();
+    if (_fd >= 0)
+        close(_fd);
+    _fd = -1;
+    if (!_path.empty())
+        unlink(_path.c_str());
+    _path.clear();
+}
+
+std::string Stats_server::format() const
+{
+    std::ostringstream header;
+    std::ostringstream values;
+
+    for (std::size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        uint64_t sum = 0;
+        for (const Shard_stats *shard : _stats)
+            sum += (shard->*counters[i].counter).get();
+        header << (i ? "," : "") << counters[i].name;
+        values << (i ? "," : "") << sum;
+    }
+
+    histogram_header<decltype(Shard_stats::probe_length)::bucket_count>(header, "probe_length");
+    histogram_values(values, _stats, &Shard_stats::probe_length);
+    histogram_header<decltype(Shard_stats::record_latency_ns)::bucket_count>(header, "record_latency_ns");
+    histogram_values(values, _stats, &Shard_stats::record_latency_ns);
+
+    return header.str() + "\n" + values.str() + "\n";
+}
+
+void Stats_server::run()
+{
+    struct pollfd pfd;
+
+    pfd.fd = _fd;
+    pfd.events = POLLIN;
+
+    while (!_stop) {
+        if (poll(&pfd, 1, 500) <= 0)
+            continue;
+
+        int client_fd = accept(_fd, NULL, NULL);
+        if (client_fd < 0)
+            continue;
+        send_to_sock(client_fd, format());
+        close(client_fd);
+    }
+}
+
+} // namespace agg
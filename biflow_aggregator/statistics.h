@@ -0,0 +1,171 @@
+/**
+ * @file statistics.h
+ * @brief Runtime statistics of flow cache provided over UNIX socket.
+ * @version 1.0
+ * @date 17.10.2026
+ *
+ * @copyright Copyright (c) 2026 CESNET
+ */
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace agg {
+
+/**
+ * @brief Counter written by one thread and read by statistics thread.
+ *
+ * Owner thread updates counter without atomic read-modify-write instruction.
+ */
+class Counter {
+public:
+
+    Counter() : _value(0)
+    {
+    }
+
+    void add(uint64_t n = 1) noexcept
+    {
+        _value.store(_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void set(uint64_t value) noexcept
+    {
+        _value.store(value, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const noexcept
+    {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> _value;
+};
+
+/**
+ * @brief Histogram with power of two buckets.
+ *
+ * Bucket 0 counts zero values, bucket i counts values from 2^(i-1) to 2^i - 1,
+ * the last bucket counts also all bigger values.
+ */
+template<std::size_t N>
+class Histogram {
+public:
+
+    static constexpr std::size_t bucket_count = N;
+
+    void add(uint64_t value) noexcept
+    {
+        std::size_t index = value ? 64 - __builtin_clzll(value) : 0;
+        _buckets[index < N ? index : N - 1].add();
+    }
+
+    uint64_t get(std::size_t index) const noexcept
+    {
+        return _buckets[index].get();
+    }
+
+private:
+    Counter _buckets[N];
+};
+
+/**
+ * @brief Every period-th record is used to measure processing latency.
+ */
+constexpr uint64_t latency_sample_period = 64;
+
+/**
+ * @brief Size of cache line, used to separate statistics from data of other threads.
+ */
+constexpr std::size_t stats_cache_line_size = 64;
+
+/**
+ * @brief Statistics of one flow cache shard, written only by thread which owns the shard.
+ *
+ * Counters are padded from both sides, so statistics thread and other workers never
+ * share cache line with them.
+ */
+struct Shard_stats {
+    uint8_t _pad0[stats_cache_line_size];
+
+    Counter records;          ///< Aggregated records
+    Counter flows;            ///< Flows in flow cache
+    Counter capacity;         ///< Maximal number of flows in flow cache
+    Counter inserted;         ///< Created flows
+    Counter collisions;       ///< Flows exported because new flow took their place (SWAPPED)
+    Counter evictions;        ///< Flows exported because flow cache was full (FULL)
+    Counter passive_expired;  ///< Flows exported by passive timeout
+    Counter active_expired;   ///< Flows exported by active timeout
+    Counter flushed;          ///< Flows exported by global flush, format change or termination
+    Counter flush_count;      ///< Number of flushes
+    Counter flush_time_us;    ///< Total duration of flushes in microseconds
+    Counter slab_bytes;       ///< Memory held by slab allocator of aggregated data
+
+    /**
+     * @brief Distance of inserted or updated flow from its desired slot.
+     */
+    Histogram<8> probe_length;
+
+    /**
+     * @brief Processing time of sampled records in nanoseconds.
+     */
+    Histogram<24> record_latency_ns;
+
+    uint8_t _pad1[stats_cache_line_size];
+};
+
+/**
+ * @brief Thread which sends statistics of all shards to every client connected to UNIX socket.
+ *
+ * Client receives line with comma separated names followed by line with values, then
+ * the connection is closed (the same format as link_traffic module uses for munin).
+ */
+class Stats_server {
+public:
+
+    Stats_server();
+    ~Stats_server();
+
+    Stats_server(const Stats_server&) = delete;
+    Stats_server& operator=(const Stats_server&) = delete;
+
+    /**
+     * @brief Create socket and start thread.
+     *
+     * @param path  Path of UNIX socket
+     * @param stats Statistics of all shards, they must exist until stop() is called
+     * @return 0 on success, 1 on error
+     */
+    int start(const std::string& path, const std::vector<const Shard_stats *>& stats);
+
+    /**
+     * @brief Stop thread and remove socket.
+     */
+    void stop();
+
+    /**
+     * @brief Sum statistics of all shards and format them.
+     */
+    std::string format() const;
+
+private:
+    void run();
+
+    std::string _path;
+    int _fd;
+    std::atomic<bool> _stop;
+    std::thread _thread;
+    std::vector<const Shard_stats *> _stats;
+};
+
+} // namespace agg
+
+#endif // STATISTICS_H
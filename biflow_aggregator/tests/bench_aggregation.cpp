@@ -0,0 +1,121 @@
+/**
+ * @file bench_aggregation.cpp
+ * @brief Microbenchmark of per-record field aggregation.
+ * @version 1.0
+ * @date 17.10.2026
+ *
+ * Compares the previous per-record loop, which copied vector of all fields for every record,
+ * with the compiled aggregation plan. Built by `make check`, run as `./tests/bench_aggregation [records]`.
+ *
+ * @copyright Copyright (c) 2026 CESNET
+ */
+
+#include "../aggregator.h"
+#include "../aggregator_functions.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unirec/unirec.h>
+
+namespace {
+
+/**
+ * @brief Aggregation types used for generated fields, cycled in this order.
+ */
+const agg::Field_type bench_types[] = {agg::SUM, agg::MIN, agg::MAX, agg::LAST, agg::BIT_OR};
+
+/**
+ * @brief Aggregate record the way main loop did it before aggregation plan was introduced.
+ */
+void aggregate_copy(const agg::Fields& fields, const ur_template_t *tmplt, const void *in_data, uint8_t *ctx_data)
+{
+    std::vector<std::pair<agg::Field, std::size_t>> copy = fields.get_fields();
+    for (auto agg_field : copy) {
+        agg::Field *field = std::addressof(agg_field.first);
+        field->aggregate(ur_get_ptr_by_id(tmplt, in_data, field->ur_fid), std::addressof(ctx_data[agg_field.second]));
+    }
+}
+
+template<typename Func>
+double records_per_second(std::size_t records, Func func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < records; i++)
+        func();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return records / elapsed.count();
+}
+
+int run_bench(std::size_t field_cnt, std::size_t records)
+{
+    std::string tmplt_str;
+    agg::Fields fields;
+    agg::Aggregation_plan plan;
+
+    for (std::size_t i = 0; i < field_cnt; i++) {
+        std::string name = "BENCH_FIELD_" + std::to_string(i);
+        int id = ur_define_field(name.c_str(), UR_TYPE_UINT64);
+        if (id < 0) {
+            std::cerr << "Cannot define field " << name << std::endl;
+            return 1;
+        }
+        tmplt_str.append((i ? "," : "") + name);
+
+        agg::Field_config cfg = {};
+        cfg.name = name;
+        cfg.type = bench_types[i % (sizeof(bench_types) / sizeof(bench_types[0]))];
+        cfg.to_output = true;
+        agg::Field field(cfg, id, id, id, id);
+        fields.add_field(field);
+    }
+    plan.compile(fields);
+
+    ur_template_t *tmplt = ur_create_template(tmplt_str.c_str(), NULL);
+    if (tmplt == NULL) {
+        std::cerr << "Cannot create template" << std::endl;
+        return 1;
+    }
+    void *rec = ur_create_record(tmplt, 0);
+    for (const auto& agg_field : fields.get_fields())
+        *static_cast<uint64_t *>(ur_get_ptr_by_id(tmplt, rec, agg_field.first.ur_fid)) = agg_field.second + 1;
+
+    std::vector<uint8_t> ctx_data(fields.get_size());
+    fields.init(ctx_data.data());
+
+    double copy_rate = records_per_second(records, [&]() {
+        aggregate_copy(fields, tmplt, rec, ctx_data.data());
+    });
+    double plan_rate = records_per_second(records, [&]() {
+        plan.aggregate(tmplt, rec, ctx_data.data(), false);
+    });
+
+    std::cout << "fields=" << field_cnt
+              << " copy_records_per_s=" << static_cast<uint64_t>(copy_rate)
+              << " plan_records_per_s=" << static_cast<uint64_t>(plan_rate)
+              << " speedup=" << plan_rate / copy_rate << std::endl;
+
+    fields.deinit(ctx_data.data());
+    ur_free_record(rec);
+    ur_free_template(tmplt);
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t records = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 1000000;
+    int ret = 0;
+
+    for (std::size_t field_cnt : {10, 30, 60}) {
+        if ((ret = run_bench(field_cnt, records)) != 0)
+            break;
+    }
+
+    ur_finalize();
+    return ret;
+}
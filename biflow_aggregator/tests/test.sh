@@ -17,7 +17,8 @@ run_test_with_global_timeout() {
     local section=$4
     local config=$5
     local global_timeout=$6
-    (./biflow_aggregator -i "u:lr,u:ba" -e -c $config -n $section -g $global_timeout & ) || true
+    local threads=${7:-1}
+    (./biflow_aggregator -i "u:lr,u:ba" -e -c $config -n $section -g $global_timeout -t $threads & ) || true
     local AGGREGATOR_PID=$!
     sleep 0.5
     die_if_not_running $AGGREGATOR_PID "Failed to start biflow aggregator"
@@ -39,7 +40,13 @@ run_test_with_global_timeout() {
     kill $LOGGER_PID 2>/dev/null
     wait $LOGGER_PID
     
-    if ! diff $output $reference; then
+    if [ "$threads" -gt 1 ]; then
+        # Shards send their flows independently, only the set of records must match
+        if ! diff <(sort $output) <(sort $reference); then
+            echo $output doesnt match $reference
+            success="false"
+        fi
+    elif ! diff $output $reference; then
         echo $output doesnt match $reference
         success="false"
     fi
@@ -83,6 +90,9 @@ for input in "$script_path"/inputs/input*; do
     echo "Running test with absolute global timeout..."
     run_test_with_global_timeout $input ${output}_gt5a ${reference}_gt5a $section $config "5a"
 
+    echo "Running test with 4 worker threads..."
+    run_test_with_global_timeout $input ${output}_gt0_t4 ${reference}_gt0 $section $config "0" 4
+
 done
 
 if [ "$success" = "true" ]; then
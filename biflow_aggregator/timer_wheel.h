@@ -0,0 +1,334 @@
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timing wheel used to expire flows.
+ * @version 1.0
+ * @date 17.10.2026
+ *
+ * @copyright Copyright (c) 2026 CESNET
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+/**
+ * @brief Timer embedded in owner structure.
+ */
+template<typename T>
+struct Timer_node {
+    Timer_node *next;
+    Timer_node *prev;
+    time_t expire;   ///< Expiration time in seconds
+    uint64_t seq;    ///< Order of scheduling, timers with the same expiration fire in this order
+    uint8_t level;   ///< Wheel level which holds the timer
+    T *owner;        ///< Structure the timer belongs to
+};
+
+/**
+ * @brief Hierarchical timing wheel with one second resolution.
+ *
+ * Level 0 has one slot per second, every higher level has slots covering whole range
+ * of the level below. Timers from higher level are moved (cascaded) down when time reaches
+ * their slot. Schedule, cancel and expire are O(1). Cascaded timers are inserted before timers
+ * scheduled after them, so the slot keeps scheduling order. Timers scheduled to time which
+ * was already processed are appended to separate overdue list. Timers appended since the last
+ * advance are sorted by expiration time and merged into already sorted part of the list by the next advance.
+ */
+template<typename T>
+class Timer_wheel {
+public:
+    using Node = Timer_node<T>;
+
+    Timer_wheel() : _next(0), _seq(0)
+    {
+        clear();
+    }
+
+    Timer_wheel(const Timer_wheel&) = delete;
+    Timer_wheel& operator=(const Timer_wheel&) = delete;
+
+    /**
+     * @brief Insert timer to wheel.
+     *
+     * @param node   Timer which is not scheduled
+     * @param expire Expiration time
+     */
+    void schedule(Node *node, time_t expire) noexcept
+    {
+        node->expire = expire;
+        node->seq = _seq++;
+        add(node);
+    }
+
+    /**
+     * @brief Remove timer from wheel.
+     *
+     * @param node Scheduled timer
+     */
+    void cancel(Node *node) noexcept
+    {
+        if (node == _unsorted)
+            _unsorted = node->next != &_overdue ? node->next : nullptr;
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        _count[node->level]--;
+    }
+
+    /**
+     * @brief Change expiration time of scheduled timer.
+     */
+    void reschedule(Node *node, time_t expire) noexcept
+    {
+        cancel(node);
+        schedule(node, expire);
+    }
+
+    /**
+     * @brief Expire all timers with expiration time lower or equal to given time.
+     *
+     * Expired timers are removed from wheel before expire_fnc is called with their owner.
+     *
+     * @param now        Current time
+     * @param expire_fnc Function called for every expired timer
+     */
+    template<typename Func>
+    void advance(time_t now, Func expire_fnc)
+    {
+        Node *head = &_overdue;
+
+        if (_unsorted != nullptr)
+            sort_overdue();
+        while (head->next != head && head->next->expire <= now)
+            expire(head->next, expire_fnc);
+
+        while (_next <= now) {
+            if (wheel_count() == 0) {
+                _next = now + 1;
+                break;
+            }
+
+            std::size_t index = _next & slot_mask;
+            if (index == 0) {
+                cascade();
+            } else if (_count[0] == 0) {
+                // Nothing to expire on the lowest level, skip to its end
+                time_t boundary = (_next | slot_mask) + 1;
+                _next = boundary <= now ? boundary : now + 1;
+                continue;
+            }
+
+            head = &_slots[0][index];
+            while (head->next != head)
+                expire(head->next, expire_fnc);
+            _next++;
+        }
+    }
+
+    /**
+     * @brief Remove all timers without expiration.
+     */
+    void clear() noexcept
+    {
+        for (std::size_t level = 0; level < levels; level++) {
+            for (std::size_t index = 0; index < slot_count; index++)
+                init_head(&_slots[level][index]);
+        }
+        init_head(&_overdue);
+        _unsorted = nullptr;
+        for (std::size_t level = 0; level <= levels; level++)
+            _count[level] = 0;
+        _next = 0;
+    }
+
+    /**
+     * @brief Remove all timers and set time of last processed second.
+     */
+    void reset(time_t now) noexcept
+    {
+        clear();
+        _next = now + 1;
+    }
+
+    /**
+     * @brief Get number of scheduled timers.
+     */
+    std::size_t size() const noexcept
+    {
+        return wheel_count() + _count[levels];
+    }
+
+private:
+
+    static constexpr std::size_t levels = 4;
+    static constexpr std::size_t slot_bits = 6;
+    static constexpr std::size_t slot_count = std::size_t(1) << slot_bits;
+    static constexpr std::size_t slot_mask = slot_count - 1;
+
+    /**
+     * @brief Maximal distance of expiration from current time, farther timers are cascaded repeatedly.
+     */
+    static constexpr uint64_t max_delta = (uint64_t(1) << (slot_bits * levels)) - 1;
+
+    /**
+     * @brief Level index used for list of overdue timers.
+     */
+    static constexpr uint8_t overdue_level = levels;
+
+    static void init_head(Node *head) noexcept
+    {
+        head->next = head;
+        head->prev = head;
+        head->owner = nullptr;
+    }
+
+    std::size_t wheel_count() const noexcept
+    {
+        std::size_t count = 0;
+        for (std::size_t level = 0; level < levels; level++)
+            count += _count[level];
+        return count;
+    }
+
+    template<typename Func>
+    void expire(Node *node, Func& expire_fnc)
+    {
+        cancel(node);
+        expire_fnc(node->owner);
+    }
+
+    /**
+     * @brief Insert timer to slot given by its expiration time.
+     *
+     * Timers in slot are ordered by scheduling order. Newly scheduled timers always go
+     * to the end of list, overdue timers are ordered later by sort_overdue().
+     */
+    void add(Node *node) noexcept
+    {
+        Node *head;
+
+        if (node->expire < _next) {
+            node->level = overdue_level;
+            insert_after(_overdue.prev, node);
+            if (_unsorted == nullptr)
+                _unsorted = node;
+            return;
+        }
+
+        uint64_t delta = node->expire - _next;
+        uint64_t expire = node->expire;
+        if (delta > max_delta) {
+            delta = max_delta;
+            expire = _next + max_delta;
+        }
+
+        std::size_t level = 0;
+        while (delta >= (uint64_t(1) << (slot_bits * (level + 1))))
+            level++;
+
+        head = &_slots[level][(expire >> (slot_bits * level)) & slot_mask];
+        node->level = level;
+        Node *pos = head->prev;
+        while (pos != head && pos->seq > node->seq)
+            pos = pos->prev;
+        insert_after(pos, node);
+    }
+
+    void insert_after(Node *pos, Node *node) noexcept
+    {
+        node->prev = pos;
+        node->next = pos->next;
+        pos->next->prev = node;
+        pos->next = node;
+        _count[node->level]++;
+    }
+
+    static bool is_earlier(const Node *a, const Node *b) noexcept
+    {
+        return a->expire < b->expire || (a->expire == b->expire && a->seq < b->seq);
+    }
+
+    /**
+     * @brief Order overdue timers by expiration time and scheduling order.
+     *
+     * Only timers appended since the last sort are sorted, then they are merged into sorted
+     * part of the list from its end, so older timers are visited only if newer ones precede them.
+     */
+    void sort_overdue()
+    {
+        Node *head = &_overdue;
+        Node *pos = _unsorted->prev;
+
+        _sorted.clear();
+        for (Node *node = _unsorted; node != head; node = node->next)
+            _sorted.push_back(node);
+        std::sort(_sorted.begin(), _sorted.end(), is_earlier);
+        _unsorted = nullptr;
+
+        // Detach unsorted part and insert its timers from the latest one
+        pos->next = head;
+        head->prev = pos;
+        for (auto it = _sorted.rbegin(); it != _sorted.rend(); ++it) {
+            Node *node = *it;
+            while (pos != head && is_earlier(node, pos))
+                pos = pos->prev;
+            node->prev = pos;
+            node->next = pos->next;
+            pos->next->prev = node;
+            pos->next = node;
+        }
+    }
+
+    /**
+     * @brief Move timers of current slots of higher levels down.
+     */
+    void cascade() noexcept
+    {
+        for (std::size_t level = 1; level < levels; level++) {
+            std::size_t index = (static_cast<uint64_t>(_next) >> (slot_bits * level)) & slot_mask;
+            Node *head = &_slots[level][index];
+            Node *node = head->next;
+
+            init_head(head);
+            while (node != head) {
+                Node *next = node->next;
+                _count[level]--;
+                add(node);
+                node = next;
+            }
+            if (index != 0)
+                break;
+        }
+    }
+
+    Node _slots[levels][slot_count];
+    Node _overdue;
+
+    /**
+     * @brief First overdue timer appended since the last sort, nullptr if there is none.
+     */
+    Node *_unsorted;
+
+    /**
+     * @brief Buffer reused to sort overdue timers.
+     */
+    std::vector<Node *> _sorted;
+
+    /**
+     * @brief Next second to process.
+     */
+    time_t _next;
+
+    uint64_t _seq;
+
+    /**
+     * @brief Number of timers on every level, last item is number of overdue timers.
+     */
+    std::size_t _count[levels + 1];
+};
+
+#endif // TIMER_WHEEL_H
@@ -17,15 +17,19 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <getopt.h>
 #include <time.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
 
 #include <libtrap/trap.h>
 #include <unirec/unirec.h>
 #include "fields.h"
+#include "spsc_ring.h"
 
 // Struct with information about module
 trap_module_info_t *module_info = NULL;
@@ -50,45 +54,117 @@ static ur_template_t **in_template; // UniRec template of input interface(s)
 static ur_template_t *out_template; // UniRec template of output interface
 static void *out_rec = NULL;
 
-pthread_mutex_t unirec_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define RING_SIZE (1 << 22)    // Size of ring of each input in bytes
+#define SENDER_BATCH 64         // Maximal number of messages taken from one input at once
+#define SENDER_WAIT_MS 100      // Maximal time of sleeping of sender without notification
+
+#define MSG_RECORD 0            // Payload is UniRec record
+#define MSG_FORMAT 1            // Payload is new UniRec specifier of input, it starts new epoch
+
+/**
+ * State of one input interface.
+ *
+ * Capture thread receives records and pushes them to its ring, records are
+ * copied to output and sent by single sender thread, which is the only thread
+ * that manipulates UniRec templates (they are not thread-safe). Every change of
+ * input format starts new epoch, the new specifier is passed through the ring
+ * before the records of the epoch, so each record is processed with the template
+ * of its epoch and no locks are needed on the per-record path.
+ */
+typedef struct input_s {
+   spsc_ring_t ring;
+   int index;
+   uint32_t epoch;         // Current epoch of capture thread
+   uint32_t sender_epoch;  // Epoch of in_template[index], used by sender thread only
+   int finished;           // Set by capture thread when it pushed its last message
+   int done;               // Set by sender thread when all messages of finished input were sent
+} input_t;
+
+static input_t *inputs = NULL;
 pthread_t *thr_list = NULL;
-int *thr_init = NULL;
+int thr_cnt = 0;
+
+static sem_t sender_wakeup;
+static int sender_sleeping = 0;
 
 /**
- * Capture thread to receive incomming messages and send them via
- * shared output interface.
+ * Wake up sender thread if it is sleeping, called after every pushed message.
  *
- * @param [in] index Index of the given link.
+ * The flag is checked without a fence, so the check can be ordered before the push and miss
+ * sender which is just going to sleep. Such message waits at most SENDER_WAIT_MS, or only
+ * until the next message of any input, which sees the flag.
+ */
+static void wake_sender(void)
+{
+   if (__atomic_load_n(&sender_sleeping, __ATOMIC_RELAXED) &&
+       __atomic_exchange_n(&sender_sleeping, 0, __ATOMIC_ACQ_REL)) {
+      sem_post(&sender_wakeup);
+   }
+}
+
+/**
+ * Wake up sender thread without delay, used when input finishes and no more messages follow.
+ */
+static void wake_sender_sync(void)
+{
+   /* Pairs with fence in wait_for_messages(), either sender sees the change or we see the flag */
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   wake_sender();
+}
+
+/**
+ * Push message to ring of the input, wait while the ring is full.
+ *
+ * \return 0 on success, -1 if module was stopped
+ */
+static int push_message(input_t *input, uint16_t type, const void *data, uint32_t size)
+{
+   while (!spsc_ring_push(&input->ring, type, input->epoch, data, size)) {
+      if (stop) {
+         return -1;
+      }
+      wake_sender();
+      sched_yield();
+   }
+   wake_sender();
+   return 0;
+}
+
+/**
+ * Capture thread to receive incomming messages and pass them to sender thread.
+ *
+ * @param [in] arg Pointer to input_t of the given link.
  */
 void *capture_thread(void *arg)
 {
-   int index = (*((int *) arg)) - 1;
-   int private_stop = 0;
+   input_t *input = (input_t *) arg;
+   int index = input->index;
    int ret;
    const void *rec;
    uint16_t rec_size;
    uint8_t data_fmt = TRAP_FMT_UNKNOWN;
    const char *spec = NULL;
 
-   if (index < 0) {
-      fprintf(stderr, "Illegal thread index number.\n");
-      pthread_exit(NULL);
-   }
-
    if (verbose >= 0) {
       fprintf(stderr, "Thread %i started.\n", index);
    }
 
    trap_ifcctl(TRAPIFC_INPUT, index, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
 
-   // Read data from input and log them to a file
-   while (!stop && !private_stop) {
+   // Read data from input and pass them to sender
+   while (!stop) {
       if (verbose >= 2) {
          printf("Thread %i: calling trap_recv()\n", index);
       }
 
       // Receive data from index-th input interface, wait until data are available
       ret = trap_recv(index, &rec, &rec_size);
+      if (ret != TRAP_E_OK && ret != TRAP_E_FORMAT_CHANGED) {
+         if (ret != TRAP_E_TERMINATED) {
+            fprintf(stderr, "Error: trap_recv() returned %i (%s) in thread #%i\n", ret, trap_last_error_msg, index);
+         }
+         break;
+      }
 
       if (verbose >= 2) {
          printf("Thread %i: received %hu bytes of data\n", index, rec_size);
@@ -100,26 +176,58 @@ void *capture_thread(void *arg)
             fprintf(stderr, "Interface %i received ending record, the interface will be closed.\n", index);
          }
          if (!ignoreineof) {
-            private_stop = 1;
             break;
          }
+         continue;
       }
 
-      /* critical section of UniRec manipulation */
-      pthread_mutex_lock(&unirec_mutex);
-      if (ret == TRAP_E_FORMAT_CHANGED || in_template[index] == NULL) {
+      if (ret == TRAP_E_FORMAT_CHANGED || input->epoch == 0) {
          if (trap_get_data_fmt(TRAPIFC_INPUT, index, &data_fmt, &spec) != TRAP_E_OK) {
             fprintf(stderr, "Data format was not loaded in thread #%i.\n", index);
-            goto unlock_thread_exit;
+            break;
          }
-         in_template[index] = ur_define_fields_and_update_template(spec, in_template[index]);
-         if (!in_template[index]) {
-            fprintf(stderr, "Template could not be updated in thread #%i\n", index);
-            goto unlock_thread_exit;
+         input->epoch++;
+         if (push_message(input, MSG_FORMAT, spec, strlen(spec) + 1) != 0) {
+            break;
          }
+      }
+
+      if (push_message(input, MSG_RECORD, rec, rec_size) != 0) {
+         break;
+      }
+   } // end while(!stop)
+
+   __atomic_store_n(&input->finished, 1, __ATOMIC_RELEASE);
+   wake_sender_sync();
+
+   if (verbose >= 1) {
+      printf("Thread %i exiting.\n", index);
+   }
 
+   return NULL;
+}
+
+/**
+ * Update templates according to new input format or copy record to output and send it.
+ *
+ * \return 0 on success, -1 on error
+ */
+static int process_message(input_t *input, const spsc_msg_t *msg)
+{
+   int index = input->index;
+   int ret;
+
+   if (msg->type == MSG_FORMAT) {
+      const char *spec = spsc_msg_data(msg);
+
+      in_template[index] = ur_define_fields_and_update_template(spec, in_template[index]);
+      if (!in_template[index]) {
+         fprintf(stderr, "Template could not be updated for interface #%i\n", index);
+         return -1;
       }
-      if (user_output_tmplt == 0 && ret == TRAP_E_FORMAT_CHANGED) {
+      input->sender_epoch = msg->epoch;
+
+      if (user_output_tmplt == 0) {
          /* Expand output template - add new fields from input */
          if (out_rec != NULL) {
             free(out_rec);
@@ -130,49 +238,135 @@ void *capture_thread(void *arg)
          char *spec_cpy = ur_template_string(out_template);
          if (spec_cpy == NULL) {
             fprintf(stderr, "Memory allocation problem.");
-            goto unlock_thread_exit;
+            return -1;
          }
          trap_set_data_fmt(0, TRAP_FMT_UNIREC, spec_cpy);
 
          out_rec = ur_create_record(out_template, UR_MAX_SIZE);
          if (out_rec == NULL) {
             fprintf(stderr, "ERROR: Allocation of record failed.\n");
-            goto unlock_thread_exit;
+            return -1;
          }
       } else {
-         /* Do nothing with output template, it was already set or set by User */
+         /* Do nothing with output template, it was set by User */
       }
+      return 0;
+   }
 
-      /* clear the previous output message */
-      memset(out_rec, 0, ur_rec_size(out_template, out_rec));
+   /* Messages of one input are ordered, so record always follows specifier of its epoch */
+   if (msg->epoch != input->sender_epoch) {
+      fprintf(stderr, "Error: record of epoch %u received with template of epoch %u on interface #%i\n",
+              msg->epoch, input->sender_epoch, index);
+      return -1;
+   }
 
-      ur_copy_fields(out_template, out_rec, in_template[index], rec);
+   /* clear the previous output message */
+   memset(out_rec, 0, ur_rec_size(out_template, out_rec));
 
-      ret = trap_send(0, out_rec, ur_rec_size(out_template, out_rec));
-      pthread_mutex_unlock(&unirec_mutex);
-      /* end of critical section of UniRec manipulation by multiple threads */
+   ur_copy_fields(out_template, out_rec, in_template[index], spsc_msg_data(msg));
 
-      if (ret != TRAP_E_OK) {
-         if (ret != TRAP_E_TERMINATED) {
-            // Some error has occured
-            fprintf(stderr, "Error: trap_send() returned %i (%s)\n", ret, trap_last_error_msg);
-         }
-         private_stop = 1; // Module was terminated while waiting for new data (e.g. by Ctrl-C)
-         break;
+   ret = trap_send(0, out_rec, ur_rec_size(out_template, out_rec));
+   if (ret != TRAP_E_OK) {
+      if (ret != TRAP_E_TERMINATED) {
+         // Some error has occured
+         fprintf(stderr, "Error: trap_send() returned %i (%s)\n", ret, trap_last_error_msg);
       }
+      return -1;
+   }
+   return 0;
+}
 
-   } // end while(!stop && !private_stop)
+/**
+ * Check if sender has anything to do.
+ */
+static int messages_pending(void)
+{
+   for (int i = 0; i < module_info->num_ifc_in; i++) {
+      if (!inputs[i].done && (__atomic_load_n(&inputs[i].finished, __ATOMIC_ACQUIRE) || !spsc_ring_empty(&inputs[i].ring))) {
+         return 1;
+      }
+   }
+   return 0;
+}
 
-   if (verbose >= 1) {
-      printf("Thread %i exiting.\n", index);
+/**
+ * Sleep until some capture thread pushes a message or finishes.
+ */
+static void wait_for_messages(void)
+{
+   struct timespec ts;
+
+   __atomic_store_n(&sender_sleeping, 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+   /* Message could be pushed before the flag was set */
+   if (!messages_pending()) {
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_nsec += SENDER_WAIT_MS * 1000000L;
+      if (ts.tv_nsec >= 1000000000L) {
+         ts.tv_sec += 1;
+         ts.tv_nsec -= 1000000000L;
+      }
+      sem_timedwait(&sender_wakeup, &ts);
+   }
+
+   __atomic_store_n(&sender_sleeping, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sender thread takes messages from rings of all inputs in round robin and
+ * sends them via output interface. It exits when all capture threads finished
+ * and their messages were sent.
+ */
+void *sender_thread(void *arg)
+{
+   const spsc_msg_t *msg;
+   int active = module_info->num_ifc_in;
+   int idle;
+
+   (void) arg;
+
+   while (active > 0) {
+      idle = 1;
+      active = 0;
+
+      for (int i = 0; i < module_info->num_ifc_in; i++) {
+         input_t *input = &inputs[i];
+
+         if (input->done) {
+            continue;
+         }
+
+         /* Flag has to be read before the ring, all messages pushed before it are visible then */
+         int finished = __atomic_load_n(&input->finished, __ATOMIC_ACQUIRE);
+
+         msg = NULL;
+         for (int batch = 0; batch < SENDER_BATCH && (msg = spsc_ring_front(&input->ring)) != NULL; batch++) {
+            if (process_message(input, msg) != 0) {
+               goto stop_module;
+            }
+            spsc_ring_pop(&input->ring);
+            idle = 0;
+         }
+
+         if (finished && msg == NULL) {
+            input->done = 1;
+         } else {
+            active++;
+         }
+      }
+
+      if (idle && active > 0) {
+         wait_for_messages();
+      }
    }
 
-   pthread_exit(NULL);
    return NULL;
 
-unlock_thread_exit:
-   pthread_mutex_unlock(&unirec_mutex);
-   pthread_exit(NULL);
+stop_module:
+   /* Capture threads waiting for data or for space in ring have to be stopped */
+   stop = 1;
+   trap_terminate();
    return NULL;
 }
 
@@ -362,32 +556,64 @@ int main(int argc, char **argv)
       }
    }
 
-   /* Prepare list of threads */
+   /* Prepare list of threads and rings of inputs */
    thr_list = calloc(module_info->num_ifc_in, sizeof(thr_list[0]));
-   thr_init = calloc(module_info->num_ifc_in, sizeof(thr_init[0]));
+   inputs = calloc(module_info->num_ifc_in, sizeof(inputs[0]));
 
-   if (thr_list == NULL || thr_init == NULL) {
+   if (thr_list == NULL || inputs == NULL) {
       goto exit_clean_template;
    }
 
-   /* Start a thread for each interface that will receive messages and send
-    * them via common output IFC */
    for (i = 0; i < module_info->num_ifc_in; ++i) {
-      thr_init[i] = i + 1;
-      if (pthread_create(&thr_list[i], NULL, capture_thread, &thr_init[i]) != 0) {
+      inputs[i].index = i;
+      /* Templates received by set_output_by_first_message() belong to the first epoch */
+      inputs[i].epoch = (in_template[i] != NULL) ? 1 : 0;
+      inputs[i].sender_epoch = inputs[i].epoch;
+      if (spsc_ring_init(&inputs[i].ring, RING_SIZE) != 0) {
+         fprintf(stderr, "Error: allocation of rings failed.\n");
+         goto exit_clean_template;
+      }
+   }
+
+   if (sem_init(&sender_wakeup, 0, 0) != 0) {
+      fprintf(stderr, "Error: semaphore could not be initialized.\n");
+      goto exit_clean_template;
+   }
+
+   /* Start a thread for each interface that will receive messages and pass
+    * them to a single thread sending them via common output IFC */
+   pthread_t sender;
+   if (pthread_create(&sender, NULL, sender_thread, NULL) != 0) {
+      fprintf(stderr, "Error: could not create sender thread.\n");
+      sem_destroy(&sender_wakeup);
+      goto exit_clean_template;
+   }
+
+   for (thr_cnt = 0; thr_cnt < module_info->num_ifc_in; ++thr_cnt) {
+      if (pthread_create(&thr_list[thr_cnt], NULL, capture_thread, &inputs[thr_cnt]) != 0) {
          fprintf(stderr, "Interrupted creation of threads due to failure.\n");
-         thr_init[i] = 0;
          break;
       }
    }
 
-   for (i = 0; i < module_info->num_ifc_in; ++i) {
-      if (thr_init[i] > 0 && pthread_join(thr_list[i], NULL) != 0) {
+   /* Inputs without thread will never send anything */
+   for (i = thr_cnt; i < module_info->num_ifc_in; ++i) {
+      __atomic_store_n(&inputs[i].finished, 1, __ATOMIC_RELEASE);
+   }
+   wake_sender_sync();
+
+   for (i = 0; i < thr_cnt; ++i) {
+      if (pthread_join(thr_list[i], NULL) != 0) {
          /* error */
          fprintf(stderr, "Error: could not join thread %d.\n", i);
       }
    }
 
+   if (pthread_join(sender, NULL) != 0) {
+      fprintf(stderr, "Error: could not join sender thread.\n");
+   }
+   sem_destroy(&sender_wakeup);
+
    ret = 0;
 
    // ***** Cleanup *****
@@ -402,6 +628,12 @@ int main(int argc, char **argv)
    }
 
 exit_clean_template:
+   if (inputs != NULL) {
+      for (i = 0; i < module_info->num_ifc_in; i++) {
+         spsc_ring_destroy(&inputs[i].ring);
+      }
+      free(inputs);
+   }
    if (in_template != NULL) {
       for (i = 0; i < module_info->num_ifc_in; i++) {
          ur_free_template(in_template[i]);
@@ -416,7 +648,6 @@ exit:
    TRAP_DEFAULT_FINALIZATION()
    FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
    free(thr_list);
-   free(thr_init);
    free(out_rec);
 
    return ret;
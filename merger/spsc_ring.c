@@ -0,0 +1,121 @@
+/**
+ * \file spsc_ring.c
+ * \brief Lock-free single producer single consumer ring of variable sized messages.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "spsc_ring.h"
+
+/* Message type reserved for padding at the end of buffer */
+#define SPSC_RING_PADDING UINT16_MAX
+
+static inline size_t aligned_size(size_t size)
+{
+   return (sizeof(spsc_msg_t) + size + sizeof(spsc_msg_t) - 1) / sizeof(spsc_msg_t) * sizeof(spsc_msg_t);
+}
+
+static inline spsc_msg_t *message_at(const spsc_ring_t *ring, size_t offset)
+{
+   return (spsc_msg_t *) (ring->buffer + offset);
+}
+
+int spsc_ring_init(spsc_ring_t *ring, size_t capacity)
+{
+   memset(ring, 0, sizeof(*ring));
+
+   if (capacity < sizeof(spsc_msg_t) || (capacity & (capacity - 1)) != 0) {
+      return -1;
+   }
+
+   ring->buffer = aligned_alloc(SPSC_RING_CACHE_LINE, capacity);
+   if (ring->buffer == NULL) {
+      return -1;
+   }
+   ring->capacity = capacity;
+   ring->mask = capacity - 1;
+   return 0;
+}
+
+void spsc_ring_destroy(spsc_ring_t *ring)
+{
+   free(ring->buffer);
+   ring->buffer = NULL;
+}
+
+int spsc_ring_push(spsc_ring_t *ring, uint16_t type, uint32_t epoch, const void *data, uint32_t size)
+{
+   size_t entry_size = aligned_size(size);
+   size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+   size_t offset = tail & ring->mask;
+   size_t padding = (offset + entry_size > ring->capacity) ? ring->capacity - offset : 0;
+   spsc_msg_t *msg;
+
+   if (padding + entry_size > ring->capacity - (tail - ring->cached_head)) {
+      ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+      if (padding + entry_size > ring->capacity - (tail - ring->cached_head)) {
+         return 0;
+      }
+   }
+
+   if (padding) {
+      msg = message_at(ring, offset);
+      msg->type = SPSC_RING_PADDING;
+      msg->size = padding - sizeof(spsc_msg_t);
+      tail += padding;
+      offset = 0;
+   }
+
+   msg = message_at(ring, offset);
+   msg->size = size;
+   msg->type = type;
+   msg->epoch = epoch;
+   if (size) {
+      memcpy(msg + 1, data, size);
+   }
+
+   __atomic_store_n(&ring->tail, tail + entry_size, __ATOMIC_RELEASE);
+   return 1;
+}
+
+const spsc_msg_t *spsc_ring_front(spsc_ring_t *ring)
+{
+   size_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+   for (;;) {
+      if (head == ring->cached_tail) {
+         ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+         if (head == ring->cached_tail) {
+            return NULL;
+         }
+      }
+
+      const spsc_msg_t *msg = message_at(ring, head & ring->mask);
+      if (msg->type != SPSC_RING_PADDING) {
+         return msg;
+      }
+
+      head += aligned_size(msg->size);
+      __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+   }
+}
+
+void spsc_ring_pop(spsc_ring_t *ring)
+{
+   size_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+   __atomic_store_n(&ring->head, head + aligned_size(message_at(ring, head & ring->mask)->size), __ATOMIC_RELEASE);
+}
+
+int spsc_ring_empty(spsc_ring_t *ring)
+{
+   return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,110 @@
+/**
+ * \file spsc_ring.h
+ * \brief Lock-free single producer single consumer ring of variable sized messages.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPSC_RING_CACHE_LINE 64
+
+/**
+ * Message header, payload of size bytes follows it.
+ */
+typedef struct spsc_msg_s {
+   uint32_t size;     ///< Size of the payload
+   uint16_t type;     ///< User defined message type
+   uint16_t reserved;
+   uint32_t epoch;    ///< User defined version of payload format
+   uint32_t reserved2;
+} spsc_msg_t;
+
+/**
+ * Ring buffer used to pass messages from one producer thread to one consumer thread.
+ *
+ * Messages are stored back-to-back in one contiguous buffer. When a message does not
+ * fit to the end of the buffer, padding message is inserted and the message is stored
+ * from the beginning of the buffer. Positions of producer and consumer are kept in
+ * separate cache lines together with cached copy of the other one, so shared variables
+ * are read only when the cached value is not sufficient.
+ */
+typedef struct spsc_ring_s {
+   uint8_t *buffer;
+   size_t capacity;
+   size_t mask;
+
+   uint8_t pad0[SPSC_RING_CACHE_LINE];
+
+   size_t head;         ///< Consumer position
+   size_t cached_tail;
+
+   uint8_t pad1[SPSC_RING_CACHE_LINE];
+
+   size_t tail;         ///< Producer position
+   size_t cached_head;
+
+   uint8_t pad2[SPSC_RING_CACHE_LINE];
+} spsc_ring_t;
+
+/**
+ * Allocate buffer of the ring.
+ *
+ * \param [in] ring Ring to initialize.
+ * \param [in] capacity Size of ring in bytes, power of 2.
+ * \return 0 on success, -1 on error
+ */
+int spsc_ring_init(spsc_ring_t *ring, size_t capacity);
+
+/**
+ * Free buffer of the ring.
+ */
+void spsc_ring_destroy(spsc_ring_t *ring);
+
+/**
+ * Insert new message to ring. Called by producer only.
+ *
+ * \param [in] ring Ring.
+ * \param [in] type Message type.
+ * \param [in] epoch Message epoch.
+ * \param [in] data Pointer to payload.
+ * \param [in] size Size of payload.
+ * \return 1 if message was inserted, 0 if there is not enough space in ring
+ */
+int spsc_ring_push(spsc_ring_t *ring, uint16_t type, uint32_t epoch, const void *data, uint32_t size);
+
+/**
+ * Get the oldest message in ring. Called by consumer only.
+ *
+ * \return Pointer to message or NULL if ring is empty.
+ */
+const spsc_msg_t *spsc_ring_front(spsc_ring_t *ring);
+
+/**
+ * Remove the oldest message returned by spsc_ring_front(). Called by consumer only.
+ */
+void spsc_ring_pop(spsc_ring_t *ring);
+
+/**
+ * Check if ring is empty, it can be called by any thread.
+ */
+int spsc_ring_empty(spsc_ring_t *ring);
+
+/**
+ * Get pointer to message payload.
+ */
+static inline const void *spsc_msg_data(const spsc_msg_t *msg)
+{
+   return msg + 1;
+}
+
+#endif /* SPSC_RING_H */
@@ -0,0 +1,113 @@
+/**
+ * \file select.c
+ * \brief Partial sorting used to get top N entries without sorting all of them.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "select.h"
+
+static inline void swap_elements(uint8_t *a, uint8_t *b, uint8_t *tmp, size_t size)
+{
+   memcpy(tmp, a, size);
+   memcpy(a, b, size);
+   memcpy(b, tmp, size);
+}
+
+size_t partial_sort(void *base, size_t nmemb, size_t size, size_t n, int (*compar)(const void *, const void *))
+{
+   uint8_t *array = base;
+   uint8_t tmp[size];
+   uint8_t pivot[size];
+   ptrdiff_t lo = 0;
+   ptrdiff_t hi = (ptrdiff_t) nmemb - 1;
+   ptrdiff_t k = (ptrdiff_t) n - 1;
+
+   if (n == 0 || nmemb == 0) {
+      return 0;
+   }
+   if (n >= nmemb) {
+      qsort(base, nmemb, size, compar);
+      return nmemb;
+   }
+
+   while (lo < hi) {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      ptrdiff_t i = lo - 1;
+      ptrdiff_t j = hi + 1;
+
+      /* Median of three is used as pivot */
+      if (compar(array + mid * size, array + lo * size) < 0) {
+         swap_elements(array + mid * size, array + lo * size, tmp, size);
+      }
+      if (compar(array + hi * size, array + lo * size) < 0) {
+         swap_elements(array + hi * size, array + lo * size, tmp, size);
+      }
+      if (compar(array + hi * size, array + mid * size) < 0) {
+         swap_elements(array + hi * size, array + mid * size, tmp, size);
+      }
+      memcpy(pivot, array + mid * size, size);
+
+      for (;;) {
+         do {
+            i++;
+         } while (compar(array + i * size, pivot) < 0);
+         do {
+            j--;
+         } while (compar(array + j * size, pivot) > 0);
+         if (i >= j) {
+            break;
+         }
+         swap_elements(array + i * size, array + j * size, tmp, size);
+      }
+
+      /* Elements lo..j are not bigger than pivot, j+1..hi are not smaller */
+      if (k <= j) {
+         hi = j;
+      } else {
+         lo = j + 1;
+      }
+   }
+
+   qsort(base, n, size, compar);
+   return n;
+}
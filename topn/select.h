@@ -0,0 +1,62 @@
+/**
+ * \file select.h
+ * \brief Partial sorting used to get top N entries without sorting all of them.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef _SELECT_
+#define _SELECT_
+
+#include <stddef.h>
+
+/**
+* \brief Function moves n smallest elements (according to compar) to the beginning of array and sorts them.
+*
+* Elements are selected by quickselect with Hoare partitioning (expected linear time, equal elements do not slow it down) and only the selected elements are sorted by qsort. Order of the other elements is unspecified. Arguments are the same as of qsort.
+*
+* \param base Array of elements.
+* \param nmemb Number of elements in array.
+* \param size Size of element.
+* \param n Number of elements to select.
+* \param compar Comparison function, same as for qsort.
+* \return Number of selected elements, that is min(n, nmemb).
+*/
+size_t partial_sort(void *base, size_t nmemb, size_t size, size_t n, int (*compar)(const void *, const void *));
+
+#endif /* _SELECT_ */
@@ -0,0 +1,341 @@
+/**
+ * \file space_saving.c
+ * \brief Space-Saving summary of heavy hitters with bounded error.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "select.h"
+#include "space_saving.h"
+
+/* Size of hash index per counter, keeps load factor of the index at most 0.5 */
+#define SS_INDEX_RATIO 2
+
+#define SS_CACHE_LINE 64
+
+uint32_t ss_hash(const void *key, uint32_t key_size)
+{
+   const uint8_t *ptr = key;
+   uint64_t hash = 0x9e3779b97f4a7c15ULL ^ key_size;
+   uint64_t word;
+
+   while (key_size >= 8) {
+      memcpy(&word, ptr, 8);
+      hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+      hash ^= hash >> 32;
+      ptr += 8;
+      key_size -= 8;
+   }
+   if (key_size > 0) {
+      word = 0;
+      memcpy(&word, ptr, key_size);
+      hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+   }
+
+   hash ^= hash >> 33;
+   hash *= 0xc4ceb9fe1a85ec53ULL;
+   hash ^= hash >> 33;
+   return (uint32_t) hash;
+}
+
+static inline uint8_t *ss_key(const ss_table_t *table, uint32_t counter)
+{
+   return table->keys + (size_t) counter * table->key_size;
+}
+
+static void ss_sift_up(ss_table_t *table, uint32_t pos)
+{
+   ss_heap_node_t node = table->heap[pos];
+
+   while (pos > 0) {
+      uint32_t parent = (pos - 1) / 4;
+
+      if (table->heap[parent].count <= node.count) {
+         break;
+      }
+      table->heap[pos] = table->heap[parent];
+      table->counters[table->heap[pos].counter].heap_index = pos;
+      pos = parent;
+   }
+   table->heap[pos] = node;
+   table->counters[node.counter].heap_index = pos;
+}
+
+static void ss_sift_down(ss_table_t *table, uint32_t pos)
+{
+   ss_heap_node_t node = table->heap[pos];
+
+   for (;;) {
+      uint32_t first = 4 * pos + 1;
+      uint32_t last = first + 4 < table->size ? first + 4 : table->size;
+      uint32_t smallest = first;
+
+      if (first >= table->size) {
+         break;
+      }
+      for (uint32_t child = first + 1; child < last; child++) {
+         if (table->heap[child].count < table->heap[smallest].count) {
+            smallest = child;
+         }
+      }
+      if (table->heap[smallest].count >= node.count) {
+         break;
+      }
+      table->heap[pos] = table->heap[smallest];
+      table->counters[table->heap[pos].counter].heap_index = pos;
+      pos = smallest;
+   }
+   table->heap[pos] = node;
+   table->counters[node.counter].heap_index = pos;
+}
+
+/**
+* \brief Function removes counter from hash index, following entries of the cluster are shifted back.
+*/
+static void ss_index_remove(ss_table_t *table, uint32_t counter)
+{
+   uint32_t mask = table->index_mask;
+   uint32_t i = table->counters[counter].hash & mask;
+   uint32_t j;
+
+   while (table->index[i] != counter + 1) {
+      i = (i + 1) & mask;
+   }
+
+   j = i;
+   for (;;) {
+      j = (j + 1) & mask;
+      if (table->index[j] == 0) {
+         break;
+      }
+
+      uint32_t home = table->counters[table->index[j] - 1].hash & mask;
+      /* Entry at j can be moved to i only if its home slot is not in cyclic interval (i, j> */
+      if ((i <= j) ? (home <= i || home > j) : (home <= i && home > j)) {
+         table->index[i] = table->index[j];
+         i = j;
+      }
+   }
+   table->index[i] = 0;
+}
+
+uint32_t ss_capacity(size_t memory, uint32_t key_size)
+{
+   size_t per_counter = key_size + sizeof(ss_counter_t) + sizeof(ss_heap_node_t) + sizeof(uint32_t) * SS_INDEX_RATIO + sizeof(ss_item_t);
+   size_t capacity = memory / per_counter;
+
+   if (capacity < 1) {
+      capacity = 1;
+   } else if (capacity > UINT32_MAX / (2 * SS_INDEX_RATIO)) {
+      capacity = UINT32_MAX / (2 * SS_INDEX_RATIO);
+   }
+   return (uint32_t) capacity;
+}
+
+ss_table_t *ss_init(uint32_t capacity, uint32_t key_size)
+{
+   ss_table_t *table = calloc(1, sizeof(ss_table_t));
+   uint32_t index_size = 1;
+
+   if (table == NULL || capacity == 0 || key_size == 0 || capacity > UINT32_MAX / (2 * SS_INDEX_RATIO)) {
+      free(table);
+      return NULL;
+   }
+
+   while (index_size < capacity * SS_INDEX_RATIO) {
+      index_size *= 2;
+   }
+
+   table->capacity = capacity;
+   table->key_size = key_size;
+   table->index_mask = index_size - 1;
+   table->keys = malloc((size_t) capacity * key_size);
+   table->counters = malloc(capacity * sizeof(ss_counter_t));
+   /* Node 0 is placed at the end of a cache line, so children 4 * i + 1 to 4 * i + 4 start at its beginning */
+   table->heap_memory = aligned_alloc(SS_CACHE_LINE, ((capacity + 3) * sizeof(ss_heap_node_t) + SS_CACHE_LINE - 1) / SS_CACHE_LINE * SS_CACHE_LINE);
+   table->index = calloc(index_size, sizeof(uint32_t));
+   table->items = malloc(capacity * sizeof(ss_item_t));
+
+   if (table->keys == NULL || table->counters == NULL || table->heap_memory == NULL || table->index == NULL || table->items == NULL) {
+      ss_destroy(table);
+      return NULL;
+   }
+   table->heap = (ss_heap_node_t *) table->heap_memory + 3;
+   return table;
+}
+
+/**
+* \brief Function adds count with given error to the key.
+*/
+static void ss_add(ss_table_t *table, const void *key, uint32_t hash, uint64_t count, uint64_t error)
+{
+   uint32_t mask = table->index_mask;
+   uint32_t i = hash & mask;
+   uint32_t counter;
+   ss_counter_t *c;
+
+   while (table->index[i] != 0) {
+      counter = table->index[i] - 1;
+      c = &table->counters[counter];
+      if (c->hash == hash && memcmp(ss_key(table, counter), key, table->key_size) == 0) {
+         table->heap[c->heap_index].count += count;
+         c->error += error;
+         ss_sift_down(table, c->heap_index);
+         return;
+      }
+      i = (i + 1) & mask;
+   }
+
+   if (table->size < table->capacity) {
+      counter = table->size++;
+      c = &table->counters[counter];
+      c->error = error;
+      c->hash = hash;
+      table->heap[counter].count = count;
+      table->heap[counter].counter = counter;
+      memcpy(ss_key(table, counter), key, table->key_size);
+      table->index[i] = counter + 1;
+      ss_sift_up(table, counter);
+      return;
+   }
+
+   /* Replace key with the smallest count, new key inherits its count as error */
+   counter = table->heap[0].counter;
+   c = &table->counters[counter];
+   ss_index_remove(table, counter);
+
+   c->error = table->heap[0].count + error;
+   table->heap[0].count += count;
+   c->hash = hash;
+   memcpy(ss_key(table, counter), key, table->key_size);
+
+   /* Removal could shift the empty slot found above, so the slot is searched again */
+   i = hash & mask;
+   while (table->index[i] != 0) {
+      i = (i + 1) & mask;
+   }
+   table->index[i] = counter + 1;
+   ss_sift_down(table, 0);
+}
+
+void ss_update(ss_table_t *table, const void *key, uint64_t weight)
+{
+   table->total += weight;
+   ss_add(table, key, ss_hash(key, table->key_size), weight, 0);
+}
+
+void ss_update_hash(ss_table_t *table, const void *key, uint32_t hash, uint64_t weight)
+{
+   table->total += weight;
+   ss_add(table, key, hash, weight, 0);
+}
+
+void ss_merge(ss_table_t *dst, const ss_table_t *src)
+{
+   for (uint32_t i = 0; i < src->size; i++) {
+      uint64_t count = src->heap[src->counters[i].heap_index].count;
+
+      ss_add(dst, ss_key(src, i), src->counters[i].hash, count + src->missing, src->counters[i].error + src->missing);
+   }
+
+   /* Key that is not monitored by src could have weight up to this bound there */
+   dst->missing += ss_unmonitored_bound(src);
+   dst->total += src->total;
+}
+
+int ss_compare_items(const void *a, const void *b)
+{
+   if (((ss_item_t *) a)->count < ((ss_item_t *) b)->count) {
+      return 1;
+   } else if (((ss_item_t *) a)->count == ((ss_item_t *) b)->count) {
+      return 0;
+   } else {
+      return -1;
+   }
+}
+
+uint32_t ss_items(ss_table_t *table, ss_item_t **items)
+{
+   for (uint32_t i = 0; i < table->size; i++) {
+      table->items[i].key = ss_key(table, i);
+      table->items[i].count = table->heap[table->counters[i].heap_index].count + table->missing;
+      table->items[i].error = table->counters[i].error + table->missing;
+   }
+
+   *items = table->items;
+   return table->size;
+}
+
+uint32_t ss_top(ss_table_t *table, uint32_t n, ss_item_t **items)
+{
+   uint32_t size = ss_items(table, items);
+
+   return partial_sort(*items, size, sizeof(ss_item_t), n, ss_compare_items);
+}
+
+uint64_t ss_unmonitored_bound(const ss_table_t *table)
+{
+   if (table->size < table->capacity) {
+      return table->missing;
+   }
+   return table->heap[0].count + table->missing;
+}
+
+void ss_clear(ss_table_t *table)
+{
+   memset(table->index, 0, ((size_t) table->index_mask + 1) * sizeof(uint32_t));
+   table->size = 0;
+   table->total = 0;
+   table->missing = 0;
+}
+
+void ss_destroy(ss_table_t *table)
+{
+   if (table == NULL) {
+      return;
+   }
+   free(table->keys);
+   free(table->counters);
+   free(table->heap_memory);
+   free(table->index);
+   free(table->items);
+   free(table);
+}
@@ -0,0 +1,199 @@
+/**
+ * \file space_saving.h
+ * \brief Space-Saving summary of heavy hitters with bounded error.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef _SPACE_SAVING_
+#define _SPACE_SAVING_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+* \brief Counter of one monitored key, its count is stored in heap node.
+*
+* Real weight of the key lies in interval <count - error, count>. Error is the count of the key which was replaced when this key started to be monitored.
+*/
+typedef struct ss_counter_struct {
+   uint64_t error;       /*!< Maximal overestimation of count. */
+   uint32_t hash;        /*!< Hash of the key, used to find its slot in hash index. */
+   uint32_t heap_index;  /*!< Position of the counter in min-heap, count of the key is stored there. */
+} ss_counter_t;
+
+/**
+* \brief Node of min-heap of counters.
+*/
+typedef struct ss_heap_node_struct {
+   uint64_t count;       /*!< Overestimated weight of the key. */
+   uint32_t counter;     /*!< Index of the counter. */
+   uint32_t reserved;
+} ss_heap_node_t;
+
+/**
+* \brief Entry of sorted output of Space-Saving summary.
+*/
+typedef struct ss_item_struct {
+   const void *key;
+   uint64_t count;
+   uint64_t error;
+} ss_item_t;
+
+/**
+* \brief Space-Saving summary (Metwally et al.) with fixed number of counters.
+*
+* Monitored keys are found by open addressing hash index, counters are ordered in 4-ary min-heap by their count. Counts are stored directly in heap nodes and all children of a node share one cache line, since a replaced key is usually sifted down to the bottom of the heap. New key replaces the key with the smallest count and inherits its count as error. Every key with weight bigger than total / capacity is guaranteed to be monitored and error of any counter is never bigger than total / capacity.
+*/
+typedef struct ss_table_struct {
+   uint32_t capacity;      /*!< Maximal number of monitored keys. */
+   uint32_t key_size;      /*!< Size of key in bytes. */
+   uint32_t size;          /*!< Number of monitored keys. */
+   uint32_t index_mask;    /*!< Number of slots of hash index - 1. */
+   uint64_t total;         /*!< Sum of all weights added since last clear. */
+   uint64_t missing;       /*!< Sum of bounds of merged summaries, key could have weight up to this value in summaries where it was not monitored. */
+   uint8_t *keys;          /*!< Keys of counters, key_size bytes each. */
+   ss_counter_t *counters;
+   ss_heap_node_t *heap;   /*!< Min-heap of counts, heap[4 * i + 1] to heap[4 * i + 4] are children of heap[i]. */
+   void *heap_memory;      /*!< Allocated memory of heap, heap is shifted inside it to align children to cache line. */
+   uint32_t *index;        /*!< Hash index, slot contains index of counter + 1, 0 means empty slot. */
+   ss_item_t *items;       /*!< Buffer for sorted output. */
+} ss_table_t;
+
+/**
+* \brief Function computes hash of the key used by the summary.
+*
+* Summaries with the same key size use the same hash, so a key updated in several summaries can be hashed only once, see ss_update_hash().
+*
+* \param key Key of key_size bytes.
+* \param key_size Size of key in bytes.
+* \return Hash of the key.
+*/
+uint32_t ss_hash(const void *key, uint32_t key_size);
+
+/**
+* \brief Function returns number of counters which fit into given memory.
+*
+* \param memory Size of memory in bytes.
+* \param key_size Size of key in bytes.
+* \return Number of counters, at least 1.
+*/
+uint32_t ss_capacity(size_t memory, uint32_t key_size);
+
+/**
+* \brief Function allocates Space-Saving summary.
+*
+* \param capacity Maximal number of monitored keys.
+* \param key_size Size of key in bytes.
+* \return Pointer to the summary or NULL if memory allocation failed.
+*/
+ss_table_t *ss_init(uint32_t capacity, uint32_t key_size);
+
+/**
+* \brief Function adds weight to the key.
+*
+* \param table Space-Saving summary.
+* \param key Key of key_size bytes.
+* \param weight Weight added to the key (1 for flows, number of packets or bytes).
+*/
+void ss_update(ss_table_t *table, const void *key, uint64_t weight);
+
+/**
+* \brief Function adds weight to the key whose hash was already computed by ss_hash().
+*
+* \param table Space-Saving summary.
+* \param key Key of key_size bytes.
+* \param hash Hash of the key.
+* \param weight Weight added to the key.
+*/
+void ss_update_hash(ss_table_t *table, const void *key, uint32_t hash, uint64_t weight);
+
+/**
+* \brief Function adds all keys of another summary with their counts and errors.
+*
+* Summaries are mergeable: key that was not monitored by src could have weight up to the bound of src there, so this bound is added to count and error of every key of dst (stored in missing). Summaries of consecutive time slots are merged this way to get summary of whole time window.
+*
+* \param dst Summary to which src is added.
+* \param src Merged summary, it is not modified.
+*/
+void ss_merge(ss_table_t *dst, const ss_table_t *src);
+
+/**
+* \brief Function returns all monitored keys in no particular order.
+*
+* Returned array is owned by the summary and it is valid until next call of ss_update, ss_clear, ss_items or ss_top. Items can be reordered by the caller, e.g. grouped by part of the key and selected by partial_sort() with ss_compare_items().
+*
+* \param table Space-Saving summary.
+* \param items Pointer which will point to items.
+* \return Number of returned items.
+*/
+uint32_t ss_items(ss_table_t *table, ss_item_t **items);
+
+/**
+* \brief Function compares items by count in descending order.
+*/
+int ss_compare_items(const void *a, const void *b);
+
+/**
+* \brief Function returns monitored keys with the biggest counts.
+*
+* Returned array is owned by the summary and it is valid until next call of ss_update, ss_clear, ss_items or ss_top.
+*
+* \param table Space-Saving summary.
+* \param n Maximal number of returned items.
+* \param items Pointer which will point to items sorted by count in descending order.
+* \return Number of returned items.
+*/
+uint32_t ss_top(ss_table_t *table, uint32_t n, ss_item_t **items);
+
+/**
+* \brief Function returns the biggest possible weight of a key which is not monitored.
+*/
+uint64_t ss_unmonitored_bound(const ss_table_t *table);
+
+/**
+* \brief Function removes all keys from the summary.
+*/
+void ss_clear(ss_table_t *table);
+
+/**
+* \brief Function frees the summary.
+*/
+void ss_destroy(ss_table_t *table);
+
+#endif /* _SPACE_SAVING_ */
@@ -53,40 +53,114 @@ UR_FIELDS(
    ipaddr DST_IP,
    uint16 DST_PORT,
    uint16 SRC_PORT,
-   uint8 PROTOCOL
+   uint8 PROTOCOL,
+   time TIME_FIRST,
+   time TIME_LAST,
+   uint8 TOPN_ENTITY,
+   uint8 TOPN_METRIC,
+   int32 TOPN_PORT,
+   uint8 TOPN_PREFIX,
+   uint32 TOPN_RANK,
+   uint64 TOPN_VALUE,
+   uint64 TOPN_ERROR
 )
 
 /* Structure with information about module */
 trap_module_info_t *module_info = NULL;
 
 #define MODULE_BASIC_INFO(BASIC) \
-   BASIC("topn", "Module for computing various Top N statistics.", 1, 0)
+   BASIC("topn", "Module for computing various Top N statistics. Top N lists can be sent to output interface as UniRec records (parameter -o).", 1, 0)
 
 #define MODULE_PARAMS(PARAM) \
    PARAM('n', "top_n", "Number of entities for top N statistics.", required_argument, "uint8_t") \
    PARAM('l', "time", "Length of time interval in seconds. Statistics are calculated upon this interval.", required_argument, "uint8_t") \
    PARAM('p', "ports", "Specific ports upon which statistics will be calculated independently. Use format -p x1,x2,x3...", required_argument, "string") \
-   PARAM('m', "prefix", "Length of the prefix for IPv4 and IPv6. Use format -m x1,x2 for both or -m x1 for IPv4 only.", required_argument, "string")
+   PARAM('m', "prefix", "Length of the prefix for IPv4 and IPv6. Use format -m x1,x2 for both or -m x1 for IPv4 only.", required_argument, "string") \
+   PARAM('s', "memory", "Memory in MB for top N IPs and networks, it is divided among all of them (16 MB by default).", required_argument, "uint32_t") \
+   PARAM('w', "window", "Length of sliding window in seconds, multiple of -l. Statistics of the last window are reported every -l seconds.", required_argument, "uint32_t") \
+   PARAM('o', "output", "Send top N lists to output interface as UniRec records.", no_argument, "none")
 
-time_t time1;
 static int print_stats = 0;
 static int stop = 0;
 static int interval = 0;
+static int window = 0;
 static int topn = 0;
 static int *port = NULL;
 static int port_cnt = 0;
 static int port_set = -1;
+static uint16_t *port_index = NULL;   /* Index + 1 of port in -p parameter for each port number, 0 if port is not given */
+static int memory = IP_STATS_MEMORY;
+static uint64_t prefix128[2] = {0, 0};
+static uint32_t prefix = 0;
+static int prefix_set = 0;
+static int prefix_only_v4 = -1;
+
+/* Output of top N lists, out_tmplt is NULL if -o parameter is not used */
+static ur_template_t *out_tmplt = NULL;
+static void *out_rec = NULL;
+
+/* Time slots of statistics, records are added to one of them, completed ones are read by reporting thread */
+static topn_stats_t *slots = NULL;
+static int slot_cnt = 0;
+static int window_slots = 1;
+static topn_stats_t window_stats;   /* Merged slots of sliding window, used only if window_slots > 1 */
+
+static pthread_mutex_t report_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t report_cond = PTHREAD_COND_INITIALIZER;
+static int report_slot = -1;        /* Completed slot which is being reported, -1 if reporting thread is idle */
+static int report_finish = 0;
+
+/* Variables used only by reporting thread */
+static port_t *port_buffer = NULL;
+static char ip_string[INET6_ADDRSTRLEN];
+static char ip_string2[INET6_ADDRSTRLEN];
+static ur_time_t report_time_first;
+static ur_time_t report_time_last;
+
+static const char *metric_names[] = {"flows", "packets", "bytes"};
 
 /* Handling SIGTERM and SIGINT signals */
 TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1);
 
+/* Output interface has to be known before TRAP initialization */
+void get_o_param(int argc, char **argv, const char *module_getopt_string, const struct option *long_options)
+{
+   /* backup global variables */
+   int bck_optind = optind, bck_optopt = optopt, bck_opterr = opterr;
+   char *bck_optarg = optarg;
+   signed char opt;
+
+   /* "i:" is added, otherwise getopt would move argument of -i to the end of argv (see flowcounter) */
+   char *getopt_string_with_i = malloc(strlen(module_getopt_string) + 3);
+   if (getopt_string_with_i == NULL) {
+      malloc_err();
+   }
+   sprintf(getopt_string_with_i, "%s%s", module_getopt_string, "i:");
+
+   opterr = 0;                  /* disable getopt error output */
+   while ((opt = TRAP_GETOPT(argc, argv, getopt_string_with_i, long_options)) != -1) {
+      if (opt == 'o') {
+         module_info->num_ifc_out = 1;
+      }
+   }
+
+   free(getopt_string_with_i);
+
+   /* restore global variables */
+   optind = bck_optind;
+   optopt = bck_optopt;
+   opterr = bck_opterr;
+   optarg = bck_optarg;
+}
+
 int main(int argc, char **argv)
 {
    int ret;
 
-   int array_counter = 0;
    INIT_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
 
+   get_o_param(argc, argv, module_getopt_string, long_options);
+
    /* TRAP initialization */
    TRAP_DEFAULT_INITIALIZATION(argc, argv, *module_info);
 
@@ -97,11 +171,8 @@ int main(int argc, char **argv)
 
    /* Create UniRec template */
    char *unirec_specifier = "PACKETS,BYTES,SRC_IP,DST_IP,SRC_PORT,DST_PORT,PROTOCOL";
+   char *out_specifier = "TIME_FIRST,TIME_LAST,TOPN_ENTITY,TOPN_METRIC,TOPN_PORT,TOPN_PREFIX,TOPN_RANK,SRC_IP,DST_IP,SRC_PORT,DST_PORT,PROTOCOL,TOPN_VALUE,TOPN_ERROR";
    char opt;
-   uint64_t prefix128[2] = {0, 0};
-   uint32_t prefix = 0;
-   int prefix_set = 0;
-   int prefix_only_v4 = -1;
 
    while ((opt = TRAP_GETOPT(argc, argv, module_getopt_string, long_options)) != -1) {
       switch (opt) {
@@ -143,6 +214,30 @@ int main(int argc, char **argv)
          }
          break;
 
+      case 's':
+         memory = atoi(optarg);
+         if (memory <= 0) {
+            fprintf(stderr, "Invalid argument for parameter -s\n");
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            TRAP_DEFAULT_FINALIZATION();
+            return EXIT_FAILURE;
+         }
+         break;
+
+      case 'w':
+         window = atoi(optarg);
+         if (window <= 0) {
+            fprintf(stderr, "Invalid argument for parameter -w\n");
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            TRAP_DEFAULT_FINALIZATION();
+            return EXIT_FAILURE;
+         }
+         break;
+
+      case 'o':
+         /* processed earlier */
+         break;
+
       default:
          fprintf(stderr, "Invalid arguments.\n");
          FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
@@ -165,6 +260,16 @@ int main(int argc, char **argv)
       return EXIT_FAILURE;
    }
 
+   if (window != 0) {
+      if (window < interval || window % interval != 0) {
+         fprintf(stderr, "Parameter -w has to be multiple of -l.\n");
+         TRAP_DEFAULT_FINALIZATION();
+         FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+         return EXIT_FAILURE;
+      }
+      window_slots = window / interval;
+   }
+
    ur_template_t *tmplt = ur_create_input_template(0, unirec_specifier, NULL);
    if (tmplt == NULL) {
       fprintf(stderr, "Error: Invalid UniRec specifier.\n");
@@ -173,220 +278,68 @@ int main(int argc, char **argv)
       return EXIT_FAILURE;
    }
 
-   /* Counting Top N flows */
-   flow_t *array_of_bytes = calloc(topn, sizeof(flow_t));
-   flow_t **sorted_array_of_bytes = calloc(topn, sizeof(flow_t*));
-   flow_t *record_bytes = calloc(1, sizeof(flow_t));
-   flow_t *array_of_packets = calloc(topn, sizeof(flow_t));
-   flow_t **sorted_array_of_packets = calloc(topn, sizeof(flow_t*));
-   flow_t *record_packets = calloc(1, sizeof(flow_t));
-
-   if (array_of_bytes == NULL || sorted_array_of_bytes == NULL || record_bytes == NULL || array_of_packets == NULL || sorted_array_of_packets == NULL || record_packets == NULL) {
-      malloc_err();
-   }
-
-   flow_t **array_of_bytes_port = NULL;
-   flow_t ***sorted_array_of_bytes_port = NULL;
-   flow_t **array_of_packets_port = NULL;
-   flow_t ***sorted_array_of_packets_port = NULL;
-   int *array_counter_port = NULL;
-
-   if (port_set != -1) {
-      array_of_bytes_port = malloc(port_cnt *(sizeof(flow_t *)));
-      sorted_array_of_bytes_port = malloc(port_cnt *(sizeof(flow_t **)));
-      array_of_packets_port = malloc(port_cnt *(sizeof(flow_t *)));
-      sorted_array_of_packets_port = malloc(port_cnt *(sizeof(flow_t **)));
-      array_counter_port = malloc(port_cnt *(sizeof(int)));
-
-      if (array_of_bytes_port == NULL || sorted_array_of_bytes_port == NULL || array_of_packets_port == NULL || sorted_array_of_packets_port == NULL || array_counter_port == NULL) {
-         malloc_err();
-      }
-
-      for (int i = 0; i < port_cnt; i ++) {
-         array_of_bytes_port[i] = malloc(topn * sizeof(flow_t));
-         sorted_array_of_bytes_port[i] = malloc(topn * sizeof(flow_t*));
-         array_of_packets_port[i] = malloc(topn * sizeof(flow_t));
-         sorted_array_of_packets_port[i] = malloc(topn * sizeof(flow_t*));
-         array_counter_port[i] = 0;
-
-         if (array_of_bytes_port[i] == NULL || sorted_array_of_bytes_port[i] == NULL || array_of_packets_port[i] == NULL || sorted_array_of_packets_port[i] == NULL) {
-            malloc_err();
-         }
+   if (module_info->num_ifc_out == 1) {
+      out_tmplt = ur_create_output_template(0, out_specifier, NULL);
+      if (out_tmplt == NULL) {
+         fprintf(stderr, "Error: Invalid UniRec specifier of output.\n");
+         ur_free_template(tmplt);
+         TRAP_DEFAULT_FINALIZATION();
+         FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+         return EXIT_FAILURE;
       }
-   }
-
-   /* Counting top N ports */
-
-   port_t *array_of_ports = calloc(65536, sizeof(port_t));
-
-   if (array_of_ports == NULL) {
-      malloc_err();
-   }
-
-   port_t **array_of_ports_port = NULL;
-
-   if (port_set != -1) {
-      array_of_ports_port = malloc(port_cnt *(sizeof(port_t *)));
 
-      if (array_of_ports_port == NULL) {
+      out_rec = ur_create_record(out_tmplt, 0);
+      if (out_rec == NULL) {
          malloc_err();
       }
-
-      for (int i = 0; i < port_cnt; i++) {
-         array_of_ports_port[i] = calloc(65536, sizeof(port_t));
-
-         if (array_of_ports_port[i] == NULL) {
-            malloc_err();
-         }
-      }
    }
 
-   /* Top N IPs */
-   fht_table_t *table_flows = fht_init(HASH_TABLE_SIZE * 4, sizeof(ip_addr_t), sizeof(ip_t), 0);      /* 32k */
-   fht_iter_t *iter_flows = fht_init_iter(table_flows);
-   fhf_table_t *table_pab = fhf_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t));      /* 8k, pab = packets and bytes */
-   fhf_iter_t *iter_pab = fhf_init_iter(table_pab);
-
-   if (table_flows == NULL || iter_flows == NULL || table_pab == NULL || iter_pab == NULL) {
-      malloc_err();
+   /*
+    * One slot is filled while the previous window_slots slots are reported, so reporting never blocks
+    * processing of records (two slots, double buffering, if sliding window is not used).
+    */
+   int ip_stats_cnt = 1;
+   if (prefix_set == 1) {
+      ip_stats_cnt = (prefix_only_v4 == -1) ? 3 : 2;
    }
-
-   fht_table_t **table_flows_port = NULL;
-   fht_iter_t **iter_flows_port = NULL;
-   fhf_table_t **table_pab_port = NULL;
-   fhf_iter_t **iter_pab_port = NULL;
-
+   /* All ports from -p parameter share one set of statistics keyed by port and IP */
    if (port_set != -1) {
-      table_pab_port = malloc(port_cnt *(sizeof(fhf_table_t *)));
-      iter_pab_port = malloc(port_cnt *(sizeof(fhf_iter_t *)));
-      table_flows_port = malloc(port_cnt *(sizeof(fht_table_t *)));
-      iter_flows_port = malloc(port_cnt *(sizeof(fht_iter_t *)));
-
-      if (table_pab_port == NULL || iter_pab_port == NULL || table_flows_port == NULL || iter_flows_port == NULL) {
-         malloc_err();
-      }
-
-      for (int i = 0; i < port_cnt; i++) {
-         table_pab_port[i] = fhf_init(HASH_TABLE_SIZE / 2, sizeof(ip_addr_t), sizeof(ip_t));   /* 4k */
-         iter_pab_port[i] = fhf_init_iter(table_pab_port[i]);
-         table_flows_port[i] = fht_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t), 0);   /* 8k */
-         iter_flows_port[i] = fht_init_iter(table_flows_port[i]);
-
-         if (table_pab_port[i] == NULL || iter_pab_port[i] == NULL || table_flows_port[i] == NULL || iter_flows_port[i] == NULL) {
-            malloc_err();
-         }
-
-      }
+      ip_stats_cnt *= 2;
    }
+   slot_cnt = window_slots + 1;
+   int parts = (window_slots > 1) ? slot_cnt + 1 : slot_cnt;
+   size_t ss_memory = ((size_t) memory << 20) / (parts * ip_stats_cnt * 3);
 
-   /* Top networks */
-   fht_table_t *table_prefix_flows = fht_init(HASH_TABLE_SIZE * 2, sizeof(ip_addr_t), sizeof(ip_t), 0);   /* 16k */
-   fht_iter_t *iter_prefix_flows = fht_init_iter(table_prefix_flows);
-   fhf_table_t *table_prefix_pab = fhf_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t));   /* 8k */
-   fhf_iter_t *iter_prefix_pab = fhf_init_iter(table_prefix_pab);
+   slots = calloc(slot_cnt, sizeof(topn_stats_t));
+   port_buffer = malloc(65536 * sizeof(port_t));
 
-   if (table_prefix_flows == NULL || iter_prefix_flows == NULL || table_prefix_pab == NULL || iter_prefix_pab == NULL) {
+   if (slots == NULL || port_buffer == NULL) {
       malloc_err();
    }
 
-   fht_table_t *table_prefix_flows_v6 = NULL;
-   fht_iter_t *iter_prefix_flows_v6 = NULL;
-   fhf_table_t *table_prefix_pab_v6 = NULL;
-   fhf_iter_t *iter_prefix_pab_v6 = NULL;
-
-   if (prefix_only_v4 == -1) {
-      table_prefix_flows_v6 = fht_init(HASH_TABLE_SIZE * 2, sizeof(ip_addr_t), sizeof(ip_t), 0);   /* 16k */
-      iter_prefix_flows_v6 = fht_init_iter(table_prefix_flows_v6);
-      table_prefix_pab_v6 = fhf_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t));   /* 8k */
-      iter_prefix_pab_v6 = fhf_init_iter(table_prefix_pab_v6);
-
-      if (table_prefix_flows_v6 == NULL || iter_prefix_flows_v6 == NULL || table_prefix_pab_v6 == NULL || iter_prefix_pab_v6 == NULL) {
-         malloc_err();
-      }
-   }
-
-   fhf_table_t **table_prefix_pab_port = NULL;
-   fhf_iter_t **iter_prefix_pab_port = NULL;
-
-   fht_table_t **table_prefix_flows_port = NULL;
-   fht_iter_t **iter_prefix_flows_port = NULL;
-
-   fhf_table_t **table_prefix_pab_port_v6 = NULL;
-   fhf_iter_t **iter_prefix_pab_port_v6 = NULL;
-
-   fht_table_t **table_prefix_flows_port_v6 = NULL;
-   fht_iter_t **iter_prefix_flows_port_v6 = NULL;
-
-   if (port_set != -1) {
-      table_prefix_pab_port = malloc(port_cnt *(sizeof(fhf_table_t *)));
-      iter_prefix_pab_port = malloc(port_cnt *(sizeof(fhf_iter_t *)));
-      table_prefix_flows_port = malloc(port_cnt *(sizeof(fht_table_t *)));
-      iter_prefix_flows_port = malloc(port_cnt *(sizeof(fht_iter_t *)));
-
-      if (table_prefix_pab_port == NULL || iter_prefix_pab_port == NULL || table_prefix_flows_port == NULL || iter_prefix_flows_port == NULL) {
+   for (int i = 0; i < slot_cnt; i++) {
+      if (topn_stats_init(&slots[i], ss_memory) == -1) {
          malloc_err();
       }
-
-      if (prefix_only_v4 == -1) {
-         table_prefix_pab_port_v6 = malloc(port_cnt *(sizeof(fhf_table_t *)));
-         iter_prefix_pab_port_v6 = malloc(port_cnt *(sizeof(fhf_iter_t *)));
-         table_prefix_flows_port_v6 = malloc(port_cnt *(sizeof(fht_table_t *)));
-         iter_prefix_flows_port_v6 = malloc(port_cnt *(sizeof(fht_iter_t *)));
-
-         if (table_prefix_pab_port_v6 == NULL || iter_prefix_pab_port_v6 == NULL || table_prefix_flows_port_v6 == NULL || iter_prefix_flows_port_v6 == NULL) {
-            malloc_err();
-         }
-      }
-
-      for (int i = 0; i < port_cnt; i++) {
-         table_prefix_pab_port[i] = fhf_init(HASH_TABLE_SIZE / 2, sizeof(ip_addr_t), sizeof(ip_t));   /* 4k */
-         iter_prefix_pab_port[i] = fhf_init_iter(table_prefix_pab_port[i]);
-         table_prefix_flows_port[i] = fht_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t), 0);   /* 8k */
-         iter_prefix_flows_port[i] = fht_init_iter(table_prefix_flows_port[i]);
-
-         if (table_prefix_pab_port[i] == NULL || iter_prefix_pab_port[i] == NULL || table_prefix_flows_port[i] == NULL || iter_prefix_flows_port[i] == NULL) {
-            malloc_err();
-         }
-
-         if (prefix_only_v4 == -1) {
-            table_prefix_pab_port_v6[i] = fhf_init(HASH_TABLE_SIZE / 2, sizeof(ip_addr_t), sizeof(ip_t));   /* 4k */
-            iter_prefix_pab_port_v6[i] = fhf_init_iter(table_prefix_pab_port_v6[i]);
-            table_prefix_flows_port_v6[i] = fht_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t), 0);   /* 8k */
-            iter_prefix_flows_port_v6[i] = fht_init_iter(table_prefix_flows_port_v6[i]);
-
-            if (table_prefix_pab_port_v6[i] == NULL || iter_prefix_pab_port_v6[i] == NULL || table_prefix_flows_port_v6[i] == NULL || iter_prefix_flows_port_v6[i] == NULL) {
-               malloc_err();
-            }
-         }
-      }
    }
 
-   /* Additional code */
-   ip_addr_t masked_ip;
-   char *ip_string = malloc(INET6_ADDRSTRLEN);
-   char *ip_string2 = malloc(INET6_ADDRSTRLEN);
-   ip_t *record_ip = malloc(sizeof(ip_t));
-   ip_addr_t *key_lost = malloc(sizeof(ip_addr_t));
-   ip_t *data_lost = malloc(sizeof(ip_t));
-
-   if (ip_string == NULL || ip_string2 == NULL || record_ip == NULL || key_lost == NULL || data_lost == NULL) {
+   if (window_slots > 1 && topn_stats_init(&window_stats, ss_memory) == -1) {
       malloc_err();
    }
 
-   uint64_t received_flows = 0;
-   uint64_t all_bytes = 0;
-   uint32_t average_bytes = 0;
-   uint64_t all_packets = 0;
-   uint32_t average_packets = 0;
-
-   char time_print_buff[128];
-   time_t time_print;
+   pthread_t report_thread;
+   if (pthread_create(&report_thread, NULL, report_stats_thread, NULL) != 0) {
+      fprintf(stderr, "Error: Reporting thread could not be created.\n");
+      TRAP_DEFAULT_FINALIZATION();
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+      return EXIT_FAILURE;
+   }
 
    const void *data;
    uint16_t data_size;
+   int current_slot = 0;
 
-   seedMT(time(NULL));
-   time1 = time(NULL);
+   slots[current_slot].time_first = time(NULL);
    alarm(interval);
 
    while (!stop) {
@@ -400,405 +353,50 @@ int main(int argc, char **argv)
          break;
       }
 
-      received_flows++;
-      all_bytes += ur_get(tmplt, data, F_BYTES);
-      average_bytes = all_bytes / received_flows;
-      all_packets += ur_get(tmplt, data, F_PACKETS);
-      average_packets = all_packets / received_flows;
-
-      /*if ((received_flows > 190000) && received_flows % 200000 == 0) {
-         printf("%" PRIu64 "k (%" PRIu64 "M): average bytes: %d, average packets: %d,\n", received_flows / 1000, received_flows / 1000000, average_bytes, average_packets);
-      }*/
-
-      record_ip->bytes = ur_get(tmplt, data, F_BYTES);
-      record_ip->packets = ur_get(tmplt, data, F_PACKETS);
-      record_ip->flows = 1;
-      record_ip->src_ip = ur_get(tmplt, data, F_SRC_IP);
-
-      record_bytes->max_number = ur_get(tmplt, data, F_BYTES);
-      record_bytes->src_ip = ur_get(tmplt, data, F_SRC_IP);
-      record_bytes->dst_ip = ur_get(tmplt, data, F_DST_IP);
-      record_bytes->src_port = ur_get(tmplt, data, F_SRC_PORT);
-      record_bytes->dst_port = ur_get(tmplt, data, F_DST_PORT);
-      record_bytes->protocol = ur_get(tmplt, data, F_PROTOCOL);
-
-      record_packets->max_number = ur_get(tmplt, data, F_PACKETS);
-      record_packets->src_ip = ur_get(tmplt, data, F_SRC_IP);
-      record_packets->dst_ip = ur_get(tmplt, data, F_DST_IP);
-      record_packets->src_port = ur_get(tmplt, data, F_SRC_PORT);
-      record_packets->dst_port = ur_get(tmplt, data, F_DST_PORT);
-      record_packets->protocol = ur_get(tmplt, data, F_PROTOCOL);
-
-
-      /* Prefixes */
-
-      if (prefix_set == 1) {
-         if (ip_is4(&ur_get(tmplt, data, F_SRC_IP)) == 1) {
-            masked_ip = ur_get(tmplt, data, F_SRC_IP);
-            masked_ip.ui32[2] = masked_ip.ui32[2] & prefix;
-
-            process_ip_flows(table_prefix_flows, &masked_ip, record_ip, key_lost, data_lost, data, tmplt);
-            process_ip_pab(table_prefix_pab, &masked_ip, record_ip, data, tmplt,  average_packets,  average_bytes);
-
-            if (port_set != -1) {
-               for (int p = 0; p < port_cnt; p++) {
-                  if (record_bytes->dst_port == port[p] || record_bytes->src_port == port[p]) {
-                     process_ip_flows(table_prefix_flows_port[p], &masked_ip, record_ip, key_lost, data_lost, data, tmplt);
-                     process_ip_pab(table_prefix_pab_port[p], &masked_ip, record_ip, data, tmplt,  average_packets / 3,  average_bytes / 3);
-                  }
-               }
-            }
-         } else if (prefix_only_v4 == -1) {
-            masked_ip = (ur_get(tmplt, data, F_SRC_IP));
-            masked_ip.ui64[0] = masked_ip.ui64[0] & prefix128[0];
-            masked_ip.ui64[1] = masked_ip.ui64[1] & prefix128[1];
-
-            process_ip_flows(table_prefix_flows_v6, &masked_ip, record_ip, key_lost, data_lost, data, tmplt);
-            process_ip_pab(table_prefix_pab_v6, &masked_ip, record_ip, data, tmplt,  average_packets,  average_bytes);
-
-            if (port_set != -1) {
-               for (int p = 0; p < port_cnt; p++) {
-                  if (record_bytes->dst_port == port[p] || record_bytes->src_port == port[p]) {
-                     process_ip_flows(table_prefix_flows_port_v6[p], &masked_ip, record_ip, key_lost, data_lost, data, tmplt);
-                     process_ip_pab(table_prefix_pab_port_v6[p], &masked_ip, record_ip, data, tmplt,  average_packets / 3,  average_bytes / 3);
-
-                  }
-               }
-            }
-         }
-      }
-
-      /* IPs */
-      process_ip_flows(table_flows, &ur_get(tmplt, data, F_SRC_IP), record_ip, key_lost, data_lost, data, tmplt);
-      process_ip_pab(table_pab, &ur_get(tmplt, data, F_SRC_IP), record_ip, data, tmplt,  average_packets,  average_bytes);
+      process_record(&slots[current_slot], tmplt, data);
 
-      if (port_set != -1) {
-         for (int p = 0; p < port_cnt; p++) {
-            if (record_bytes->dst_port == port[p] || record_bytes->src_port == port[p]) {
-               process_ip_flows(table_flows_port[p], &ur_get(tmplt, data, F_SRC_IP), record_ip, key_lost, data_lost, data, tmplt);
-               process_ip_pab(table_pab_port[p], &ur_get(tmplt, data, F_SRC_IP), record_ip, data, tmplt,  average_packets / 3,  average_bytes / 3);
-            }
-         }
-      }
-
-      /* Flows */
-      process_flows(array_of_bytes,  sorted_array_of_bytes, record_bytes, array_counter);
-      process_flows(array_of_packets, sorted_array_of_packets, record_packets, array_counter);
-      if (array_counter < topn) {
-         array_counter++;
-      }
-
-      if (port_set != -1) {
-         for (int p = 0; p < port_cnt; p++) {
-            if (record_bytes->dst_port == port[p] || record_bytes->src_port == port[p]) {
-               process_flows(array_of_bytes_port[p], sorted_array_of_bytes_port[p], record_bytes, array_counter_port[p]);
-               process_flows(array_of_packets_port[p], sorted_array_of_packets_port[p], record_packets, array_counter_port[p]);
-               if (array_counter_port[p] < topn) {
-                  array_counter_port[p]++;
-               }
-            }
-         }
-      }
-
-      /* Ports */
-      array_of_ports[ur_get(tmplt, data, F_DST_PORT)].flows += 1;
-      array_of_ports[ur_get(tmplt, data, F_SRC_PORT)].flows += 1;
-      array_of_ports[ur_get(tmplt, data, F_DST_PORT)].port = ur_get(tmplt, data, F_DST_PORT);
-      array_of_ports[ur_get(tmplt, data, F_SRC_PORT)].port = ur_get(tmplt, data, F_SRC_PORT);
-
-      array_of_ports[ur_get(tmplt, data, F_DST_PORT)].packets += ur_get(tmplt, data, F_PACKETS);
-      array_of_ports[ur_get(tmplt, data, F_SRC_PORT)].packets += ur_get(tmplt, data, F_PACKETS);
-      array_of_ports[ur_get(tmplt, data, F_DST_PORT)].bytes += ur_get(tmplt, data, F_BYTES);
-      array_of_ports[ur_get(tmplt, data, F_SRC_PORT)].bytes += ur_get(tmplt, data, F_BYTES);
-
-
-      if (port_set != -1) {
-         for (int p = 0; p < port_cnt; p++) {
-            if (record_bytes->dst_port == port[p]) {
-               array_of_ports_port[p][ur_get(tmplt, data, F_SRC_PORT)].flows += 1;
-               array_of_ports_port[p][ur_get(tmplt, data, F_SRC_PORT)].port = ur_get(tmplt, data, F_SRC_PORT);
-
-               array_of_ports_port[p][ur_get(tmplt, data, F_SRC_PORT)].packets += ur_get(tmplt, data, F_PACKETS);
-               array_of_ports_port[p][ur_get(tmplt, data, F_SRC_PORT)].bytes += ur_get(tmplt, data, F_BYTES);
-            }
-
-            if (record_bytes->src_port == port[p]) {
-               array_of_ports_port[p][ur_get(tmplt, data, F_DST_PORT)].flows += 1;
-               array_of_ports_port[p][ur_get(tmplt, data, F_DST_PORT)].port = ur_get(tmplt, data, F_DST_PORT);
-
-               array_of_ports_port[p][ur_get(tmplt, data, F_DST_PORT)].packets += ur_get(tmplt, data, F_PACKETS);
-               array_of_ports_port[p][ur_get(tmplt, data, F_DST_PORT)].bytes += ur_get(tmplt, data, F_BYTES);
-            }
-         }
-      }
-
-      /* Printing results after time is up */
+      /* Reporting results after time is up */
       if (print_stats == 1) {
-         time_print = time(NULL);
-         struct tm tmp_tm;
-         strftime(time_print_buff, 128, "%Y-%m-%d %H:%M:%S", localtime_r (&time_print, &tmp_tm));
-         printf ("\n===================\n%s\n===================\n", time_print_buff);
-
-         print_top_flows(sorted_array_of_bytes, sorted_array_of_packets, array_counter, ip_string, ip_string2, -1);
-         array_counter = 0;
-
-         if (port_set != -1) {
-            for (int p = 0; p < port_cnt; p++) {
-               print_top_flows(sorted_array_of_bytes_port[p], sorted_array_of_packets_port[p], array_counter_port[p], ip_string, ip_string2, port[p]);
-               array_counter_port[p] = 0;
-            }
-         }
-
-         print_top_ports(array_of_ports, -1);
-         memset(array_of_ports, 0, sizeof(port_t) * 65536);
-
-         if (port_set != -1) {
-            for (int p = 0; p < port_cnt; p++) {
-               print_top_ports(array_of_ports_port[p], port[p]);
-               memset(array_of_ports_port[p], 0, sizeof(port_t) * 65536);
-            }
-         }
-
-         print_top_ip(ip_string, table_pab, iter_pab, table_flows, iter_flows, -1, 0);
-         fhf_clear(table_pab);
-         fhf_reinit_iter(iter_pab);
-         fht_clear(table_flows);
-         fht_reinit_iter(iter_flows);
-
-         if (port_set != -1) {
-            for (int p = 0; p < port_cnt; p++) {
-               print_top_ip(ip_string, table_pab_port[p], iter_pab_port[p], table_flows_port[p], iter_flows_port[p], port[p], 0);
-               fhf_clear(table_pab_port[p]);
-               fhf_reinit_iter(iter_pab_port[p]);
-               fht_clear(table_flows_port[p]);
-               fht_reinit_iter(iter_flows_port[p]);
-            }
-         }
-
-         if (prefix_set == 1) {
-            print_top_ip(ip_string, table_prefix_pab, iter_prefix_pab, table_prefix_flows, iter_prefix_flows, -1, 1);
-            fhf_clear(table_prefix_pab);
-            fhf_reinit_iter(iter_prefix_pab);
-            fht_clear(table_prefix_flows);
-            fht_reinit_iter(iter_prefix_flows);
-
-            if (port_set != -1) {
-               for (int p = 0; p < port_cnt; p++) {
-                  print_top_ip(ip_string, table_prefix_pab_port[p], iter_prefix_pab_port[p], table_prefix_flows_port[p], iter_prefix_flows_port[p], port[p], 1);
-                  fhf_clear(table_prefix_pab_port[p]);
-                  fhf_reinit_iter(iter_prefix_pab_port[p]);
-                  fht_clear(table_prefix_flows_port[p]);
-                  fht_reinit_iter(iter_prefix_flows_port[p]);
-               }
-            }
-
-            if (prefix_only_v4 == -1) {
-               print_top_ip(ip_string, table_prefix_pab_v6, iter_prefix_pab_v6, table_prefix_flows_v6, iter_prefix_flows_v6, -1, 1);
-               fhf_clear(table_prefix_pab_v6);
-               fhf_reinit_iter(iter_prefix_pab_v6);
-               fht_clear(table_prefix_flows_v6);
-               fht_reinit_iter(iter_prefix_flows_v6);
-
-               if (port_set != -1) {
-                  for (int p = 0; p < port_cnt; p++) {
-                     print_top_ip(ip_string, table_prefix_pab_port_v6[p], iter_prefix_pab_port_v6[p], table_prefix_flows_port_v6[p], iter_prefix_flows_port_v6[p], port[p], 1);
-                     fhf_clear(table_prefix_pab_port_v6[p]);
-                     fhf_reinit_iter(iter_prefix_pab_port_v6[p]);
-                     fht_clear(table_prefix_flows_port_v6[p]);
-                     fht_reinit_iter(iter_prefix_flows_port_v6[p]);
-                  }
-               }
-            }
-         }
-
+         current_slot = complete_slot(current_slot);
          print_stats = 0;
 
-         received_flows = 0;
-         all_bytes = 0;
-         average_bytes = 0;
-         all_packets = 0;
-         average_packets = 0;
-
          alarm(interval);
-
-         seedMT(time(NULL));
-         time1 = time(NULL);
-      }
-   }
-
-   /* Printing final results after interrupt */
-
-   time_print = time(NULL);
-   struct tm tmp_tm;
-   strftime (time_print_buff, 128, "%Y-%m-%d %H:%M:%S", localtime_r (&time_print, &tmp_tm));
-   printf ("\n===================\n%s\n===================\n", time_print_buff);
-
-   print_top_flows(sorted_array_of_bytes, sorted_array_of_packets, array_counter, ip_string, ip_string2, -1);
-
-   if (port_set != -1) {
-      for (int p = 0; p < port_cnt; p++) {
-         print_top_flows(sorted_array_of_bytes_port[p], sorted_array_of_packets_port[p], array_counter_port[p], ip_string, ip_string2, port[p]);
-      }
-   }
-
-   print_top_ports(array_of_ports, -1);
-
-   if (port_set != -1) {
-      for (int p = 0; p < port_cnt; p++) {
-         print_top_ports(array_of_ports_port[p], port[p]);
-      }
-   }
-
-   print_top_ip(ip_string, table_pab, iter_pab, table_flows, iter_flows, -1, 0);
-
-   if (port_set != -1) {
-      for (int p = 0; p < port_cnt; p++) {
-         print_top_ip(ip_string, table_pab_port[p], iter_pab_port[p], table_flows_port[p], iter_flows_port[p], port[p], 0);
       }
    }
 
-   if (prefix_set == 1) {
-      print_top_ip(ip_string, table_prefix_pab, iter_prefix_pab, table_prefix_flows, iter_prefix_flows,-1, 1);
-
-      if (port_set != -1) {
-         for (int p = 0; p < port_cnt; p++) {
-            print_top_ip(ip_string, table_prefix_pab_port[p], iter_prefix_pab_port[p], table_prefix_flows_port[p], iter_prefix_flows_port[p], port[p], 1);
-         }
-      }
-
-      if (prefix_only_v4 == -1) {
-         print_top_ip(ip_string, table_prefix_pab_v6, iter_prefix_pab_v6, table_prefix_flows_v6, iter_prefix_flows_v6, -1, 1);
-
-         if (port_set != -1) {
-            for (int p = 0; p < port_cnt; p++) {
-               print_top_ip(ip_string, table_prefix_pab_port_v6[p], iter_prefix_pab_port_v6[p], table_prefix_flows_port_v6[p], iter_prefix_flows_port_v6[p], port[p], 1);
-            }
-         }
-      }
-   }
+   /* Reporting final results after interrupt */
+   complete_slot(current_slot);
 
+   pthread_mutex_lock(&report_mutex);
+   report_finish = 1;
+   pthread_cond_broadcast(&report_cond);
+   pthread_mutex_unlock(&report_mutex);
+   pthread_join(report_thread, NULL);
 
    /* Cleanup */
    /* Alarm has to be cancelled before cleanup */
    alarm(0);
 
-   free(ip_string2);
-   free(ip_string);
-
-   if (port_set != -1) {
-      for (int i = 0; i < port_cnt; i++) {
-         free(sorted_array_of_bytes_port[i]);
-         free(array_of_bytes_port[i]);
-         free(sorted_array_of_packets_port[i]);
-         free(array_of_packets_port[i]);
-      }
-
-      free(array_of_bytes_port);
-      free(sorted_array_of_bytes_port);
-      free(array_of_packets_port);
-      free(sorted_array_of_packets_port);
-
-      free(array_counter_port);
-
-      free(port);
+   for (int i = 0; i < slot_cnt; i++) {
+      topn_stats_destroy(&slots[i]);
    }
+   free(slots);
 
-   free(record_bytes);
-   free(sorted_array_of_bytes);
-   free(array_of_bytes);
-   free(record_packets);
-   free(sorted_array_of_packets);
-   free(array_of_packets);
-
-
-   free(array_of_ports);
-
-   if (port_set != -1) {
-      for (int i = 0; i < port_cnt; i++) {
-         free(array_of_ports_port[i]);
-      }
-      free(array_of_ports_port);
+   if (window_slots > 1) {
+      topn_stats_destroy(&window_stats);
    }
 
-   free(record_ip);
-
-
-   fhf_destroy(table_pab);
-   fhf_destroy_iter(iter_pab);
-
-   fht_destroy(table_flows);
-   fht_destroy_iter(iter_flows);
-
-   if (port_set != -1)  {
-      for (int i = 0; i < port_cnt; i++) {
-         fhf_destroy(table_pab_port[i]);
-         fhf_destroy_iter(iter_pab_port[i]);
-
-         fht_destroy(table_flows_port[i]);
-         fht_destroy_iter(iter_flows_port[i]);
-      }
-
-      free(table_pab_port);
-      free(iter_pab_port);
-
-      free(table_flows_port);
-      free(iter_flows_port);
-   }
-
-   free(key_lost);
-   free(data_lost);
-
-   if (prefix_set == 1) {
-      fht_destroy(table_prefix_flows);
-      fht_destroy_iter(iter_prefix_flows);
-
-      fhf_destroy(table_prefix_pab);
-      fhf_destroy_iter(iter_prefix_pab);
-
-      if (prefix_only_v4 == -1) {
-         fht_destroy(table_prefix_flows_v6);
-         fht_destroy_iter(iter_prefix_flows_v6);
-
-         fhf_destroy(table_prefix_pab_v6);
-         fhf_destroy_iter(iter_prefix_pab_v6);
-      }
-
-      if (port_set != -1) {
-         for (int i = 0; i < port_cnt; i++) {
-            fhf_destroy(table_prefix_pab_port[i]);
-            fhf_destroy_iter(iter_prefix_pab_port[i]);
-
-            fht_destroy(table_prefix_flows_port[i]);
-            fht_destroy_iter(iter_prefix_flows_port[i]);
-
-            if (prefix_only_v4 == -1) {
-               fhf_destroy(table_prefix_pab_port_v6[i]);
-               fhf_destroy_iter(iter_prefix_pab_port_v6[i]);
-
-               fht_destroy(table_prefix_flows_port_v6[i]);
-               fht_destroy_iter(iter_prefix_flows_port_v6[i]);
-            }
-         }
-
-         free(table_prefix_pab_port);
-         free(iter_prefix_pab_port);
-
-         free(table_prefix_flows_port);
-         free(iter_prefix_flows_port);
-
-         if (prefix_only_v4 == -1) {
-            free(table_prefix_pab_port_v6);
-            free(iter_prefix_pab_port_v6);
-
-            free(table_prefix_flows_port_v6);
-            free(iter_prefix_flows_port_v6);
-         }
-      }
-   }
+   free(port_buffer);
+   free(port);
+   free(port_index);
 
    /* Trap cleanup before exiting */
    TRAP_DEFAULT_FINALIZATION();
 
+   if (out_tmplt != NULL) {
+      ur_free_record(out_rec);
+      ur_free_template(out_tmplt);
+   }
    ur_finalize();
    ur_free_template(tmplt);
    FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
@@ -813,139 +411,65 @@ void sig_handler(int signal)
    print_stats = 1;
 }
 
-int get_array_index(uint32_t key, flow_t **sorted_array, size_t num) {
-   if (sorted_array[0]->max_number > key) {
-      return -1;
-   }
-
-   /**
-   * In case sorted_array has less than 4 elements, I process it manually.
-   * It's because main algorithm (see below) doesn't work well for 1, 2 and 3 members.
-   */
+int flow_heap_init(flow_heap_t *heap)
+{
+   heap->flows = malloc(topn * sizeof(flow_t));
+   heap->count = 0;
 
-   if (num == 1) {
-      if (sorted_array[0]->max_number > key) {
-         return -1;
-      } else {
-         return 0;
-      }
-   }
+   return heap->flows == NULL ? -1 : 0;
+}
 
-   if (num == 2) {
-      if (sorted_array[0]->max_number > key) {
-         return -1;
-      } else if (sorted_array[0]->max_number < key) {
-         if (sorted_array[1]->max_number > key) {
-            return 0;
-         } else if (sorted_array[1]->max_number == key) {
-            return 0;
-         } else {
-            return 1;
-         }
-      }
-   }
+void process_flows(flow_heap_t *heap, const flow_t *record)
+{
+   flow_t *flows = heap->flows;
+   int pos;
 
-   if (num == 3) {
-      if (sorted_array[0]->max_number > key) {
-         return -1;
-      } else if (sorted_array[0]->max_number < key) {
-         if (sorted_array[1]->max_number > key) {
-            return 0;
-         } else if (sorted_array[1]->max_number == key) {
-            return 0;
-         } else {
-            if (sorted_array[2]->max_number > key) {
-               return 1;
-            } else if (sorted_array[2]->max_number == key) {
-               return 1;
-            } else {
-               return 2;
-            }
-         }
-      }
-   }
+   if (heap->count < topn) {
+      /* Heap is not full yet, record is added as a new leaf */
+      pos = heap->count++;
 
-   int first = 0;
-   int last = num -1;
-   int middle = (first + last) / 2;
+      while (pos > 0) {
+         int parent = (pos - 1) / 2;
 
-   while (first <= last) {
-      if (sorted_array[middle]->max_number < key) {
-         first = middle + 1;
-      } else if (sorted_array[middle]->max_number == key) {
-         while (sorted_array[middle]->max_number == key) {
-            if (middle == 0) {
-               return -1;
-            }
-            middle--;
+         if (flows[parent].max_number <= record->max_number) {
+            break;
          }
-         return middle;
-      } else {
-         last = middle - 1;
+         flows[pos] = flows[parent];
+         pos = parent;
       }
-
-      middle = (first + last) / 2;
+      flows[pos] = *record;
+      return;
    }
 
-   if (first > last) {
-      if (last == -1) {
-         return -1;
-      } else if (first -1 != -1) {
-         return first -1;
-      }
+   if (record->max_number <= flows[0].max_number) {
+      return;
    }
-   return -1;
-}
-
-void process_flows(flow_t *array, flow_t **sorted_array, flow_t *record, int array_counter)
-{
-   int array_index;
-
-   if (array_counter == 0) {
-      sorted_array[0] = memmove(&array[0], record, sizeof(flow_t));
-   } else if (array_counter < topn) {
-      array_index = get_array_index (record->max_number, sorted_array, array_counter);
-
-      if (array_counter == 1) {
-         if (array_index == -1) {
-            sorted_array[1] = sorted_array[0];
-            sorted_array[0] = memmove(&array[1], record, sizeof(flow_t));
-         } else {
-            sorted_array[1] = memmove(&array[1], record, sizeof(flow_t));
-         }
-      } else {
-         if (array_index == -1) {
-            for (int i = array_counter; i > 0; i--) {
-               sorted_array[i] = sorted_array[i-1];
-            }
-
-            sorted_array[0] = memmove(&array[array_counter], record, sizeof(flow_t));
-         } else if (array_index != -1) {
-            for (int i = array_counter; i > array_index + 1; i--) {
-               sorted_array[i] = sorted_array[i-1];
-            }
 
-            sorted_array[array_index + 1] = memmove(&array[array_counter], record, sizeof(flow_t));
+   /* Record replaces the smallest of top N flows */
+   pos = 0;
+   for (;;) {
+      int child = 2 * pos + 1;
 
-         }
+      if (child >= heap->count) {
+         break;
       }
-   } else if (array_counter == topn) {
-      array_index = get_array_index (record->max_number, sorted_array, array_counter);
-
-      if (array_index != -1) {
-         flow_t *temp = sorted_array[0];
-
-         for (int i = 0; i < array_index; i++) {
-            sorted_array[i] = sorted_array[i + 1];
-         }
-
-         sorted_array[array_index] = memmove(temp, record, sizeof(flow_t));
+      if (child + 1 < heap->count && flows[child + 1].max_number < flows[child].max_number) {
+         child++;
+      }
+      if (flows[child].max_number >= record->max_number) {
+         break;
       }
+      flows[pos] = flows[child];
+      pos = child;
    }
+   flows[pos] = *record;
 }
 
-void print_top_flows(flow_t **sorted_array_of_bytes, flow_t **sorted_array_of_packets, int array_counter, char *ip_string, char *ip_string2, int port_number)
+void print_top_flows(flow_heap_t *flows_bytes, flow_heap_t *flows_packets, char *ip_string, char *ip_string2, int port_number)
 {
+   qsort(flows_bytes->flows, flows_bytes->count, sizeof(flow_t), compare_max_number);
+   qsort(flows_packets->flows, flows_packets->count, sizeof(flow_t), compare_max_number);
+
    printf("\n");
    if (port_number == -1) {
       printf("Top flows based on transferred bytes\n");
@@ -955,13 +479,16 @@ void print_top_flows(flow_t **sorted_array_of_bytes, flow_t **sorted_array_of_pa
    printf("------------------------------------\n");
    printf("N | Src ip | Dst ip | Src port | Dst port | Protocol | Bytes\n");
 
-   int y = 0;
-   for (int i = array_counter-1; i >= 0; y++, i--) {
-      ip_to_str(&sorted_array_of_bytes[i]->src_ip, ip_string);
-      ip_to_str(&sorted_array_of_bytes[i]->dst_ip, ip_string2);
+   for (int i = 0; i < flows_bytes->count; i++) {
+      flow_t *flow = &flows_bytes->flows[i];
+
+      ip_to_str(&flow->src_ip, ip_string);
+      ip_to_str(&flow->dst_ip, ip_string2);
 
-      printf("%d\t%s\t%s\t%d\t%d\t%d\t%u\n", y + 1, ip_string, ip_string2,
-      sorted_array_of_bytes[i]->src_port, sorted_array_of_bytes[i]->dst_port, sorted_array_of_bytes[i]->protocol,sorted_array_of_bytes[i]->max_number);
+      printf("%d\t%s\t%s\t%d\t%d\t%d\t%u\n", i + 1, ip_string, ip_string2,
+      flow->src_port, flow->dst_port, flow->protocol, flow->max_number);
+      send_entry(TOPN_ENTITY_FLOW, TOPN_METRIC_BYTES, port_number, 0, i + 1, &flow->src_ip, &flow->dst_ip,
+      flow->src_port, flow->dst_port, flow->protocol, flow->max_number, 0);
    }
 
    printf("\n");
@@ -973,19 +500,139 @@ void print_top_flows(flow_t **sorted_array_of_bytes, flow_t **sorted_array_of_pa
    printf("------------------------------------\n");
    printf("N | Src ip | Dst ip | Src port | Dst port | Protocol | Packets\n");
 
-   y=0;
-   for (int i = array_counter-1; i >= 0; y++, i--) {
-      ip_to_str(&sorted_array_of_packets[i]->src_ip, ip_string);
-      ip_to_str(&sorted_array_of_packets[i]->dst_ip, ip_string2);
+   for (int i = 0; i < flows_packets->count; i++) {
+      flow_t *flow = &flows_packets->flows[i];
 
-      printf("%d\t%s\t%s\t%d\t%d\t%d\t%u\n", y + 1, ip_string, ip_string2,
-      sorted_array_of_packets[i]->src_port, sorted_array_of_packets[i]->dst_port, sorted_array_of_packets[i]->protocol, sorted_array_of_packets[i]->max_number);
+      ip_to_str(&flow->src_ip, ip_string);
+      ip_to_str(&flow->dst_ip, ip_string2);
+
+      printf("%d\t%s\t%s\t%d\t%d\t%d\t%u\n", i + 1, ip_string, ip_string2,
+      flow->src_port, flow->dst_port, flow->protocol, flow->max_number);
+      send_entry(TOPN_ENTITY_FLOW, TOPN_METRIC_PACKETS, port_number, 0, i + 1, &flow->src_ip, &flow->dst_ip,
+      flow->src_port, flow->dst_port, flow->protocol, flow->max_number, 0);
    }
 }
 
-void print_top_ports(port_t *array_of_ports, int port_number)
+int port_stats_init(port_stats_t *stats)
 {
-   qsort (array_of_ports, 65536, sizeof(port_t), compare_flows);
+   stats->ports = malloc(PORT_STATS_INIT * sizeof(port_t));
+   stats->index = calloc(2 * PORT_STATS_INIT, sizeof(uint32_t));
+   stats->index_mask = 2 * PORT_STATS_INIT - 1;
+   stats->used_cnt = 0;
+   stats->size = PORT_STATS_INIT;
+
+   if (stats->ports == NULL || stats->index == NULL) {
+      port_stats_destroy(stats);
+      return -1;
+   }
+   return 0;
+}
+
+/**
+* \brief Function returns first slot of (group, port) in hash index of port statistics.
+*/
+static inline uint32_t port_slot(const port_stats_t *stats, uint16_t group, uint16_t port_number)
+{
+   uint32_t hash = (((uint32_t) group << 16) | port_number) * 2654435761U;
+
+   return (hash ^ (hash >> 16)) & stats->index_mask;
+}
+
+/**
+* \brief Function returns statistics of port, new entry is added if port is not used yet.
+*/
+static port_t *get_port_entry(port_stats_t *stats, uint16_t group, uint16_t port_number)
+{
+   uint32_t slot = port_slot(stats, group, port_number);
+   int i;
+
+   while (stats->index[slot] != 0) {
+      port_t *entry = &stats->ports[stats->index[slot] - 1];
+
+      if (entry->port == port_number && entry->group == group) {
+         return entry;
+      }
+      slot = (slot + 1) & stats->index_mask;
+   }
+
+   if (stats->used_cnt == stats->size) {
+      port_t *ports = realloc(stats->ports, 2 * stats->size * sizeof(port_t));
+      uint32_t *index = calloc(4 * (size_t) stats->size, sizeof(uint32_t));
+
+      if (ports == NULL || index == NULL) {
+         malloc_err();
+      }
+      stats->ports = ports;
+      stats->size *= 2;
+
+      /* Index keeps at least half of its slots empty */
+      free(stats->index);
+      stats->index = index;
+      stats->index_mask = 2 * stats->size - 1;
+      for (i = 0; i < stats->used_cnt; i++) {
+         uint32_t s = port_slot(stats, stats->ports[i].group, stats->ports[i].port);
+
+         while (stats->index[s] != 0) {
+            s = (s + 1) & stats->index_mask;
+         }
+         stats->index[s] = i + 1;
+      }
+      slot = port_slot(stats, group, port_number);
+      while (stats->index[slot] != 0) {
+         slot = (slot + 1) & stats->index_mask;
+      }
+   }
+
+   i = stats->used_cnt++;
+   stats->index[slot] = i + 1;
+   memset(&stats->ports[i], 0, sizeof(port_t));
+   stats->ports[i].port = port_number;
+   stats->ports[i].group = group;
+   return &stats->ports[i];
+}
+
+void process_port(port_stats_t *stats, uint16_t group, uint16_t port_number, uint64_t packets, uint64_t bytes)
+{
+   port_t *entry = get_port_entry(stats, group, port_number);
+
+   entry->flows += 1;
+   entry->packets += packets;
+   entry->bytes += bytes;
+}
+
+void port_stats_merge(port_stats_t *dst, const port_stats_t *src)
+{
+   for (int i = 0; i < src->used_cnt; i++) {
+      port_t *entry = get_port_entry(dst, src->ports[i].group, src->ports[i].port);
+
+      entry->flows += src->ports[i].flows;
+      entry->packets += src->ports[i].packets;
+      entry->bytes += src->ports[i].bytes;
+   }
+}
+
+void port_stats_clear(port_stats_t *stats)
+{
+   stats->used_cnt = 0;
+   memset(stats->index, 0, (stats->index_mask + 1) * sizeof(uint32_t));
+}
+
+void port_stats_destroy(port_stats_t *stats)
+{
+   free(stats->ports);
+   free(stats->index);
+   stats->ports = NULL;
+   stats->index = NULL;
+}
+
+/**
+* \brief Function prints top N of given ports, array of ports is reordered.
+*/
+static void print_port_list(port_t *buffer, size_t ports_cnt, int port_number)
+{
+   size_t number_of_ports;
+
+   number_of_ports = partial_sort(buffer, ports_cnt, sizeof(port_t), topn, compare_flows);
    printf("\n");
    if (port_number == -1) {
       printf("Top ports based on transferred flows\n");
@@ -995,14 +642,12 @@ void print_top_ports(port_t *array_of_ports, int port_number)
    printf("------------------------------------\n");
    printf("N\tPort\tFlows\n");
 
-   for (int i = 0; i < topn; i++) {
-      if (array_of_ports[i].flows == 0) {
-         break;
-      }
-      printf("%d\t%u\t%" PRIu64 "\n", i + 1, array_of_ports[i].port, array_of_ports[i].flows);
+   for (size_t i = 0; i < number_of_ports; i++) {
+      printf("%zu\t%u\t%" PRIu64 "\n", i + 1, buffer[i].port, buffer[i].flows);
+      send_entry(TOPN_ENTITY_PORT, TOPN_METRIC_FLOWS, port_number, 0, i + 1, NULL, NULL, buffer[i].port, 0, 0, buffer[i].flows, 0);
    }
 
-   qsort (array_of_ports, 65536, sizeof(port_t), compare_packets);
+   number_of_ports = partial_sort(buffer, ports_cnt, sizeof(port_t), topn, compare_packets);
    printf("\n");
    if (port_number == -1) {
       printf("Top ports based on transferred packets\n");
@@ -1012,14 +657,15 @@ void print_top_ports(port_t *array_of_ports, int port_number)
    printf("------------------------------------\n");
    printf("N\tPort\tPackets\n");
 
-   for (int i = 0; i < topn; i++) {
-      if (array_of_ports[i].packets == 0) {
+   for (size_t i = 0; i < number_of_ports; i++) {
+      if (buffer[i].packets == 0) {
          break;
       }
-      printf("%d\t%u\t%" PRIu64 "\n", i + 1, array_of_ports[i].port, array_of_ports[i].packets);
+      printf("%zu\t%u\t%" PRIu64 "\n", i + 1, buffer[i].port, buffer[i].packets);
+      send_entry(TOPN_ENTITY_PORT, TOPN_METRIC_PACKETS, port_number, 0, i + 1, NULL, NULL, buffer[i].port, 0, 0, buffer[i].packets, 0);
    }
 
-   qsort (array_of_ports, 65536, sizeof(port_t), compare_bytes);
+   number_of_ports = partial_sort(buffer, ports_cnt, sizeof(port_t), topn, compare_bytes);
    printf("\n");
    if (port_number == -1) {
       printf("Top ports based on transferred bytes\n");
@@ -1029,123 +675,171 @@ void print_top_ports(port_t *array_of_ports, int port_number)
    printf("------------------------------------\n");
    printf("N\tPort\tBytes\n");
 
-   for (int i = 0; i < topn; i++) {
-      if (array_of_ports[i].bytes == 0) {
+   for (size_t i = 0; i < number_of_ports; i++) {
+      if (buffer[i].bytes == 0) {
          break;
       }
-      printf("%d\t%u\t%" PRIu64 "\n", i + 1, array_of_ports[i].port, array_of_ports[i].bytes);
+      printf("%zu\t%u\t%" PRIu64 "\n", i + 1, buffer[i].port, buffer[i].bytes);
+      send_entry(TOPN_ENTITY_PORT, TOPN_METRIC_BYTES, port_number, 0, i + 1, NULL, NULL, buffer[i].port, 0, 0, buffer[i].bytes, 0);
    }
 }
 
-void print_top_ip(char *ip_string, fhf_table_t *table_pab, fhf_iter_t *iter_pab, fht_table_t *table_flows, fht_iter_t *iter_flows, int port_number, int prefix_set)
+void print_top_ports(port_stats_t *stats, port_t *buffer, int port_number)
 {
-   ip_t *ip_array = (void *) &(table_flows->data_field[0]);
-   int number_of_records = 0;
+   memcpy(buffer, stats->ports, stats->used_cnt * sizeof(port_t));
+   print_port_list(buffer, stats->used_cnt, port_number);
+}
 
-   /* Flows */
-   while (fht_get_next_iter(iter_flows) != FHF_ITER_RET_END) {
-      ip_t *entry = (void *) &iter_flows->data_ptr[0];
-      ip_addr_t *address = (void *) &iter_flows->key_ptr[0];
+void print_top_ports_port(port_stats_t *stats)
+{
+   port_t *grouped = malloc((stats->used_cnt + 1) * sizeof(port_t));
+   int *end = calloc(port_cnt, sizeof(int));
+   int start = 0;
+
+   if (grouped == NULL || end == NULL) {
+      malloc_err();
+   }
 
-      ip_array[number_of_records].flows = entry->flows;
-      ip_array[number_of_records].packets = entry->packets;
-      ip_array[number_of_records].bytes = entry->bytes;
-      ip_array[number_of_records].src_ip = address[0];
+   /* Counting sort by port from -p parameter, end[p] is the first entry after group of port p */
+   for (int i = 0; i < stats->used_cnt; i++) {
+      end[stats->ports[i].group - 1]++;
+   }
+   for (int p = 0; p < port_cnt; p++) {
+      int cnt = end[p];
+      end[p] = start;
+      start += cnt;
+   }
+   for (int i = 0; i < stats->used_cnt; i++) {
+      grouped[end[stats->ports[i].group - 1]++] = stats->ports[i];
+   }
 
-      number_of_records++;
+   start = 0;
+   for (int p = 0; p < port_cnt; p++) {
+      print_port_list(grouped + start, end[p] - start, port[p]);
+      start = end[p];
    }
 
+   free(grouped);
+   free(end);
+}
+
+/**
+* \brief Function prints list of IPs (or networks), first number_of_records of items are the top N sorted by count.
+*
+* \param items Monitored IPs of the list.
+* \param items_cnt Number of items.
+* \param number_of_records Number of printed items.
+* \param unmonitored Bound of real value of IPs that are not monitored.
+* \param total Sum of the statistic.
+*/
+static void print_ip_list(char *ip_string, ss_item_t *items, uint32_t items_cnt, uint32_t number_of_records, uint64_t unmonitored, uint64_t total,
+                          int metric, int port_number, int prefix_length)
+{
+   const char *name = metric_names[metric];
+   uint8_t entity = (prefix_length == 0) ? TOPN_ENTITY_IP : TOPN_ENTITY_NETWORK;
+   uint64_t unlisted;
+
    if (number_of_records == 0) {
       return;
    }
 
-   qsort (ip_array, number_of_records, sizeof(ip_t), compare_flows_table);
+   /* Real value of any IP that is not listed is at most the biggest count of the others or the smallest counter */
+   unlisted = unmonitored;
+   for (uint32_t i = number_of_records; i < items_cnt; i++) {
+      if (items[i].count > unlisted) {
+         unlisted = items[i].count;
+      }
+   }
+
    printf("\n");
-   if (prefix_set == 0) {
+   if (prefix_length == 0) {
       if (port_number == -1) {
-         printf("Top IPs based on transferred flows\n");
+         printf("Top IPs based on transferred %s\n", name);
       } else {
-         printf("Top IPs based on transferred flows by port %d\n", port_number);
+         printf("Top IPs based on transferred %s by port %d\n", name, port_number);
       }
    } else {
       if (port_number == -1) {
-         printf("Top networks based on transferred flows\n");
+         printf("Top networks based on transferred %s\n", name);
       } else {
-         printf("Top networks based on transferred flows by port %d\n", port_number);
+         printf("Top networks based on transferred %s by port %d\n", name, port_number);
       }
    }
    printf("------------------------------------\n");
-   printf("N\tIP\t\tFlows\n");
-
-   for (int i = 0; i < topn && i < number_of_records; i++) {
-      ip_to_str(&ip_array[i].src_ip, ip_string);
-      printf("%d\t%s\t%" PRIu64 "\n", i + 1, ip_string, ip_array[i].flows);
+   if (port_number == -1) {
+      printf("Unlisted entries have at most %" PRIu64 " %s (total %" PRIu64 ")\n", unlisted, name, total);
+   } else {
+      printf("Unlisted entries have at most %" PRIu64 " %s (total %" PRIu64 " of all ports from -p)\n", unlisted, name, total);
    }
+   printf("N\tIP\t\t%c%s\tError\n", toupper(name[0]), name + 1);
 
+   for (uint32_t i = 0; i < number_of_records; i++) {
+      ip_to_str((ip_addr_t *) items[i].key, ip_string);
+      printf("%u\t%s\t%" PRIu64 "\t%" PRIu64 "\n", i + 1, ip_string, items[i].count, items[i].error);
+      send_entry(entity, metric, port_number, prefix_length, i + 1, (const ip_addr_t *) items[i].key, NULL, 0, 0, 0, items[i].count, items[i].error);
+   }
+}
 
-   /* Packets */
-   ip_array = (void *) &(table_pab->data_field[0]);
-   number_of_records = 0;
+void print_top_ip_stats(char *ip_string, ss_table_t *table, int metric, int port_number, int prefix_length)
+{
+   ss_item_t *items;
+   uint32_t number_of_records = ss_top(table, topn, &items);
 
-   while (fhf_get_next_iter(iter_pab) != FHF_ITER_RET_END) {
-      ip_t *entry = (ip_t *) &iter_pab->data_ptr[0];
-      ip_addr_t *address = (ip_addr_t *) &iter_pab->key_ptr[0];
+   print_ip_list(ip_string, items, table->size, number_of_records, ss_unmonitored_bound(table), table->total, metric, port_number, prefix_length);
+}
 
-      ip_array[number_of_records].flows = entry->flows;
-      ip_array[number_of_records].packets = entry->packets;
-      ip_array[number_of_records].bytes = entry->bytes;
-      ip_array[number_of_records].src_ip = address[0];
+void print_top_ip(char *ip_string, ip_stats_t *stats, int port_number, int prefix_length)
+{
+   print_top_ip_stats(ip_string, stats->flows, TOPN_METRIC_FLOWS, port_number, prefix_length);
+   print_top_ip_stats(ip_string, stats->packets, TOPN_METRIC_PACKETS, port_number, prefix_length);
+   print_top_ip_stats(ip_string, stats->bytes, TOPN_METRIC_BYTES, port_number, prefix_length);
+}
 
-      number_of_records++;
+void print_top_ip_port_stats(char *ip_string, ss_table_t *table, int metric, int prefix_length)
+{
+   ss_item_t *items;
+   uint32_t items_cnt = ss_items(table, &items);
+   ss_item_t *grouped = malloc((items_cnt + 1) * sizeof(ss_item_t));
+   uint32_t *end = calloc(port_cnt, sizeof(uint32_t));
+   uint32_t start = 0;
+   port_ip_t key;
+
+   if (grouped == NULL || end == NULL) {
+      malloc_err();
    }
 
-   qsort (ip_array, number_of_records, sizeof(ip_t), compare_packets_table);
-   printf("\n");
-   if (prefix_set == 0) {
-      if (port_number == -1) {
-         printf("Top IPs based on transferred packets\n");
-      } else {
-         printf("Top IPs based on transferred packets by port %d\n", port_number);
-      }
-   } else {
-      if (port_number == -1) {
-         printf("Top networks based on transferred packets\n");
-      } else {
-         printf("Top networks based on transferred packets by port %d\n", port_number);
-      }
+   /* Counting sort by port groups items in one pass, end[p] is the first item after group of port p */
+   for (uint32_t i = 0; i < items_cnt; i++) {
+      memcpy(&key, items[i].key, sizeof(port_ip_t));
+      end[key.port_index]++;
    }
-   printf("------------------------------------\n");
-   printf("N\tIP\t\tPackets\n");
-
-   for (int i = 0; i < topn && i < number_of_records; i++) {
-      ip_to_str(&ip_array[i].src_ip, ip_string);
-      printf("%d\t%s\t%" PRIu64 "\n", i + 1, ip_string, ip_array[i].packets);
+   for (int p = 0; p < port_cnt; p++) {
+      uint32_t cnt = end[p];
+      end[p] = start;
+      start += cnt;
+   }
+   for (uint32_t i = 0; i < items_cnt; i++) {
+      memcpy(&key, items[i].key, sizeof(port_ip_t));
+      grouped[end[key.port_index]++] = items[i];
    }
 
+   start = 0;
+   for (int p = 0; p < port_cnt; p++) {
+      uint32_t number_of_records = partial_sort(grouped + start, end[p] - start, sizeof(ss_item_t), topn, ss_compare_items);
 
-   /* Bytes */
-   qsort (ip_array, number_of_records, sizeof(ip_t), compare_bytes_table);
-   printf("\n");
-   if (prefix_set == 0) {
-      if (port_number == -1) {
-         printf("Top IPs based on transferred bytes\n");
-      } else {
-         printf("Top IPs based on transferred bytes by port %d\n", port_number);
-      }
-   } else {
-      if (port_number == -1) {
-         printf("Top networks based on transferred bytes\n");
-      } else {
-         printf("Top networks based on transferred bytes by port %d\n", port_number);
-      }
+      print_ip_list(ip_string, grouped + start, end[p] - start, number_of_records, ss_unmonitored_bound(table), table->total, metric, port[p], prefix_length);
+      start = end[p];
    }
-   printf("------------------------------------\n");
-   printf("N\tIP\t\tBytes\n");
 
-   for (int i = 0; i < topn && i < number_of_records; i++) {
-      ip_to_str(&ip_array[i].src_ip, ip_string);
-      printf("%d\t%s\t%" PRIu64 "\n", i + 1, ip_string, ip_array[i].bytes);
-   }
+   free(grouped);
+   free(end);
+}
+
+void print_top_ip_port(char *ip_string, ip_stats_t *stats, int prefix_length)
+{
+   print_top_ip_port_stats(ip_string, stats->flows, TOPN_METRIC_FLOWS, prefix_length);
+   print_top_ip_port_stats(ip_string, stats->packets, TOPN_METRIC_PACKETS, prefix_length);
+   print_top_ip_port_stats(ip_string, stats->bytes, TOPN_METRIC_BYTES, prefix_length);
 }
 
 int process_prefix_args(char *optarg, uint64_t *prefix128, uint32_t *prefix, int *prefix_set, int *prefix_only_v4)
@@ -1216,8 +910,9 @@ int process_ports_args(char *optarg) {
    }
 
    port = malloc((port_cnt + 1) * (sizeof(int)));
+   port_index = calloc(65536, sizeof(uint16_t));
 
-   if (port == NULL) {
+   if (port == NULL || port_index == NULL) {
       return -1;
    }
 
@@ -1232,10 +927,11 @@ int process_ports_args(char *optarg) {
 
       port[port_cnt] = strtol(token, &end, 10);
 
-      if (port[port_cnt] == 0 && end == token) {
+      if ((port[port_cnt] == 0 && end == token) || port[port_cnt] > 65535 || port_index[port[port_cnt]] != 0) {
          return -1;
       }
 
+      port_index[port[port_cnt]] = port_cnt + 1;
       port_cnt++;
       token = strtok(NULL, ",");
    }
@@ -1246,85 +942,458 @@ int process_ports_args(char *optarg) {
 }
 
 
-void process_ip_flows(fht_table_t *table_flows, ip_addr_t *ip, ip_t *record, ip_addr_t *key_lost, ip_t *data_lost, const void *data, ur_template_t *tmplt)
+int ip_stats_init(ip_stats_t *stats, size_t memory, uint32_t key_size)
 {
-   ip_t *record2 = NULL;
-   uint64_t table_row;
-   uint64_t table_col_row;
-   int ret;
-   int removed = 0;
+   uint32_t capacity = ss_capacity(memory, key_size);
+
+   stats->flows = ss_init(capacity, key_size);
+   stats->packets = ss_init(capacity, key_size);
+   stats->bytes = ss_init(capacity, key_size);
+
+   if (stats->flows == NULL || stats->packets == NULL || stats->bytes == NULL) {
+      ip_stats_destroy(stats);
+      return -1;
+   }
+   return 0;
+}
+
+void process_ip(ip_stats_t *stats, const void *key, uint64_t packets, uint64_t bytes)
+{
+   uint32_t hash = ss_hash(key, stats->flows->key_size);
+
+   ss_update_hash(stats->flows, key, hash, 1);
+   ss_update_hash(stats->packets, key, hash, packets);
+   ss_update_hash(stats->bytes, key, hash, bytes);
+}
+
+void ip_stats_clear(ip_stats_t *stats)
+{
+   ss_clear(stats->flows);
+   ss_clear(stats->packets);
+   ss_clear(stats->bytes);
+}
+
+void ip_stats_destroy(ip_stats_t *stats)
+{
+   ss_destroy(stats->flows);
+   ss_destroy(stats->packets);
+   ss_destroy(stats->bytes);
+   stats->flows = NULL;
+   stats->packets = NULL;
+   stats->bytes = NULL;
+}
+
+void ip_stats_merge(ip_stats_t *dst, const ip_stats_t *src)
+{
+   ss_merge(dst->flows, src->flows);
+   ss_merge(dst->packets, src->packets);
+   ss_merge(dst->bytes, src->bytes);
+}
+
+int topn_stats_init(topn_stats_t *stats, size_t memory)
+{
+   memset(stats, 0, sizeof(topn_stats_t));
 
-   int random = randomMT() % FLOWS_RANDOM_MAX;
+   if (flow_heap_init(&stats->flows_bytes) == -1 || flow_heap_init(&stats->flows_packets) == -1 ||
+       port_stats_init(&stats->ports) == -1 || ip_stats_init(&stats->ip, memory, sizeof(ip_addr_t)) == -1) {
+      return -1;
+   }
 
-   if ((record2 = fht_get_data(table_flows, ip)) == NULL) {
-      if (random < FLOWS_RANDOM) {
-         ret = fht_insert(table_flows, ip, record, key_lost, data_lost);
+   if (prefix_set == 1) {
+      if (ip_stats_init(&stats->prefix, memory, sizeof(ip_addr_t)) == -1) {
+         return -1;
+      }
 
-         if (ret == FHT_INSERT_LOST) {
-            table_row = (table_flows->table_rows - 1) & (table_flows->hash_function)(ip, table_flows->key_size);
-            table_col_row = table_row *FHT_TABLE_COLS;
+      if (prefix_only_v4 == -1 && ip_stats_init(&stats->prefix_v6, memory, sizeof(ip_addr_t)) == -1) {
+         return -1;
+      }
+   }
 
-            int timediff = (int) difftime(time(NULL), time1);
-            timediff = (timediff / FLOWS_TIME_INTERVAL) + 1;
+   if (port_set != -1) {
+      stats->flows_bytes_port = calloc(port_cnt, sizeof(flow_heap_t));
+      stats->flows_packets_port = calloc(port_cnt, sizeof(flow_heap_t));
 
-            for (int i = 0; i < FHT_TABLE_COLS; i++) {
-               if (((ip_t *) &(table_flows->data_field[(table_col_row + i) * table_flows->data_size]))->flows < FLOWS_MULTIPLIER * timediff && (ip_cmp(ip, ((ip_addr_t*) &(table_flows->key_field[(table_col_row + i) * table_flows->key_size]))) != 0)) {
-                  fht_remove(table_flows, ((ip_addr_t*) &(table_flows->key_field[(table_col_row + i) * table_flows->key_size])));
-                  removed = 1;
-               }
-            }
+      if (stats->flows_bytes_port == NULL || stats->flows_packets_port == NULL || port_stats_init(&stats->ports_port) == -1) {
+         return -1;
+      }
 
-            if (removed == 1) {
-               if (data_lost->flows >= FLOWS_BIG_BASE + timediff * FLOWS_BIG_MULTIPLIER) {
-                  fht_insert(table_flows, &data_lost->src_ip, data_lost, key_lost, data_lost);
-               }
-            }
+      for (int i = 0; i < port_cnt; i++) {
+         if (flow_heap_init(&stats->flows_bytes_port[i]) == -1 || flow_heap_init(&stats->flows_packets_port[i]) == -1) {
+            return -1;
          }
       }
-   } else {
-      record2->bytes += ur_get(tmplt, data, F_BYTES);
-      record2->packets += ur_get(tmplt, data, F_PACKETS);
-      record2->flows += 1;
+
+      if (ip_stats_init(&stats->ip_port, memory, sizeof(port_ip_t)) == -1) {
+         return -1;
+      }
+
+      if (prefix_set == 1) {
+         if (ip_stats_init(&stats->prefix_port, memory, sizeof(port_ip_t)) == -1) {
+            return -1;
+         }
+
+         if (prefix_only_v4 == -1 && ip_stats_init(&stats->prefix_port_v6, memory, sizeof(port_ip_t)) == -1) {
+            return -1;
+         }
+      }
+   }
+
+   return 0;
+}
+
+void topn_stats_clear(topn_stats_t *stats)
+{
+   stats->time_first = 0;
+   stats->time_last = 0;
+
+   stats->flows_bytes.count = 0;
+   stats->flows_packets.count = 0;
+   port_stats_clear(&stats->ports);
+   ip_stats_clear(&stats->ip);
+
+   if (prefix_set == 1) {
+      ip_stats_clear(&stats->prefix);
+
+      if (prefix_only_v4 == -1) {
+         ip_stats_clear(&stats->prefix_v6);
+      }
+   }
+
+   if (port_set != -1) {
+      for (int p = 0; p < port_cnt; p++) {
+         stats->flows_bytes_port[p].count = 0;
+         stats->flows_packets_port[p].count = 0;
+      }
+      port_stats_clear(&stats->ports_port);
+
+      ip_stats_clear(&stats->ip_port);
+
+      if (prefix_set == 1) {
+         ip_stats_clear(&stats->prefix_port);
+
+         if (prefix_only_v4 == -1) {
+            ip_stats_clear(&stats->prefix_port_v6);
+         }
+      }
+   }
+}
+
+void topn_stats_destroy(topn_stats_t *stats)
+{
+   free(stats->flows_bytes.flows);
+   free(stats->flows_packets.flows);
+   port_stats_destroy(&stats->ports);
+   ip_stats_destroy(&stats->ip);
+   ip_stats_destroy(&stats->prefix);
+   ip_stats_destroy(&stats->prefix_v6);
+
+   if (port_set != -1) {
+      for (int i = 0; i < port_cnt; i++) {
+         if (stats->flows_bytes_port != NULL) {
+            free(stats->flows_bytes_port[i].flows);
+         }
+         if (stats->flows_packets_port != NULL) {
+            free(stats->flows_packets_port[i].flows);
+         }
+      }
+   }
+
+   free(stats->flows_bytes_port);
+   free(stats->flows_packets_port);
+   port_stats_destroy(&stats->ports_port);
+   ip_stats_destroy(&stats->ip_port);
+   ip_stats_destroy(&stats->prefix_port);
+   ip_stats_destroy(&stats->prefix_port_v6);
+}
+
+void topn_stats_merge(topn_stats_t *dst, topn_stats_t *src)
+{
+   if (src->time_first == 0) {
+      return;
+   }
+   if (dst->time_first == 0 || src->time_first < dst->time_first) {
+      dst->time_first = src->time_first;
+   }
+   if (src->time_last > dst->time_last) {
+      dst->time_last = src->time_last;
+   }
+
+   for (int i = 0; i < src->flows_bytes.count; i++) {
+      process_flows(&dst->flows_bytes, &src->flows_bytes.flows[i]);
+   }
+   for (int i = 0; i < src->flows_packets.count; i++) {
+      process_flows(&dst->flows_packets, &src->flows_packets.flows[i]);
+   }
+   port_stats_merge(&dst->ports, &src->ports);
+   ip_stats_merge(&dst->ip, &src->ip);
+
+   if (prefix_set == 1) {
+      ip_stats_merge(&dst->prefix, &src->prefix);
+
+      if (prefix_only_v4 == -1) {
+         ip_stats_merge(&dst->prefix_v6, &src->prefix_v6);
+      }
+   }
+
+   if (port_set != -1) {
+      for (int p = 0; p < port_cnt; p++) {
+         for (int i = 0; i < src->flows_bytes_port[p].count; i++) {
+            process_flows(&dst->flows_bytes_port[p], &src->flows_bytes_port[p].flows[i]);
+         }
+         for (int i = 0; i < src->flows_packets_port[p].count; i++) {
+            process_flows(&dst->flows_packets_port[p], &src->flows_packets_port[p].flows[i]);
+         }
+      }
+      port_stats_merge(&dst->ports_port, &src->ports_port);
+
+      ip_stats_merge(&dst->ip_port, &src->ip_port);
+
+      if (prefix_set == 1) {
+         ip_stats_merge(&dst->prefix_port, &src->prefix_port);
+
+         if (prefix_only_v4 == -1) {
+            ip_stats_merge(&dst->prefix_port_v6, &src->prefix_port_v6);
+         }
+      }
+   }
+}
+
+/**
+* \brief Function adds flow to statistics of port given by -p parameter.
+*
+* \param p Index of the port in -p parameter.
+* \param ip_key Source IP of the flow with port_index set to p.
+* \param prefix_key Masked source IP with port_index set to p, NULL if the prefix of the flow is not computed.
+*/
+static void process_record_port(topn_stats_t *stats, int p, port_ip_t *ip_key, port_ip_t *prefix_key, const flow_t *record_bytes,
+                                const flow_t *record_packets, uint64_t packets, uint64_t bytes)
+{
+   ip_key->port_index = p;
+   process_ip(&stats->ip_port, ip_key, packets, bytes);
+
+   if (prefix_key != NULL) {
+      prefix_key->port_index = p;
+      process_ip(ip_is4(&prefix_key->ip) ? &stats->prefix_port : &stats->prefix_port_v6, prefix_key, packets, bytes);
+   }
+
+   process_flows(&stats->flows_bytes_port[p], record_bytes);
+   process_flows(&stats->flows_packets_port[p], record_packets);
+}
+
+void process_record(topn_stats_t *stats, ur_template_t *tmplt, const void *data)
+{
+   flow_t record_bytes;
+   flow_t record_packets;
+   port_ip_t ip_key;
+   port_ip_t prefix_key;
+   port_ip_t *prefix_key_ptr = NULL;
+   uint64_t packets = ur_get(tmplt, data, F_PACKETS);
+   uint64_t bytes = ur_get(tmplt, data, F_BYTES);
+
+   record_bytes.max_number = ur_get(tmplt, data, F_BYTES);
+   record_bytes.src_ip = ur_get(tmplt, data, F_SRC_IP);
+   record_bytes.dst_ip = ur_get(tmplt, data, F_DST_IP);
+   record_bytes.src_port = ur_get(tmplt, data, F_SRC_PORT);
+   record_bytes.dst_port = ur_get(tmplt, data, F_DST_PORT);
+   record_bytes.protocol = ur_get(tmplt, data, F_PROTOCOL);
+
+   record_packets = record_bytes;
+   record_packets.max_number = ur_get(tmplt, data, F_PACKETS);
+
+   /* Keys are built once, port_index is set only for statistics of ports */
+   memset(&ip_key, 0, sizeof(port_ip_t));
+   ip_key.ip = record_bytes.src_ip;
+
+   /* Prefixes */
+   if (prefix_set == 1) {
+      if (ip_is4(&record_bytes.src_ip) == 1) {
+         memset(&prefix_key, 0, sizeof(port_ip_t));
+         prefix_key.ip = record_bytes.src_ip;
+         prefix_key.ip.ui32[2] = prefix_key.ip.ui32[2] & prefix;
+         prefix_key_ptr = &prefix_key;
+
+         process_ip(&stats->prefix, &prefix_key.ip, packets, bytes);
+      } else if (prefix_only_v4 == -1) {
+         memset(&prefix_key, 0, sizeof(port_ip_t));
+         prefix_key.ip = record_bytes.src_ip;
+         prefix_key.ip.ui64[0] = prefix_key.ip.ui64[0] & prefix128[0];
+         prefix_key.ip.ui64[1] = prefix_key.ip.ui64[1] & prefix128[1];
+         prefix_key_ptr = &prefix_key;
+
+         process_ip(&stats->prefix_v6, &prefix_key.ip, packets, bytes);
+      }
+   }
+
+   /* IPs */
+   process_ip(&stats->ip, &ip_key.ip, packets, bytes);
+
+   /* Flows */
+   process_flows(&stats->flows_bytes, &record_bytes);
+   process_flows(&stats->flows_packets, &record_packets);
+
+   /* Ports */
+   process_port(&stats->ports, 0, record_bytes.dst_port, packets, bytes);
+   process_port(&stats->ports, 0, record_bytes.src_port, packets, bytes);
+
+   if (port_set != -1) {
+      /* Ports of the flow are looked up instead of comparing them with every port from -p parameter */
+      int p_dst = port_index[record_bytes.dst_port] - 1;
+      int p_src = port_index[record_bytes.src_port] - 1;
+
+      if (p_dst != -1) {
+         process_record_port(stats, p_dst, &ip_key, prefix_key_ptr, &record_bytes, &record_packets, packets, bytes);
+         process_port(&stats->ports_port, p_dst + 1, record_bytes.src_port, packets, bytes);
+      }
+
+      if (p_src != -1) {
+         if (p_src != p_dst) {
+            process_record_port(stats, p_src, &ip_key, prefix_key_ptr, &record_bytes, &record_packets, packets, bytes);
+         }
+         process_port(&stats->ports_port, p_src + 1, record_bytes.dst_port, packets, bytes);
+      }
    }
 }
 
-void process_ip_pab(fhf_table_t *table_pab, ip_addr_t *ip, ip_t *record, const void *data, ur_template_t *tmplt, int average_packets, int average_bytes)
+void send_entry(uint8_t entity, uint8_t metric, int port_number, uint8_t prefix_length, uint32_t rank, const ip_addr_t *src_ip, const ip_addr_t *dst_ip,
+                uint16_t src_port, uint16_t dst_port, uint8_t protocol, uint64_t value, uint64_t error)
 {
-   ip_t *record2 = NULL;
-   uint64_t table_row;
-   uint64_t table_col_row;
+   static int send_failed = 0;
+   ip_addr_t zero_ip;
    int ret;
-   int removed = 0;
 
-   if (fhf_get_data(table_pab, ip, (void *) &record2) == FHF_FOUND) {
-      record2->bytes += ur_get(tmplt, data, F_BYTES);
-      record2->packets += ur_get(tmplt, data, F_PACKETS);
-      record2->flows += 1;
-   } else {
-      ret = fhf_insert(table_pab, ip, record);
+   if (out_tmplt == NULL || send_failed) {
+      return;
+   }
+
+   memset(&zero_ip, 0, sizeof(ip_addr_t));
+
+   ur_set(out_tmplt, out_rec, F_TIME_FIRST, report_time_first);
+   ur_set(out_tmplt, out_rec, F_TIME_LAST, report_time_last);
+   ur_set(out_tmplt, out_rec, F_TOPN_ENTITY, entity);
+   ur_set(out_tmplt, out_rec, F_TOPN_METRIC, metric);
+   ur_set(out_tmplt, out_rec, F_TOPN_PORT, port_number);
+   ur_set(out_tmplt, out_rec, F_TOPN_PREFIX, prefix_length);
+   ur_set(out_tmplt, out_rec, F_TOPN_RANK, rank);
+   ur_set(out_tmplt, out_rec, F_SRC_IP, src_ip != NULL ? *src_ip : zero_ip);
+   ur_set(out_tmplt, out_rec, F_DST_IP, dst_ip != NULL ? *dst_ip : zero_ip);
+   ur_set(out_tmplt, out_rec, F_SRC_PORT, src_port);
+   ur_set(out_tmplt, out_rec, F_DST_PORT, dst_port);
+   ur_set(out_tmplt, out_rec, F_PROTOCOL, protocol);
+   ur_set(out_tmplt, out_rec, F_TOPN_VALUE, value);
+   ur_set(out_tmplt, out_rec, F_TOPN_ERROR, error);
+
+   ret = trap_send(0, out_rec, ur_rec_fixlen_size(out_tmplt));
+   TRAP_DEFAULT_SEND_ERROR_HANDLING(ret, return, send_failed = 1);
+}
+
+void report_stats(topn_stats_t *stats)
+{
+   char time_print_buff[128];
+   struct tm tmp_tm;
+   int prefix_length_v4 = __builtin_popcount(prefix);
+   int prefix_length_v6 = __builtin_popcountll(prefix128[0]) + __builtin_popcountll(prefix128[1]);
+
+   report_time_first = ur_time_from_sec_msec(stats->time_first, 0);
+   report_time_last = ur_time_from_sec_msec(stats->time_last, 0);
+
+   strftime(time_print_buff, 128, "%Y-%m-%d %H:%M:%S", localtime_r(&stats->time_last, &tmp_tm));
+   printf("\n===================\n%s\n===================\n", time_print_buff);
+
+   print_top_flows(&stats->flows_bytes, &stats->flows_packets, ip_string, ip_string2, -1);
+
+   if (port_set != -1) {
+      for (int p = 0; p < port_cnt; p++) {
+         print_top_flows(&stats->flows_bytes_port[p], &stats->flows_packets_port[p], ip_string, ip_string2, port[p]);
+      }
+   }
+
+   print_top_ports(&stats->ports, port_buffer, -1);
+
+   if (port_set != -1) {
+      print_top_ports_port(&stats->ports_port);
+   }
+
+   print_top_ip(ip_string, &stats->ip, -1, 0);
+
+   if (port_set != -1) {
+      print_top_ip_port(ip_string, &stats->ip_port, 0);
+   }
+
+   if (prefix_set == 1) {
+      print_top_ip(ip_string, &stats->prefix, -1, prefix_length_v4);
 
-      if (ret == FHF_INSERT_FULL) {
-         table_row = (table_pab->table_rows - 1) & (table_pab->hash_function)(ip, table_pab->key_size, (uint64_t) table_pab);
-         table_col_row = table_row *FHF_TABLE_COLS;
+      if (port_set != -1) {
+         print_top_ip_port(ip_string, &stats->prefix_port, prefix_length_v4);
+      }
 
-         int timediff = (int) difftime(time(NULL), time1);
-         timediff = (timediff / PAB_TIME_INTERVAL) + 1;
+      if (prefix_only_v4 == -1) {
+         print_top_ip(ip_string, &stats->prefix_v6, -1, prefix_length_v6);
 
-         for (int i = 0; i < FHF_TABLE_COLS; i++) {
-            if (((ip_t *) &(table_pab->data_field[(table_col_row + i) *table_pab->data_size]))->packets < (unsigned long int) average_packets * (PAB_BASE + timediff * PAB_MULTIPLIER) &&
-            ((ip_t *) &(table_pab->data_field[(table_col_row + i) * table_pab->data_size]))->bytes < (unsigned long int) average_bytes * (PAB_BASE + timediff * PAB_MULTIPLIER)) {
-               fhf_remove(table_pab, ((ip_addr_t*) (&(table_pab->key_field[(table_col_row + i) * table_pab->key_size]))));
-               removed = 1;
-            }
+         if (port_set != -1) {
+            print_top_ip_port(ip_string, &stats->prefix_port_v6, prefix_length_v6);
          }
+      }
+   }
+
+   fflush(stdout);
+}
+
+void *report_stats_thread(void *arg)
+{
+   (void) arg;
+
+   pthread_mutex_lock(&report_mutex);
+   for (;;) {
+      while (report_slot == -1 && !report_finish) {
+         pthread_cond_wait(&report_cond, &report_mutex);
+      }
+      if (report_slot == -1) {
+         break;
+      }
+
+      int last = report_slot;
+      pthread_mutex_unlock(&report_mutex);
 
-         if (removed == 1) {
-            if (ur_get(tmplt, data, F_PACKETS) > average_packets * PAB_BASE || ur_get(tmplt, data, F_BYTES) > average_bytes * (PAB_BASE * 2)) {
-               fhf_insert(table_pab, ip, record);
-            }
+      if (window_slots > 1) {
+         /* Window consists of the last completed slot and window_slots - 1 slots before it */
+         topn_stats_clear(&window_stats);
+         for (int i = 0; i < window_slots; i++) {
+            topn_stats_merge(&window_stats, &slots[(last - i + slot_cnt) % slot_cnt]);
          }
+         report_stats(&window_stats);
+      } else {
+         report_stats(&slots[last]);
       }
+
+      pthread_mutex_lock(&report_mutex);
+      report_slot = -1;
+      pthread_cond_broadcast(&report_cond);
    }
+   pthread_mutex_unlock(&report_mutex);
+
+   return NULL;
+}
+
+int complete_slot(int current_slot)
+{
+   time_t now = time(NULL);
+   int next_slot = (current_slot + 1) % slot_cnt;
+
+   /* Wait until previous report is done, then its slots can be reused */
+   pthread_mutex_lock(&report_mutex);
+   while (report_slot != -1) {
+      pthread_cond_wait(&report_cond, &report_mutex);
+   }
+   slots[current_slot].time_last = now;
+   report_slot = current_slot;
+   pthread_cond_broadcast(&report_cond);
+   pthread_mutex_unlock(&report_mutex);
+
+   /* The oldest slot is not part of the reported window */
+   topn_stats_clear(&slots[next_slot]);
+   slots[next_slot].time_first = now;
+
+   return next_slot;
 }
 
 void malloc_err(void)
@@ -1366,33 +1435,11 @@ int compare_bytes(const void *a, const void *b)
    }
 }
 
-int compare_flows_table(const void *a, const void *b)
-{
-   if (((ip_t *) a)->flows < ((ip_t *) b)->flows) {
-      return 1;
-   } else if (((ip_t *) a)->flows == ((ip_t *) b)->flows) {
-      return 0;
-   } else {
-      return -1;
-   }
-}
-
-int compare_packets_table(const void *a, const void *b)
-{
-   if (((ip_t *) a)->packets < ((ip_t *) b)->packets) {
-      return 1;
-   } else if (((ip_t *) a)->packets == ((ip_t *) b)->packets) {
-      return 0;
-   } else {
-      return -1;
-   }
-}
-
-int compare_bytes_table(const void *a, const void *b)
+int compare_max_number(const void *a, const void *b)
 {
-   if (((ip_t *) a)->bytes < ((ip_t *) b)->bytes) {
+   if (((flow_t *) a)->max_number < ((flow_t *) b)->max_number) {
       return 1;
-   } else if (((ip_t *) a)->bytes == ((ip_t *) b)->bytes) {
+   } else if (((flow_t *) a)->max_number == ((flow_t *) b)->max_number) {
       return 0;
    } else {
       return -1;
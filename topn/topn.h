@@ -49,6 +49,7 @@
 #include <config.h>
 #endif
 
+#include <ctype.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -58,7 +59,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <inttypes.h>
-#include <nemea-common.h>
+#include <pthread.h>
 
 #include <libtrap/trap.h>
 #include <unirec/unirec.h>
@@ -66,18 +67,22 @@
 #include <string.h>
 #include <time.h>
 
-#include "twister.h" //!< Pseudorandom number generator
+#include "select.h"
+#include "space_saving.h"
 
-#define HASH_TABLE_SIZE 8192 
-#define FLOWS_TIME_INTERVAL 16  
-#define FLOWS_MULTIPLIER 8  
-#define FLOWS_BIG_BASE 800  
-#define FLOWS_BIG_MULTIPLIER 600 
-#define FLOWS_RANDOM_MAX 256
-#define FLOWS_RANDOM 16
-#define PAB_TIME_INTERVAL 8
-#define PAB_BASE 8
-#define PAB_MULTIPLIER 3
+#define IP_STATS_MEMORY 16   /*!< Default memory in MB for top N IPs and networks (parameter -s). */
+#define PORT_STATS_INIT 256  /*!< Initial number of entries of port statistics, the array grows with used ports. */
+
+/* Values of TOPN_ENTITY field of output records */
+#define TOPN_ENTITY_FLOW 0
+#define TOPN_ENTITY_PORT 1
+#define TOPN_ENTITY_IP 2
+#define TOPN_ENTITY_NETWORK 3
+
+/* Values of TOPN_METRIC field of output records */
+#define TOPN_METRIC_FLOWS 0
+#define TOPN_METRIC_PACKETS 1
+#define TOPN_METRIC_BYTES 2
 
 typedef struct flow_struct {
    uint32_t max_number;     /*!< max_number represents bytes or packets. flow_t is used for flows with both packets and bytes, having single variable allows for single function that can process both packets and bytes */ 
@@ -91,16 +96,71 @@ typedef struct flow_struct {
 typedef struct port_struct {
    uint64_t packets;
    uint64_t bytes;
-   uint16_t port;     		/*!< Stats about ports are saved in big array of 65 536 ports, number of port is used as index (and so index = port number). When stats are about to be printed, qsort is used to get Topn ports - this however messes up indexes - thus additional info about port number needs to be saved */ 
+   uint16_t port;     		/*!< Stats about ports are saved in big array of 65 536 ports, number of port is used as index (and so index = port number). When stats are about to be printed, used ports are copied and partially sorted to get Topn ports - this however loses indexes - thus additional info about port number needs to be saved */ 
+   uint16_t group;    /*!< Index + 1 of port from -p parameter which communicated with the port, 0 in statistics of all traffic. */
    uint64_t flows; 
 } port_t;
 
-typedef struct ip_struct {
-   uint64_t flows;
-   uint64_t bytes;
-   uint64_t packets;  
-   ip_addr_t src_ip;   /*!< Hash table is used for saving stats about IPs and networks. Similar to port_t, qsort is used and since data and key(=IP) fields in hash table are in a different memory space, info about IP needs to be saved. */  
-} ip_t;
+/**
+* \brief Top N flows with most packets or bytes, kept in bounded min-heap ordered by max_number.
+*/
+typedef struct flow_heap_struct {
+   flow_t *flows;     /*!< Array of topn flows, flows[0] is the smallest of them. */
+   int count;         /*!< Number of flows in heap. */
+} flow_heap_t;
+
+/**
+* \brief Statistics of ports that were seen in the current interval.
+*
+* Entries are keyed by (group, port), so statistics of all ports from -p parameter share one table and its memory grows only with pairs of ports that were seen.
+*/
+typedef struct port_stats_struct {
+   port_t *ports;        /*!< Dense array of used ports in order of their first flow. */
+   uint32_t *index;      /*!< Hash index with open addressing, slot holds position in ports + 1, 0 if it is empty. */
+   uint32_t index_mask;  /*!< Number of slots of index - 1, index has at least twice more slots than used entries. */
+   int used_cnt;         /*!< Number of used ports. */
+   int size;             /*!< Allocated number of entries of ports, it is doubled when all of them are used. */
+} port_stats_t;
+
+/**
+* \brief Composite key of IP (or network) and port given by -p parameter.
+*
+* Statistics of all ports from -p parameter share one set of summaries keyed by (port, IP), so their memory is used by the ports with the most traffic.
+*/
+typedef struct port_ip_struct {
+   ip_addr_t ip;           /*!< IP or masked network, it has to be first so that key can be printed as IP. */
+   uint32_t port_index;    /*!< Index of port in -p parameter. */
+   uint32_t reserved;      /*!< Always 0, key must not contain uninitialized padding. */
+} port_ip_t;
+
+/**
+* \brief Heavy hitters of IPs (or networks) for each of flows, packets and bytes.
+*/
+typedef struct ip_stats_struct {
+   ss_table_t *flows;
+   ss_table_t *packets;
+   ss_table_t *bytes;
+} ip_stats_t;
+
+/**
+* \brief All statistics of one time slot (interval of -l seconds, or merged sliding window).
+*/
+typedef struct topn_stats_struct {
+   time_t time_first;                 /*!< Start of the slot, 0 if the slot was not used yet. */
+   time_t time_last;                  /*!< End of the slot. */
+   flow_heap_t flows_bytes;
+   flow_heap_t flows_packets;
+   port_stats_t ports;
+   ip_stats_t ip;
+   ip_stats_t prefix;
+   ip_stats_t prefix_v6;
+   flow_heap_t *flows_bytes_port;     /*!< Arrays of statistics of ports given by -p parameter. */
+   flow_heap_t *flows_packets_port;
+   port_stats_t ports_port;           /*!< Ports communicating with each port given by -p parameter, grouped by port_t.group. */
+   ip_stats_t ip_port;                /*!< IPs and networks of all ports given by -p parameter, keyed by port_ip_t. */
+   ip_stats_t prefix_port;
+   ip_stats_t prefix_port_v6;
+} topn_stats_t;
 
 /**
 * \brief Function sets variable which results in printing Topn stats.
@@ -108,63 +168,143 @@ typedef struct ip_struct {
 void sig_handler(int signal);
 
 /**
-* \brief Function returns index where new flow record should be placed.
+* \brief Function checks if -o parameter is present and sets number of output interfaces accordingly.
 *
-* This function is used to find out whether the new flow is bigger than any other flow record in a given sorted array. It uses binary search to find first smaller flow. If no smaller flow is found, -1 is returned. If smaller flow is found, then it returns index of that smaller flow.
+* \param argc Number of arguments.
+* \param argv Arguments of the module.
+* \param module_getopt_string Parameters of the module for getopt.
+* \param long_options Long parameters of the module for getopt.
+*/
+void get_o_param(int argc, char **argv, const char *module_getopt_string, const struct option *long_options);
+
+/**
+* \brief Function allocates heap for topn flows.
 *
-* \param key Basically number of packets/bytes of new flow record.
-* \param sorted_array Sorted array of pointers pointing to elements of array of flow_t records.
-* \param num Number of elements in a given sorted array.
-* \return -1 if no smaller flow found, index of first smaller flow otherwise.
+* \param heap Heap to initialize.
+* \return 0 if OK, -1 if error occurred.
 */
-int get_array_index(uint32_t key, flow_t ** sorted_array, size_t num);
+int flow_heap_init(flow_heap_t *heap);
 
 /**
 * \brief Function processes flows for top N flows stats - adds new big flow, removes smallest one.
 *
-* Stats about Topn flows are stored in an array of TOP_N elements of flow_t type. Having only TOP_N elements (lower memory consumption) means once full, only biggest new flows can be added and for each new flow added, smallest one in array will get removed. If Topn is 1000, linear loop through array would be slow thus binary search is used instead. Binary search means array have to sorted. If new biggest flow is added, all current elements have to be moved by 1. To avoid moving too much memory, I use array of pointers which is sorted, each pointer points to (indexes to) flow_t element in unsorted array of flow_t records.
-*
-* Function uses get_array_index function to find out if given flow is big enough to be added to array of topn flows. If array isn't full, it's added regardless. If array is full and it's big enough, it's added. During any add of new member, sorted array is moved accordingly.
+* Until the heap contains topn flows, each flow is added. Then the flow is compared with the root of min-heap, which is the smallest of top N flows, and if it's bigger, it replaces the root and is sifted down. Most flows are small, so they are rejected by single comparison and bigger ones cost O(log N).
 *
-* \param array Array of flow records.
-* \param sorted_array Sorted array of pointers pointing to elements of array of flow_t records.
+* \param heap Heap of top N flows.
 * \param record Record containing info about given flow.
-* \param array_counter Number of how many members array currently contains.
 */
-void process_flows(flow_t * array, flow_t ** sorted_array, flow_t* record, int array_counter);
+void process_flows(flow_heap_t *heap, const flow_t *record);
 
 /**
 * \brief Function prints top N flows.
 *
-* \param sorted_array_of_bytes Sorted array of pointers pointing to array that contains flows with top N bytes.
-* \param sorted_array_of_packets Sorted array of pointers pointing to array that contains flows with top N packets.
-* \param array_counter Number of elements in both sorted arrays.
+* Flows in both heaps are sorted, so heaps have to be cleared (count set to 0) before next flow is processed.
+*
+* \param flows_bytes Heap of flows with top N bytes.
+* \param flows_packets Heap of flows with top N packets.
 * \param ip_string Pointer for ip_to_str function.
 * \param ip_string2 Pointer for ip_to_str function.
 * \param port_number Changes text output slightly.
 */
-void print_top_flows(flow_t ** sorted_array_of_bytes, flow_t ** sorted_array_of_packets, int array_counter, char * ip_string, char *ip_string2, int port_number);
+void print_top_flows(flow_heap_t *flows_bytes, flow_heap_t *flows_packets, char *ip_string, char *ip_string2, int port_number);
+
+/**
+* \brief Function allocates statistics of ports.
+*
+* \param stats Statistics to initialize.
+* \return 0 if OK, -1 if error occurred.
+*/
+int port_stats_init(port_stats_t *stats);
+
+/**
+* \brief Function adds flow to statistics of given port.
+*
+* \param stats Statistics of ports.
+* \param group Index + 1 of port from -p parameter, 0 for statistics of all traffic.
+* \param port_number Port of the flow.
+* \param packets Number of packets of the flow.
+* \param bytes Number of bytes of the flow.
+*/
+void process_port(port_stats_t *stats, uint16_t group, uint16_t port_number, uint64_t packets, uint64_t bytes);
+
+/**
+* \brief Function adds statistics of all used ports of src to dst.
+*/
+void port_stats_merge(port_stats_t *dst, const port_stats_t *src);
+
+/**
+* \brief Function removes statistics of used ports, used at the end of interval.
+*/
+void port_stats_clear(port_stats_t *stats);
+
+/**
+* \brief Function frees statistics of ports.
+*/
+void port_stats_destroy(port_stats_t *stats);
 
 /**
 * \brief Function prints top N ports.
 *
-* \param array_of_ports Array containing stats of all ports.
+* Only used ports are copied to buffer and top N of them are selected by partial_sort for each of flows, packets and bytes, so the cost depends on number of used ports and N instead of all 65 536 ports.
+*
+* \param stats Statistics of ports.
+* \param buffer Array of 65 536 ports used for selection, it can be shared by all statistics.
 * \param port_number Changes text output slightly.
 */
-void print_top_ports(port_t * array_of_ports, int port_number);
+void print_top_ports(port_stats_t *stats, port_t *buffer, int port_number);
 
 /**
-* \brief Function prints top N ports.
+* \brief Function prints top N ports for each port given by -p parameter.
+*
+* Used entries are grouped by port from -p parameter in one pass of counting sort and top N of each group are selected by partial_sort.
+*
+* \param stats Statistics of ports of all ports from -p parameter.
+*/
+void print_top_ports_port(port_stats_t *stats);
+
+/**
+* \brief Function prints top N IPs (or networks) of one statistic together with error bound of each entry.
+*
+* Real value of each printed entry lies in interval <count - error, count>. Header of the list contains the bound of real value of any entry that is not listed.
 *
 * \param ip_string Pointer for ip_to_str function.
-* \param table_pab Pointer to the hash table containing IPs with most packets and bytes.
-* \param fhf_iter_t Pointer to the iterator of table_pab.
-* \param table_flows Pointer to the hash table containing IPs with most flows.
-* \param fht_iter_t Pointer to the iterator of table_flows.
+* \param table Space-Saving summary of the statistic.
+* \param metric Statistic, one of TOPN_METRIC_* values.
 * \param port_number Changes text output slightly.
-* \param prefix_set Changes text output slightly.
+* \param prefix_length Length of networks, 0 for IPs.
+*/
+void print_top_ip_stats(char *ip_string, ss_table_t *table, int metric, int port_number, int prefix_length);
+
+/**
+* \brief Function prints top N IPs (or networks) based on flows, packets and bytes.
+*
+* \param ip_string Pointer for ip_to_str function.
+* \param stats Statistics of IPs or networks.
+* \param port_number Changes text output slightly.
+* \param prefix_length Length of networks, 0 for IPs.
+*/
+void print_top_ip(char *ip_string, ip_stats_t *stats, int port_number, int prefix_length);
+
+/**
+* \brief Function prints top N IPs (or networks) of one statistic for each port given by -p parameter.
+*
+* Monitored keys are grouped by port in one pass of counting sort and top N of each group are selected, so the cost depends on number of monitored keys, not on number of ports.
+*
+* \param ip_string Pointer for ip_to_str function.
+* \param table Space-Saving summary of the statistic keyed by port_ip_t.
+* \param metric Statistic, one of TOPN_METRIC_* values.
+* \param prefix_length Length of networks, 0 for IPs.
 */
-void print_top_ip(char * ip_string, fhf_table_t * table_pab, fhf_iter_t * iter_pab, fht_table_t * table_flows, fht_iter_t * iter_flows,int port_number, int prefix_set);
+void print_top_ip_port_stats(char *ip_string, ss_table_t *table, int metric, int prefix_length);
+
+/**
+* \brief Function prints top N IPs (or networks) based on flows, packets and bytes for each port given by -p parameter.
+*
+* \param ip_string Pointer for ip_to_str function.
+* \param stats Statistics of IPs or networks keyed by port_ip_t.
+* \param prefix_length Length of networks, 0 for IPs.
+*/
+void print_top_ip_port(char *ip_string, ip_stats_t *stats, int prefix_length);
 
 /**
 * \brief Function processes arguments for -m parameter (length of the prefixes).
@@ -181,7 +321,7 @@ int process_prefix_args(char * optarg, uint64_t *prefix128, uint32_t * prefix, i
 /**
 * \brief Function processes arguments for -p parameter (various number of ports).
 *
-* Function allocates memory for global variable int * port and fills each element with port numbers given in an optarg parameter.
+* Function allocates memory for global variable int * port and fills each element with port numbers given in an optarg parameter. Index of each port is stored in global lookup table port_index, so ports of a flow are found without iterating over all of them.
 *
 * \param optarg String containing arguments.
 * \return 0 if OK, -1 if error occurred.
@@ -189,73 +329,131 @@ int process_prefix_args(char * optarg, uint64_t *prefix128, uint32_t * prefix, i
 int process_ports_args(char * optarg);
 
 /**
-* \brief Function processes incoming flows and manages hash table of top N IPs with most flows.
+* \brief Function allocates statistics of IPs or networks.
+*
+* \param stats Statistics to initialize.
+* \param memory Memory in bytes of each of flows, packets and bytes summaries.
+* \param key_size Size of key, ip_addr_t or port_ip_t.
+* \return 0 if OK, -1 if error occurred.
+*/
+int ip_stats_init(ip_stats_t *stats, size_t memory, uint32_t key_size);
+
+/**
+* \brief Function adds incoming flow to statistics of IPs or networks.
 *
-* Function uses fast_hash_table from Nemea-Framework/common/, which is a fast 4-way hash table with least recently used (LRU) algorithm used to replace oldest record in a row. This is useful because we can expect that most active IPs will be able to keep themselves in a table.
+* Each of flows, packets and bytes is counted by its own Space-Saving summary with fixed number of counters. Unlike fixed size hash table that drops records on collisions, the summary replaces IP with the smallest count and remembers that count as error of the new IP, so every value is overestimated at most by the remembered error and every IP with more than total / capacity flows (packets, bytes) is guaranteed to be present.
 *
-* When the new flow is received, function checks if it's key (IP) is already in table. If yes, it's updated (+1 flow). If not, it's added to the table, possibly replacing oldest record if a given row is full. Because real network contains a lot of flows per second and this module aims to not use too much memory, some improvements have been made - based on observation that most network traffic is small and probably won't make it to top N. First is that it uses probability sampling - so that only e.g. 1 in 10 flows will be processed. Second is that if a row is full, each member is inspected and if it's number of flow is lower than computed number that scales with time, it's removed. Computed number should be small enough to not remove any big/huge records. So IPs with small potential to appear in top N and passed probability test will be removed and row won't be full. Third improvement is that if a record is replaced by a new one and during second improvement some elements have been removed, then number of flows of replaced record is inspected. If it's bigger than computed number (which should be rather big/huge), it's returned to hash table. This is made for cases where IP with big chance to appear in top N is removed because at some time a lot of new IPs are added to the same row, despite none of them probably make it to top N.
+* Key is hashed only once for all three summaries.
 *
-* \param table_flows Pointer to hash table, where records will be stored.
-* \param ip IP address, will be used as key to hash table.
-* \param record Record containing data which will be saved to hash table.
-* \param key_lost If new record removes least recentl  used one, removed key will go there.
-* \param data_lost If new record removes least recently used one, removed data will go there.
-* \param data Used for UniRec functions and macros.
-* \param tmplt Used for UniRec functions and macros.
+* \param stats Statistics of IPs or networks.
+* \param key IP address or masked network, port_ip_t for statistics of ports.
+* \param packets Number of packets of the flow.
+* \param bytes Number of bytes of the flow.
+*/
+void process_ip(ip_stats_t *stats, const void *key, uint64_t packets, uint64_t bytes);
+
+/**
+* \brief Function removes all IPs from statistics, used at the end of interval.
+*/
+void ip_stats_clear(ip_stats_t *stats);
+
+/**
+* \brief Function frees statistics of IPs or networks.
+*/
+void ip_stats_destroy(ip_stats_t *stats);
+
+/**
+* \brief Function adds statistics of src to dst, see ss_merge().
+*/
+void ip_stats_merge(ip_stats_t *dst, const ip_stats_t *src);
+
+/**
+* \brief Function allocates all statistics of one time slot according to parameters of the module.
+*
+* \param stats Statistics to initialize, they can be freed by topn_stats_destroy() even if error occurred.
+* \param memory Memory in bytes of each Space-Saving summary.
+* \return 0 if OK, -1 if error occurred.
 */
-void process_ip_flows(fht_table_t * table_flows, ip_addr_t * ip, ip_t * record, ip_addr_t * key_lost, ip_t * data_lost, const void *data, ur_template_t *tmplt);
+int topn_stats_init(topn_stats_t *stats, size_t memory);
 
 /**
-* \brief Function processes incoming flows and manages hash table of top N IPs with most packets and bytes.
+* \brief Function removes all statistics of time slot.
+*/
+void topn_stats_clear(topn_stats_t *stats);
+
+/**
+* \brief Function frees all statistics of time slot.
+*/
+void topn_stats_destroy(topn_stats_t *stats);
+
+/**
+* \brief Function adds statistics of time slot src to dst, unused slots are skipped.
+*/
+void topn_stats_merge(topn_stats_t *dst, topn_stats_t *src);
+
+/**
+* \brief Function adds incoming flow to all statistics of time slot.
 *
-* Function is somewhat similar to function process_ip_flows, but uses fast_hash_filter from Nemea-Framework/common/, which is a fast 8-way hash table with no replacement algorithm. Unlike processing IPs with top N flows where flows come only by 1 (+1) and thus it's difficult to predict which IP will make it to top N, processing IPs with most packets and bytes is simpler. Based on observation, biggest flow (from top N flows with most bytes stats) can be 100 000x bigger than average of all received bytes in a given time. Also usually more packets = more bytes, so I use only 1 hash table to save memory. 
+* \param stats Statistics of current time slot.
+* \param tmplt Template of input interface.
+* \param data Incoming record.
+*/
+void process_record(topn_stats_t *stats, ur_template_t *tmplt, const void *data);
+
+/**
+* \brief Function sends one entry of top N list to output interface, it does nothing if -o parameter is not used.
 *
-* When the new flow is received, function checks if it's key (IP) is already in table. If yes, it's updated. If not, it's added to the table, if row isn't full. If row is full, each member is inspected and if it's number of packets and bytes is lower than computed number, it's removed. Computed number is based of average of received packets and bytes and scales with time. It should be small enough to not remove any big/huge records. If any records were removed, new flow is added if it's packets or bytes are bigger than some small multiplier of average.
+* Fields which are not relevant for the entity (e.g. ports of IP) are set to zero.
+*/
+void send_entry(uint8_t entity, uint8_t metric, int port_number, uint8_t prefix_length, uint32_t rank, const ip_addr_t *src_ip, const ip_addr_t *dst_ip,
+                uint16_t src_port, uint16_t dst_port, uint8_t protocol, uint64_t value, uint64_t error);
+
+/**
+* \brief Function prints (and sends) all top N lists of time slot.
 *
-* \param table_pab Pointer to hash table, where records will be stored.
-* \param ip IP address, will be used as key to hash table.
-* \param record Record containing data which will be saved to hash table.
-* \param data Used for UniRec functions and macros.
-* \param tmplt Used for UniRec functions and macros.
-* \param average_packets Arithmetic mean of all received packets in a given time.
-* \param average_bytes Arithmetic mean of all received bytes in a given time.
+* Flows in heaps of the slot are sorted, so the slot has to be cleared before it is used again.
 */
-void process_ip_pab(fhf_table_t * table_pab, ip_addr_t * ip, ip_t * record, const void *data, ur_template_t *tmplt, int average_packets, int average_bytes);
+void report_stats(topn_stats_t *stats);
 
 /**
-* \brief Function writes message to stderr and exits program.
+* \brief Reporting thread, it reports every completed slot (or sliding window ending with it) while main thread fills next slot.
 */
-void malloc_err(void);
+void *report_stats_thread(void *arg);
 
 /**
-* \brief Function used by library function qsort().
+* \brief Function passes current slot to reporting thread and returns next slot, which is cleared.
+*
+* It waits only if reporting of previous slot is not finished yet.
+*
+* \param current_slot Slot which is completed.
+* \return Slot to which next records are added.
 */
-int compare_flows(const void * a, const void * b);
+int complete_slot(int current_slot);
 
 /**
-* \brief Function used by library function qsort().
+* \brief Function writes message to stderr and exits program.
 */
-int compare_packets(const void * a, const void * b);
+void malloc_err(void);
 
 /**
 * \brief Function used by library function qsort().
 */
-int compare_bytes(const void * a, const void * b);
+int compare_flows(const void * a, const void * b);
 
 /**
 * \brief Function used by library function qsort().
 */
-int compare_flows_table(const void * a, const void * b);
+int compare_packets(const void * a, const void * b);
 
 /**
 * \brief Function used by library function qsort().
 */
-int compare_packets_table(const void * a, const void * b);
+int compare_bytes(const void * a, const void * b);
 
 /**
 * \brief Function used by library function qsort().
 */
-int compare_bytes_table(const void * a, const void * b);
+int compare_max_number(const void * a, const void * b);
 
 #endif /* _TOPN_ */
 
@@ -0,0 +1,263 @@
+/**
+ * \file bench_liburfilter.c
+ * \brief Benchmark of compilation and matching of representative filters
+ * \date 2026
+ *
+ * Records with random values are generated once and every filter is compiled and matched
+ * on all of them record by record and in batches. One line of key=value pairs is printed
+ * for every filter, so results can be compared between versions. Built by `make check`,
+ * run as `./bench_liburfilter [records]`.
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <unirec/unirec.h>
+
+#include "liburfilter.h"
+
+#define COMPILE_REPEAT 20
+#define MIN_MATCHES 2000000
+
+extern char *str_buffer;
+
+static const char *dns_names[] = {
+   "www.example.com", "mail.example.org", "cdn.example.net", "example.com",
+   "mail.cesnet.cz", "www.liberouter.org", "ns1.example.com", "host.local"
+};
+
+static double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Append formatted string to filter, buffer is reallocated as needed */
+static void append(char **buf, size_t *len, const char *fmt, unsigned a, unsigned b)
+{
+   char item[64];
+   int n = snprintf(item, sizeof(item), fmt, a, b);
+
+   *buf = realloc(*buf, *len + n + 1);
+   memcpy(*buf + *len, item, n + 1);
+   *len += n;
+}
+
+/* Filter with IN array of count IPv4 addresses, every fourth is a /24 prefix */
+static char *ipArrayFilter(unsigned count)
+{
+   char *buf = NULL;
+   size_t len = 0;
+
+   append(&buf, &len, "SRC_IP in [", 0, 0);
+   for (unsigned i = 0; i < count; i++) {
+      append(&buf, &len, i % 4 ? "10.%u.%u.1" : "10.%u.%u.0/24", (i * 7) % 256, i / 4 % 256);
+      append(&buf, &len, i + 1 < count ? ", " : "]", 0, 0);
+   }
+   return buf;
+}
+
+/* Filter with IN array of count ports */
+static char *portArrayFilter(unsigned count)
+{
+   char *buf = NULL;
+   size_t len = 0;
+
+   append(&buf, &len, "DST_PORT in [", 0, 0);
+   for (unsigned i = 0; i < count; i++) {
+      append(&buf, &len, i + 1 < count ? "%u, " : "%u]", i * 61 % 65536, 0);
+   }
+   return buf;
+}
+
+/* Filter nested to given depth, levels alternate AND and OR */
+static char *nestedFilter(unsigned depth)
+{
+   char *buf = NULL;
+   size_t len = 0;
+
+   for (unsigned i = 0; i < depth; i++) {
+      append(&buf, &len, i % 2 ? "(DST_PORT > %u || " : "(PROTOCOL != %u && ", i % 2 ? 1000 + i : 6 + i % 11, 0);
+   }
+   append(&buf, &len, "BYTES > %u", 1500, 0);
+   for (unsigned i = 0; i < depth; i++) {
+      append(&buf, &len, ")", 0, 0);
+   }
+   return buf;
+}
+
+#define FIELD(tmplt, rec, type, name) (*(type *) ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name(name)))
+
+static void fillRecord(const ur_template_t *tmplt, void *rec)
+{
+   char ip[32];
+
+   snprintf(ip, sizeof(ip), "10.%d.%d.%d", rand() % 256, rand() % 64, rand() % 4);
+   ip_from_str(ip, &FIELD(tmplt, rec, ip_addr_t, "SRC_IP"));
+   snprintf(ip, sizeof(ip), "192.168.%d.%d", rand() % 256, rand() % 256);
+   ip_from_str(ip, &FIELD(tmplt, rec, ip_addr_t, "DST_IP"));
+   FIELD(tmplt, rec, uint16_t, "SRC_PORT") = rand() % 65536;
+   FIELD(tmplt, rec, uint16_t, "DST_PORT") = rand() % 4 ? rand() % 1024 : 443;
+   FIELD(tmplt, rec, uint8_t, "PROTOCOL") = rand() % 3 ? 6 : 17;
+   FIELD(tmplt, rec, uint64_t, "BYTES") = rand() % 3000;
+   FIELD(tmplt, rec, uint32_t, "PACKETS") = rand() % 20 + 1;
+   FIELD(tmplt, rec, int8_t, "TTL_DIFF") = rand() % 5 - 2;
+   ur_set_string(tmplt, rec, ur_get_id_by_name("DNS_NAME"), dns_names[rand() % (sizeof(dns_names) / sizeof(dns_names[0]))]);
+}
+
+static int runBench(FILE *out, const char *name, const char *filter, const ur_template_t *tmplt,
+                    const void **recs, int count)
+{
+   uint64_t *bitmap = malloc(URFILTER_BITMAP_WORDS(count) * sizeof(uint64_t));
+   int repeat = count < MIN_MATCHES ? (MIN_MATCHES + count - 1) / count : 1;
+   long matched = 0, batch_matched = 0;
+   double start, compile_time, match_time, batch_time;
+   urfilter_t *urf = NULL;
+
+   start = now();
+   for (int i = 0; i < COMPILE_REPEAT; i++) {
+      urfilter_destroy(urf);
+      urf = urfilter_create(filter, "bench");
+      if (urfilter_compile(urf) != URFILTER_TRUE) {
+         fprintf(stderr, "Error: Unable to compile filter %s.\n", name);
+         urfilter_destroy(urf);
+         free(bitmap);
+         return 1;
+      }
+   }
+   compile_time = (now() - start) / COMPILE_REPEAT;
+
+   start = now();
+   for (int r = 0; r < repeat; r++) {
+      for (int i = 0; i < count; i++) {
+         matched += urfilter_match(urf, tmplt, recs[i]);
+      }
+   }
+   match_time = now() - start;
+
+   start = now();
+   for (int r = 0; r < repeat; r++) {
+      batch_matched += urfilter_match_batch(urf, tmplt, recs, count, bitmap);
+   }
+   batch_time = now() - start;
+
+   fprintf(out, "filter=%s length=%zu compile_us=%.1f match_ns=%.2f batch_ns=%.2f matched=%ld%s\n",
+           name, strlen(filter), compile_time * 1e6, match_time * 1e9 / ((double) repeat * count),
+           batch_time * 1e9 / ((double) repeat * count), matched / repeat,
+           matched == batch_matched ? "" : " error=batch_mismatch");
+   fflush(out);
+
+   urfilter_destroy(urf);
+   free(bitmap);
+   return matched != batch_matched;
+}
+
+int main(int argc, char **argv)
+{
+   int count = argc > 1 ? atoi(argv[1]) : 65536;
+   char *ip_array_small = ipArrayFilter(16);
+   char *ip_array_large = ipArrayFilter(4096);
+   char *port_array_large = portArrayFilter(1000);
+   char *nested = nestedFilter(16);
+   const struct {
+      const char *name;
+      const char *filter;
+   } filters[] = {
+      {"simple", "PROTOCOL == 6 && DST_PORT == 443"},
+      {"ports_bytes", "(SRC_PORT == 53 || DST_PORT == 53 || port == 443) && BYTES > 1000 && PACKETS < 10"},
+      {"signed", "TTL_DIFF < 0 || TTL_DIFF > 1"},
+      {"ip", "SRC_IP == 10.1.2.3 || DST_IP != 192.168.1.1"},
+      {"ipnet", "SRC_IP == 10.128.0.0/9 || DST_IP == 192.168.128.0/17 || host == 2001:db8::/32"},
+      {"in_ports", "DST_PORT in [22, 25, 53, 80, 110, 143, 443, 993, 995]"},
+      {"in_ports_large", port_array_large},
+      {"in_ip_small", ip_array_small},
+      {"in_ip_large", ip_array_large},
+      {"regex", "DNS_NAME =~ \"\\.example\\.com$\" || DNS_NAME =~ \"^mail\\.\""},
+      {"regex_many", "DNS_NAME =~ \"example\" && (DNS_NAME =~ \"^www\" || DNS_NAME =~ \"^ns[0-9]\" || DNS_NAME =~ \"org$\")"},
+      {"nested", nested},
+   };
+   int ret = 0;
+
+   // library reports compiled filters to stdout, keep results separated from them
+   FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+   if (out == NULL || freopen("/dev/null", "w", stdout) == NULL || count <= 0) {
+      fprintf(stderr, "Usage: %s [records]\n", argv[0]);
+      return 1;
+   }
+
+   str_buffer = malloc(65536);
+   if (ur_define_set_of_fields("ipaddr SRC_IP,ipaddr DST_IP,uint16 SRC_PORT,uint16 DST_PORT,uint8 PROTOCOL,"
+                               "uint64 BYTES,uint32 PACKETS,int8 TTL_DIFF,string DNS_NAME") != UR_OK) {
+      fprintf(stderr, "Error: Unable to define fields.\n");
+      return 1;
+   }
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_IP,SRC_PORT,DST_PORT,PROTOCOL,BYTES,PACKETS,TTL_DIFF,DNS_NAME", NULL);
+   const void **recs = malloc(count * sizeof(void *));
+
+   srand(1);
+   for (int i = 0; i < count; i++) {
+      void *rec = ur_create_record(tmplt, 64);
+      fillRecord(tmplt, rec);
+      recs[i] = rec;
+   }
+
+   fprintf(out, "records=%d\n", count);
+   for (size_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++) {
+      ret |= runBench(out, filters[i].name, filters[i].filter, tmplt, recs, count);
+   }
+
+   for (int i = 0; i < count; i++) {
+      ur_free_record((void *) recs[i]);
+   }
+   free(recs);
+   ur_free_template(tmplt);
+   ur_finalize();
+   free(str_buffer);
+   free(ip_array_small);
+   free(ip_array_large);
+   free(port_array_large);
+   free(nested);
+   fclose(out);
+   return ret;
+}
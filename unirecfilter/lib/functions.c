@@ -51,8 +51,10 @@
 #include <unistd.h>
 #include <time.h>
 #include <ctype.h>
+#include <math.h>
 
 #include "functions.h"
+#include "valueset.h"
 
 // get numbers of protocols and services
 #include <netdb.h>
@@ -61,6 +63,7 @@
 #define __STDC_FORMAT_MACROS
 // regexp
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <regex.h>
 #include "fields.h"
 
@@ -309,7 +312,13 @@ static int compareUI64(const void *p1, const void *p2)
 
 static int compareI64(const void *p1, const void *p2)
 {
-   return ((*(int64_t *) p1) - (*(int64_t *) p2));
+   if ((*(int64_t *) p1) == (*(int64_t *) p2)) {
+      return 0;
+   } else if ((*(int64_t *) p1) > (*(int64_t *) p2)) {
+      return 1;
+   } else {
+      return -1;
+   }
 }
 
 static int compareDouble(const void *p1, const void *p2)
@@ -335,6 +344,53 @@ static int compareIPs(const void *p1, const void *p2)
    return ip_cmp(&((const struct ipprefix *) p1)->ip, &((const struct ipprefix *) p2)->ip);
 }
 
+/* Order prefixes by address, prefixes with the same address from the shortest one */
+static int compareIPPrefixes(const void *p1, const void *p2)
+{
+   int res = compareIPs(p1, p2);
+
+   if (res == 0) {
+      return ip_cmp(&((const struct ipprefix *) p1)->mask, &((const struct ipprefix *) p2)->mask);
+   }
+   return res;
+}
+
+/*
+ * Sort prefixes and remove prefixes contained in other prefix of array. Remaining prefixes
+ * are disjoint, so bsearch with compareIPwithPrefix finds every address they contain.
+ * Returns new number of prefixes.
+ */
+static uint32_t normalizePrefixes(struct ipprefix *prefixes, uint32_t count)
+{
+   uint32_t kept = 0;
+
+   qsort(prefixes, count, sizeof(struct ipprefix), compareIPPrefixes);
+   for (uint32_t i = 0; i < count; i++) {
+      if (kept > 0 && ip_is4(&prefixes[i].ip) == ip_is4(&prefixes[kept - 1].ip)) {
+         ip_addr_t masked = prefixes[i].ip;
+         ip_mask(&masked, &prefixes[kept - 1].mask);
+         if (ip_cmp(&masked, &prefixes[kept - 1].ip) == 0) {
+            continue;
+         }
+      }
+      prefixes[kept++] = prefixes[i];
+   }
+   return kept;
+}
+
+/* Build hash set of array values, keys are values converted to 64 bits or IP addresses */
+static void buildHashSet(struct expression_array *array, const uint64_t *keys, uint8_t key_words)
+{
+   // if allocation fails, the array is searched by bsearch
+   array->hash_set = newHashSet(array->array_size, key_words);
+   if (array->hash_set == NULL) {
+      return;
+   }
+   for (uint32_t i = 0; i < array->array_size; i++) {
+      hashSetInsert(array->hash_set, keys + i * key_words);
+   }
+}
+
 static int compareIPwithPrefix(const void *p1, const void *p2)
 {
    struct ipprefix *stack = (struct ipprefix *) p2;
@@ -351,9 +407,10 @@ static int compareIPwithPrefix(const void *p1, const void *p2)
    return ip_cmp(&needle, &stack->ip);
 }
 
-struct ast *newExpressionArray(char *column, char *cmp, char *array)
+/* Create array node for given field, values are filled by fillArray() */
+static struct expression_array *initArray(char *column, char *cmp)
 {
-   int i, id, iddst, host = 0;
+   int id, iddst, host = 0;
    struct expression_array *newast = (struct expression_array *) malloc(sizeof(struct expression_array));
 
    /* init all arrays, one will be allocated: */
@@ -361,6 +418,11 @@ struct ast *newExpressionArray(char *column, char *cmp, char *array)
    newast->array_values_ipprefix = 0;
    newast->array_values_date = 0;
    newast->array_values_double = 0;
+   newast->hash_set = NULL;
+   newast->prefix_trie = NULL;
+   newast->array_size = 0;
+   newast->filename = NULL;
+   newast->pending = NULL;
 
    newast->id = UR_INVALID_FIELD;
    newast->dstid = UR_INVALID_FIELD;
@@ -397,21 +459,16 @@ struct ast *newExpressionArray(char *column, char *cmp, char *array)
       }
    }
 
-   newast->array_size = 0;
-   newast->array_values = 0;
-
-   char *p = array;
-   int strsize = strlen(array);
-   for (i = 0; i < strsize; i++) {
-      if (array[i] == ',') {
-         newast->array_size++;
-         array[i] = 0;
-      }
-   }
-   if (i != 0) {
-      newast->array_size++;
-   }
+   return newast;
+}
 
+/*
+ * Parse array_size values separated by '\0' into arrays of node and build lookup
+ * structure for large arrays. Returns 0 on success, 1 on error.
+ */
+static int fillArray(struct expression_array *newast, char *p)
+{
+   int i;
    char is_unsigned_int = 0;
    switch (newast->field_type) {
    case UR_TYPE_UINT8:
@@ -431,7 +488,7 @@ struct ast *newExpressionArray(char *column, char *cmp, char *array)
                printf("Error: %s could not be parsed.\n", p);
                free(newast->array_values);
                newast->array_values = 0;
-               goto parsing_error;
+               return 1;
             }
          } else {
             if (sscanf(p, "%"SCNi64, &newast->array_values[i]) != 1) {
@@ -439,7 +496,7 @@ struct ast *newExpressionArray(char *column, char *cmp, char *array)
                printf("Error: %s could not be parsed.\n", p);
                free(newast->array_values);
                newast->array_values = 0;
-               goto parsing_error;
+               return 1;
             }
          }
          p += strlen(p) + 1;
@@ -449,6 +506,9 @@ struct ast *newExpressionArray(char *column, char *cmp, char *array)
       } else {
          qsort(newast->array_values, newast->array_size, sizeof(uint64_t), compareI64);
       }
+      if (newast->array_size >= VALUESET_MIN_SIZE) {
+         buildHashSet(newast, newast->array_values, 1);
+      }
       break;
    case UR_TYPE_IP:
       // Expect the array is pure IP addresses only at first
@@ -468,14 +528,9 @@ struct ast *newExpressionArray(char *column, char *cmp, char *array)
             prefixlen = atoi(mask + 1);
             *mask = 0;
             mask += 1;
-            // switch this array into IP prefixes (different evaluation)
+            // switch this array into IP prefixes (different evaluation),
+            // addresses without prefix are kept as /32 or /128 prefixes
             newast->ipprefixes = 1;
-         } else if (newast->ipprefixes == 1) {
-            printf("Error: Found IP without prefix after IP with prefix. Please use either IP addresses or IP prefixes.\n");
-            newast->id = UR_INVALID_FIELD;
-            free(newast->array_values_ipprefix);
-            newast->array_values_ipprefix = 0;
-            goto parsing_error;
          }
 
          if (!ip_from_str(p, &newast->array_values_ipprefix[i].ip)) {
@@ -484,7 +539,7 @@ struct ast *newExpressionArray(char *column, char *cmp, char *array)
             newast->id = UR_INVALID_FIELD;
             free(newast->array_values_ipprefix);
             newast->array_values_ipprefix = 0;
-            goto parsing_error;
+            return 1;
          } else {
             if (newast->ipprefixes == 0 && ip_is4(&newast->array_values_ipprefix[i].ip)) {
                prefixlen = 32;
@@ -506,7 +561,24 @@ struct ast *newExpressionArray(char *column, char *cmp, char *array)
             p += strlen(p) + 1;
          }
       }
-      qsort(newast->array_values_ipprefix, newast->array_size, sizeof(struct ipprefix), compareIPs);
+      if (newast->ipprefixes == 1) {
+         newast->array_size = normalizePrefixes(newast->array_values_ipprefix, newast->array_size);
+         if (newast->array_size >= VALUESET_MIN_SIZE) {
+            newast->prefix_trie = newPrefixTrie(newast->array_values_ipprefix, newast->array_size);
+         }
+      } else {
+         qsort(newast->array_values_ipprefix, newast->array_size, sizeof(struct ipprefix), compareIPs);
+         if (newast->array_size >= VALUESET_MIN_SIZE) {
+            uint64_t *keys = malloc(newast->array_size * 2 * sizeof(uint64_t));
+            if (keys != NULL) {
+               for (i = 0; i < newast->array_size; i++) {
+                  memcpy(keys + 2 * i, &newast->array_values_ipprefix[i].ip, 2 * sizeof(uint64_t));
+               }
+               buildHashSet(newast, keys, 2);
+               free(keys);
+            }
+         }
+      }
       break;
    case UR_TYPE_TIME:
       newast->array_values_date = calloc(newast->array_size, sizeof(ur_time_t));
@@ -516,11 +588,14 @@ struct ast *newExpressionArray(char *column, char *cmp, char *array)
             printf("Error: %s could not be loaded. Expected format: YYYY-mm-ddTHH:MM:SS.sss, (.sss is optional). Eg. 2018-06-27T19:44:41.123.\n", p);
             free(newast->array_values_date);
             newast->array_values_date = 0;
-            goto parsing_error;
+            return 1;
          }
          p += strlen(p) + 1;
       }
       qsort(newast->array_values_date, newast->array_size, sizeof(ur_time_t), compareUI64);
+      if (newast->array_size >= VALUESET_MIN_SIZE) {
+         buildHashSet(newast, newast->array_values_date, 1);
+      }
       break;
    case UR_TYPE_FLOAT:
    case UR_TYPE_DOUBLE:
@@ -531,7 +606,7 @@ struct ast *newExpressionArray(char *column, char *cmp, char *array)
             printf("Error: %s could not be parsed.\n", p);
             free(newast->array_values_double);
             newast->array_values_double = 0;
-            goto parsing_error;
+            return 1;
          }
          p += strlen(p) + 1;
       }
@@ -540,11 +615,32 @@ struct ast *newExpressionArray(char *column, char *cmp, char *array)
       break;
    default:
       /* not supported */
-      free(column);
-      free(array);
       printf("Type %d is not supported.\n", newast->field_type);
-      free(newast);
-      return NULL;
+      return 1;
+   }
+
+   return 0;
+}
+
+struct ast *newExpressionArray(char *column, char *cmp, char *array)
+{
+   int i;
+   struct expression_array *newast = initArray(column, cmp);
+
+   char *p = array;
+   int strsize = strlen(array);
+   for (i = 0; i < strsize; i++) {
+      if (array[i] == ',') {
+         newast->array_size++;
+         array[i] = 0;
+      }
+   }
+   if (i != 0) {
+      newast->array_size++;
+   }
+
+   if (fillArray(newast, p) != 0) {
+      goto parsing_error;
    }
 
    free(array);
@@ -557,6 +653,234 @@ parsing_error:
    return NULL;
 }
 
+static void freeArrayValues(struct expression_array *array)
+{
+   free(array->array_values);
+   free(array->array_values_ipprefix);
+   free(array->array_values_date);
+   free(array->array_values_double);
+   freeHashSet(array->hash_set);
+   freePrefixTrie(array->prefix_trie);
+}
+
+/*
+ * Read list file with one value per line into buffer of values separated by '\0'.
+ * Blank lines and lines starting with '#' are skipped. Returns NULL on error.
+ */
+static char *readListFile(const char *filename, uint32_t *count, struct stat *st)
+{
+   FILE *f = fopen(filename, "r");
+   char *buffer, *line, *end, *out;
+   size_t size;
+
+   if (f == NULL) {
+      fprintf(stderr, "Error: Unable to open list file %s.\n", filename);
+      return NULL;
+   }
+   if (fstat(fileno(f), st) != 0 || (buffer = malloc(st->st_size + 1)) == NULL) {
+      fprintf(stderr, "Error: Unable to read list file %s.\n", filename);
+      fclose(f);
+      return NULL;
+   }
+   size = fread(buffer, 1, st->st_size, f);
+   fclose(f);
+
+   // values are moved to the beginning of buffer, so they never overwrite unread lines
+   *count = 0;
+   out = buffer;
+   end = buffer + size;
+   for (line = buffer; line < end; ) {
+      char *eol = memchr(line, '\n', end - line);
+      char *b = line, *e;
+      if (eol == NULL) {
+         eol = end;
+      }
+      e = eol;
+      while (b < e && isspace((unsigned char) *b)) {
+         b++;
+      }
+      while (e > b && isspace((unsigned char) e[-1])) {
+         e--;
+      }
+      if (b < e && *b != '#') {
+         memmove(out, b, e - b);
+         out += e - b;
+         *out++ = 0;
+         (*count)++;
+      }
+      line = eol + 1;
+   }
+   return buffer;
+}
+
+/* Fill array with values from file and remember version of the file */
+static int loadArrayFile(struct expression_array *array, const char *filename)
+{
+   struct stat st;
+   int res;
+   char *buffer = readListFile(filename, &array->array_size, &st);
+
+   if (buffer == NULL) {
+      return 1;
+   }
+   res = fillArray(array, buffer);
+   free(buffer);
+
+   array->file_mtime = st.st_mtim;
+   array->file_inode = st.st_ino;
+   array->file_size = st.st_size;
+   return res;
+}
+
+struct ast *newExpressionArrayFile(char *column, char *cmp, char *filename)
+{
+   struct expression_array *newast = initArray(column, cmp);
+
+   newast->filename = filename;
+   if (loadArrayFile(newast, filename) != 0) {
+      printf("Error: Values of %s could not be loaded from %s.\n", column, filename);
+      free(column);
+      free(filename);
+      free(newast);
+      return NULL;
+   }
+   return (struct ast *) newast;
+}
+
+/*
+ * Load array again if its file has changed or force is set. New values are prepared in separate node
+ * and published in pending, updateArray() swaps them with values in use. Only one
+ * thread may reload arrays of the tree at a time.
+ * Returns 1 if array was reloaded, 0 if file has not changed, -1 on error.
+ */
+static int reloadArrayFile(struct expression_array *array, int force)
+{
+   struct stat st;
+   struct expression_array *loaded;
+
+   if (stat(array->filename, &st) != 0) {
+      fprintf(stderr, "Error: Unable to access list file %s.\n", array->filename);
+      return -1;
+   }
+   if (!force && st.st_ino == array->file_inode && st.st_size == array->file_size &&
+       st.st_mtim.tv_sec == array->file_mtime.tv_sec && st.st_mtim.tv_nsec == array->file_mtime.tv_nsec) {
+      return 0;
+   }
+   // do not retry broken file until it changes again
+   array->file_mtime = st.st_mtim;
+   array->file_inode = st.st_ino;
+   array->file_size = st.st_size;
+
+   loaded = (struct expression_array *) calloc(1, sizeof(struct expression_array));
+   if (loaded == NULL) {
+      return -1;
+   }
+   loaded->type = array->type;
+   loaded->cmp = array->cmp;
+   loaded->id = array->id;
+   loaded->dstid = array->dstid;
+   loaded->field_type = array->field_type;
+   if (loadArrayFile(loaded, array->filename) != 0) {
+      fprintf(stderr, "Error: Values of %s could not be reloaded from %s, keeping previous values.\n",
+              array->column, array->filename);
+      freeArrayValues(loaded);
+      free(loaded);
+      return -1;
+   }
+
+   loaded = __atomic_exchange_n(&array->pending, loaded, __ATOMIC_ACQ_REL);
+   if (loaded != NULL) {
+      // previous values were not used yet
+      freeArrayValues(loaded);
+      free(loaded);
+   }
+   return 1;
+}
+
+int countArrayFiles(struct ast *ast)
+{
+   if (!ast) {
+      return 0;
+   }
+   switch (ast->type) {
+   case NODE_T_AST:
+      return countArrayFiles(ast->l) + countArrayFiles(ast->r);
+   case NODE_T_BRACKET:
+   case NODE_T_NEGATION:
+      return countArrayFiles(((struct brack *) ast)->b);
+   case NODE_T_EXPRESSION_ARRAY:
+      return ((struct expression_array *) ast)->filename != NULL;
+   default:
+      return 0;
+   }
+}
+
+int reloadArrayFiles(struct ast *ast, int force)
+{
+   int res, reloaded = 0, error = 0;
+
+   if (!ast) {
+      return 0;
+   }
+   switch (ast->type) {
+   case NODE_T_AST:
+      res = reloadArrayFiles(ast->l, force);
+      error |= res < 0;
+      reloaded += res > 0 ? res : 0;
+      res = reloadArrayFiles(ast->r, force);
+      error |= res < 0;
+      reloaded += res > 0 ? res : 0;
+      break;
+   case NODE_T_BRACKET:
+   case NODE_T_NEGATION:
+      return reloadArrayFiles(((struct brack *) ast)->b, force);
+   case NODE_T_EXPRESSION_ARRAY:
+      if (((struct expression_array *) ast)->filename != NULL) {
+         return reloadArrayFile((struct expression_array *) ast, force);
+      }
+      break;
+   default:
+      break;
+   }
+   return error ? -1 : reloaded;
+}
+
+void updateArray(struct expression_array *array)
+{
+   struct expression_array *loaded, current;
+
+   if (__atomic_load_n(&array->pending, __ATOMIC_RELAXED) == NULL) {
+      return;
+   }
+   loaded = __atomic_exchange_n(&array->pending, NULL, __ATOMIC_ACQUIRE);
+   if (loaded == NULL) {
+      return;
+   }
+
+   // only values are swapped, the other members may be used by thread reloading the file
+   current = *loaded;
+   loaded->array_size = array->array_size;
+   loaded->array_values = array->array_values;
+   loaded->array_values_ipprefix = array->array_values_ipprefix;
+   loaded->ipprefixes = array->ipprefixes;
+   loaded->array_values_date = array->array_values_date;
+   loaded->array_values_double = array->array_values_double;
+   loaded->hash_set = array->hash_set;
+   loaded->prefix_trie = array->prefix_trie;
+
+   array->array_size = current.array_size;
+   array->array_values = current.array_values;
+   array->array_values_ipprefix = current.array_values_ipprefix;
+   array->ipprefixes = current.ipprefixes;
+   array->array_values_date = current.array_values_date;
+   array->array_values_double = current.array_values_double;
+   array->hash_set = current.hash_set;
+   array->prefix_trie = current.prefix_trie;
+
+   freeArrayValues(loaded);
+   free(loaded);
+}
+
 struct ast *newProtocol(char *cmp, char *data)
 {
     struct protocol *newast = (struct protocol *) malloc(sizeof(struct protocol));
@@ -893,6 +1217,11 @@ void printAST(struct ast *ast)
          printf("%s", TTY_RESET);
       }
 
+      if (array->filename != NULL) {
+         printf(" IN file(\"%s\")", array->filename);
+         break;
+      }
+
       printf(" IN [");
       if (array->id != UR_INVALID_FIELD) {
          for (int i=0; i < array->array_size; i++) {
@@ -1093,13 +1422,17 @@ void freeAST(struct ast *ast)
    case NODE_T_EXPRESSION_DATETIME:
       free(((struct expression_datetime *) ast)->column);
       break;
-   case NODE_T_EXPRESSION_ARRAY:
+   case NODE_T_EXPRESSION_ARRAY: {
+      struct expression_array *pending = ((struct expression_array *) ast)->pending;
       free(((struct expression_array *) ast)->column);
-      free(((struct expression_array *) ast)->array_values);
-      free(((struct expression_array *) ast)->array_values_ipprefix);
-      free(((struct expression_array *) ast)->array_values_date);
-      free(((struct expression_array *) ast)->array_values_double);
+      free(((struct expression_array *) ast)->filename);
+      freeArrayValues((struct expression_array *) ast);
+      if (pending != NULL) {
+         freeArrayValues(pending);
+         free(pending);
+      }
       break;
+   }
    case NODE_T_PROTOCOL:
       free(((struct protocol*) ast)->cmp);
       free(((struct protocol*) ast)->data);
@@ -1183,7 +1516,7 @@ int compareFloating(double a, double b, cmp_op op) {
       case OP_GT:
          return a > b;
       case OP_EQ:
-         return abs(a - b) < EPS;
+         return fabs(a - b) < EPS;
       default:
          fprintf(stderr, "Warning: Invalid comparison operator.\n");
          return 0;
@@ -1191,55 +1524,55 @@ int compareFloating(double a, double b, cmp_op op) {
    return 0;
 }
 
+/* Search integer array, signed values are stored as their 64-bit two's complement */
+static int findInteger(struct expression_array *ast, uint64_t val, int (*compar)(const void *, const void *))
+{
+   if (ast->hash_set != NULL) {
+      return hashSetContains(ast->hash_set, &val);
+   }
+   return bsearch(&val, ast->array_values, ast->array_size, sizeof(uint64_t), compar) != NULL;
+}
+
 int compareElemInArray(void *val, struct expression_array *ast)
 {
    void *res = NULL;
 
-   uint64_t val_u;
-   int64_t val_i;
    double val_f;
+   uint64_t key[2];
 
    switch (ast->field_type) {
    case UR_TYPE_UINT8:
-      val_u = *((uint8_t *) val);
-      res = bsearch(&val_u, ast->array_values, ast->array_size, sizeof(uint64_t), compareUI64);
-      break;
+      return findInteger(ast, *((uint8_t *) val), compareUI64);
    case UR_TYPE_UINT16:
-      val_u = *((uint16_t *) val);
-      res = bsearch(&val_u, ast->array_values, ast->array_size, sizeof(uint64_t), compareUI64);
-      break;
+      return findInteger(ast, *((uint16_t *) val), compareUI64);
    case UR_TYPE_UINT32:
-      val_u = *((uint32_t *) val);
-      res = bsearch(&val_u, ast->array_values, ast->array_size, sizeof(uint64_t), compareUI64);
-      break;
+      return findInteger(ast, *((uint32_t *) val), compareUI64);
    case UR_TYPE_UINT64:
-      val_u = *((uint64_t *) val);
-      res = bsearch(&val_u, ast->array_values, ast->array_size, sizeof(uint64_t), compareUI64);
-      break;
+      return findInteger(ast, *((uint64_t *) val), compareUI64);
    case UR_TYPE_INT8:
-      val_i = *((uint8_t *) val);
-      res = bsearch(&val_i, ast->array_values, ast->array_size, sizeof(int64_t), compareI64);
-      break;
+      return findInteger(ast, (int64_t) *((int8_t *) val), compareI64);
    case UR_TYPE_INT16:
-      val_i = *((uint16_t *) val);
-      res = bsearch(&val_i, ast->array_values, ast->array_size, sizeof(int64_t), compareI64);
-      break;
+      return findInteger(ast, (int64_t) *((int16_t *) val), compareI64);
    case UR_TYPE_INT32:
-      val_i = *((uint32_t *) val);
-      res = bsearch(&val_i, ast->array_values, ast->array_size, sizeof(int64_t), compareI64);
-      break;
+      return findInteger(ast, (int64_t) *((int32_t *) val), compareI64);
    case UR_TYPE_INT64:
-      val_i = *((uint64_t *) val);
-      res = bsearch(&val_i, ast->array_values, ast->array_size, sizeof(int64_t), compareI64);
-      break;
+      return findInteger(ast, *((int64_t *) val), compareI64);
    case UR_TYPE_IP:
-      if (ast->ipprefixes == 0) {
+      if (ast->prefix_trie != NULL) {
+         return prefixTrieContains(ast->prefix_trie, (ip_addr_t *) val);
+      } else if (ast->hash_set != NULL) {
+         memcpy(key, val, sizeof(key));
+         return hashSetContains(ast->hash_set, key);
+      } else if (ast->ipprefixes == 0) {
          res = bsearch(val, ast->array_values_ipprefix, ast->array_size, sizeof(struct ipprefix), compareIPs);
       } else {
          res = bsearch(val, ast->array_values_ipprefix, ast->array_size, sizeof(struct ipprefix), compareIPwithPrefix);
       }
       break;
    case UR_TYPE_TIME:
+      if (ast->hash_set != NULL) {
+         return hashSetContains(ast->hash_set, (uint64_t *) val);
+      }
       res = bsearch(val, ast->array_values_date, ast->array_size, sizeof(ur_time_t), compareUI64);
       break;
    case UR_TYPE_FLOAT:
@@ -1288,9 +1621,9 @@ int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec)
       int type = ur_get_type(((struct expression*) ast)->id);
       switch (type) {
       case UR_TYPE_UINT8:
-         return compareSigned(*(uint8_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
+         return compareUnsigned(*(uint8_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
       case UR_TYPE_INT8:
-         return compareUnsigned(*(int8_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
+         return compareSigned(*(int8_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
       case UR_TYPE_INT16:
          return compareSigned(*(int16_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
       case UR_TYPE_UINT16:
@@ -1309,6 +1642,9 @@ int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec)
       if (((struct expression_fp*) ast)->id == UR_INVALID_FIELD) {
          return 0;
       }
+      if (ur_get_type(((struct expression_fp*) ast)->id) == UR_TYPE_FLOAT) {
+         return compareFloating(*(float *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression_fp*) ast)->id)), ((struct expression_fp*) ast)->number, ((struct expression_fp*) ast)->cmp);
+      }
       return compareFloating(*(double *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression_fp*) ast)->id)), ((struct expression_fp*) ast)->number, ((struct expression_fp*) ast)->cmp);
    case NODE_T_EXPRESSION_DATETIME:
       if (((struct expression*) ast)->id == UR_INVALID_FIELD) {
@@ -1333,6 +1669,9 @@ int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec)
          if (((struct expression_array*) ast)->id == UR_INVALID_FIELD) {
             return 0;
          }
+         if (((struct expression_array*) ast)->filename != NULL) {
+            updateArray((struct expression_array *) ast);
+         }
 
          int result = 0;
          /* This test should be probably everywhere */
@@ -1460,7 +1799,6 @@ int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec)
          return is_equal == (((struct str*) ast)->cmp == OP_EQ);
       } else { // string
          if (((struct str*) ast)->cmp == OP_RE) {
-
             memcpy(str_buffer, expr, size);
             str_buffer[size] = '\0';
 
@@ -51,6 +51,7 @@
 
 #include <unirec/unirec.h>
 #include <sys/types.h>
+#include <time.h>
 #include <regex.h>
 
 extern int yydebug;
@@ -77,6 +78,9 @@ struct ipprefix {
    ip_addr_t mask;
 };
 
+struct hash_set;
+struct prefix_trie;
+
 /* AST nodes */
 struct ast {
    node_type type;
@@ -133,6 +137,13 @@ struct expression_array {
    char ipprefixes;
    ur_time_t *array_values_date;
    double *array_values_double;
+   struct hash_set *hash_set;          // set of values of large arrays of integers, times and IP addresses
+   struct prefix_trie *prefix_trie;    // trie of large arrays of IP prefixes
+   char *filename;                     // file with values, NULL when values are given in filter
+   struct timespec file_mtime;         // version of file used for current values
+   ino_t file_inode;
+   off_t file_size;
+   struct expression_array *pending;   // values reloaded from file, see updateArray()
    ur_field_id_t id;
    ur_field_id_t dstid;
    ur_field_type_t field_type;
@@ -182,6 +193,11 @@ int yylex();
 int yyparse();
 void printAST(struct ast *ast);
 int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec);
+int compareElemInArray(void *val, struct expression_array *ast);
+int countArrayFiles(struct ast *ast);
+int reloadArrayFiles(struct ast *ast, int force);
+void updateArray(struct expression_array *array);
+void ip_mask(ip_addr_t *tg_ip, ip_addr_t *mask);
 void freeAST(struct ast *tree);
 struct ast *getTree(const char *str, const char *port_number);
 void changeProtocol(struct ast **ast);
@@ -0,0 +1,145 @@
+/**
+ * \file fuzz_liburfilter.c
+ * \brief libFuzzer target of filter parser and evaluators
+ * \date 2026
+ *
+ * Input is used as filter. Filters which compile are matched on fixed set of records by the
+ * tree evaluator, the compiled program, batch evaluation and filter group, and the target
+ * aborts when their results differ. Built by `make fuzz_liburfilter CC=clang`, run as
+ * `./fuzz_liburfilter fuzz_corpus`.
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unirec/unirec.h>
+
+#include "functions.h"
+#include "liburfilter.h"
+
+#define FUZZ_RECORDS 16
+
+static ur_template_t *tmplt;
+static const void *recs[FUZZ_RECORDS];
+
+static const char *ips[] = {"10.0.0.1", "10.0.0.2", "192.168.1.1", "::1", "2001:db8::1", "0.0.0.0"};
+static const char *names[] = {"www.example.com", "mail.example.org", "", "a", "example", "ab\\.c"};
+
+#define FIELD(type, name) (*(type *) ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name(name)))
+
+static int init(void)
+{
+   // library reports compiled filters to stdout
+   if (freopen("/dev/null", "w", stdout) == NULL) {
+      return 1;
+   }
+   str_buffer = malloc(65536);
+   if (ur_define_set_of_fields("ipaddr SRC_IP,ipaddr DST_IP,uint16 SRC_PORT,uint16 DST_PORT,uint8 PROTOCOL,"
+                               "uint64 BYTES,int8 TTL_DIFF,double SCALE,time TIME,char FLAG,string DNS_NAME") != UR_OK) {
+      return 1;
+   }
+   tmplt = ur_create_template("SRC_IP,DST_IP,SRC_PORT,DST_PORT,PROTOCOL,BYTES,TTL_DIFF,SCALE,TIME,FLAG,DNS_NAME", NULL);
+   if (tmplt == NULL) {
+      return 1;
+   }
+
+   for (int i = 0; i < FUZZ_RECORDS; i++) {
+      void *rec = ur_create_record(tmplt, 64);
+      ip_from_str(ips[i % 6], &FIELD(ip_addr_t, "SRC_IP"));
+      ip_from_str(ips[(i / 2) % 6], &FIELD(ip_addr_t, "DST_IP"));
+      FIELD(uint16_t, "SRC_PORT") = i * 40;
+      FIELD(uint16_t, "DST_PORT") = i % 3 ? 80 : 65535;
+      FIELD(uint8_t, "PROTOCOL") = i % 2 ? 6 : 17;
+      FIELD(uint64_t, "BYTES") = i % 5 ? (uint64_t) i * 1000 : UINT64_MAX;
+      FIELD(int8_t, "TTL_DIFF") = i - 8;
+      FIELD(double, "SCALE") = i * 0.5;
+      FIELD(ur_time_t, "TIME") = ur_time_from_sec_msec(1500000000 + i * 100000000, 0);
+      FIELD(char, "FLAG") = "abz"[i % 3];
+      ur_set_string(tmplt, rec, ur_get_id_by_name("DNS_NAME"), names[i % 6]);
+      recs[i] = rec;
+   }
+   return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+   static int initialized = 0;
+   uint64_t bitmap, group_bitmap;
+   int results[1];
+
+   if (!initialized) {
+      if (init() != 0) {
+         abort();
+      }
+      initialized = 1;
+   }
+
+   char *filter = strndup((const char *) data, size);
+   // lists from files would make inputs depend on the file system
+   if (filter == NULL || strstr(filter, "file") != NULL) {
+      free(filter);
+      return 0;
+   }
+
+   urfilter_t *urf = urfilter_create(filter, "fuzz");
+   if (urfilter_compile(urf) == URFILTER_TRUE) {
+      urfilter_group_t *group = urfilter_group_create(&urf, 1);
+      if (group == NULL) {
+         abort();
+      }
+      urfilter_match_batch(urf, tmplt, recs, FUZZ_RECORDS, &bitmap);
+      urfilter_group_match_batch(group, tmplt, recs, FUZZ_RECORDS, &group_bitmap);
+
+      for (int i = 0; i < FUZZ_RECORDS; i++) {
+         int expected = evalAST((struct ast *) urf->tree, tmplt, recs[i]);
+         urfilter_group_match(group, tmplt, recs[i], results);
+         if (urfilter_match(urf, tmplt, recs[i]) != expected || results[0] != expected ||
+             (int) ((bitmap >> i) & 1) != expected || (int) ((group_bitmap >> i) & 1) != expected) {
+            fprintf(stderr, "Evaluators differ on record %d of filter: %s\n", i, filter);
+            abort();
+         }
+      }
+      urfilter_group_destroy(group);
+   }
+   urfilter_destroy(urf);
+   free(filter);
+   return 0;
+}
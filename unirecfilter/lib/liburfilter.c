@@ -52,6 +52,7 @@
 #endif
 
 #include "functions.h"
+#include "program.h"
 #include "liburfilter.h"
 
 #include <string.h>
@@ -78,13 +79,25 @@ int urfilter_compile(urfilter_t *unirec_filter)
    // @TODO Verify if template is present in global context (filter keywords MUST be known before compile)
 
    if (unirec_filter->filter) {
+      // compiling again replaces program and tree of the previous compilation
+      freeProgram((struct urf_program *) unirec_filter->program);
+      unirec_filter->program = NULL;
+      if (unirec_filter->tree) {
+         freeAST((struct ast *) unirec_filter->tree);
+         unirec_filter->tree = NULL;
+      }
       // parse string filter into AST
       unirec_filter->tree = (void *) getTree(unirec_filter->filter, unirec_filter->ifc_identifier);
       if (unirec_filter->tree == NULL) {
          return URFILTER_ERROR;
-      } else {
-         return URFILTER_TRUE;
       }
+      // lower AST to program of pre-typed tests evaluated by urfilter_match()
+      unirec_filter->program = (void *) compileAST((struct ast *) unirec_filter->tree);
+      if (unirec_filter->program == NULL) {
+         printf("[URFilter] Unable to compile filter rule. Memory allocation failed.\n");
+         return URFILTER_ERROR;
+      }
+      return URFILTER_TRUE;
    }
 
    printf("[URFilter] Unable to compile filter rule. No string filter given.\n");
@@ -110,21 +123,139 @@ int urfilter_match(urfilter_t *unirec_filter, const ur_template_t *template, con
       }
    }
 
-   if (unirec_filter->tree) {
-      return evalAST((struct ast *) unirec_filter->tree, template, record);
+   if (unirec_filter->program) {
+      return evalProgram((struct urf_program *) unirec_filter->program, template, record);
    }
 
    printf("[URFilter] Trying to match UniRec to uninitalized filter. Returning FALSE.\n");
    return URFILTER_FALSE;
 }
 
+int urfilter_match_batch(urfilter_t *unirec_filter, const ur_template_t *template, const void **records, int count, uint64_t *bitmap)
+{
+   int matched = 0;
+
+   if (unirec_filter->filter && !unirec_filter->tree && urfilter_compile(unirec_filter) != URFILTER_TRUE) {
+      printf("[URFilter] Syntax error in filter: %s.\n", unirec_filter->filter);
+      return URFILTER_ERROR;
+   }
+
+   for (int i = 0; i < count; i += URF_BATCH_SIZE) {
+      uint32_t n = count - i < URF_BATCH_SIZE ? count - i : URF_BATCH_SIZE;
+      if (unirec_filter->program) {
+         bitmap[i / URF_BATCH_SIZE] = evalProgramBatch((struct urf_program *) unirec_filter->program, template, records + i, n);
+      } else {
+         // empty filter means always TRUE
+         bitmap[i / URF_BATCH_SIZE] = n == URF_BATCH_SIZE ? ~UINT64_C(0) : (UINT64_C(1) << n) - 1;
+      }
+      matched += __builtin_popcountll(bitmap[i / URF_BATCH_SIZE]);
+   }
+   return matched;
+}
+
+int urfilter_reload_lists(urfilter_t *unirec_filter, int force)
+{
+   if (!unirec_filter->tree) {
+      return 0;
+   }
+   int reloaded = reloadArrayFiles((struct ast *) unirec_filter->tree, force);
+   return reloaded < 0 ? URFILTER_ERROR : reloaded;
+}
+
+int urfilter_list_count(urfilter_t *unirec_filter)
+{
+   if (!unirec_filter->tree) {
+      return 0;
+   }
+   return countArrayFiles((struct ast *) unirec_filter->tree);
+}
+
 void urfilter_destroy(urfilter_t *object)
 {
    if (object) {
       free(object->filter);
+      freeProgram((struct urf_program *) object->program);
       if (object->tree) {
          freeAST((struct ast *) object->tree);
       }
       free(object);
    }
 }
+
+urfilter_group_t *urfilter_group_create(urfilter_t **filters, int count)
+{
+   urfilter_group_t *group = (urfilter_group_t *) calloc(1, sizeof (urfilter_group_t));
+   const struct urf_program **programs = (const struct urf_program **) calloc(count ? count : 1, sizeof (struct urf_program *));
+
+   if (group == NULL || programs == NULL) {
+      free(group);
+      free(programs);
+      return NULL;
+   }
+
+   for (int i = 0; i < count; i++) {
+      if (!filters[i]->filter) {
+         // empty filter means always TRUE
+         continue;
+      }
+      if (!filters[i]->tree && urfilter_compile(filters[i]) != URFILTER_TRUE) {
+         printf("[URFilter] Syntax error in filter: %s.\n", filters[i]->filter);
+         free(programs);
+         free(group);
+         return NULL;
+      }
+      programs[i] = (const struct urf_program *) filters[i]->program;
+   }
+
+   group->count = count;
+   group->shared = (void *) compileShared(programs, count);
+   free(programs);
+   if (group->shared == NULL) {
+      printf("[URFilter] Unable to compile filter group. Memory allocation failed.\n");
+      free(group);
+      return NULL;
+   }
+   return group;
+}
+
+int urfilter_group_match(urfilter_group_t *group, const ur_template_t *template, const void *record, int *results)
+{
+   struct urf_shared *shared = (struct urf_shared *) group->shared;
+   int matched = 0;
+
+   resetShared(shared);
+   for (int i = 0; i < group->count; i++) {
+      results[i] = evalShared(shared, i, template, record) ? URFILTER_TRUE : URFILTER_FALSE;
+      matched += results[i];
+   }
+   return matched;
+}
+
+int urfilter_group_match_batch(urfilter_group_t *group, const ur_template_t *template, const void **records, int count, uint64_t *bitmaps)
+{
+   struct urf_shared *shared = (struct urf_shared *) group->shared;
+   int words = URFILTER_BITMAP_WORDS(count);
+   int matched = 0;
+
+   for (int i = 0; i < count; i += URF_BATCH_SIZE) {
+      uint32_t n = count - i < URF_BATCH_SIZE ? count - i : URF_BATCH_SIZE;
+      uint64_t any = 0;
+
+      resetShared(shared);
+      for (int j = 0; j < group->count; j++) {
+         uint64_t bits = evalSharedBatch(shared, j, template, records + i, n);
+         bitmaps[j * words + i / URF_BATCH_SIZE] = bits;
+         any |= bits;
+      }
+      matched += __builtin_popcountll(any);
+   }
+   return matched;
+}
+
+void urfilter_group_destroy(urfilter_group_t *group)
+{
+   if (group) {
+      freeShared((struct urf_shared *) group->shared);
+      free(group);
+   }
+}
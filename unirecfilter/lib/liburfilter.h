@@ -55,10 +55,14 @@
 #define URFILTER_FALSE 0
 #define URFILTER_ERROR (-1)
 
+/* Number of 64b words of bitmap with results of batch of count records */
+#define URFILTER_BITMAP_WORDS(count) (((count) + 63) / 64)
+
 typedef struct urfilter_s {
    char *filter;
    void *tree;
    const char *ifc_identifier;
+   void *program;
 } urfilter_t;
 
 /**
@@ -69,17 +73,84 @@ typedef struct urfilter_s {
 urfilter_t *urfilter_create(const char *filter_str, const char *ifc_identifier);
 
 /**
+ * Compile filter, previously compiled program is freed, so groups created from the filter must be created again.
  *
  * \return URFILTER_TRUE on success and URFILTER_ERROR on syntax error.
  */
 int urfilter_compile(urfilter_t *unirec_filter);
 
 /**
+ * Regular expressions are evaluated by matcher of compiled filter which keeps results for the last string,
+ * so one filter must not match records in more threads at once. Different filters are independent.
  *
  * \return Result of condition eval: URFILTER_TRUE/URFILTER_FALSE. URFILTER_ERROR on syntax error.
  */
 int urfilter_match(urfilter_t *unirec_filter, const ur_template_t *template, const void *record);
 
+/**
+ * Match batch of records with the same template. Numeric, port and IP comparisons are evaluated
+ * over columns of gathered fields using SIMD instructions when the CPU supports them.
+ * Batch evaluation uses buffer of compiled filter, so one filter must not match batches in more threads at once.
+ *
+ * \param[in] records Array of count records.
+ * \param[out] bitmap Bit i is set if record i matches the filter, URFILTER_BITMAP_WORDS(count) words.
+ * \return Number of matching records, URFILTER_ERROR on syntax error.
+ */
+int urfilter_match_batch(urfilter_t *unirec_filter, const ur_template_t *template, const void **records, int count, uint64_t *bitmap);
+
+/**
+ * Reload values of IN arrays given as file("...") if their files have changed.
+ * New values are prepared by the calling thread and the next urfilter_match() starts to use them,
+ * so lists can be reloaded by another thread than the one matching records. The filter must be
+ * already compiled and lists of one filter must not be reloaded by more threads at once.
+ *
+ * \param[in] force Reload all files even if they have not changed.
+ * \return Number of reloaded files, URFILTER_ERROR if some file could not be loaded (its previous values are kept).
+ */
+int urfilter_reload_lists(urfilter_t *unirec_filter, int force);
+
+/**
+ * Get number of IN arrays given as file("...") in compiled filter.
+ *
+ * \return Number of arrays loaded from files, 0 if filter is not compiled.
+ */
+int urfilter_list_count(urfilter_t *unirec_filter);
+
 void urfilter_destroy(urfilter_t *object);
 
+typedef struct urfilter_group_s {
+   int count;
+   void *shared;
+} urfilter_group_t;
+
+/**
+ * Create group of filters matched on the same records. Equal conditions of all filters
+ * (e.g. the same IN array or regular expression used by more outputs) are evaluated only once per record.
+ * Filters are compiled if needed and must not be destroyed before the group, the array itself
+ * is not referenced after the call.
+ *
+ * \param[in] filters Array of filters, filter without string filter matches every record.
+ * \param[in] count Number of filters.
+ * \return Pointer to group, NULL on syntax error or memory allocation error.
+ */
+urfilter_group_t *urfilter_group_create(urfilter_t **filters, int count);
+
+/**
+ *
+ * \param[out] results Result of every filter of the group: URFILTER_TRUE/URFILTER_FALSE.
+ * \return Number of matching filters.
+ */
+int urfilter_group_match(urfilter_group_t *group, const ur_template_t *template, const void *record, int *results);
+
+/**
+ * Match batch of records with the same template, see urfilter_match_batch().
+ *
+ * \param[out] bitmaps Bitmap of matching records of every filter, bitmap of filter i starts at
+ *                     bitmaps[i * URFILTER_BITMAP_WORDS(count)].
+ * \return Number of records matching at least one filter.
+ */
+int urfilter_group_match_batch(urfilter_group_t *group, const ur_template_t *template, const void **records, int count, uint64_t *bitmaps);
+
+void urfilter_group_destroy(urfilter_group_t *group);
+
 #endif /* LIBUNIRECFILTER_H */
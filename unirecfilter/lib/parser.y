@@ -14,6 +14,7 @@
     struct ast *newExpressionFP(char *column, char *cmp, double number);
     struct ast *newExpressionDateTime(char *column, char *cmp, char *datetime);
     struct ast *newExpressionArray(char *column, char *cmp, char *array);
+    struct ast *newExpressionArrayFile(char *column, char *cmp, char *filename);
     struct ast *newIP(char *column, char *cmp, char *ip);
     struct ast *newIPNET(char *column, char *cmp, char *ipAddr);
     struct ast *newString(char *column, char *cmp, char *s);
@@ -44,6 +45,7 @@
 %token <string> IP
 %token <string> DATETIME
 %token <string> ARRAY
+%token <string> FILE_ARRAY
 %token <string> STRING
 %token <string> NET
 %token <string> BOOLEAN
@@ -80,6 +82,9 @@ exp:
     | COLUMN CMP ARRAY { $$ = newExpressionArray($1, $2, $3); if ($$ == NULL) {YYERROR;}}
     | HOST CMP ARRAY { $$ = newExpressionArray(strdup("host"), $2, $3); if ($$ == NULL) {YYERROR;}}
     | PORT CMP ARRAY { $$ = newExpressionArray(strdup("port"), $2, $3); if ($$ == NULL) {YYERROR;}}
+    | COLUMN CMP FILE_ARRAY { $$ = newExpressionArrayFile($1, $2, $3); if ($$ == NULL) {YYERROR;}}
+    | HOST CMP FILE_ARRAY { $$ = newExpressionArrayFile(strdup("host"), $2, $3); if ($$ == NULL) {YYERROR;}}
+    | PORT CMP FILE_ARRAY { $$ = newExpressionArrayFile(strdup("port"), $2, $3); if ($$ == NULL) {YYERROR;}}
     | PROTOCOL CMP UNSIGNED { $$ = newExpression(strdup("PROTOCOL"), $2, $3, 0); }
     | PROTOCOL EQ UNSIGNED { $$ = newExpression(strdup("PROTOCOL"), $2, $3, 0); }
     | PROTOCOL EQ PROTO_NAME { $$ = (struct ast *) newProtocol($2, $3); }
@@ -0,0 +1,881 @@
+/**
+ * \file program.c
+ * \brief Filter compiled from abstract syntax tree to flat program of pre-typed tests
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define URF_X86_KERNELS
+#endif
+
+#include "program.h"
+#include "strmatch.h"
+
+/* Index of URF_CMP_* bit for result of comparison of a and b */
+#define CMP_SHIFT(a, b) ((a) < (b) ? 0 : ((a) == (b) ? 1 : 2))
+
+#define FLOAT_EPS 1e-8
+
+static uint8_t getCmpMask(cmp_op cmp)
+{
+   switch (cmp) {
+   case OP_EQ:
+      return URF_CMP_EQ;
+   case OP_NE:
+      return URF_CMP_LT | URF_CMP_GT;
+   case OP_LT:
+      return URF_CMP_LT;
+   case OP_LE:
+      return URF_CMP_LT | URF_CMP_EQ;
+   case OP_GT:
+      return URF_CMP_GT;
+   case OP_GE:
+      return URF_CMP_GT | URF_CMP_EQ;
+   default:
+      fprintf(stderr, "Warning: Invalid comparison operator, corresponding rule will always evaluate false.\n");
+      return 0;
+   }
+}
+
+static int testFalse(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   return 0;
+}
+
+static int testTrue(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   return 1;
+}
+
+/* Integer fields are compared as unsigned resp. signed 64b numbers as in compareUnsigned() resp. compareSigned() */
+#define DEFINE_INT_TEST(name, type, member) \
+static int name(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec) \
+{ \
+   type val = *(const type *) ur_get_ptr_by_id(in_tmplt, in_rec, insn->id); \
+   return (insn->cmp_mask >> CMP_SHIFT(val, insn->value.member)) & 1; \
+}
+
+DEFINE_INT_TEST(testUint8, uint8_t, u)
+DEFINE_INT_TEST(testUint16, uint16_t, u)
+DEFINE_INT_TEST(testUint32, uint32_t, u)
+DEFINE_INT_TEST(testUint64, uint64_t, u)
+DEFINE_INT_TEST(testInt8, int8_t, i)
+DEFINE_INT_TEST(testInt16, int16_t, i)
+DEFINE_INT_TEST(testInt32, int32_t, i)
+DEFINE_INT_TEST(testInt64, int64_t, i)
+DEFINE_INT_TEST(testTime, ur_time_t, u)
+
+/*
+ * Floating point fields are equal within FLOAT_EPS as in compareFloating(), comparison
+ * with NaN is false except for != as with comparison operators of C.
+ */
+#define DEFINE_FP_TEST(name, type) \
+static int name(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec) \
+{ \
+   double val = *(const type *) ur_get_ptr_by_id(in_tmplt, in_rec, insn->id); \
+   if (isnan(val) || isnan(insn->value.d)) { \
+      return insn->cmp == OP_NE; \
+   } \
+   if (insn->cmp == OP_EQ) { \
+      return fabs(val - insn->value.d) < FLOAT_EPS; \
+   } \
+   return (insn->cmp_mask >> CMP_SHIFT(val, insn->value.d)) & 1; \
+}
+
+DEFINE_FP_TEST(testFloat, float)
+DEFINE_FP_TEST(testDouble, double)
+
+static int testPort(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   uint64_t src = *(const uint16_t *) ur_get_ptr_by_id(in_tmplt, in_rec, insn->id);
+   uint64_t dst = *(const uint16_t *) ur_get_ptr_by_id(in_tmplt, in_rec, insn->dstid);
+   return ((insn->cmp_mask >> CMP_SHIFT(src, insn->value.u)) & 1) ||
+          ((insn->cmp_mask >> CMP_SHIFT(dst, insn->value.u)) & 1);
+}
+
+/* Combine results of ip_cmp() of source and destination address as evalAST() does */
+static int ipResult(const struct urf_insn *insn, int cmp_res1, int cmp_res2)
+{
+   if (cmp_res1 == 0 || cmp_res2 == 0) {
+      return (insn->cmp_mask & URF_CMP_EQ) != 0;
+   } else if (cmp_res1 < 0 || cmp_res2 < 0) {
+      return (insn->cmp_mask & URF_CMP_LT) != 0;
+   } else {
+      return (insn->cmp_mask & URF_CMP_GT) != 0;
+   }
+}
+
+static int testIP(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   const struct ip *ip = (const struct ip *) insn->node;
+   int cmp_res1 = ip_cmp((ip_addr_t *) ur_get_ptr_by_id(in_tmplt, in_rec, insn->id), &ip->ipAddr);
+   int cmp_res2 = cmp_res1;
+
+   if (insn->dstid != UR_INVALID_FIELD) {
+      cmp_res2 = ip_cmp((ip_addr_t *) ur_get_ptr_by_id(in_tmplt, in_rec, insn->dstid), &ip->ipAddr);
+   }
+   return ipResult(insn, cmp_res1, cmp_res2);
+}
+
+static int testNet(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   struct ipnet *ipnet = (struct ipnet *) insn->node;
+   ip_addr_t cur_ip = *((ip_addr_t *) ur_get_ptr_by_id(in_tmplt, in_rec, insn->id));
+   int cmp_res1, cmp_res2;
+
+   /* check if both IPs are of the same version and return if not */
+   if (ip_is4(&cur_ip) != ip_is4(&ipnet->ipAddr)) {
+      return insn->cmp == OP_NE || insn->cmp == OP_LT || insn->cmp == OP_GT;
+   }
+   ip_mask(&cur_ip, &ipnet->ipMask);
+   cmp_res1 = ip_cmp(&cur_ip, &ipnet->ipAddr);
+   cmp_res2 = cmp_res1;
+
+   if (insn->dstid != UR_INVALID_FIELD) {
+      cur_ip = *((ip_addr_t *) ur_get_ptr_by_id(in_tmplt, in_rec, insn->dstid));
+      ip_mask(&cur_ip, &ipnet->ipMask);
+      cmp_res2 = ip_cmp(&cur_ip, &ipnet->ipAddr);
+   }
+   return ipResult(insn, cmp_res1, cmp_res2);
+}
+
+static int testArray(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   struct expression_array *array = (struct expression_array *) insn->node;
+
+   if (!ur_is_present(in_tmplt, insn->id)) {
+      printf("Error: Field '%s' is not in the UniRec template.\n", array->column);
+      return 0;
+   }
+   if (compareElemInArray(ur_get_ptr_by_id(in_tmplt, in_rec, insn->id), array)) {
+      return 1;
+   }
+   if (insn->dstid != UR_INVALID_FIELD && ur_is_present(in_tmplt, insn->dstid)) {
+      return compareElemInArray(ur_get_ptr_by_id(in_tmplt, in_rec, insn->dstid), array);
+   }
+   return 0;
+}
+
+static int testArrayFile(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   // take values reloaded from file by other thread
+   updateArray((struct expression_array *) insn->node);
+   return testArray(insn, in_tmplt, in_rec);
+}
+
+static int testChar(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   const char *expr = (const char *) ur_get_ptr_by_id(in_tmplt, in_rec, insn->id);
+   return (insn->value.u == (uint8_t) *expr) == (insn->cmp == OP_EQ);
+}
+
+static int testString(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   const char *s = ((const struct str *) insn->node)->s;
+   size_t size = ur_get_var_len(in_tmplt, in_rec, insn->id);
+   const char *expr = (const char *) ur_get_ptr_by_id(in_tmplt, in_rec, insn->id);
+   int is_equal = (insn->value.u == size && memcmp(s, expr, size) == 0);
+
+   return is_equal == (insn->cmp == OP_EQ);
+}
+
+static int testRegex(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   size_t size = ur_get_var_len(in_tmplt, in_rec, insn->id);
+   const char *expr = (const char *) ur_get_ptr_by_id(in_tmplt, in_rec, insn->id);
+
+   if (insn->matcher != NULL) {
+      return strMatcherMatch(insn->matcher, insn->pattern, expr, size);
+   }
+
+   memcpy(str_buffer, expr, size);
+   str_buffer[size] = '\0';
+   return regexec(&((struct str *) insn->node)->re, str_buffer, 0, NULL, 0) != REG_NOMATCH;
+}
+
+static urf_test getIntTest(ur_field_type_t type)
+{
+   switch (type) {
+   case UR_TYPE_UINT8:
+      return testUint8;
+   case UR_TYPE_UINT16:
+      return testUint16;
+   case UR_TYPE_UINT32:
+      return testUint32;
+   case UR_TYPE_UINT64:
+      return testUint64;
+   case UR_TYPE_INT8:
+      return testInt8;
+   case UR_TYPE_INT16:
+      return testInt16;
+   case UR_TYPE_INT32:
+      return testInt32;
+   case UR_TYPE_INT64:
+      return testInt64;
+   default:
+      return testFalse;
+   }
+}
+
+/*
+ * Fill test of leaf node. Nodes which always evaluate false (unknown fields, wrong types)
+ * get testFalse, so their fields are never accessed.
+ */
+static void compileLeaf(struct ast *ast, struct urf_insn *insn)
+{
+   insn->test = testFalse;
+   insn->id = UR_INVALID_FIELD;
+   insn->dstid = UR_INVALID_FIELD;
+   insn->cmp = OP_INVALID;
+   insn->cmp_mask = 0;
+   insn->value.u = 0;
+   insn->node = ast;
+   insn->matcher = NULL;
+   insn->pattern = 0;
+
+   if (!ast) {
+      return;
+   }
+   switch (ast->type) {
+   case NODE_T_BOOLEAN:
+      insn->test = ((struct boolean *) ast)->value ? testTrue : testFalse;
+      break;
+   case NODE_T_EXPRESSION: {
+      struct expression *expr = (struct expression *) ast;
+      if (expr->id != UR_INVALID_FIELD) {
+         insn->id = expr->id;
+         insn->cmp = expr->cmp;
+         insn->cmp_mask = getCmpMask(expr->cmp);
+         insn->value.i = expr->number;
+         insn->test = getIntTest(ur_get_type(expr->id));
+      }
+      break;
+   }
+   case NODE_T_EXPRESSION_FP: {
+      struct expression_fp *expr = (struct expression_fp *) ast;
+      if (expr->id != UR_INVALID_FIELD) {
+         insn->id = expr->id;
+         insn->cmp = expr->cmp;
+         insn->cmp_mask = getCmpMask(expr->cmp);
+         insn->value.d = expr->number;
+         insn->test = ur_get_type(expr->id) == UR_TYPE_FLOAT ? testFloat : testDouble;
+      }
+      break;
+   }
+   case NODE_T_EXPRESSION_DATETIME: {
+      struct expression_datetime *expr = (struct expression_datetime *) ast;
+      if (expr->id != UR_INVALID_FIELD) {
+         insn->id = expr->id;
+         insn->cmp = expr->cmp;
+         insn->cmp_mask = getCmpMask(expr->cmp);
+         insn->value.u = expr->date;
+         insn->test = testTime;
+      }
+      break;
+   }
+   case NODE_T_EXPRESSION_PORT: {
+      struct expression_port *port = (struct expression_port *) ast;
+      if (port->srcport != UR_INVALID_FIELD && port->dstport != UR_INVALID_FIELD) {
+         insn->id = port->srcport;
+         insn->dstid = port->dstport;
+         insn->cmp = port->cmp;
+         insn->cmp_mask = getCmpMask(port->cmp);
+         insn->value.u = port->number;
+         insn->test = testPort;
+      }
+      break;
+   }
+   case NODE_T_EXPRESSION_ARRAY: {
+      struct expression_array *array = (struct expression_array *) ast;
+      if (array->id != UR_INVALID_FIELD) {
+         insn->id = array->id;
+         insn->dstid = array->dstid;
+         insn->test = array->filename != NULL ? testArrayFile : testArray;
+      }
+      break;
+   }
+   case NODE_T_IP: {
+      struct ip *ip = (struct ip *) ast;
+      if (ip->id != UR_INVALID_FIELD) {
+         insn->id = ip->id;
+         insn->dstid = ip->dstid;
+         insn->cmp = ip->cmp;
+         insn->cmp_mask = getCmpMask(ip->cmp);
+         insn->test = testIP;
+      }
+      break;
+   }
+   case NODE_T_NET: {
+      struct ipnet *ipnet = (struct ipnet *) ast;
+      if (ipnet->id != UR_INVALID_FIELD) {
+         insn->id = ipnet->id;
+         insn->dstid = ipnet->dstid;
+         insn->cmp = ipnet->cmp;
+         insn->cmp_mask = getCmpMask(ipnet->cmp);
+         insn->test = testNet;
+      }
+      break;
+   }
+   case NODE_T_STRING: {
+      struct str *str = (struct str *) ast;
+      if (str->id == UR_INVALID_FIELD) {
+         break;
+      }
+      insn->id = str->id;
+      insn->cmp = str->cmp;
+      if (ur_get_type(str->id) == UR_TYPE_CHAR) {
+         // only single character can be equal
+         if (strlen(str->s) == 1) {
+            insn->value.u = (uint8_t) str->s[0];
+            insn->test = testChar;
+         } else {
+            insn->test = str->cmp == OP_EQ ? testFalse : testTrue;
+         }
+      } else if (str->cmp == OP_RE) {
+         insn->test = testRegex;
+      } else {
+         insn->value.u = strlen(str->s);
+         insn->test = testString;
+      }
+      break;
+   }
+   default:
+      break;
+   }
+}
+
+/* Number of instructions of compiled subtree, every leaf is one test */
+static uint32_t countLeaves(struct ast *ast)
+{
+   if (!ast) {
+      return 1;
+   }
+   switch (ast->type) {
+   case NODE_T_AST:
+      if (ast->operator == OP_NOP) {
+         return countLeaves(ast->l);
+      } else if (ast->operator == OP_OR || ast->operator == OP_AND) {
+         return countLeaves(ast->l) + countLeaves(ast->r);
+      }
+      return 1;
+   case NODE_T_BRACKET:
+   case NODE_T_NEGATION:
+      return countLeaves(((struct brack *) ast)->b);
+   default:
+      return 1;
+   }
+}
+
+/*
+ * Emit instructions of subtree starting at pc, jump to jt when subtree is true and to jf otherwise.
+ * Logical operators are short-circuited by jump targets, negation swaps them.
+ */
+static uint32_t emit(struct urf_program *prog, uint32_t pc, struct ast *ast, uint32_t jt, uint32_t jf)
+{
+   if (ast && ast->type == NODE_T_AST) {
+      if (ast->operator == OP_NOP) {
+         return emit(prog, pc, ast->l, jt, jf);
+      } else if (ast->operator == OP_AND) {
+         uint32_t right = pc + countLeaves(ast->l);
+         emit(prog, pc, ast->l, right, jf);
+         return emit(prog, right, ast->r, jt, jf);
+      } else if (ast->operator == OP_OR) {
+         uint32_t right = pc + countLeaves(ast->l);
+         emit(prog, pc, ast->l, jt, right);
+         return emit(prog, right, ast->r, jt, jf);
+      }
+      fprintf(stderr, "Warning: Unknown operator in NODE_T_AST.\n");
+      ast = NULL;
+   } else if (ast && ast->type == NODE_T_BRACKET) {
+      return emit(prog, pc, ((struct brack *) ast)->b, jt, jf);
+   } else if (ast && ast->type == NODE_T_NEGATION) {
+      return emit(prog, pc, ((struct brack *) ast)->b, jf, jt);
+   }
+
+   compileLeaf(ast, &prog->insns[pc]);
+   prog->insns[pc].jt = jt;
+   prog->insns[pc].jf = jf;
+   return pc + 1;
+}
+
+/**
+ * \brief Compile abstract syntax tree to program
+ * \param[in] ast tree created by getTree(), it must not be freed before the program
+ * \return compiled program, NULL on memory allocation error
+ */
+struct urf_program *compileAST(struct ast *ast)
+{
+   uint32_t size = countLeaves(ast);
+   struct urf_program *prog = (struct urf_program *) malloc(sizeof(struct urf_program) + size * sizeof(struct urf_insn));
+
+   if (prog == NULL) {
+      return NULL;
+   }
+   prog->reach = (uint64_t *) malloc((size + 2) * sizeof(uint64_t));
+   if (prog->reach == NULL) {
+      free(prog);
+      return NULL;
+   }
+   prog->size = size;
+   prog->matchers = NULL;
+   emit(prog, 0, ast, size, size + 1);
+
+   // regular expressions on the same field are evaluated together by matcher of the program
+   for (uint32_t pc = 0; pc < size; pc++) {
+      struct urf_insn *insn = &prog->insns[pc];
+      if (insn->test == testRegex) {
+         struct str *str = (struct str *) insn->node;
+         insn->matcher = strMatcherAdd(&prog->matchers, insn->id, str->s, &str->re, &insn->pattern);
+      }
+   }
+   return prog;
+}
+
+/**
+ * \brief Evaluate compiled program on UniRec record
+ * \return 1 if record matches the filter, 0 otherwise
+ */
+int evalProgram(const struct urf_program *prog, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   uint32_t pc = 0;
+
+   while (pc < prog->size) {
+      const struct urf_insn *insn = &prog->insns[pc];
+      pc = insn->test(insn, in_tmplt, in_rec) ? insn->jt : insn->jf;
+   }
+   return pc == prog->size;
+}
+
+void freeProgram(struct urf_program *prog)
+{
+   if (prog) {
+      free(prog->reach);
+      strMatcherFree(prog->matchers);
+   }
+   free(prog);
+}
+
+/* States of results of distinct tests in struct urf_shared */
+#define LEAF_UNKNOWN 0
+#define LEAF_FALSE 1
+#define LEAF_TRUE 2
+
+static int sameArray(const struct expression_array *a, const struct expression_array *b)
+{
+   if (a == b) {
+      return 1;
+   }
+   // values of arrays from files can change independently
+   if (a->filename != NULL || b->filename != NULL || a->field_type != b->field_type ||
+       a->array_size != b->array_size || a->ipprefixes != b->ipprefixes) {
+      return 0;
+   }
+   switch (a->field_type) {
+   case UR_TYPE_IP:
+      return memcmp(a->array_values_ipprefix, b->array_values_ipprefix, a->array_size * sizeof(struct ipprefix)) == 0;
+   case UR_TYPE_TIME:
+      return memcmp(a->array_values_date, b->array_values_date, a->array_size * sizeof(ur_time_t)) == 0;
+   case UR_TYPE_FLOAT:
+   case UR_TYPE_DOUBLE:
+      return memcmp(a->array_values_double, b->array_values_double, a->array_size * sizeof(double)) == 0;
+   default:
+      return memcmp(a->array_values, b->array_values, a->array_size * sizeof(uint64_t)) == 0;
+   }
+}
+
+/* Check if two instructions test the same condition */
+static int sameLeaf(const struct urf_insn *a, const struct urf_insn *b)
+{
+   if (a->test != b->test || a->id != b->id || a->dstid != b->dstid || a->cmp != b->cmp ||
+       a->cmp_mask != b->cmp_mask || a->value.u != b->value.u) {
+      return 0;
+   }
+   if (a->test == testIP) {
+      return ip_cmp(&((struct ip *) a->node)->ipAddr, &((struct ip *) b->node)->ipAddr) == 0;
+   } else if (a->test == testNet) {
+      return ip_cmp(&((struct ipnet *) a->node)->ipAddr, &((struct ipnet *) b->node)->ipAddr) == 0 &&
+             ip_cmp(&((struct ipnet *) a->node)->ipMask, &((struct ipnet *) b->node)->ipMask) == 0;
+   } else if (a->test == testArray || a->test == testArrayFile) {
+      return sameArray((struct expression_array *) a->node, (struct expression_array *) b->node);
+   } else if (a->test == testString || a->test == testRegex) {
+      return strcmp(((struct str *) a->node)->s, ((struct str *) b->node)->s) == 0;
+   }
+   return 1;
+}
+
+/**
+ * \brief Merge equal tests of programs of more filters
+ * \param[in] programs compiled filters, NULL stands for filter matching every record
+ * \return shared programs, NULL on memory allocation error
+ */
+struct urf_shared *compileShared(const struct urf_program **programs, uint32_t count)
+{
+   struct urf_shared *shared = (struct urf_shared *) calloc(1, sizeof(struct urf_shared));
+   const struct urf_insn **distinct;
+   uint32_t total = 0;
+
+   if (shared == NULL) {
+      return NULL;
+   }
+   shared->program_count = count;
+   shared->programs = malloc(count * sizeof(struct urf_program *));
+   shared->offsets = malloc(count * sizeof(uint32_t));
+   for (uint32_t i = 0; i < count; i++) {
+      total += programs[i] ? programs[i]->size : 0;
+   }
+   shared->leaves = malloc((total + 1) * sizeof(uint32_t));
+   shared->results = malloc(total + 1);
+   shared->batch_known = malloc((total + 1) * sizeof(uint64_t));
+   shared->batch_true = malloc((total + 1) * sizeof(uint64_t));
+   distinct = malloc((total + 1) * sizeof(struct urf_insn *));
+   if (!shared->programs || !shared->offsets || !shared->leaves || !shared->results ||
+       !shared->batch_known || !shared->batch_true || !distinct) {
+      free(distinct);
+      freeShared(shared);
+      return NULL;
+   }
+
+   // filters have few tests, so quadratic search of equal tests is cheap
+   total = 0;
+   for (uint32_t i = 0; i < count; i++) {
+      shared->programs[i] = programs[i];
+      shared->offsets[i] = total;
+      for (uint32_t pc = 0; programs[i] && pc < programs[i]->size; pc++) {
+         const struct urf_insn *insn = &programs[i]->insns[pc];
+         uint32_t leaf;
+         for (leaf = 0; leaf < shared->leaf_count && !sameLeaf(distinct[leaf], insn); leaf++);
+         if (leaf == shared->leaf_count) {
+            distinct[shared->leaf_count++] = insn;
+         }
+         shared->leaves[total++] = leaf;
+      }
+   }
+   free(distinct);
+   return shared;
+}
+
+/**
+ * \brief Forget results of tests, must be called before programs are evaluated on new record or batch
+ */
+void resetShared(struct urf_shared *shared)
+{
+   memset(shared->results, LEAF_UNKNOWN, shared->leaf_count);
+   memset(shared->batch_known, 0, shared->leaf_count * sizeof(uint64_t));
+   memset(shared->batch_true, 0, shared->leaf_count * sizeof(uint64_t));
+}
+
+/**
+ * \brief Evaluate program of filter with given index, results of tests are reused by the other programs
+ * \return 1 if record matches the filter, 0 otherwise
+ */
+int evalShared(struct urf_shared *shared, uint32_t index, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   const struct urf_program *prog = shared->programs[index];
+   const uint32_t *leaves = shared->leaves + shared->offsets[index];
+   uint32_t pc = 0;
+
+   if (prog == NULL) {
+      return 1;
+   }
+   while (pc < prog->size) {
+      const struct urf_insn *insn = &prog->insns[pc];
+      uint8_t *result = &shared->results[leaves[pc]];
+      if (*result == LEAF_UNKNOWN) {
+         *result = insn->test(insn, in_tmplt, in_rec) ? LEAF_TRUE : LEAF_FALSE;
+      }
+      pc = *result == LEAF_TRUE ? insn->jt : insn->jf;
+   }
+   return pc == prog->size;
+}
+
+void freeShared(struct urf_shared *shared)
+{
+   if (shared == NULL) {
+      return;
+   }
+   free(shared->programs);
+   free(shared->offsets);
+   free(shared->leaves);
+   free(shared->results);
+   free(shared->batch_known);
+   free(shared->batch_true);
+   free(shared);
+}
+
+/*
+ * Batch evaluation. Records of batch flow through program as bitmaps: every instruction
+ * tests only records which reached it and passes them to jt resp. jf. Tests of integer,
+ * port and IP fields gather the field of all records to column and compare it at once.
+ */
+
+/* Combine bitmaps of lower and equal records to result of comparison given by cmp_mask */
+static inline uint64_t cmpResult(uint8_t cmp_mask, uint64_t lt, uint64_t eq)
+{
+   uint64_t gt = ~(lt | eq);
+   return (lt & -(uint64_t) ((cmp_mask & URF_CMP_LT) != 0)) |
+          (eq & -(uint64_t) ((cmp_mask & URF_CMP_EQ) != 0)) |
+          (gt & -(uint64_t) ((cmp_mask & URF_CMP_GT) != 0));
+}
+
+/* Compare column of signed numbers with value, column has URF_BATCH_SIZE items */
+static uint64_t cmpColumnScalar(const int64_t *col, int64_t value, uint8_t cmp_mask)
+{
+   uint64_t lt = 0, eq = 0;
+
+   for (uint32_t i = 0; i < URF_BATCH_SIZE; i++) {
+      lt |= (uint64_t) (col[i] < value) << i;
+      eq |= (uint64_t) (col[i] == value) << i;
+   }
+   return cmpResult(cmp_mask, lt, eq);
+}
+
+#ifdef URF_X86_KERNELS
+__attribute__((target("avx2")))
+static uint64_t cmpColumnAVX2(const int64_t *col, int64_t value, uint8_t cmp_mask)
+{
+   __m256i v = _mm256_set1_epi64x(value);
+   uint64_t lt = 0, eq = 0;
+
+   for (uint32_t i = 0; i < URF_BATCH_SIZE; i += 4) {
+      __m256i x = _mm256_loadu_si256((const __m256i *) (col + i));
+      lt |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, x))) << i;
+      eq |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, x))) << i;
+   }
+   return cmpResult(cmp_mask, lt, eq);
+}
+
+__attribute__((target("sse4.2")))
+static uint64_t cmpColumnSSE42(const int64_t *col, int64_t value, uint8_t cmp_mask)
+{
+   __m128i v = _mm_set1_epi64x(value);
+   uint64_t lt = 0, eq = 0;
+
+   for (uint32_t i = 0; i < URF_BATCH_SIZE; i += 2) {
+      __m128i x = _mm_loadu_si128((const __m128i *) (col + i));
+      lt |= (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(v, x))) << i;
+      eq |= (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v, x))) << i;
+   }
+   return cmpResult(cmp_mask, lt, eq);
+}
+#endif
+
+/* Comparison kernel supported by CPU, it is selected once when the library is loaded */
+static uint64_t (*cmpColumn)(const int64_t *col, int64_t value, uint8_t cmp_mask) = cmpColumnScalar;
+
+#ifdef URF_X86_KERNELS
+__attribute__((constructor))
+static void selectCmpColumn(void)
+{
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2")) {
+      cmpColumn = cmpColumnAVX2;
+   } else if (__builtin_cpu_supports("sse4.2")) {
+      cmpColumn = cmpColumnSSE42;
+   }
+}
+#endif
+
+/* Unsigned numbers are compared as signed after flipping of the highest bit */
+#define SIGN_FLIP (UINT64_C(1) << 63)
+
+/* Offset of static field is the same in all records of template */
+#define FIELD_OFFSET(in_tmplt, in_recs, id) \
+   ((const char *) ur_get_ptr_by_id(in_tmplt, in_recs[0], id) - (const char *) in_recs[0])
+
+#define GATHER_COLUMN(type, flip) \
+   for (uint32_t i = 0; i < count; i++) { \
+      col[i] = (int64_t) ((uint64_t) (int64_t) *(const type *) ((const char *) in_recs[i] + offset) ^ (flip)); \
+   }
+
+/*
+ * Load integer field of all records to column, returns 0 if test is not integer comparison.
+ * Value compared with the column is stored to value.
+ */
+static int gatherInt(const struct urf_insn *insn, ur_field_id_t id, const ur_template_t *in_tmplt,
+                     const void **in_recs, uint32_t count, int64_t *col, int64_t *value)
+{
+   ptrdiff_t offset = FIELD_OFFSET(in_tmplt, in_recs, id);
+
+   if (insn->test == testUint8) {
+      GATHER_COLUMN(uint8_t, SIGN_FLIP)
+   } else if (insn->test == testUint16 || insn->test == testPort) {
+      GATHER_COLUMN(uint16_t, SIGN_FLIP)
+   } else if (insn->test == testUint32) {
+      GATHER_COLUMN(uint32_t, SIGN_FLIP)
+   } else if (insn->test == testUint64 || insn->test == testTime) {
+      GATHER_COLUMN(uint64_t, SIGN_FLIP)
+   } else if (insn->test == testInt8) {
+      GATHER_COLUMN(int8_t, 0)
+   } else if (insn->test == testInt16) {
+      GATHER_COLUMN(int16_t, 0)
+   } else if (insn->test == testInt32) {
+      GATHER_COLUMN(int32_t, 0)
+   } else if (insn->test == testInt64) {
+      GATHER_COLUMN(int64_t, 0)
+   } else {
+      return 0;
+   }
+   *value = (insn->test == testInt8 || insn->test == testInt16 || insn->test == testInt32 || insn->test == testInt64) ?
+            insn->value.i : (int64_t) (insn->value.u ^ SIGN_FLIP);
+   return 1;
+}
+
+/* Compare IP field of all records with address, returns bitmap of equal records */
+static uint64_t eqIPColumn(ur_field_id_t id, const ur_template_t *in_tmplt, const void **in_recs, uint32_t count,
+                           const ip_addr_t *addr)
+{
+   ptrdiff_t offset = FIELD_OFFSET(in_tmplt, in_recs, id);
+   uint64_t eq = 0;
+#ifdef URF_X86_KERNELS
+   __m128i a = _mm_loadu_si128((const __m128i *) addr);
+
+   for (uint32_t i = 0; i < count; i++) {
+      __m128i x = _mm_loadu_si128((const __m128i *) ((const char *) in_recs[i] + offset));
+      eq |= (uint64_t) (_mm_movemask_epi8(_mm_cmpeq_epi8(a, x)) == 0xFFFF) << i;
+   }
+#else
+   for (uint32_t i = 0; i < count; i++) {
+      eq |= (uint64_t) (ip_cmp((ip_addr_t *) ((const char *) in_recs[i] + offset), addr) == 0) << i;
+   }
+#endif
+   return eq;
+}
+
+/* Evaluate instruction on records of batch given by mask, returns bitmap of records satisfying test */
+static uint64_t testBatch(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void **in_recs,
+                          uint32_t count, uint64_t mask)
+{
+   int64_t col[URF_BATCH_SIZE] = {0};
+   int64_t value;
+   uint64_t result = 0;
+
+   if (insn->test == testTrue) {
+      return mask;
+   } else if (insn->test == testFalse) {
+      return 0;
+   } else if (gatherInt(insn, insn->id, in_tmplt, in_recs, count, col, &value)) {
+      result = cmpColumn(col, value, insn->cmp_mask);
+      if (insn->test == testPort) {
+         gatherInt(insn, insn->dstid, in_tmplt, in_recs, count, col, &value);
+         result |= cmpColumn(col, value, insn->cmp_mask);
+      }
+      return result & mask;
+   } else if (insn->test == testIP && (insn->cmp_mask == URF_CMP_EQ || insn->cmp_mask == (URF_CMP_LT | URF_CMP_GT))) {
+      const ip_addr_t *addr = &((const struct ip *) insn->node)->ipAddr;
+      result = eqIPColumn(insn->id, in_tmplt, in_recs, count, addr);
+      if (insn->dstid != UR_INVALID_FIELD) {
+         result |= eqIPColumn(insn->dstid, in_tmplt, in_recs, count, addr);
+      }
+      return (insn->cmp_mask == URF_CMP_EQ ? result : ~result) & mask;
+   }
+
+   // other tests are evaluated record by record
+   while (mask) {
+      uint32_t i = __builtin_ctzll(mask);
+      result |= (uint64_t) (insn->test(insn, in_tmplt, in_recs[i]) != 0) << i;
+      mask &= mask - 1;
+   }
+   return result;
+}
+
+/* Evaluate program on batch, results of tests are cached in batch_known/batch_true when leaves are given */
+static uint64_t evalBatch(const struct urf_program *prog, const uint32_t *leaves, uint64_t *batch_known, uint64_t *batch_true,
+                          const ur_template_t *in_tmplt, const void **in_recs, uint32_t count)
+{
+   uint64_t *reach = prog->reach;
+
+   memset(reach, 0, (prog->size + 2) * sizeof(uint64_t));
+   reach[0] = count >= URF_BATCH_SIZE ? ~UINT64_C(0) : (UINT64_C(1) << count) - 1;
+   for (uint32_t pc = 0; pc < prog->size; pc++) {
+      const struct urf_insn *insn = &prog->insns[pc];
+      uint64_t mask = reach[pc];
+      uint64_t result;
+
+      if (mask == 0) {
+         continue;
+      }
+      if (leaves != NULL) {
+         uint32_t leaf = leaves[pc];
+         uint64_t unknown = mask & ~batch_known[leaf];
+         if (unknown) {
+            batch_true[leaf] |= testBatch(insn, in_tmplt, in_recs, count, unknown);
+            batch_known[leaf] |= unknown;
+         }
+         result = batch_true[leaf];
+      } else {
+         result = testBatch(insn, in_tmplt, in_recs, count, mask);
+      }
+      reach[insn->jt] |= mask & result;
+      reach[insn->jf] |= mask & ~result;
+   }
+   return reach[prog->size];
+}
+
+/**
+ * \brief Evaluate compiled program on batch of records with the same template
+ * \param[in] count number of records, at most URF_BATCH_SIZE
+ * \return bitmap of records matching the filter
+ */
+uint64_t evalProgramBatch(const struct urf_program *prog, const ur_template_t *in_tmplt, const void **in_recs, uint32_t count)
+{
+   return evalBatch(prog, NULL, NULL, NULL, in_tmplt, in_recs, count);
+}
+
+/**
+ * \brief Evaluate program of filter with given index on batch, results of tests are reused by the other programs
+ * \param[in] count number of records, at most URF_BATCH_SIZE
+ * \return bitmap of records matching the filter
+ */
+uint64_t evalSharedBatch(struct urf_shared *shared, uint32_t index, const ur_template_t *in_tmplt, const void **in_recs, uint32_t count)
+{
+   const struct urf_program *prog = shared->programs[index];
+
+   if (prog == NULL) {
+      return count >= URF_BATCH_SIZE ? ~UINT64_C(0) : (UINT64_C(1) << count) - 1;
+   }
+   return evalBatch(prog, shared->leaves + shared->offsets[index], shared->batch_known, shared->batch_true,
+                    in_tmplt, in_recs, count);
+}
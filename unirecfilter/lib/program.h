@@ -0,0 +1,125 @@
+/**
+ * \file program.h
+ * \brief Filter compiled from abstract syntax tree to flat program of pre-typed tests
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef LIB_UNIREC_PROGRAM_H
+#define LIB_UNIREC_PROGRAM_H
+
+#include <stdint.h>
+
+#include "functions.h"
+
+struct str_matcher;
+
+struct urf_insn;
+
+/* Test of one leaf of the tree, returns non-zero when the record satisfies it */
+typedef int (*urf_test)(const struct urf_insn *insn, const ur_template_t *in_tmplt, const void *in_rec);
+
+/* Accepted results of comparison, see cmp_mask of struct urf_insn */
+#define URF_CMP_LT 0x1
+#define URF_CMP_EQ 0x2
+#define URF_CMP_GT 0x4
+
+/*
+ * Instruction of compiled filter. Test is selected by field type and operator during
+ * compilation, so evaluation does not dispatch on types. Program continues with
+ * instruction jt when test is true, with jf otherwise.
+ */
+struct urf_insn {
+   urf_test test;
+   uint32_t jt;
+   uint32_t jf;
+   ur_field_id_t id;
+   ur_field_id_t dstid;
+   uint8_t cmp_mask;       // accepted results of comparison (URF_CMP_* bits)
+   cmp_op cmp;
+   union {
+      uint64_t u;
+      int64_t i;
+      double d;
+   } value;
+   struct ast *node;       // node with other operands (IP addresses, arrays, strings)
+   struct str_matcher *matcher;  // matcher of all regular expressions on the field, NULL if not used
+   uint32_t pattern;             // index of regular expression in matcher
+};
+
+/*
+ * Compiled filter. Jumps go only forward, jump to size means the record matches
+ * the filter, jump to size + 1 means it does not.
+ */
+struct urf_program {
+   uint32_t size;
+   uint64_t *reach;        // records reaching every instruction during batch evaluation, size + 2 items
+   struct str_matcher *matchers;  // matchers of regular expressions used by the program
+   struct urf_insn insns[];
+};
+
+/*
+ * Programs of more filters evaluated on the same records. Equal leaves of all programs
+ * are merged, so every distinct test is evaluated at most once per record.
+ */
+struct urf_shared {
+   uint32_t program_count;
+   const struct urf_program **programs;   // NULL program matches every record
+   uint32_t *offsets;                     // leaves of program i start at leaves[offsets[i]]
+   uint32_t *leaves;                      // index of distinct test of every instruction
+   uint32_t leaf_count;
+   uint8_t *results;                      // results of distinct tests for current record
+   uint64_t *batch_known;                 // records of current batch with known result of distinct test
+   uint64_t *batch_true;                  // records of current batch satisfying distinct test
+};
+
+/* Maximal number of records evaluated by one call of batch evaluation, bit i of result is record i */
+#define URF_BATCH_SIZE 64
+
+struct urf_program *compileAST(struct ast *ast);
+int evalProgram(const struct urf_program *prog, const ur_template_t *in_tmplt, const void *in_rec);
+uint64_t evalProgramBatch(const struct urf_program *prog, const ur_template_t *in_tmplt, const void **in_recs, uint32_t count);
+void freeProgram(struct urf_program *prog);
+
+struct urf_shared *compileShared(const struct urf_program **programs, uint32_t count);
+void resetShared(struct urf_shared *shared);
+int evalShared(struct urf_shared *shared, uint32_t index, const ur_template_t *in_tmplt, const void *in_rec);
+uint64_t evalSharedBatch(struct urf_shared *shared, uint32_t index, const ur_template_t *in_tmplt, const void **in_recs, uint32_t count);
+void freeShared(struct urf_shared *shared);
+
+#endif /* LIB_UNIREC_PROGRAM_H */
@@ -0,0 +1,454 @@
+/**
+ * \file strmatch.c
+ * \brief Combined matching of all regular expressions used with one UniRec field
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "strmatch.h"
+
+#define NO_STATE UINT32_MAX
+
+/* Characters with special meaning in extended regular expressions */
+#define ERE_SPECIAL ".[]()*+?{}|^$\\"
+
+#define BIT_GET(bits, i) (((bits)[(i) / 64] >> ((i) % 64)) & 1)
+#define BIT_SET(bits, i) ((bits)[(i) / 64] |= 1ULL << ((i) % 64))
+
+static void endRun(const char *run, uint32_t run_len, char *best, uint32_t *best_len)
+{
+   if (run_len > *best_len) {
+      memcpy(best, run, run_len);
+      *best_len = run_len;
+   }
+}
+
+/*
+ * Find the longest sequence of characters which must be present in every string matching
+ * regex. Only characters outside of groups, brackets and optional repetitions are used and
+ * regex with alternation has no required literal. Returns length of literal stored to best.
+ */
+static uint32_t requiredLiteral(const char *regex, char *best)
+{
+   const char *p = regex;
+   char *run = best + strlen(regex) + 1;
+   uint32_t run_len = 0, best_len = 0;
+   int depth = 0;
+
+   if (strchr(regex, '|') != NULL) {
+      return 0;
+   }
+   while (*p) {
+      char c = *p++;
+      if (c == '\\') {
+         if (*p == '\0' || strchr(ERE_SPECIAL, *p) == NULL) {
+            // class, back reference or word boundary
+            endRun(run, run_len, best, &best_len);
+            run_len = 0;
+            p += *p != '\0';
+            continue;
+         }
+         c = *p++;
+      } else if (c == '[') {
+         endRun(run, run_len, best, &best_len);
+         run_len = 0;
+         p += *p == '^';
+         p += *p == ']';
+         while (*p && *p != ']') {
+            if (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.')) {
+               const char *end = strchr(p + 2, ']');
+               p = end ? end : p + strlen(p) - 1;
+            }
+            p++;
+         }
+         p += *p == ']';
+         continue;
+      } else if (c == '*' || c == '?' || c == '{') {
+         // previous character is optional
+         run_len -= run_len > 0;
+         endRun(run, run_len, best, &best_len);
+         run_len = 0;
+         if (c == '{') {
+            while (*p && *p != '}') {
+               p++;
+            }
+            p += *p == '}';
+         }
+         continue;
+      } else if (strchr(ERE_SPECIAL, c) != NULL) {
+         endRun(run, run_len, best, &best_len);
+         run_len = 0;
+         depth += (c == '(') - (c == ')');
+         continue;
+      }
+      if (depth == 0) {
+         run[run_len++] = c;
+      } else {
+         endRun(run, run_len, best, &best_len);
+         run_len = 0;
+      }
+   }
+   endRun(run, run_len, best, &best_len);
+   return best_len;
+}
+
+/* Recognize literal patterns (with optional anchors) and find literal required by others */
+static int parsePattern(struct str_pattern *pattern, const char *regex)
+{
+   size_t len = strlen(regex);
+   const char *p = regex;
+   int start = 0, end = 0, literal = 1;
+   uint32_t literal_len = 0;
+   char *buffer = malloc(2 * len + 2);
+
+   if (buffer == NULL) {
+      return 0;
+   }
+   if (*p == '^') {
+      start = 1;
+      p++;
+   }
+   while (*p) {
+      if (*p == '\\' && p[1] != '\0' && strchr(ERE_SPECIAL, p[1]) != NULL) {
+         buffer[literal_len++] = p[1];
+         p += 2;
+      } else if (*p == '$' && p[1] == '\0') {
+         end = 1;
+         p++;
+      } else if (strchr(ERE_SPECIAL, *p) != NULL) {
+         literal = 0;
+         break;
+      } else {
+         buffer[literal_len++] = *p++;
+      }
+   }
+
+   if (literal && literal_len > 0) {
+      pattern->kind = start ? (end ? PATTERN_EXACT : PATTERN_PREFIX) : (end ? PATTERN_SUFFIX : PATTERN_CONTAINS);
+   } else {
+      pattern->kind = PATTERN_REGEX;
+      literal_len = requiredLiteral(regex, buffer);
+   }
+   if (literal_len == 0) {
+      free(buffer);
+      buffer = NULL;
+   }
+   pattern->literal = buffer;
+   pattern->literal_len = literal_len;
+   return 1;
+}
+
+/* Add regular expression to matcher of field id from list matchers, returns NULL on error */
+struct str_matcher *strMatcherAdd(struct str_matcher **matchers, ur_field_id_t id, const char *regex, const regex_t *re, uint32_t *pattern)
+{
+   struct str_matcher *matcher;
+
+   for (matcher = *matchers; matcher != NULL; matcher = matcher->next) {
+      if (matcher->id == id) {
+         break;
+      }
+   }
+   if (matcher == NULL) {
+      matcher = (struct str_matcher *) calloc(1, sizeof(struct str_matcher));
+      if (matcher == NULL) {
+         return NULL;
+      }
+      matcher->id = id;
+      matcher->next = *matchers;
+      *matchers = matcher;
+   }
+
+   if (matcher->size == matcher->capacity) {
+      uint32_t capacity = matcher->capacity ? 2 * matcher->capacity : 16;
+      struct str_pattern *patterns = realloc(matcher->patterns, capacity * sizeof(struct str_pattern));
+      if (patterns == NULL) {
+         return NULL;
+      }
+      matcher->patterns = patterns;
+      matcher->capacity = capacity;
+   }
+   if (!parsePattern(&matcher->patterns[matcher->size], regex)) {
+      return NULL;
+   }
+   matcher->patterns[matcher->size].re = re;
+   *pattern = matcher->size++;
+   matcher->dirty = 1;
+   return matcher;
+}
+
+static void freeAutomaton(struct str_matcher *matcher)
+{
+   free(matcher->delta);
+   free(matcher->out_begin);
+   free(matcher->out);
+   free(matcher->found);
+   free(matcher->known);
+   free(matcher->result);
+   matcher->delta = NULL;
+   matcher->out_begin = NULL;
+   matcher->out = NULL;
+   matcher->found = NULL;
+   matcher->known = NULL;
+   matcher->result = NULL;
+   matcher->state_count = 0;
+}
+
+/* Free all matchers of the list */
+void strMatcherFree(struct str_matcher *matchers)
+{
+   while (matchers != NULL) {
+      struct str_matcher *matcher = matchers;
+      matchers = matcher->next;
+      for (uint32_t i = 0; i < matcher->size; i++) {
+         free(matcher->patterns[i].literal);
+      }
+      free(matcher->patterns);
+      freeAutomaton(matcher);
+      free(matcher->last);
+      free(matcher);
+   }
+}
+
+/* Build Aho-Corasick automaton of literals of all patterns, returns 0 on error */
+static int buildAutomaton(struct str_matcher *matcher)
+{
+   uint32_t total = 1, words = matcher->size / 64 + 1;
+   uint32_t *fail = NULL, *queue = NULL, *own_head = NULL, *own_next = NULL, *out_count = NULL;
+   uint32_t c, i, s, head, tail;
+   int ok = 0;
+
+   freeAutomaton(matcher);
+   matcher->dirty = 0;
+   matcher->last_valid = 0;
+
+   // every byte used in literals has its own class, the others share class 0
+   memset(matcher->classes, 0, sizeof(matcher->classes));
+   matcher->class_count = 1;
+   for (i = 0; i < matcher->size; i++) {
+      struct str_pattern *pattern = &matcher->patterns[i];
+      for (uint32_t j = 0; j < pattern->literal_len; j++) {
+         uint8_t byte = (uint8_t) pattern->literal[j];
+         if (matcher->classes[byte] == 0) {
+            matcher->classes[byte] = matcher->class_count++;
+         }
+      }
+      total += pattern->literal_len;
+   }
+
+   matcher->delta = malloc((size_t) total * matcher->class_count * sizeof(uint32_t));
+   matcher->out_begin = malloc((total + 1) * sizeof(uint32_t));
+   matcher->found = calloc(words, sizeof(uint64_t));
+   matcher->known = calloc(words, sizeof(uint64_t));
+   matcher->result = calloc(words, sizeof(uint64_t));
+   fail = malloc(total * sizeof(uint32_t));
+   queue = malloc(total * sizeof(uint32_t));
+   own_head = malloc(total * sizeof(uint32_t));
+   out_count = calloc(total, sizeof(uint32_t));
+   own_next = malloc((matcher->size + 1) * sizeof(uint32_t));
+   if (!matcher->delta || !matcher->out_begin || !matcher->found || !matcher->known || !matcher->result ||
+       !fail || !queue || !own_head || !out_count || !own_next) {
+      goto cleanup;
+   }
+
+   // trie of literals
+   matcher->state_count = 1;
+   for (c = 0; c < matcher->class_count; c++) {
+      matcher->delta[c] = NO_STATE;
+   }
+   own_head[0] = NO_STATE;
+   for (i = 0; i < matcher->size; i++) {
+      struct str_pattern *pattern = &matcher->patterns[i];
+      if (pattern->literal_len == 0) {
+         continue;
+      }
+      s = 0;
+      for (uint32_t j = 0; j < pattern->literal_len; j++) {
+         uint32_t *next = &matcher->delta[s * matcher->class_count + matcher->classes[(uint8_t) pattern->literal[j]]];
+         if (*next == NO_STATE) {
+            uint32_t t = matcher->state_count++;
+            for (c = 0; c < matcher->class_count; c++) {
+               matcher->delta[t * matcher->class_count + c] = NO_STATE;
+            }
+            own_head[t] = NO_STATE;
+            *next = t;
+         }
+         s = *next;
+      }
+      own_next[i] = own_head[s];
+      own_head[s] = i;
+   }
+
+   // breadth first search sets failure links and completes transitions
+   head = tail = 0;
+   fail[0] = 0;
+   queue[tail++] = 0;
+   while (head < tail) {
+      s = queue[head++];
+      for (uint32_t p = own_head[s]; p != NO_STATE; p = own_next[p]) {
+         out_count[s]++;
+      }
+      if (s != 0) {
+         out_count[s] += out_count[fail[s]];
+      }
+      for (c = 0; c < matcher->class_count; c++) {
+         uint32_t *next = &matcher->delta[s * matcher->class_count + c];
+         if (*next == NO_STATE) {
+            *next = s == 0 ? 0 : matcher->delta[fail[s] * matcher->class_count + c];
+         } else {
+            fail[*next] = s == 0 ? 0 : matcher->delta[fail[s] * matcher->class_count + c];
+            queue[tail++] = *next;
+         }
+      }
+   }
+
+   // outputs of state are its own patterns followed by outputs of its failure state
+   matcher->out_begin[0] = 0;
+   for (s = 0; s < matcher->state_count; s++) {
+      matcher->out_begin[s + 1] = matcher->out_begin[s] + out_count[s];
+   }
+   matcher->out = malloc((matcher->out_begin[matcher->state_count] + 1) * sizeof(uint32_t));
+   if (matcher->out == NULL) {
+      goto cleanup;
+   }
+   for (i = 0; i < tail; i++) {
+      uint32_t pos;
+      s = queue[i];
+      pos = matcher->out_begin[s];
+      for (uint32_t p = own_head[s]; p != NO_STATE; p = own_next[p]) {
+         matcher->out[pos++] = p;
+      }
+      if (s != 0) {
+         memcpy(matcher->out + pos, matcher->out + matcher->out_begin[fail[s]], out_count[fail[s]] * sizeof(uint32_t));
+      }
+   }
+   ok = 1;
+
+cleanup:
+   if (!ok) {
+      fprintf(stderr, "Warning: Unable to build string matcher, regular expressions are evaluated separately.\n");
+      freeAutomaton(matcher);
+   }
+   free(fail);
+   free(queue);
+   free(own_head);
+   free(own_next);
+   free(out_count);
+   return ok;
+}
+
+/* Find literals of all patterns in string */
+static void scan(struct str_matcher *matcher, const char *str, size_t size)
+{
+   uint32_t words = matcher->size / 64 + 1;
+   uint32_t s = 0;
+
+   memset(matcher->found, 0, words * sizeof(uint64_t));
+   memset(matcher->known, 0, words * sizeof(uint64_t));
+   for (size_t i = 0; i < size; i++) {
+      s = matcher->delta[s * matcher->class_count + matcher->classes[(uint8_t) str[i]]];
+      for (uint32_t o = matcher->out_begin[s]; o < matcher->out_begin[s + 1]; o++) {
+         uint32_t p = matcher->out[o];
+         pattern_kind kind = matcher->patterns[p].kind;
+         if (kind == PATTERN_CONTAINS || kind == PATTERN_REGEX ||
+             (kind == PATTERN_PREFIX && i + 1 == matcher->patterns[p].literal_len)) {
+            BIT_SET(matcher->found, p);
+         }
+      }
+   }
+   // patterns ending at the end of string
+   for (uint32_t o = matcher->out_begin[s]; o < matcher->out_begin[s + 1]; o++) {
+      uint32_t p = matcher->out[o];
+      pattern_kind kind = matcher->patterns[p].kind;
+      if (kind == PATTERN_SUFFIX || (kind == PATTERN_EXACT && size == matcher->patterns[p].literal_len)) {
+         BIT_SET(matcher->found, p);
+      }
+   }
+}
+
+int strMatcherMatch(struct str_matcher *matcher, uint32_t pattern, const char *str, size_t size)
+{
+   struct str_pattern *p = &matcher->patterns[pattern];
+   int same;
+
+   // regexec() sees the string only up to the first null byte
+   size = strnlen(str, size);
+   if (matcher->dirty) {
+      // patterns were added, results of the last string are lost
+      buildAutomaton(matcher);
+   }
+   same = matcher->last_valid && matcher->last_len == size && memcmp(matcher->last, str, size) == 0;
+
+   if (!same) {
+      if (matcher->last_capacity < size + 1) {
+         free(matcher->last);
+         matcher->last = malloc(size + 1);
+         matcher->last_capacity = matcher->last ? size + 1 : 0;
+         if (matcher->last == NULL) {
+            matcher->last_valid = 0;
+            return 0;
+         }
+      }
+      memcpy(matcher->last, str, size);
+      matcher->last[size] = '\0';
+      matcher->last_len = size;
+      matcher->last_valid = matcher->state_count > 0;
+      if (!matcher->last_valid) {
+         return regexec(p->re, matcher->last, 0, NULL, 0) != REG_NOMATCH;
+      }
+      scan(matcher, str, size);
+   }
+
+   if (p->kind != PATTERN_REGEX) {
+      return BIT_GET(matcher->found, pattern);
+   }
+   if (!BIT_GET(matcher->known, pattern)) {
+      BIT_SET(matcher->known, pattern);
+      if ((p->literal_len == 0 || BIT_GET(matcher->found, pattern)) &&
+          regexec(p->re, matcher->last, 0, NULL, 0) != REG_NOMATCH) {
+         BIT_SET(matcher->result, pattern);
+      } else {
+         matcher->result[pattern / 64] &= ~(1ULL << (pattern % 64));
+      }
+   }
+   return BIT_GET(matcher->result, pattern);
+}
@@ -0,0 +1,98 @@
+/**
+ * \file strmatch.h
+ * \brief Combined matching of all regular expressions used with one UniRec field
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef LIB_UNIREC_STRMATCH_H
+#define LIB_UNIREC_STRMATCH_H
+
+#include <stdint.h>
+#include <regex.h>
+#include <unirec/unirec.h>
+
+/* Kind of pattern given by regular expression */
+typedef enum { PATTERN_CONTAINS, PATTERN_PREFIX, PATTERN_SUFFIX, PATTERN_EXACT, PATTERN_REGEX } pattern_kind;
+
+struct str_pattern {
+   pattern_kind kind;
+   char *literal;          // whole pattern for literal kinds, substring required by PATTERN_REGEX or NULL
+   uint32_t literal_len;
+   const regex_t *re;      // compiled regular expression owned by filter node
+};
+
+/*
+ * All patterns of =~ rules on one field in one compiled filter. Literals of patterns
+ * are searched by Aho-Corasick automaton in one pass over the string, regular expressions
+ * are executed only when their required literal was found. Results for the last string are
+ * kept, so other rules of the filter evaluated on the same record do not scan it again.
+ * Matchers are owned by program of the filter and freed with it.
+ */
+struct str_matcher {
+   ur_field_id_t id;
+   uint32_t size;
+   uint32_t capacity;
+   struct str_pattern *patterns;
+   char dirty;             // automaton has to be built again
+
+   // automaton with transitions for every state and byte class
+   uint8_t classes[256];
+   uint32_t class_count;
+   uint32_t state_count;
+   uint32_t *delta;
+   uint32_t *out_begin;    // patterns ending in state s are out[out_begin[s]] .. out[out_begin[s + 1] - 1]
+   uint32_t *out;
+
+   // results for the last string
+   char *last;
+   size_t last_len;
+   size_t last_capacity;
+   char last_valid;
+   uint64_t *found;        // literal of pattern was found at required position
+   uint64_t *known;        // result of regular expression is known
+   uint64_t *result;       // result of regular expression
+
+   struct str_matcher *next;
+};
+
+struct str_matcher *strMatcherAdd(struct str_matcher **matchers, ur_field_id_t id, const char *regex, const regex_t *re, uint32_t *pattern);
+void strMatcherFree(struct str_matcher *matchers);
+int strMatcherMatch(struct str_matcher *matcher, uint32_t pattern, const char *str, size_t size);
+
+#endif /* LIB_UNIREC_STRMATCH_H */
@@ -5,6 +5,10 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
 
 #include <unirec/unirec.h>
 
@@ -74,6 +78,298 @@ static void test_array_ip4(void **state)
    ur_free_template(tmplt);
 }
 
+static void test_array_overlapping_prefixes(void **state)
+{
+   int result;
+   urfilter_t *urf = urfilter_create("SRC_IP in [10.1.2.0/24, 10.0.0.0/8, 10.1.0.0/16, 192.168.1.0/24]", "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   void *fv = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP"));
+
+   ip_from_str("10.200.0.1", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   ip_from_str("10.1.3.1", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   ip_from_str("192.168.2.1", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   urfilter_destroy(urf);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void test_array_mixed_prefixes(void **state)
+{
+   int result;
+   urfilter_t *urf = urfilter_create("SRC_IP in [10.0.0.0/8, 192.168.1.1, 10.1.1.1, 2001:db8:1::/48, 2001:db8::1]", "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+   assert_int_equal(urfilter_list_count(urf), 0);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   void *fv = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP"));
+
+   ip_from_str("192.168.1.1", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   ip_from_str("192.168.1.2", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   ip_from_str("10.5.5.5", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   ip_from_str("2001:db8::1", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   ip_from_str("2001:db8::2", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   ip_from_str("2001:db8:1::5", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   urfilter_destroy(urf);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void test_array_large(void **state)
+{
+   int result;
+   char filter[4096] = "SRC_IP in [";
+   char prefix[32];
+
+   // enough prefixes to use prefix trie instead of bsearch
+   for (int i = 0; i < 64; i++) {
+      snprintf(prefix, sizeof(prefix), "%s10.%d.0.0/16", i ? ", " : "", 4 * i);
+      strcat(filter, prefix);
+   }
+   strcat(filter, ", 2001:db8::/32] && DST_PORT in [");
+   for (int i = 0; i < 64; i++) {
+      snprintf(prefix, sizeof(prefix), "%s%d", i ? ", " : "", 1000 + 2 * i);
+      strcat(filter, prefix);
+   }
+   strcat(filter, "]");
+
+   urfilter_t *urf = urfilter_create(filter, "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   void *ip = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP"));
+   uint16_t *port = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("DST_PORT"));
+
+   ip_from_str("10.8.1.1", ip);
+   *port = 1126;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   *port = 1127;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   *port = 1000;
+   ip_from_str("10.9.1.1", ip);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   ip_from_str("2001:db8:1::1", ip);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   ip_from_str("2001:db9::1", ip);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   urfilter_destroy(urf);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void write_list(const char *filename, const char *content)
+{
+   FILE *f = fopen(filename, "w");
+   assert_non_null(f);
+   fputs(content, f);
+   fclose(f);
+}
+
+static void test_array_file(void **state)
+{
+   int result;
+   char filename[] = "/tmp/test_liburfilter_XXXXXX";
+   char filter[64];
+   int fd = mkstemp(filename);
+   assert_true(fd >= 0);
+   close(fd);
+
+   write_list(filename, "# blacklist\n10.0.0.0/8\n\n  192.168.1.0/24  \n");
+   snprintf(filter, sizeof(filter), "SRC_IP in file(\"%s\")", filename);
+   urfilter_t *urf = urfilter_create(filter, "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+   assert_int_equal(urfilter_list_count(urf), 1);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   void *fv = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP"));
+
+   ip_from_str("192.168.1.5", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   ip_from_str("172.16.0.1", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   // unchanged file is not loaded again
+   assert_int_equal(urfilter_reload_lists(urf, 0), 0);
+
+   write_list(filename, "172.16.0.0/12\n");
+   assert_int_equal(urfilter_reload_lists(urf, 1), 1);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   ip_from_str("192.168.1.5", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   // broken file keeps previous values
+   write_list(filename, "not an address\n");
+   assert_int_equal(urfilter_reload_lists(urf, 1), URFILTER_ERROR);
+   ip_from_str("172.16.0.1", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   urfilter_destroy(urf);
+   unlink(filename);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void test_regex_shared(void **state)
+{
+   urfilter_t *urf1 = urfilter_create("DNS_NAME =~ \"\\.example\\.com$\" || DNS_NAME =~ \"^mail\\.\"", "testifc0");
+   urfilter_t *urf2 = urfilter_create("DNS_NAME =~ \"exam[a-z]+le\" && !(DNS_NAME =~ \"^www\")", "testifc1");
+   assert_int_equal(urfilter_compile(urf1), URFILTER_TRUE);
+   assert_int_equal(urfilter_compile(urf2), URFILTER_TRUE);
+
+   ur_template_t *tmplt = ur_create_template("DST_PORT,DNS_NAME", NULL);
+   void *rec = ur_create_record(tmplt, 256);
+   ur_field_id_t id = ur_get_id_by_name("DNS_NAME");
+
+   ur_set_string(tmplt, rec, id, "www.example.com");
+   assert_int_equal(urfilter_match(urf1, tmplt, rec), 1);
+   assert_int_equal(urfilter_match(urf2, tmplt, rec), 0);
+
+   ur_set_string(tmplt, rec, id, "mail.example.org");
+   assert_int_equal(urfilter_match(urf1, tmplt, rec), 1);
+   assert_int_equal(urfilter_match(urf2, tmplt, rec), 1);
+
+   ur_set_string(tmplt, rec, id, "example.com");
+   assert_int_equal(urfilter_match(urf1, tmplt, rec), 0);
+   assert_int_equal(urfilter_match(urf2, tmplt, rec), 1);
+
+   // every filter has its own matchers, destroying one filter does not affect the others
+   urfilter_destroy(urf1);
+   ur_set_string(tmplt, rec, id, "www.exampppple.cz");
+   assert_int_equal(urfilter_match(urf2, tmplt, rec), 0);
+   ur_set_string(tmplt, rec, id, "exampppple.cz");
+   assert_int_equal(urfilter_match(urf2, tmplt, rec), 1);
+
+   urfilter_destroy(urf2);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void test_group(void **state)
+{
+   urfilter_t *urf[4];
+   int results[4];
+   urf[0] = urfilter_create("DST_PORT in [22, 80, 443] && SRC_IP == 10.0.0.1", "testifc0");
+   urf[1] = urfilter_create("DST_PORT in [22, 80, 443] || SRC_IP == 10.0.0.2", "testifc1");
+   urf[2] = urfilter_create("", "testifc2");
+   urf[3] = urfilter_create("!(DST_PORT in [22, 80, 443])", "testifc3");
+   urfilter_group_t *group = urfilter_group_create(urf, 4);
+   assert_non_null(group);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   ip_from_str("10.0.0.1", ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP")));
+   *(uint16_t *) ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("DST_PORT")) = 80;
+
+   assert_int_equal(urfilter_group_match(group, tmplt, rec, results), 3);
+   assert_int_equal(results[0], 1);
+   assert_int_equal(results[1], 1);
+   assert_int_equal(results[2], 1);
+   assert_int_equal(results[3], 0);
+
+   // results of shared conditions must not be kept between records
+   ip_from_str("10.0.0.2", ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP")));
+   *(uint16_t *) ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("DST_PORT")) = 53;
+
+   assert_int_equal(urfilter_group_match(group, tmplt, rec, results), 3);
+   assert_int_equal(results[0], 0);
+   assert_int_equal(results[1], 1);
+   assert_int_equal(results[2], 1);
+   assert_int_equal(results[3], 1);
+
+   urfilter_group_destroy(group);
+   for (int i = 0; i < 4; i++) {
+      urfilter_destroy(urf[i]);
+   }
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void test_match_batch(void **state)
+{
+   uint64_t bitmap[URFILTER_BITMAP_WORDS(70)];
+   void *recs[70];
+   int expected = 0;
+   urfilter_t *urf = urfilter_create("(DST_PORT == 80 || DST_PORT >= 1000) && TTL_DIFF < 0 && SRC_IP != 10.0.0.1", "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT,TTL_DIFF", NULL);
+   for (int i = 0; i < 70; i++) {
+      recs[i] = ur_create_record(tmplt, 0);
+      ip_from_str(i % 3 ? "10.0.0.1" : "10.0.0.2", ur_get_ptr_by_id(tmplt, recs[i], ur_get_id_by_name("SRC_IP")));
+      *(uint16_t *) ur_get_ptr_by_id(tmplt, recs[i], ur_get_id_by_name("DST_PORT")) = i % 2 ? 80 : i * 30;
+      *(int8_t *) ur_get_ptr_by_id(tmplt, recs[i], ur_get_id_by_name("TTL_DIFF")) = (i % 5) - 2;
+   }
+
+   for (int i = 0; i < 70; i++) {
+      expected += urfilter_match(urf, tmplt, recs[i]);
+   }
+   assert_int_equal(urfilter_match_batch(urf, tmplt, (const void **) recs, 70, bitmap), expected);
+   for (int i = 0; i < 70; i++) {
+      assert_int_equal((bitmap[i / 64] >> (i % 64)) & 1, urfilter_match(urf, tmplt, recs[i]));
+   }
+
+   urfilter_destroy(urf);
+   for (int i = 0; i < 70; i++) {
+      ur_free_record(recs[i]);
+   }
+   ur_free_template(tmplt);
+}
+
 static void test_array_double(void **state)
 {
    int result;
@@ -98,6 +394,27 @@ static void test_array_double(void **state)
    ur_free_template(tmplt);
 }
 
+static void test_double_nan(void **state)
+{
+   const char *filters[] = {"SCALE < 1.5", "SCALE <= 1.5", "SCALE == 1.5", "SCALE >= 1.5", "SCALE > 1.5", "SCALE != 1.5"};
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT,SCALE", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   double *fv = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SCALE"));
+   *fv = NAN;
+
+   for (int i = 0; i < 6; i++) {
+      urfilter_t *urf = urfilter_create(filters[i], "testifc0");
+      assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+      // compiling again replaces the previous program
+      assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+      assert_int_equal(urfilter_match(urf, tmplt, rec), i == 5);
+      urfilter_destroy(urf);
+   }
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
 static void test_array_time(void **state)
 {
    int result;
@@ -155,6 +472,66 @@ static void test_array_badtypes(void **state)
 }
 
 
+static void test_signed_compare(void **state)
+{
+   int result;
+   urfilter_t *urf = urfilter_create("TTL_DIFF < 0 && PROTOCOL >= 17", "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+
+   ur_template_t *tmplt = ur_create_template("TTL_DIFF,PROTOCOL", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   int8_t *diff = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("TTL_DIFF"));
+   uint8_t *proto = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("PROTOCOL"));
+
+   *diff = -5;
+   *proto = 6;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   *proto = 200;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   *diff = 5;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   urfilter_destroy(urf);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void test_negation(void **state)
+{
+   int result;
+   urfilter_t *urf = urfilter_create("!(DST_PORT == 80 || DST_PORT == 443) && SCALE > 1.0", "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+
+   ur_template_t *tmplt = ur_create_template("DST_PORT,SCALE", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   uint16_t *port = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("DST_PORT"));
+   double *scale = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SCALE"));
+
+   *port = 443;
+   *scale = 2.0;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   *port = 22;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   *scale = 0.5;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   urfilter_destroy(urf);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
 static void test_array_complexfree(void **state)
 {
    urfilter_t *urf;
@@ -171,6 +548,8 @@ int main(void)
    ur_define_field("SCALE", UR_TYPE_DOUBLE);
    ur_define_field("TIME", UR_TYPE_TIME);
    ur_define_field("PROTOCOL", UR_TYPE_UINT8);
+   ur_define_field("TTL_DIFF", UR_TYPE_INT8);
+   ur_define_field("DNS_NAME", UR_TYPE_STRING);
 
    const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_create_destroy),
@@ -178,10 +557,20 @@ int main(void)
       cmocka_unit_test(test_array),
       cmocka_unit_test(test_array_ip4),
       cmocka_unit_test(test_array_double),
+      cmocka_unit_test(test_double_nan),
       cmocka_unit_test(test_array_time),
       cmocka_unit_test(test_array_missingfield),
       cmocka_unit_test(test_array_badtypes),
       cmocka_unit_test(test_array_complexfree),
+      cmocka_unit_test(test_array_overlapping_prefixes),
+      cmocka_unit_test(test_array_mixed_prefixes),
+      cmocka_unit_test(test_array_large),
+      cmocka_unit_test(test_array_file),
+      cmocka_unit_test(test_regex_shared),
+      cmocka_unit_test(test_group),
+      cmocka_unit_test(test_match_batch),
+      cmocka_unit_test(test_signed_compare),
+      cmocka_unit_test(test_negation),
    };
    return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -0,0 +1,375 @@
+/**
+ * \file valueset.c
+ * \brief Hash set and prefix trie used to evaluate large IN arrays
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <arpa/inet.h>
+
+#include "valueset.h"
+
+#define GROUP_SIZE 8
+#define CTRL_EMPTY 0x80
+#define BYTES_LSB 0x0101010101010101ULL
+#define BYTES_MSB 0x8080808080808080ULL
+
+#define TRIE_STRIDE 6
+#define TRIE_CHUNK_MASK ((1U << TRIE_STRIDE) - 1)
+
+static inline uint64_t mix64(uint64_t x)
+{
+   x ^= x >> 33;
+   x *= 0xff51afd7ed558ccdULL;
+   x ^= x >> 33;
+   x *= 0xc4ceb9fe1a85ec53ULL;
+   x ^= x >> 33;
+   return x;
+}
+
+static inline uint64_t hashKey(const uint64_t *key, uint8_t key_words)
+{
+   uint64_t hash = mix64(key[0]);
+   if (key_words == 2) {
+      hash = mix64(hash ^ key[1]);
+   }
+   return hash;
+}
+
+static inline uint64_t loadGroup(const uint8_t *ctrl)
+{
+   uint64_t group;
+   memcpy(&group, ctrl, sizeof(group));
+   return group;
+}
+
+/* Set highest bit of every byte of group equal to h2, there can be false positives */
+static inline uint64_t matchGroup(uint64_t group, uint8_t h2)
+{
+   uint64_t x = group ^ (BYTES_LSB * h2);
+   return (x - BYTES_LSB) & ~x & BYTES_MSB;
+}
+
+/* Return index of first byte marked in match and unmark it */
+static inline unsigned nextMatch(uint64_t *match)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   unsigned i = __builtin_ctzll(*match) >> 3;
+   *match &= *match - 1;
+#else
+   unsigned i = __builtin_clzll(*match) >> 3;
+   *match &= ~(0x8000000000000000ULL >> (i << 3));
+#endif
+   return i;
+}
+
+static inline int keysEqual(const uint64_t *a, const uint64_t *b, uint8_t key_words)
+{
+   return a[0] == b[0] && (key_words == 1 || a[1] == b[1]);
+}
+
+struct hash_set *newHashSet(uint32_t count, uint8_t key_words)
+{
+   uint64_t slots = 2 * GROUP_SIZE;
+   struct hash_set *set = (struct hash_set *) malloc(sizeof(struct hash_set));
+
+   if (set == NULL) {
+      return NULL;
+   }
+   // keep load factor below 7/8
+   while (slots * 7 / 8 <= count) {
+      slots <<= 1;
+   }
+   set->mask = slots - 1;
+   set->key_words = key_words;
+   set->ctrl = (uint8_t *) malloc(slots + GROUP_SIZE);
+   set->keys = (uint64_t *) malloc(slots * key_words * sizeof(uint64_t));
+   if (set->ctrl == NULL || set->keys == NULL) {
+      freeHashSet(set);
+      return NULL;
+   }
+   memset(set->ctrl, CTRL_EMPTY, slots + GROUP_SIZE);
+   return set;
+}
+
+void hashSetInsert(struct hash_set *set, const uint64_t *key)
+{
+   uint64_t hash = hashKey(key, set->key_words);
+   uint64_t pos = (hash >> 7) & set->mask;
+   uint64_t stride = 0;
+   uint64_t empty;
+
+   if (hashSetContains(set, key)) {
+      return;
+   }
+   while ((empty = loadGroup(set->ctrl + pos) & BYTES_MSB) == 0) {
+      stride += GROUP_SIZE;
+      pos = (pos + stride) & set->mask;
+   }
+   pos = (pos + nextMatch(&empty)) & set->mask;
+
+   set->ctrl[pos] = hash & 0x7f;
+   if (pos < GROUP_SIZE) {
+      set->ctrl[set->mask + 1 + pos] = hash & 0x7f;
+   }
+   memcpy(set->keys + pos * set->key_words, key, set->key_words * sizeof(uint64_t));
+}
+
+int hashSetContains(const struct hash_set *set, const uint64_t *key)
+{
+   uint64_t hash = hashKey(key, set->key_words);
+   uint64_t pos = (hash >> 7) & set->mask;
+   uint64_t stride = 0;
+
+   while (1) {
+      uint64_t group = loadGroup(set->ctrl + pos);
+      uint64_t match = matchGroup(group, hash & 0x7f);
+
+      while (match) {
+         uint64_t slot = (pos + nextMatch(&match)) & set->mask;
+         if (keysEqual(set->keys + slot * set->key_words, key, set->key_words)) {
+            return 1;
+         }
+      }
+      if (group & BYTES_MSB) {
+         return 0;
+      }
+      stride += GROUP_SIZE;
+      pos = (pos + stride) & set->mask;
+   }
+}
+
+void freeHashSet(struct hash_set *set)
+{
+   if (set == NULL) {
+      return;
+   }
+   free(set->ctrl);
+   free(set->keys);
+   free(set);
+}
+
+/* Prefix converted to bits aligned to the left, bits after prefix length are zero */
+struct trie_prefix {
+   uint64_t key[2];
+   uint8_t len;
+   uint8_t is6;
+};
+
+static void ipToKey(const ip_addr_t *ip, uint64_t *key)
+{
+   if (ip_is4(ip)) {
+      key[0] = (uint64_t) ntohl(ip->ui32[2]) << 32;
+      key[1] = 0;
+   } else {
+      key[0] = be64toh(ip->ui64[0]);
+      key[1] = be64toh(ip->ui64[1]);
+   }
+}
+
+/* Get TRIE_STRIDE bits of key starting at bit depth, bits after the end of key are zero */
+static inline unsigned getChunk(const uint64_t *key, unsigned depth)
+{
+   if (depth + TRIE_STRIDE <= 64) {
+      return (key[0] >> (64 - TRIE_STRIDE - depth)) & TRIE_CHUNK_MASK;
+   } else if (depth >= 64) {
+      if (depth + TRIE_STRIDE <= 128) {
+         return (key[1] >> (128 - TRIE_STRIDE - depth)) & TRIE_CHUNK_MASK;
+      }
+      return (key[1] << (depth + TRIE_STRIDE - 128)) & TRIE_CHUNK_MASK;
+   }
+   return ((key[0] << (depth + TRIE_STRIDE - 64)) | (key[1] >> (128 - TRIE_STRIDE - depth))) & TRIE_CHUNK_MASK;
+}
+
+static int compareTriePrefixes(const void *p1, const void *p2)
+{
+   const struct trie_prefix *a = (const struct trie_prefix *) p1;
+   const struct trie_prefix *b = (const struct trie_prefix *) p2;
+
+   if (a->is6 != b->is6) {
+      return a->is6 < b->is6 ? -1 : 1;
+   }
+   for (int i = 0; i < 2; i++) {
+      if (a->key[i] != b->key[i]) {
+         return a->key[i] < b->key[i] ? -1 : 1;
+      }
+   }
+   return 0;
+}
+
+static int reserveNodes(struct prefix_trie *trie, uint32_t count)
+{
+   if (trie->size + count > trie->capacity) {
+      uint32_t capacity = trie->capacity * 2;
+      while (capacity < trie->size + count) {
+         capacity *= 2;
+      }
+      struct prefix_trie_node *nodes = realloc(trie->nodes, capacity * sizeof(struct prefix_trie_node));
+      if (nodes == NULL) {
+         return 0;
+      }
+      trie->nodes = nodes;
+      trie->capacity = capacity;
+   }
+   trie->size += count;
+   return 1;
+}
+
+/*
+ * Fill node at given depth from sorted prefixes which share first depth bits and are
+ * longer than depth (or all prefixes for root). Children of node are stored in
+ * consecutive nodes, so they are allocated together before their subtrees.
+ */
+static int buildNode(struct prefix_trie *trie, uint32_t node, const struct trie_prefix *prefixes,
+                     uint32_t count, unsigned depth)
+{
+   uint64_t full = 0, inner = 0;
+   uint32_t base, i, j, child;
+
+   for (i = 0; i < count; i++) {
+      if (prefixes[i].len <= depth + TRIE_STRIDE) {
+         unsigned covered = depth + TRIE_STRIDE - prefixes[i].len;
+         unsigned chunk = getChunk(prefixes[i].key, depth);
+         full |= covered == TRIE_STRIDE ? ~0ULL : ((1ULL << (1U << covered)) - 1) << chunk;
+      }
+   }
+   for (i = 0; i < count; i++) {
+      unsigned chunk = getChunk(prefixes[i].key, depth);
+      if (!(full & (1ULL << chunk))) {
+         inner |= 1ULL << chunk;
+      }
+   }
+
+   base = trie->size;
+   if (!reserveNodes(trie, __builtin_popcountll(inner))) {
+      return 0;
+   }
+   trie->nodes[node].full = full;
+   trie->nodes[node].inner = inner;
+   trie->nodes[node].base = base;
+
+   // prefixes with the same chunk are adjacent, because they are sorted
+   child = base;
+   for (i = 0; i < count; i = j) {
+      unsigned chunk = getChunk(prefixes[i].key, depth);
+      for (j = i + 1; j < count && getChunk(prefixes[j].key, depth) == chunk; j++);
+      if (inner & (1ULL << chunk)) {
+         if (!buildNode(trie, child++, prefixes + i, j - i, depth + TRIE_STRIDE)) {
+            return 0;
+         }
+      }
+   }
+   return 1;
+}
+
+struct prefix_trie *newPrefixTrie(struct ipprefix *prefixes, uint32_t count)
+{
+   struct prefix_trie *trie = (struct prefix_trie *) malloc(sizeof(struct prefix_trie));
+   struct trie_prefix *sorted = (struct trie_prefix *) malloc(count * sizeof(struct trie_prefix));
+   uint32_t count4 = 0;
+
+   if (trie == NULL || sorted == NULL) {
+      free(trie);
+      free(sorted);
+      return NULL;
+   }
+   trie->capacity = 64;
+   trie->size = 2;
+   trie->nodes = (struct prefix_trie_node *) malloc(trie->capacity * sizeof(struct prefix_trie_node));
+   if (trie->nodes == NULL) {
+      free(trie);
+      free(sorted);
+      return NULL;
+   }
+
+   for (uint32_t i = 0; i < count; i++) {
+      uint64_t mask[2];
+      ipToKey(&prefixes[i].ip, sorted[i].key);
+      ipToKey(&prefixes[i].mask, mask);
+      sorted[i].is6 = ip_is6(&prefixes[i].ip);
+      sorted[i].len = __builtin_popcountll(mask[0]) + __builtin_popcountll(mask[1]);
+      sorted[i].key[0] &= mask[0];
+      sorted[i].key[1] &= mask[1];
+      if (!sorted[i].is6) {
+         count4++;
+      }
+   }
+   qsort(sorted, count, sizeof(struct trie_prefix), compareTriePrefixes);
+
+   if (!buildNode(trie, 0, sorted, count4, 0) || !buildNode(trie, 1, sorted + count4, count - count4, 0)) {
+      free(sorted);
+      freePrefixTrie(trie);
+      return NULL;
+   }
+   free(sorted);
+   return trie;
+}
+
+int prefixTrieContains(const struct prefix_trie *trie, const ip_addr_t *ip)
+{
+   uint64_t key[2];
+   uint32_t node = ip_is4(ip) ? 0 : 1;
+   unsigned depth = 0;
+
+   ipToKey(ip, key);
+   while (1) {
+      const struct prefix_trie_node *n = &trie->nodes[node];
+      uint64_t bit = 1ULL << getChunk(key, depth);
+
+      if (n->full & bit) {
+         return 1;
+      }
+      if (!(n->inner & bit)) {
+         return 0;
+      }
+      node = n->base + __builtin_popcountll(n->inner & (bit - 1));
+      depth += TRIE_STRIDE;
+   }
+}
+
+void freePrefixTrie(struct prefix_trie *trie)
+{
+   if (trie == NULL) {
+      return;
+   }
+   free(trie->nodes);
+   free(trie);
+}
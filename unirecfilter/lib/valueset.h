@@ -0,0 +1,91 @@
+/**
+ * \file valueset.h
+ * \brief Hash set and prefix trie used to evaluate large IN arrays
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef LIB_UNIREC_VALUESET_H
+#define LIB_UNIREC_VALUESET_H
+
+#include <stdint.h>
+
+#include "functions.h"
+
+/* Arrays with fewer elements are searched by bsearch, which is faster for them */
+#define VALUESET_MIN_SIZE 32
+
+/*
+ * Open addressing hash set of 64-bit or 128-bit keys. Every slot has one control byte,
+ * which is either EMPTY or 7 bits of hash of the key in slot. Lookup compares eight
+ * control bytes at once and touches keys only for slots with matching hash bits.
+ */
+struct hash_set {
+   uint64_t mask;          // number of slots - 1
+   uint8_t key_words;      // 1 for integers, 2 for IP addresses
+   uint8_t *ctrl;          // control bytes, first group is repeated after the last slot
+   uint64_t *keys;
+};
+
+/*
+ * Multibit trie of IP prefixes with 6 bits per level. Node keeps bitmap of children
+ * which are fully covered by some prefix and bitmap of children which are nodes,
+ * those are stored contiguously from index base, so a node takes 24 bytes.
+ */
+struct prefix_trie_node {
+   uint64_t full;
+   uint64_t inner;
+   uint32_t base;
+};
+
+struct prefix_trie {
+   struct prefix_trie_node *nodes;  // node 0 is IPv4 root, node 1 is IPv6 root
+   uint32_t size;
+   uint32_t capacity;
+};
+
+struct hash_set *newHashSet(uint32_t count, uint8_t key_words);
+void hashSetInsert(struct hash_set *set, const uint64_t *key);
+int hashSetContains(const struct hash_set *set, const uint64_t *key);
+void freeHashSet(struct hash_set *set);
+
+struct prefix_trie *newPrefixTrie(struct ipprefix *prefixes, uint32_t count);
+int prefixTrieContains(const struct prefix_trie *trie, const ip_addr_t *ip);
+void freePrefixTrie(struct prefix_trie *trie);
+
+#endif /* LIB_UNIREC_VALUESET_H */
@@ -48,6 +48,8 @@
 #endif
 
 #include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -81,9 +83,10 @@ trap_module_info_t *module_info = NULL;
   PARAM('f', "file", "Read template and filter from file.", required_argument, "string") \
   PARAM('c', "cut", "Quit after N records are received.", required_argument, "int32") \
 
-static int stop = 0;               // Flag to interrupt process
-static int send_eof = 1;           // Flag to enable EOF
-int reload_filter = 0;             // Flag to reload filter from file
+static volatile sig_atomic_t stop = 0;  // Flag to interrupt process
+static int send_eof = 1;                // Flag to enable EOF
+volatile sig_atomic_t reload_filter = 0; // Flag to reload filter from file
+volatile sig_atomic_t reload_lists = 0;  // Flag to reload all lists given by file("...") in filters
 int verbose;                       // Verbosity level
 
 unsigned int num_records = 0;      // Number of records received (total of all inputs)
@@ -100,6 +103,194 @@ void reload_filter_signal_handler(int signum) {
    reload_filter = 1;
 }
 
+// Handler for SIGHUP to set flag for force reloading of lists
+void reload_lists_signal_handler(int signum) {
+   reload_lists = 1;
+}
+
+// Filters shared with thread reloading lists, it is locked while filters are replaced
+pthread_mutex_t filters_mutex = PTHREAD_MUTEX_INITIALIZER;
+struct unirec_output_t **shared_outputs = NULL;
+int shared_n_outputs = 0;
+
+// Filters of all outputs matched together, conditions used by more outputs are evaluated once per record
+urfilter_group_t *filter_group = NULL;
+// Outputs with the same output specifier send the same record, it is built only for the first of them
+int *record_owner = NULL;
+int *record_built = NULL;
+
+// Compile filters, so lists can be reloaded before they are used by urfilter_group_match()
+int compile_filters(struct unirec_output_t **output_specifiers, int n_outputs)
+{
+   urfilter_t *filters[n_outputs];
+
+   for (int i = 0; i < n_outputs; i++) {
+      filters[i] = output_specifiers[i]->filter;
+      if (filters[i]->filter != NULL && filters[i]->tree == NULL && urfilter_compile(filters[i]) != URFILTER_TRUE) {
+         fprintf(stderr, "Error: Syntax error in filter: %s.\n", filters[i]->filter);
+         return 1;
+      }
+   }
+
+   if (record_owner == NULL) {
+      record_owner = (int *) calloc(n_outputs, sizeof(int));
+      record_built = (int *) calloc(n_outputs, sizeof(int));
+      if (!record_owner || !record_built) {
+         fprintf(stderr, "Error: Insufficient memory available: compile_filters.\n");
+         return 1;
+      }
+   }
+   urfilter_group_destroy(filter_group);
+   filter_group = urfilter_group_create(filters, n_outputs);
+   if (filter_group == NULL) {
+      fprintf(stderr, "Error: Unable to create group of filters.\n");
+      return 1;
+   }
+
+   for (int i = 0; i < n_outputs; i++) {
+      record_owner[i] = i;
+      for (int j = 0; j < i; j++) {
+         if (strcmp(output_specifiers[i]->output_specifier_str, output_specifiers[j]->output_specifier_str) == 0) {
+            record_owner[i] = j;
+            break;
+         }
+      }
+   }
+   return 0;
+}
+
+// Copy fields of output template present in input record to output record
+int build_record(struct unirec_output_t *output_specifier, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   //Iterate over all output fields; if the field is present in input template, copy it to output record
+   // If missing, set null
+   void *ptr1 = NULL, *ptr2 = NULL;
+   ur_field_id_t id = 0;
+   int rec_ind = 0;
+   while ((id = ur_iter_fields_record_order(output_specifier->out_tmplt, rec_ind++)) != UR_ITER_END) {
+      if (ur_is_present(in_tmplt, id)) {
+         if (!ur_is_dynamic(id)) { //static field
+            ptr1 = ur_get_ptr_by_id(in_tmplt, in_rec, id);
+            ptr2 = ur_get_ptr_by_id(output_specifier->out_tmplt, output_specifier->out_rec, id);
+            //copy the data
+            if ((ptr1 != NULL) && (ptr2 != NULL)) {
+               memcpy(ptr2, ptr1, ur_get_size(id));
+            }
+         } else { //dynamic field
+            char *in_ptr = ur_get_ptr_by_id(in_tmplt, in_rec, id);
+            int size = ur_get_var_len(in_tmplt, in_rec, id);
+            // Check size of dynamic field and if longer than maximum size then cut it
+            if (size > DYN_FIELD_MAX_SIZE) {
+               size = DYN_FIELD_MAX_SIZE;
+            }
+            //copy the data
+            if (ur_set_var(output_specifier->out_tmplt, output_specifier->out_rec, id, in_ptr, size) != UR_OK) {
+               fprintf(stderr, "Error: failed to copy data to output.)\n");
+               return 1;
+            }
+         }
+      }
+   }
+   return 0;
+}
+
+// Match all records of batch and send them to interfaces whose filters they satisfy
+int process_batch(struct record_batch *batch, const ur_template_t *in_tmplt, struct unirec_output_t **output_specifiers, int n_outputs)
+{
+   int ret;
+
+   if (batch->count == 0) {
+      return 0;
+   }
+   urfilter_group_match_batch(filter_group, in_tmplt, batch->records, batch->count, batch->bitmaps);
+
+   for (int r = 0; r < batch->count && !stop; r++) {
+      memset(record_built, 0, n_outputs * sizeof(int));
+      for (int i = 0; i < n_outputs; i++) {
+         if ((batch->bitmaps[i] >> r) & 1) {
+            if (verbose >= 1) {
+               printf("ADVANCED VERBOSE: Record %u accepted on interface %d\n", batch->first_record + r, i);
+            }
+            // Record of outputs with the same template is built only once
+            struct unirec_output_t *out = output_specifiers[record_owner[i]];
+            if (!record_built[record_owner[i]]) {
+               if (build_record(out, in_tmplt, batch->records[r]) != 0) {
+                  return 1;
+               }
+               record_built[record_owner[i]] = 1;
+            }
+            // Send record to corresponding interface
+            ret = trap_send(i, out->out_rec, ur_rec_size(out->out_tmplt, out->out_rec));
+            // Handle possible errors
+            TRAP_DEFAULT_SEND_DATA_ERROR_HANDLING(ret, continue, {stop=1; break;});
+         } else {
+            if (verbose >= 1) {
+               printf("ADVANCED VERBOSE: Record %u declined on interface %d\n", batch->first_record + r, i);
+            }
+         }
+      }
+   }
+   batch->count = 0;
+   batch->used = 0;
+   return 0;
+}
+
+// Copy received record to batch
+void add_to_batch(struct record_batch *batch, const void *in_rec, uint16_t in_rec_size)
+{
+   if (batch->count == 0) {
+      batch->first_record = num_records;
+   }
+   memcpy(batch->buffer + batch->used, in_rec, in_rec_size);
+   batch->records[batch->count++] = batch->buffer + batch->used;
+   batch->used += (in_rec_size + 7) & ~(size_t) 7;
+}
+
+// Thread checking files of lists every second, new values are built here and the main loop only swaps them
+void *reload_lists_thread(void *arg)
+{
+   for (int tick = 1; !stop; tick++) {
+      usleep(100000);
+      if (!reload_lists && tick % 10 != 0) {
+         continue;
+      }
+      int force = reload_lists;
+      reload_lists = 0;
+
+      pthread_mutex_lock(&filters_mutex);
+      for (int i = 0; i < shared_n_outputs; i++) {
+         int ret = urfilter_reload_lists(shared_outputs[i]->filter, force);
+         if (ret > 0 && verbose >= 0) {
+            printf("VERBOSE: Reloaded %d list(s) of filter on interface %d\n", ret, i);
+         }
+      }
+      pthread_mutex_unlock(&filters_mutex);
+   }
+   return NULL;
+}
+
+// Start thread reloading lists if it is not running and some filter uses file("...")
+int start_reload_thread(struct unirec_output_t **output_specifiers, int n_outputs, pthread_t *thread, int *started)
+{
+   int lists = 0;
+
+   if (*started) {
+      return 0;
+   }
+   for (int i = 0; i < n_outputs; i++) {
+      lists += urfilter_list_count(output_specifiers[i]->filter);
+   }
+   if (lists == 0) {
+      return 0;
+   }
+   if (pthread_create(thread, NULL, reload_lists_thread, NULL) != 0) {
+      fprintf(stderr, "Error: Unable to start thread reloading lists.\n");
+      return 1;
+   }
+   *started = 1;
+   return 0;
+}
+
 // Search for delimiter (skip literals within string)
 char *skip_str_chr(char *ptr, char delim)
 {
@@ -424,11 +615,17 @@ int main(int argc, char **argv)
    int from = 0; // 0 - template and filter from CMD, 1 - from file
    int n_outputs;
    trap_ifc_spec_t ifc_spec;
+   pthread_t reload_thread;
+   int reload_thread_started = 0;
+   struct record_batch batch = {0};
+   int recv_wait = 0;                 // input interface waits for records, batch is empty
 
    INIT_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
 
    // Register signal handler for reloading file with filter
    signal(SIGUSR1, reload_filter_signal_handler);
+   // Register signal handler for reloading lists loaded from files
+   signal(SIGHUP, reload_lists_signal_handler);
 
    // Parse TRAP parameters
    ret = trap_parse_params(&argc, argv, &ifc_spec);
@@ -682,62 +879,43 @@ int main(int argc, char **argv)
       stop = 1;
    }
 
+   if (!stop && compile_filters(output_specifiers, n_outputs) != 0) {
+      stop = 1;
+   }
+   shared_outputs = output_specifiers;
+   shared_n_outputs = n_outputs;
+   if (!stop && start_reload_thread(output_specifiers, n_outputs, &reload_thread, &reload_thread_started) != 0) {
+      stop = 1;
+   }
+
+   // Allocate batch of received records
+   batch.buffer = (char *) malloc(BATCH_BUFFER_SIZE);
+   batch.bitmaps = (uint64_t *) calloc(n_outputs, sizeof(uint64_t));
+   if (!batch.buffer || !batch.bitmaps) {
+      fprintf(stderr, "Error: Not enough memory for batch of records.\n");
+      stop = 1;
+   }
+   trap_ifcctl(TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_NO_WAIT);
+
    if (verbose >= 0) {
          printf("VERBOSE: Main loop started\n");
    }
    // Main loop
    // Copy data from input to output
    while (!stop) {
-      // The first record should be already loaded, process it first,
-      // then load another one at the end of the loop 
+      // The first record should be already loaded, add it to batch first,
+      // then load another one at the end of the loop
+      if (batch.used + in_rec_size > BATCH_BUFFER_SIZE && process_batch(&batch, in_tmplt, output_specifiers, n_outputs) != 0) {
+         break;
+      }
+      add_to_batch(&batch, in_rec, in_rec_size);
+      num_records++;
 
       // PROCESS THE DATA
-      for (i = 0; i < n_outputs; i++) {
-         ret = urfilter_match(output_specifiers[i]->filter, in_tmplt, in_rec);
-         if (ret == URFILTER_ERROR) {
-            stop = 1;
+      // Batch is evaluated when it is full or when no more records are available immediately
+      if (batch.count == BATCH_SIZE || reload_filter == 1 || (max_num_records && max_num_records == num_records)) {
+         if (process_batch(&batch, in_tmplt, output_specifiers, n_outputs) != 0) {
             break;
-         } else if (ret == URFILTER_TRUE) {
-            if (verbose >= 1) {
-               printf("ADVANCED VERBOSE: Record %u accepted on interface %d\n", num_records, i);
-            }
-            //Iterate over all output fields; if the field is present in input template, copy it to output record
-            // If missing, set null
-            void *ptr1 = NULL, *ptr2 = NULL;
-            ur_field_id_t id = 0;
-            int rec_ind = 0;
-            while ((id = ur_iter_fields_record_order(output_specifiers[i]->out_tmplt, rec_ind++)) != UR_ITER_END) {
-               if (ur_is_present(in_tmplt, id)) {
-                  if (!ur_is_dynamic(id)) { //static field
-                     ptr1 = ur_get_ptr_by_id(in_tmplt, in_rec, id);
-                     ptr2 = ur_get_ptr_by_id(output_specifiers[i]->out_tmplt, output_specifiers[i]->out_rec, id);
-                     //copy the data
-                     if ((ptr1 != NULL) && (ptr2 != NULL)) {
-                        memcpy(ptr2, ptr1, ur_get_size(id));
-                     }
-                  } else { //dynamic field
-                     char *in_ptr = ur_get_ptr_by_id(in_tmplt, in_rec, id);
-                     int size = ur_get_var_len(in_tmplt, in_rec, id);
-                     // Check size of dynamic field and if longer than maximum size then cut it
-                     if (size > DYN_FIELD_MAX_SIZE) {
-                        size = DYN_FIELD_MAX_SIZE;
-                     }
-                     //copy the data
-                     if (ur_set_var(output_specifiers[i]->out_tmplt, output_specifiers[i]->out_rec, id, in_ptr, size) != UR_OK) {
-                        fprintf(stderr, "Error: failed to copy data to output.)\n");
-                        goto cleanup;
-                     }
-                  }
-               }
-            }
-            // Send record to corresponding interface
-            ret = trap_send(i, output_specifiers[i]->out_rec, ur_rec_size(output_specifiers[i]->out_tmplt, output_specifiers[i]->out_rec));
-            // Handle possible errors
-            TRAP_DEFAULT_SEND_DATA_ERROR_HANDLING(ret, continue, {stop=1; break;});
-         } else {
-            if (verbose >= 1) {
-               printf("ADVANCED VERBOSE: Record %u declined on interface %d\n", num_records, i);
-            }
          }
       }
       // SIGUSR1 has been sent, reload filter
@@ -745,20 +923,56 @@ int main(int argc, char **argv)
          printf("\nReloading filter...\n\n");
          printf("New filter:\n");
 
+         pthread_mutex_lock(&filters_mutex);
          if (get_filter_from_file(filename, output_specifiers, n_outputs) != 0
-            || create_templates(n_outputs, port_numbers, output_specifiers) != 0) {
+            || create_templates(n_outputs, port_numbers, output_specifiers) != 0
+            || compile_filters(output_specifiers, n_outputs) != 0) {
                stop = 1;
          }
+         pthread_mutex_unlock(&filters_mutex);
+         if (!stop && start_reload_thread(output_specifiers, n_outputs, &reload_thread, &reload_thread_started) != 0) {
+            stop = 1;
+         }
          reload_filter = 0;
       }
       // Quit if maximum number of records has been reached
-      num_records++;
       if (max_num_records && max_num_records == num_records) {
          break;
       }
 
-      // Receive data from any input interface, wait until data are available
-      ret = TRAP_RECEIVE(0, in_rec, in_rec_size, in_tmplt);
+      // Receive data from any input interface, do not wait while there are records in batch
+      ret = trap_recv(0, &in_rec, &in_rec_size);
+      if (ret == TRAP_E_TIMEOUT && !recv_wait) {
+         if (process_batch(&batch, in_tmplt, output_specifiers, n_outputs) != 0) {
+            break;
+         }
+         trap_ifcctl(TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+         recv_wait = 1;
+         ret = trap_recv(0, &in_rec, &in_rec_size);
+      }
+      if (ret == TRAP_E_OK || ret == TRAP_E_FORMAT_CHANGED) {
+         if (recv_wait) {
+            trap_ifcctl(TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_NO_WAIT);
+            recv_wait = 0;
+         }
+      }
+      if (ret == TRAP_E_FORMAT_CHANGED) {
+         // Records in batch have previous format
+         if (process_batch(&batch, in_tmplt, output_specifiers, n_outputs) != 0) {
+            break;
+         }
+         const char *spec = NULL;
+         uint8_t data_fmt;
+         if (trap_get_data_fmt(TRAPIFC_INPUT, 0, &data_fmt, &spec) != TRAP_E_OK) {
+            fprintf(stderr, "Data format was not loaded.\n");
+            break;
+         }
+         in_tmplt = ur_define_fields_and_update_template(spec, in_tmplt);
+         if (!in_tmplt) {
+            fprintf(stderr, "Template could not be edited.\n");
+            break;
+         }
+      }
       TRAP_DEFAULT_RECV_ERROR_HANDLING(ret, continue, break);
       // Check size of received data
       if (in_rec_size < ur_rec_fixlen_size(in_tmplt)) {
@@ -773,7 +987,10 @@ int main(int argc, char **argv)
          }
       }
    }
-
+   // Process records remaining in batch
+   if (batch.buffer && batch.bitmaps && process_batch(&batch, in_tmplt, output_specifiers, n_outputs) != 0) {
+      goto cleanup;
+   }
 
    // flush buffers before ending
    for (i = 0; i < n_outputs; i++) {
@@ -787,6 +1004,11 @@ cleanup:
    }
    free(str_buffer);
 
+   if (reload_thread_started) {
+      stop = 1;
+      pthread_join(reload_thread, NULL);
+   }
+
    if (send_eof == 1) {
       for (i = 0; i < n_outputs; i++) {
          ret = trap_send(i, output_specifiers[i]->out_rec, 1);
@@ -802,6 +1024,11 @@ cleanup:
    ur_free_template(in_tmplt);
    free(req_format);
 
+   urfilter_group_destroy(filter_group);
+   free(batch.buffer);
+   free(batch.bitmaps);
+   free(record_owner);
+   free(record_built);
    for (i = 0; i < n_outputs; i++) {
       if (output_specifiers[i]->filter != NULL) {
          urfilter_destroy(output_specifiers[i]->filter);
@@ -51,6 +51,8 @@
 #include <liburfilter.h>
 
 #define DYN_FIELD_MAX_SIZE 1024 // Maximal size of dynamic field, longer fields will be cutted to this size
+#define BATCH_SIZE 64 // Maximal number of records evaluated by filters at once
+#define BATCH_BUFFER_SIZE (256 * 1024) // Size of buffer with copies of records of batch
 
 #define SET_NULL(field_id, tmpl, data) \
 memset(ur_get_ptr_by_id(tmpl, data, field_id), 0, ur_get_size(field_id));
@@ -67,6 +69,16 @@ struct unirec_output_t {
    void *out_rec; /**< message to be sent */
 };
 
+/* Records received from input interface and evaluated by filters at once */
+struct record_batch {
+   char *buffer; /**< copies of received records */
+   size_t used; /**< used part of buffer */
+   const void *records[BATCH_SIZE]; /**< records in buffer */
+   int count; /**< number of records */
+   unsigned int first_record; /**< sequence number of the first record */
+   uint64_t *bitmaps; /**< records matched by filter of every output interface */
+};
+
 /** \brief search for character delimiter in string
  * Searches given string for the first occurance of given one char delimiter and returns it's position.
  * \param[in] ptr input string